@@ -858,6 +858,7 @@ private:
     void read_rangefinder(void);
     bool rangefinder_alt_ok();
     void rpm_update();
+    void update_dynamic_notch();
     void init_compass();
     void init_compass_location();
     void init_optflow();
@@ -85,6 +85,77 @@ void Copter::rpm_update(void)
 #endif
 }
 
+/*
+  update the base frequency of the gyro harmonic notch from the
+  configured source, so the notch follows the motor noise
+ */
+void Copter::update_dynamic_notch()
+{
+    const HarmonicNotchFilterParams &notch = ins.get_gyro_harmonic_notch_params();
+    if (!notch.enabled()) {
+        return;
+    }
+
+    const float ref = notch.reference();
+    float freq_hz = notch.center_freq_hz();
+
+    switch (notch.tracking_mode()) {
+    case HarmonicNotchFilterParams::TRACKING_FIXED:
+        break;
+
+    case HarmonicNotchFilterParams::TRACKING_THROTTLE: {
+        // motor noise frequency goes roughly with the square root of
+        // thrust. Don't let the notch fall too low at idle
+        const float ref_throttle = is_positive(ref) ? ref : motors->get_throttle_hover();
+        if (motors->armed() && is_positive(ref_throttle)) {
+            const float throttle = MAX(motors->get_throttle(), 0.05f);
+            freq_hz = MAX(freq_hz * safe_sqrt(throttle / ref_throttle), notch.bandwidth_hz());
+        }
+        break;
+    }
+
+#if RPM_ENABLED == ENABLED
+    case HarmonicNotchFilterParams::TRACKING_RPM: {
+        const float rpm = rpm_sensor.get_rpm(0);
+        if (is_positive(rpm)) {
+            freq_hz = rpm * (1.0f/60) * (is_positive(ref) ? ref : 1.0f);
+        }
+        break;
+    }
+#endif
+
+#ifdef HAVE_AP_BLHELI_SUPPORT
+    case HarmonicNotchFilterParams::TRACKING_ESC: {
+        // average the recent telemetry of all ESCs
+        AP_BLHeli *blheli = AP_BLHeli::get_singleton();
+        if (blheli == nullptr) {
+            break;
+        }
+        const uint32_t now_ms = AP_HAL::millis();
+        float rpm_sum = 0;
+        uint8_t count = 0;
+        for (uint8_t i=0; i<AP_BLHELI_MAX_ESCS; i++) {
+            AP_BLHeli::telem_data td;
+            if (blheli->get_telem_data(i, td) && now_ms - td.timestamp_ms < 1000 && td.rpm > 0) {
+                // telemetry RPM is in units of 100 RPM
+                rpm_sum += td.rpm * 100.0f;
+                count++;
+            }
+        }
+        if (count > 0) {
+            freq_hz = (rpm_sum / count) * (1.0f/60) * (is_positive(ref) ? ref : 1.0f);
+        }
+        break;
+    }
+#endif
+
+    default:
+        break;
+    }
+
+    ins.update_harmonic_notch_freq_hz(freq_hz);
+}
+
 // initialise compass
 void Copter::init_compass()
 {
@@ -11,6 +11,7 @@ parser.add_option("--create-checked-logs", action='store_true', default=False, h
 parser.add_option("--tolerance-euler", type=float, default=3, help="tolerance for euler angles in degrees");
 parser.add_option("--tolerance-pos", type=float, default=2, help="tolerance for position angles in meters");
 parser.add_option("--tolerance-vel", type=float, default=2, help="tolerance for velocity in meters/second");
+parser.add_option("--jobs", "-j", type=int, default=0, help="number of logs to replay in parallel (default one per CPU)");
 
 opts, args = parser.parse_args()
 
@@ -27,14 +28,39 @@ def run_cmd(cmd, dir=".", show=False, output=False, checkfail=True):
         return call(cmd, shell=True, cwd=dir)
 
 def run_replay(logfile):
-    '''run Replay on one logfile'''
+    '''run Replay on one logfile in its own directory, so parallel
+    runs don't share output logs or result files. Returns the
+    result lines for the log'''
+    import shutil, tempfile, time
     print("Processing %s" % logfile)
-    cmd = "./Replay.elf -- --check %s --tolerance-euler=%f --tolerance-pos=%f --tolerance-vel=%f " % (
-        logfile,
+    workdir = tempfile.mkdtemp(prefix="replay-")
+    cmd = "%s -- --check %s --tolerance-euler=%f --tolerance-pos=%f --tolerance-vel=%f " % (
+        os.path.abspath("Replay.elf"),
+        os.path.abspath(logfile),
         opts.tolerance_euler,
         opts.tolerance_pos,
         opts.tolerance_vel)
-    run_cmd(cmd, checkfail=False)
+    tstart = time.time()
+    output = run_cmd(cmd, dir=workdir, output=True)
+    elapsed = time.time() - tstart
+    results = read_lines(os.path.join(workdir, "replay_results.txt"))
+    innovations = read_lines(os.path.join(workdir, "replay_innovations.txt"))
+    if len(results) == 0:
+        # Replay died before reporting; keep its output for debugging
+        print("No results for %s, output:\n%s" % (logfile, output))
+    shutil.rmtree(workdir, ignore_errors=True)
+    print("Processed %s in %.1fs" % (logfile, elapsed))
+    return (logfile, results, innovations, elapsed)
+
+def read_lines(filename):
+    '''return the lines of a file, or an empty list if it is missing'''
+    try:
+        f = open(filename, "r")
+    except IOError:
+        return []
+    lines = f.readlines()
+    f.close()
+    return lines
 
 def get_log_list():
     '''get a list of log files to process'''
@@ -98,7 +124,7 @@ Git version: %s
         error_in_this_log = False
         for i in range(1,6):
             tol = tolerances[i-1]
-            if a[i] == "FPE":
+            if a[i] in ["FPE", "FAIL"]:
                 bgcolor = "red"
                 error_count += 1
                 error_in_this_log = True
@@ -116,6 +142,33 @@ Git version: %s
 
     f.write('''</table>\n''')
 
+    # largest normalised EKF innovations per log
+    f.write(
+'''<h2>EKF innovations</h2>
+<table border="1">
+<tr bgcolor="lightgrey">
+ <th>Filename</th>
+ <th>Velocity</th>
+ <th>Position</th>
+ <th>Height</th>
+ <th>Mag</th>
+ <th>Airspeed</th>
+</tr>
+''')
+    for line in read_lines("replay_innovations.txt"):
+        a = line.strip().split("\t")
+        if len(a) != 6:
+            continue
+        f.write('''<tr><td>%s</td>''' % a[0])
+        for i in range(1,6):
+            # a test ratio over 1 means the innovation was rejected
+            bgcolor = "white"
+            if float(a[i]) > 1.0:
+                bgcolor = "orange"
+            f.write('''<td bgcolor="%s" align="right">%s</td>\n''' % (bgcolor, a[i]))
+        f.write('''</tr>\n''')
+    f.write('''</table>\n''')
+
     # write summary
     f.write(
 '''<h2>Summary</h2>
@@ -139,19 +192,40 @@ Tolerance Velocity: %.3f meters/second
     f.close()
     infile.close()
 
+    print("Processed %u logs, %u errors from %u logs" % (line_count, error_count, line_errors))
+
 def check_logs():
     '''run log checking'''
+    import multiprocessing
+    from multiprocessing.pool import ThreadPool
+
     log_list = get_log_list()
 
-    # remove old results file
-    try:
-        os.unlink("replay_results.txt")
-    except Exception as ex:
-        print(ex)
-        pass
+    jobs = opts.jobs
+    if jobs <= 0:
+        jobs = multiprocessing.cpu_count()
+    print("Replaying with %u jobs" % jobs)
+
+    # each Replay runs as its own process, so the threads only wait
+    pool = ThreadPool(jobs)
+    run_results = pool.map(run_replay, sorted(log_list))
+    pool.close()
+    pool.join()
+
+    # gather the per-log results in log order
+    results = open("replay_results.txt", "w")
+    innovations = open("replay_innovations.txt", "w")
+    total_time = 0
+    for (logfile, result_lines, innovation_lines, elapsed) in run_results:
+        if len(result_lines) == 0:
+            result_lines = ["%s\tFAIL\tFAIL\tFAIL\tFAIL\tFAIL\n" % os.path.abspath(logfile)]
+        results.writelines(result_lines)
+        innovations.writelines(innovation_lines)
+        total_time += elapsed
+    results.close()
+    innovations.close()
 
-    for logfile in log_list:
-        run_replay(logfile)
+    print("Replayed %u logs in %.1fs of replay time" % (len(run_results), total_time))
 
     create_html_results()
 
@@ -1,7 +1,10 @@
 #include "DataFlashFileReader.h"
 
 #include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -29,6 +32,16 @@ DataFlashFileReader::~DataFlashFileReader()
     const uint64_t delta = micros - start_micros;
     ::printf("Replay counts: %" PRIu64 " bytes  %u entries\n", bytes_read, message_count);
     ::printf("Replay rates: %" PRIu64 " bytes/second  %" PRIu64 " messages/second\n", bytes_read*1000000/delta, message_count*1000000/delta);
+
+    if (decoded) {
+        free((void *)mapped);
+    } else if (mapped != nullptr) {
+        munmap((void *)mapped, mapped_size);
+    }
+    for (uint16_t i=0; i<LOGREADER_MAX_FORMATS; i++) {
+        free(type_index[i].offsets);
+    }
+    free(time_index);
 }
 
 bool DataFlashFileReader::open_log(const char *logfile)
@@ -37,16 +50,169 @@ bool DataFlashFileReader::open_log(const char *logfile)
     if (fd == -1) {
         return false;
     }
+
+    // map the whole log so messages are read without a syscall
+    // each. If that fails (e.g. a pipe) we fall back to read()
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            mapped = (const uint8_t *)p;
+            mapped_size = st.st_size;
+            read_offset = 0;
+        }
+    }
+    if (mapped == nullptr) {
+        // look at the start of the stream for a compressed frame
+        while (peek_len < sizeof(peek_buf)) {
+            const ssize_t n = ::read(fd, &peek_buf[peek_len], sizeof(peek_buf) - peek_len);
+            if (n <= 0) {
+                break;
+            }
+            peek_len += n;
+        }
+        if (DataFlash_Compressor::is_compressed_log(peek_buf, peek_len)) {
+            return read_whole_log() && decompress_log();
+        }
+        return true;
+    }
+    if (DataFlash_Compressor::is_compressed_log(mapped, mapped_size)) {
+        return decompress_log();
+    }
+    return true;
+}
+
+/*
+  read the rest of a log we couldn't map into memory, following the
+  bytes already peeked at, so it can be decompressed
+ */
+bool DataFlashFileReader::read_whole_log(void)
+{
+    uint64_t size = 0;
+    uint64_t space = 1024*1024;
+    uint8_t *buf = (uint8_t *)malloc(space);
+    if (buf == nullptr) {
+        return false;
+    }
+    memcpy(buf, peek_buf, peek_len);
+    size = peek_len;
+    peek_len = 0;
+    while (true) {
+        if (size == space) {
+            space *= 2;
+            uint8_t *p = (uint8_t *)realloc(buf, space);
+            if (p == nullptr) {
+                ::printf("Failed to allocate %" PRIu64 " bytes for log\n", space);
+                free(buf);
+                return false;
+            }
+            buf = p;
+        }
+        const ssize_t n = ::read(fd, &buf[size], space - size);
+        if (n <= 0) {
+            break;
+        }
+        size += n;
+    }
+    mapped = buf;
+    mapped_size = size;
+    read_offset = 0;
+    decoded = true;
+    return true;
+}
+
+/*
+  expand a compressed log into memory, replacing the mapping or copy
+  of the file. Everything else then reads the log as if it were
+  uncompressed
+ */
+bool DataFlashFileReader::decompress_log(void)
+{
+    uint64_t size = DataFlash_Compressor::decode_log(mapped, mapped_size, nullptr);
+    uint8_t *buf = (uint8_t *)malloc(size);
+    if (buf == nullptr) {
+        ::printf("Failed to allocate %" PRIu64 " bytes for decompressed log\n", size);
+        return false;
+    }
+    // frames which fail to decompress are skipped, so this can be
+    // shorter than the size from the headers
+    size = DataFlash_Compressor::decode_log(mapped, mapped_size, buf);
+    ::printf("Decompressed log: %" PRIu64 " -> %" PRIu64 " bytes\n", mapped_size, size);
+
+    if (decoded) {
+        free((void *)mapped);
+    } else {
+        munmap((void *)mapped, mapped_size);
+    }
+    mapped = buf;
+    mapped_size = size;
+    decoded = true;
     return true;
 }
 
 ssize_t DataFlashFileReader::read_input(void *buffer, const size_t count)
 {
-    uint64_t ret = ::read(fd, buffer, count);
+    uint64_t ret;
+    if (mapped != nullptr) {
+        ret = count;
+        if (read_offset + ret > mapped_size) {
+            ret = mapped_size - read_offset;
+        }
+        memcpy(buffer, &mapped[read_offset], ret);
+        read_offset += ret;
+    } else if (peek_ofs < peek_len) {
+        // bytes read while looking for a compressed frame
+        ret = MIN(count, (size_t)(peek_len - peek_ofs));
+        memcpy(buffer, &peek_buf[peek_ofs], ret);
+        peek_ofs += ret;
+        if (ret < count) {
+            const ssize_t n = ::read(fd, (uint8_t *)buffer + ret, count - ret);
+            if (n > 0) {
+                ret += n;
+            }
+        }
+    } else {
+        ret = ::read(fd, buffer, count);
+    }
     bytes_read += ret;
     return ret;
 }
 
+/*
+  work out which timestamp, if any, leads messages of a format
+ */
+uint8_t DataFlashFileReader::time_field(const struct log_Format &f)
+{
+    if (f.format[0] == 'Q' &&
+        strncmp(f.labels, "TimeUS", 6) == 0 &&
+        (f.labels[6] == ',' || f.labels[6] == 0)) {
+        return TIME_US;
+    }
+    if (f.format[0] == 'I' &&
+        strncmp(f.labels, "TimeMS", 6) == 0 &&
+        (f.labels[6] == ',' || f.labels[6] == 0)) {
+        return TIME_MS;
+    }
+    return TIME_NONE;
+}
+
+bool DataFlashFileReader::message_timestamp(uint8_t type, const uint8_t *msg, uint64_t &time_us) const
+{
+    switch (time_kind[type]) {
+    case TIME_US:
+        memcpy(&time_us, &msg[3], sizeof(time_us));
+        return true;
+    case TIME_MS: {
+        uint32_t time_ms;
+        memcpy(&time_ms, &msg[3], sizeof(time_ms));
+        time_us = time_ms * (uint64_t)1000;
+        return true;
+    }
+    }
+    return false;
+}
+
 void DataFlashFileReader::format_type(uint16_t type, char dest[5])
 {
     const struct log_Format &f = formats[type];
@@ -80,12 +246,10 @@ bool DataFlashFileReader::update(char type[5])
         if (read_input(&f.type, sizeof(f)-3) != sizeof(f)-3) {
             return false;
         }
-        memcpy(&formats[f.type], &f, sizeof(formats[f.type]));
         strncpy(type, "FMT", 3);
         type[3] = 0;
 
-        message_count++;
-        return handle_log_format_msg(f);
+        return handle_format(f);
     }
 
     if (!done_format_msgs) {
@@ -108,9 +272,248 @@ bool DataFlashFileReader::update(char type[5])
         return false;
     }
 
+    uint64_t time_us;
+    if (end_time_us != UINT64_MAX &&
+        message_timestamp(hdr[2], msg, time_us) &&
+        time_us > end_time_us) {
+        // past the end of the requested window
+        return false;
+    }
+
     strncpy(type, f.name, 4);
     type[4] = 0;
 
     message_count++;
     return handle_msg(f,msg);
 }
+
+bool DataFlashFileReader::handle_format(const struct log_Format &f)
+{
+    if (f.type >= LOGREADER_MAX_FORMATS) {
+        return false;
+    }
+    memcpy(&formats[f.type], &f, sizeof(formats[f.type]));
+    time_kind[f.type] = time_field(f);
+
+    message_count++;
+    return handle_log_format_msg(f);
+}
+
+/*
+  build the per-type and timestamp indexes in one pass over the log
+ */
+bool DataFlashFileReader::build_index(void)
+{
+    if (indexed) {
+        return true;
+    }
+    if (mapped == nullptr) {
+        return false;
+    }
+
+    // a checkpoint every 100ms of log time is plenty, as seeking
+    // walks forward from the checkpoint
+    const uint64_t time_index_interval_us = 100000;
+    uint64_t last_checkpoint_us = 0;
+
+    uint64_t ofs = 0;
+    while (ofs + 3 <= mapped_size) {
+        const uint8_t *msg = &mapped[ofs];
+        if (msg[0] != HEAD_BYTE1 || msg[1] != HEAD_BYTE2) {
+            // corrupt log; index what we have
+            break;
+        }
+        const uint8_t type = msg[2];
+        if (type >= LOGREADER_MAX_FORMATS) {
+            break;
+        }
+        uint8_t length;
+        if (type == LOG_FORMAT_MSG) {
+            length = sizeof(struct log_Format);
+            if (ofs + length > mapped_size) {
+                break;
+            }
+            struct log_Format f;
+            memcpy(&f, msg, sizeof(f));
+            if (f.type < LOGREADER_MAX_FORMATS) {
+                index_length[f.type] = f.length;
+                index_time_kind[f.type] = time_field(f);
+                memcpy(index_name[f.type], f.name, sizeof(index_name[f.type]));
+            }
+        } else {
+            length = index_length[type];
+            if (length < 3 || ofs + length > mapped_size) {
+                break;
+            }
+        }
+
+        struct type_index &ti = type_index[type];
+        if (ti.count == ti.size) {
+            const uint32_t new_size = ti.size ? ti.size * 2 : 64;
+            uint64_t *p = (uint64_t *)realloc(ti.offsets, new_size * sizeof(uint64_t));
+            if (p == nullptr) {
+                return false;
+            }
+            ti.offsets = p;
+            ti.size = new_size;
+        }
+        ti.offsets[ti.count++] = ofs;
+
+        uint64_t time_us = 0;
+        if (index_time_kind[type] == TIME_US) {
+            memcpy(&time_us, &msg[3], sizeof(time_us));
+        } else if (index_time_kind[type] == TIME_MS) {
+            uint32_t time_ms;
+            memcpy(&time_ms, &msg[3], sizeof(time_ms));
+            time_us = time_ms * (uint64_t)1000;
+        }
+        if (time_us != 0 &&
+            (time_index_count == 0 || time_us >= last_checkpoint_us + time_index_interval_us)) {
+            if (time_index_count == time_index_size) {
+                const uint32_t new_size = time_index_size ? time_index_size * 2 : 1024;
+                struct time_index_entry *p = (struct time_index_entry *)realloc(time_index, new_size * sizeof(time_index[0]));
+                if (p == nullptr) {
+                    return false;
+                }
+                time_index = p;
+                time_index_size = new_size;
+            }
+            time_index[time_index_count].time_us = time_us;
+            time_index[time_index_count].offset = ofs;
+            time_index_count++;
+            last_checkpoint_us = time_us;
+        }
+
+        ofs += length;
+    }
+
+    indexed = true;
+    return true;
+}
+
+const uint64_t *DataFlashFileReader::message_offsets(uint8_t type, uint32_t &count) const
+{
+    if (!indexed || type >= LOGREADER_MAX_FORMATS) {
+        count = 0;
+        return nullptr;
+    }
+    count = type_index[type].count;
+    return type_index[type].offsets;
+}
+
+bool DataFlashFileReader::type_in_list(uint8_t type, const char **list) const
+{
+    if (list == nullptr) {
+        return false;
+    }
+    char name[5] {};
+    memcpy(name, index_name[type], 4);
+    for (uint16_t i=0; list[i] != nullptr; i++) {
+        if (strcmp(name, list[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DataFlashFileReader::seek_to_timestamp(uint64_t time_us, const char **keep_types)
+{
+    if (!build_index()) {
+        return false;
+    }
+
+    // find the last checkpoint at or before the requested time
+    uint32_t lo = 0, hi = time_index_count;
+    while (lo < hi) {
+        const uint32_t mid = (lo + hi) / 2;
+        if (time_index[mid].time_us <= time_us) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    uint64_t target = read_offset;
+    if (lo > 0 && time_index[lo-1].offset > target) {
+        target = time_index[lo-1].offset;
+    }
+
+    // then walk forward to the first message at or after the time
+    while (target + 3 <= mapped_size) {
+        const uint8_t *msg = &mapped[target];
+        const uint8_t type = msg[2];
+        if (msg[0] != HEAD_BYTE1 || msg[1] != HEAD_BYTE2 || type >= LOGREADER_MAX_FORMATS) {
+            break;
+        }
+        const uint8_t length = type == LOG_FORMAT_MSG ? sizeof(struct log_Format) : index_length[type];
+        if (length < 3 || target + length > mapped_size) {
+            break;
+        }
+        uint64_t t = 0;
+        if (index_time_kind[type] == TIME_US) {
+            memcpy(&t, &msg[3], sizeof(t));
+        } else if (index_time_kind[type] == TIME_MS) {
+            uint32_t time_ms;
+            memcpy(&time_ms, &msg[3], sizeof(time_ms));
+            t = time_ms * (uint64_t)1000;
+        } else {
+            target += length;
+            continue;
+        }
+        if (t >= time_us) {
+            break;
+        }
+        target += length;
+    }
+
+    /*
+      deliver the format messages and any messages the caller wants
+      to keep from the skipped part of the log, in log order. We
+      merge the per-type offset lists, starting each at the current
+      read position
+     */
+    uint32_t next[LOGREADER_MAX_FORMATS] {};
+    bool wanted[LOGREADER_MAX_FORMATS] {};
+    for (uint16_t t=0; t<LOGREADER_MAX_FORMATS; t++) {
+        wanted[t] = (t == LOG_FORMAT_MSG) || type_in_list(t, keep_types);
+        if (!wanted[t]) {
+            continue;
+        }
+        const struct type_index &ti = type_index[t];
+        uint32_t a = 0, b = ti.count;
+        while (a < b) {
+            const uint32_t mid = (a + b) / 2;
+            if (ti.offsets[mid] < read_offset) {
+                a = mid + 1;
+            } else {
+                b = mid;
+            }
+        }
+        next[t] = a;
+    }
+    while (true) {
+        uint64_t best = target;
+        int16_t best_type = -1;
+        for (uint16_t t=0; t<LOGREADER_MAX_FORMATS; t++) {
+            if (!wanted[t] || next[t] >= type_index[t].count) {
+                continue;
+            }
+            const uint64_t ofs = type_index[t].offsets[next[t]];
+            if (ofs < best) {
+                best = ofs;
+                best_type = t;
+            }
+        }
+        if (best_type < 0) {
+            break;
+        }
+        next[best_type]++;
+        read_offset = best;
+        char type[5];
+        if (!update(type)) {
+            return false;
+        }
+    }
+
+    read_offset = target;
+    return true;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <DataFlash/DataFlash.h>
+#include <DataFlash/DataFlash_Compress.h>
 
 #define LOGREADER_MAX_FORMATS 255 // must be >= highest MESSAGE
 
@@ -20,6 +21,26 @@ public:
     void format_type(uint16_t type, char dest[5]);
     void get_packet_counts(uint64_t dest[]);
 
+    /*
+      build an index of the offsets of all messages per type, plus a
+      coarse timestamp index. Needs the log to be memory mapped
+     */
+    bool build_index(void);
+
+    // offsets of all messages of a type, valid after build_index()
+    const uint64_t *message_offsets(uint8_t type, uint32_t &count) const;
+
+    /*
+      skip forward to the first timestamped message at or after
+      time_us. Format messages in the skipped part of the log are
+      always delivered, as are messages with a type name in
+      keep_types (a nullptr terminated list, may be nullptr)
+     */
+    bool seek_to_timestamp(uint64_t time_us, const char **keep_types);
+
+    // stop returning messages once one is stamped after time_us
+    void set_end_timestamp(uint64_t time_us) { end_time_us = time_us; }
+
 protected:
     int fd = -1;
     bool done_format_msgs = false;
@@ -29,10 +50,58 @@ protected:
 
 private:
     ssize_t read_input(void *buf, size_t count);
+    bool handle_format(const struct log_Format &f);
+    bool message_timestamp(uint8_t type, const uint8_t *msg, uint64_t &time_us) const;
+    static uint8_t time_field(const struct log_Format &f);
+    bool type_in_list(uint8_t type, const char **list) const;
+    bool read_whole_log(void);
+    bool decompress_log(void);
 
     uint64_t bytes_read = 0;
     uint32_t message_count = 0;
     uint64_t start_micros;
 
     uint64_t packet_counts[LOGREADER_MAX_FORMATS] = {};
+
+    // the log file mapped into memory, or nullptr if we fell back
+    // to read(). For a compressed log this is the malloced
+    // decompressed copy, with decoded set
+    const uint8_t *mapped = nullptr;
+    uint64_t mapped_size = 0;
+    uint64_t read_offset = 0;
+    bool decoded = false;
+
+    // start of a log read with read(), kept while checking whether
+    // it is compressed and then returned by read_input()
+    uint8_t peek_buf[sizeof(struct df_block_header)];
+    uint8_t peek_len = 0;
+    uint8_t peek_ofs = 0;
+
+    // kind of timestamp leading each message type
+    enum {
+        TIME_NONE = 0,
+        TIME_US,
+        TIME_MS,
+    };
+    uint8_t time_kind[LOGREADER_MAX_FORMATS] {};
+
+    uint64_t end_time_us = UINT64_MAX;
+
+    // index built by build_index()
+    bool indexed = false;
+    struct type_index {
+        uint64_t *offsets;
+        uint32_t count;
+        uint32_t size;
+    } type_index[LOGREADER_MAX_FORMATS] {};
+    struct time_index_entry {
+        uint64_t time_us;
+        uint64_t offset;
+    };
+    struct time_index_entry *time_index = nullptr;
+    uint32_t time_index_count = 0;
+    uint32_t time_index_size = 0;
+    uint8_t index_length[LOGREADER_MAX_FORMATS] {};
+    uint8_t index_time_kind[LOGREADER_MAX_FORMATS] {};
+    char index_name[LOGREADER_MAX_FORMATS][4] {};
 };
@@ -157,6 +157,8 @@ void Replay::usage(void)
     ::printf("\t--no-params        don't use parameters from the log\n");
     ::printf("\t--no-fpe           do not generate floating point exceptions\n");
     ::printf("\t--packet-counts    print packet counts at end of processing\n");
+    ::printf("\t--start-time SEC   start replay at this log time (seconds)\n");
+    ::printf("\t--end-time SEC     stop replay at this log time (seconds)\n");
 }
 
 
@@ -173,6 +175,8 @@ enum {
     OPT_PARAM_FILE,
     OPT_NO_FPE,
     OPT_PACKET_COUNTS,
+    OPT_START_TIME,
+    OPT_END_TIME,
 };
 
 void Replay::flush_dataflash(void) {
@@ -230,6 +234,8 @@ void Replay::_parse_command_line(uint8_t argc, char * const argv[])
         {"no-params",       false,  0, OPT_NOPARAMS},
         {"no-fpe",          false,  0, OPT_NO_FPE},
         {"packet-counts",   false,  0, OPT_PACKET_COUNTS},
+        {"start-time",      true,   0, OPT_START_TIME},
+        {"end-time",        true,   0, OPT_END_TIME},
         {0, false, 0, 0}
     };
 
@@ -317,6 +323,14 @@ void Replay::_parse_command_line(uint8_t argc, char * const argv[])
             packet_counts = true;
             break;
 
+        case OPT_START_TIME:
+            start_time_us = atof(gopt.optarg) * 1.0e6;
+            break;
+
+        case OPT_END_TIME:
+            end_time_us = atof(gopt.optarg) * 1.0e6;
+            break;
+
         case 'h':
         default:
             usage();
@@ -551,6 +565,20 @@ void Replay::setup()
     }
     
     set_ins_update_rate(log_info.update_rate);
+
+    if (start_time_us != 0) {
+        // skip to the start time, still passing on parameters and
+        // the messages used to work out the vehicle type
+        static const char *keep_types[] = { "PARM", "MSG", nullptr };
+        if (!logreader.seek_to_timestamp(start_time_us, keep_types)) {
+            ::printf("Unable to seek to %.1f seconds\n", start_time_us*1.0e-6);
+            exit(1);
+        }
+        ::printf("Starting replay at %.1f seconds\n", start_time_us*1.0e-6);
+    }
+    if (end_time_us != 0) {
+        logreader.set_end_timestamp(end_time_us);
+    }
 }
 
 void Replay::set_ins_update_rate(uint16_t _update_rate) {
@@ -767,6 +795,17 @@ void Replay::log_check_solution(void)
     check_result.max_yaw_error   = MAX(check_result.max_yaw_error,   yaw_error);
     check_result.max_vel_error   = MAX(check_result.max_vel_error,   vel_error);
     check_result.max_pos_error   = MAX(check_result.max_pos_error,   pos_error);
+
+    float vel_innov, pos_innov, hgt_innov, tas_innov;
+    Vector3f mag_innov;
+    Vector2f offset;
+    if (_vehicle.ahrs.get_variances(vel_innov, pos_innov, hgt_innov, mag_innov, tas_innov, offset)) {
+        check_result.max_vel_innov = MAX(check_result.max_vel_innov, vel_innov);
+        check_result.max_pos_innov = MAX(check_result.max_pos_innov, pos_innov);
+        check_result.max_hgt_innov = MAX(check_result.max_hgt_innov, hgt_innov);
+        check_result.max_mag_innov = MAX(check_result.max_mag_innov, mag_innov.length());
+        check_result.max_tas_innov = MAX(check_result.max_tas_innov, tas_innov);
+    }
 }
 
 void Replay::flush_and_exit()
@@ -865,6 +904,18 @@ void Replay::report_checks(void)
                 check_result.max_vel_error);
         fclose(f);
     }
+    // the largest EKF innovations, for the CheckLogs.py summary
+    f = fopen("replay_innovations.txt","a");
+    if (f != NULL) {
+        fprintf(f, "%s\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\n",
+                log_filename,
+                check_result.max_vel_innov,
+                check_result.max_pos_innov,
+                check_result.max_hgt_innov,
+                check_result.max_mag_innov,
+                check_result.max_tas_innov);
+        fclose(f);
+    }
     failed |= show_error("Roll error", check_result.max_roll_error, tolerance_euler);
     failed |= show_error("Pitch error", check_result.max_pitch_error, tolerance_euler);
     failed |= show_error("Yaw error", check_result.max_yaw_error, tolerance_euler);
@@ -141,6 +141,8 @@ private:
     uint32_t output_counter = 0;
     uint64_t last_timestamp = 0;
     bool packet_counts = false;
+    uint64_t start_time_us = 0;
+    uint64_t end_time_us = 0;
 
     struct {
         float max_roll_error;
@@ -149,6 +151,12 @@ private:
         float max_pos_error;
         float max_alt_error;
         float max_vel_error;
+        // largest normalised EKF innovations (test ratios)
+        float max_vel_innov;
+        float max_pos_innov;
+        float max_hgt_innov;
+        float max_mag_innov;
+        float max_tas_innov;
     } check_result {};
 
     void _parse_command_line(uint8_t argc, char * const argv[]);
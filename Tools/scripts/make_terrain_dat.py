@@ -0,0 +1,239 @@
+#!/usr/bin/env python
+'''
+generate AP_Terrain degree files (NxxExxx.DAT) for a region from local
+SRTM .hgt files, so a vehicle has terrain data without fetching it from
+a GCS. Copy the output into the terrain directory of the vehicle (APM/TERRAIN
+on a microSD card, terrain/ for SITL)
+
+  make_terrain_dat.py --srtm ~/.tilecache/SRTM3 --lat1 -36 --lon1 149 --lat2 -35 --lon2 150
+
+SRTM1 and SRTM3 tiles are accepted, either plain or zipped, as
+downloaded by MAVProxy. Blocks needing SRTM data that isn't available,
+or which contain voids, are left out, and the vehicle will ask the GCS
+for them as usual.
+
+The block positions are worked out with the same single precision
+arithmetic the vehicle uses, as the vehicle checks them when it reads
+a block.
+
+The file layout is the vehicle's, including the last few blocks of a
+row sharing file space with the start of the next row at some
+latitudes. The later block wins, as it would on the vehicle.
+'''
+from __future__ import print_function
+
+import math
+import optparse
+import os
+import struct
+import sys
+import zipfile
+
+parser = optparse.OptionParser("make_terrain_dat.py [options]")
+parser.add_option("--srtm", default=".", help="directory holding SRTM .hgt or .hgt.zip files")
+parser.add_option("--out", default="terrain", help="output directory")
+parser.add_option("--lat1", type='int', help="southern latitude, whole degrees")
+parser.add_option("--lon1", type='int', help="western longitude, whole degrees")
+parser.add_option("--lat2", type='int', help="northern latitude, whole degrees")
+parser.add_option("--lon2", type='int', help="eastern longitude, whole degrees")
+parser.add_option("--spacing", type='int', default=100, help="grid spacing in meters, as TERRAIN_SPACING")
+
+opts, args = parser.parse_args()
+
+if None in (opts.lat1, opts.lon1, opts.lat2, opts.lon2):
+    parser.print_help()
+    sys.exit(1)
+
+# from AP_Terrain.h
+TERRAIN_GRID_MAVLINK_SIZE = 4
+TERRAIN_GRID_BLOCK_MUL_X = 7
+TERRAIN_GRID_BLOCK_MUL_Y = 8
+TERRAIN_GRID_BLOCK_SPACING_X = (TERRAIN_GRID_BLOCK_MUL_X-1)*TERRAIN_GRID_MAVLINK_SIZE
+TERRAIN_GRID_BLOCK_SPACING_Y = (TERRAIN_GRID_BLOCK_MUL_Y-1)*TERRAIN_GRID_MAVLINK_SIZE
+TERRAIN_GRID_BLOCK_SIZE_X = TERRAIN_GRID_MAVLINK_SIZE*TERRAIN_GRID_BLOCK_MUL_X
+TERRAIN_GRID_BLOCK_SIZE_Y = TERRAIN_GRID_MAVLINK_SIZE*TERRAIN_GRID_BLOCK_MUL_Y
+TERRAIN_GRID_FORMAT_VERSION = 1
+IO_BLOCK_SIZE = 2048
+
+
+def f32(x):
+    '''round to single precision'''
+    return struct.unpack('<f', struct.pack('<f', x))[0]
+
+
+def i32(x):
+    '''float to int32 conversion, truncating like C'''
+    return int(x)
+
+# from AP_Math
+LOCATION_SCALING_FACTOR = f32(0.011131884502145034)
+LOCATION_SCALING_FACTOR_INV = f32(89.83204953368922)
+DEG_TO_RAD = f32(f32(3.141592653589793) / f32(180.0))
+
+
+def longitude_scale(lat):
+    scale = f32(math.cos(f32(f32(lat) * f32(f32(1.0e-7) * DEG_TO_RAD))))
+    return min(max(scale, f32(0.01)), f32(1.0))
+
+
+def location_offset(lat, lng, ofs_north, ofs_east):
+    if ofs_north != 0 or ofs_east != 0:
+        dlat = i32(f32(ofs_north * LOCATION_SCALING_FACTOR_INV))
+        dlng = i32(f32(f32(ofs_east * LOCATION_SCALING_FACTOR_INV) / longitude_scale(lat)))
+        lat += dlat
+        lng += dlng
+    return lat, lng
+
+
+def location_diff(lat1, lng1, lat2, lng2):
+    return (f32(f32(lat2 - lat1) * LOCATION_SCALING_FACTOR),
+            f32(f32(f32(lng2 - lng1) * LOCATION_SCALING_FACTOR) * longitude_scale(lat1)))
+
+
+def east_blocks(lat_degrees, lon_degrees, spacing):
+    '''as AP_Terrain::east_blocks()'''
+    lat1 = lat_degrees*10*1000*1000
+    lng1 = lon_degrees*10*1000*1000
+    lat2, lng2 = location_offset(lat1, (lon_degrees+1)*10*1000*1000,
+                                 0, f32(2*spacing*TERRAIN_GRID_BLOCK_SIZE_Y))
+    offset = location_diff(lat1, lng1, lat2, lng2)
+    return i32(f32(offset[1] / f32(spacing*TERRAIN_GRID_BLOCK_SIZE_Y)))
+
+
+def crc16_ccitt(buf):
+    crc = 0
+    for b in bytearray(buf):
+        crc ^= b << 8
+        for i in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+
+class SRTM(object):
+    '''heights from a directory of SRTM tiles'''
+    def __init__(self, directory):
+        self.directory = directory
+        self.tiles = {}
+
+    def tile_name(self, lat, lon):
+        return "%c%02u%c%03u.hgt" % ('S' if lat < 0 else 'N', abs(lat),
+                                      'W' if lon < 0 else 'E', abs(lon))
+
+    def load(self, lat, lon):
+        name = self.tile_name(lat, lon)
+        path = os.path.join(self.directory, name)
+        data = None
+        if os.path.exists(path):
+            with open(path, 'rb') as f:
+                data = f.read()
+        elif os.path.exists(path + ".zip"):
+            with zipfile.ZipFile(path + ".zip") as z:
+                data = z.read(name)
+        if data is None:
+            return None
+        n = int(math.sqrt(len(data)/2))
+        if n*n*2 != len(data):
+            print("Bad SRTM tile %s" % path)
+            return None
+        return (n, struct.unpack('>%uh' % (n*n), data))
+
+    def height(self, lat, lon):
+        '''bilinearly interpolated height at lat/lon in degrees, or None'''
+        lat_int = int(math.floor(lat))
+        lon_int = int(math.floor(lon))
+        key = (lat_int, lon_int)
+        if key not in self.tiles:
+            self.tiles[key] = self.load(lat_int, lon_int)
+        tile = self.tiles[key]
+        if tile is None:
+            return None
+        (n, h) = tile
+        # rows run north to south
+        row = (1.0 - (lat - lat_int)) * (n-1)
+        col = (lon - lon_int) * (n-1)
+        r0 = min(int(row), n-2)
+        c0 = min(int(col), n-2)
+        fr = row - r0
+        fc = col - c0
+        h00 = h[r0*n + c0]
+        h01 = h[r0*n + c0 + 1]
+        h10 = h[(r0+1)*n + c0]
+        h11 = h[(r0+1)*n + c0 + 1]
+        if -32768 in (h00, h01, h10, h11):
+            return None
+        return ((1-fr)*((1-fc)*h00 + fc*h01) +
+                fr*((1-fc)*h10 + fc*h11))
+
+
+def make_block(srtm, lat_degrees, lon_degrees, grid_idx_x, grid_idx_y, spacing):
+    '''packed grid_block, or None if the SRTM data isn't available'''
+    ref_lat = lat_degrees*10*1000*1000
+    ref_lng = lon_degrees*10*1000*1000
+    # SW corner, as AP_Terrain::calculate_grid_info()
+    lat, lon = location_offset(ref_lat, ref_lng,
+                               f32(grid_idx_x * TERRAIN_GRID_BLOCK_SPACING_X * f32(spacing)),
+                               f32(grid_idx_y * TERRAIN_GRID_BLOCK_SPACING_Y * f32(spacing)))
+
+    # grid points are placed by their offset from the degree reference
+    scale = longitude_scale(ref_lat)
+    heights = []
+    for x in range(TERRAIN_GRID_BLOCK_SIZE_X):
+        north = (grid_idx_x * TERRAIN_GRID_BLOCK_SPACING_X + x) * spacing
+        for y in range(TERRAIN_GRID_BLOCK_SIZE_Y):
+            east = (grid_idx_y * TERRAIN_GRID_BLOCK_SPACING_Y + y) * spacing
+            h = srtm.height((ref_lat + north * LOCATION_SCALING_FACTOR_INV) * 1.0e-7,
+                            (ref_lng + east * LOCATION_SCALING_FACTOR_INV / scale) * 1.0e-7)
+            if h is None:
+                return None
+            heights.append(int(round(h)))
+
+    bitmap = (1 << (TERRAIN_GRID_BLOCK_MUL_X*TERRAIN_GRID_BLOCK_MUL_Y)) - 1
+
+    def pack(crc):
+        return (struct.pack('<QiiHHH', bitmap, lat, lon, crc, TERRAIN_GRID_FORMAT_VERSION, spacing) +
+                struct.pack('<%uh' % len(heights), *heights) +
+                struct.pack('<HHhb', grid_idx_x, grid_idx_y, lon_degrees, lat_degrees))
+
+    block = pack(crc16_ccitt(pack(0)))
+    return block + b'\0' * (IO_BLOCK_SIZE - len(block))
+
+
+def make_degree(srtm, lat_degrees, lon_degrees, spacing, out):
+    '''write all the blocks of one degree file'''
+    # highest grid indices of points within this degree, as
+    # AP_Terrain::calculate_grid_info()
+    ref_lat = lat_degrees*10*1000*1000
+    ref_lng = lon_degrees*10*1000*1000
+    offset = location_diff(ref_lat, ref_lng, ref_lat + 9999999, ref_lng + 9999999)
+    max_idx_x = int(offset[0] / spacing) // TERRAIN_GRID_BLOCK_SPACING_X
+    max_idx_y = int(offset[1] / spacing) // TERRAIN_GRID_BLOCK_SPACING_Y
+    eblocks = east_blocks(lat_degrees, lon_degrees, spacing)
+
+    name = "%c%02u%c%03u.DAT" % ('S' if lat_degrees < 0 else 'N', min(abs(lat_degrees), 99),
+                                 'W' if lon_degrees < 0 else 'E', min(abs(lon_degrees), 999))
+    path = os.path.join(out, name)
+    mode = 'r+b' if os.path.exists(path) else 'wb'
+    written = 0
+    missing = 0
+    with open(path, mode) as f:
+        for grid_idx_x in range(max_idx_x+1):
+            for grid_idx_y in range(max_idx_y+1):
+                block = make_block(srtm, lat_degrees, lon_degrees, grid_idx_x, grid_idx_y, spacing)
+                if block is None:
+                    missing += 1
+                    continue
+                f.seek((eblocks * grid_idx_x + grid_idx_y) * IO_BLOCK_SIZE)
+                f.write(block)
+                written += 1
+    print("%s: %u blocks, %u without SRTM data" % (path, written, missing))
+
+if not os.path.isdir(opts.out):
+    os.makedirs(opts.out)
+
+srtm = SRTM(opts.srtm)
+for lat in range(min(opts.lat1, opts.lat2), max(opts.lat1, opts.lat2)+1):
+    for lon in range(min(opts.lon1, opts.lon2), max(opts.lon1, opts.lon2)+1):
+        make_degree(srtm, lat, lon, opts.spacing, opts.out)
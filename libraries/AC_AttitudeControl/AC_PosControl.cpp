@@ -2,6 +2,7 @@
 #include "AC_PosControl.h"
 #include <AP_Math/AP_Math.h>
 #include <DataFlash/DataFlash.h>
+#include <DataFlash/DataFlash_Writer.h>
 
 extern const AP_HAL::HAL& hal;
 
@@ -824,6 +825,9 @@ float AC_PosControl::time_since_last_xy_update() const
     return (now - _last_update_xy_ms)*0.001f;
 }
 
+static DataFlash_Writer<'Q','f','f','f','f','f','f','f','f','f','f','f','f'> psc_writer(
+    "PSC", "TimeUS,TPX,TPY,PX,PY,TVX,TVY,VX,VY,TAX,TAY,AX,AY", "smmmmnnnnoooo", "FBBBBBBBBBBBB");
+
 // write log to dataflash
 void AC_PosControl::write_log()
 {
@@ -835,21 +839,19 @@ void AC_PosControl::write_log()
     float accel_x, accel_y;
     lean_angles_to_accel(accel_x, accel_y);
 
-    DataFlash_Class::instance()->Log_Write("PSC", "TimeUS,TPX,TPY,PX,PY,TVX,TVY,VX,VY,TAX,TAY,AX,AY",
-                                           "smmmmnnnnoooo", "FBBBBBBBBBBBB", "Qffffffffffff",
-                                           AP_HAL::micros64(),
-                                           (double)pos_target.x,
-                                           (double)pos_target.y,
-                                           (double)position.x,
-                                           (double)position.y,
-                                           (double)vel_target.x,
-                                           (double)vel_target.y,
-                                           (double)velocity.x,
-                                           (double)velocity.y,
-                                           (double)accel_target.x,
-                                           (double)accel_target.y,
-                                           (double)accel_x,
-                                           (double)accel_y);
+    psc_writer.write(AP_HAL::micros64(),
+                     pos_target.x,
+                     pos_target.y,
+                     position.x,
+                     position.y,
+                     vel_target.x,
+                     vel_target.y,
+                     velocity.x,
+                     velocity.y,
+                     accel_target.x,
+                     accel_target.y,
+                     accel_x,
+                     accel_y);
 }
 
 /// init_vel_controller_xyz - initialise the velocity controller - should be called once before the caller attempts to use the controller
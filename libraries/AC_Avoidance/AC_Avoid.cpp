@@ -72,16 +72,9 @@ void AC_Avoid::adjust_velocity(float kP, float accel_cmss, Vector2f &desired_vel
 
     if ((_enabled & AC_AVOID_STOP_AT_FENCE) > 0) {
         adjust_velocity_circle_fence(kP, accel_cmss_limited, desired_vel_cms, dt);
-        adjust_velocity_polygon_fence(kP, accel_cmss_limited, desired_vel_cms, dt);
     }
 
-    if ((_enabled & AC_AVOID_STOP_AT_BEACON_FENCE) > 0) {
-        adjust_velocity_beacon_fence(kP, accel_cmss_limited, desired_vel_cms, dt);
-    }
-
-    if ((_enabled & AC_AVOID_USE_PROXIMITY_SENSOR) > 0 && _proximity_enabled) {
-        adjust_velocity_proximity(kP, accel_cmss_limited, desired_vel_cms, dt);
-    }
+    adjust_velocity_obstacles(kP, accel_cmss_limited, desired_vel_cms, dt);
 }
 
 // convenience function to accept Vector3f.  Only x and y are adjusted
@@ -319,176 +312,106 @@ void AC_Avoid::adjust_velocity_circle_fence(float kP, float accel_cmss, Vector2f
 }
 
 /*
- * Adjusts the desired velocity for the polygon fence.
- */
-void AC_Avoid::adjust_velocity_polygon_fence(float kP, float accel_cmss, Vector2f &desired_vel_cms, float dt)
-{
-    // exit if the polygon fence is not enabled
-    if ((_fence.get_enabled_fences() & AC_FENCE_TYPE_POLYGON) == 0) {
-        return;
-    }
-
-    // exit if the polygon fence has already been breached
-    if ((_fence.get_breaches() & AC_FENCE_TYPE_POLYGON) != 0) {
-        return;
-    }
-
-    // exit immediately if no desired velocity
-    if (desired_vel_cms.is_zero()) {
-        return;
-    }
-
-    // get polygon boundary
-    // Note: first point in list is the return-point (which copter does not use)
-    uint16_t num_points;
-    Vector2f* boundary = _fence.get_polygon_points(num_points);
-
-    // adjust velocity using polygon
-    adjust_velocity_polygon(kP, accel_cmss, desired_vel_cms, boundary, num_points, true, _fence.get_margin(), dt);
-}
-
-/*
- * Adjusts the desired velocity for the beacon fence.
+ * Adjusts the desired velocity for the polygon fence and its zones, the
+ * beacon fence and the proximity sensor in one pass.  Only boundaries
+ * within stopping distance (plus margin) can limit the velocity, so only
+ * those are gathered, and the earth-frame ones are found through their
+ * grid indexes.  Every boundary is treated as a wall, including the sides
+ * of overlapping inclusion zones.
  */
-void AC_Avoid::adjust_velocity_beacon_fence(float kP, float accel_cmss, Vector2f &desired_vel_cms, float dt)
+void AC_Avoid::adjust_velocity_obstacles(float kP, float accel_cmss, Vector2f &desired_vel_cms, float dt)
 {
-    // exit if the beacon is not present
-    if (_beacon == nullptr) {
-        return;
-    }
-
     // exit immediately if no desired velocity
     if (desired_vel_cms.is_zero()) {
         return;
     }
 
-    // get boundary from beacons
-    uint16_t num_points;
-    const Vector2f* boundary = _beacon->get_boundary_points(num_points);
-    if (boundary == nullptr || num_points == 0) {
-        return;
-    }
-
-    // adjust velocity using beacon
-    adjust_velocity_polygon(kP, accel_cmss, desired_vel_cms, boundary, num_points, true, _fence.get_margin(), dt);
-}
+    const bool use_fence = (_enabled & AC_AVOID_STOP_AT_FENCE) > 0 &&
+        (_fence.get_enabled_fences() & AC_FENCE_TYPE_POLYGON) != 0 &&
+        (_fence.get_breaches() & AC_FENCE_TYPE_POLYGON) == 0;
+    const bool use_beacon = (_enabled & AC_AVOID_STOP_AT_BEACON_FENCE) > 0 && _beacon != nullptr;
+    const bool use_proximity = (_enabled & AC_AVOID_USE_PROXIMITY_SENSOR) > 0 && _proximity_enabled &&
+        _proximity.get_status() == AP_Proximity::Proximity_Good;
 
-/*
- * Adjusts the desired velocity based on output from the proximity sensor
- */
-void AC_Avoid::adjust_velocity_proximity(float kP, float accel_cmss, Vector2f &desired_vel_cms, float dt)
-{
-    // exit immediately if proximity sensor is not present
-    if (_proximity.get_status() != AP_Proximity::Proximity_Good) {
-        return;
-    }
+    // earth-frame boundaries need to know where we are, the proximity
+    // boundary is around the vehicle so does not
+    Vector2f position_xy;
+    const bool have_position = _ahrs.get_relative_position_NE_origin(position_xy);
+    position_xy *= 100.0f;  // m to cm
 
-    // exit immediately if no desired velocity
-    if (desired_vel_cms.is_zero()) {
-        return;
+    // for stopping
+    const float speed = desired_vel_cms.length();
+    const float stopping_distance = 2.0f + get_stopping_distance(kP, accel_cmss, speed);
+    const Vector2f stopping_vector = desired_vel_cms * (stopping_distance / speed);
+
+    // gather the boundaries close enough to matter
+    const bool slide = (AC_Avoid::BehaviourType)_behavior.get() == BEHAVIOR_SLIDE;
+    _obstacles.begin(position_xy, _ahrs.cos_yaw(), _ahrs.sin_yaw(), stopping_vector, slide);
+    if (use_fence && have_position) {
+        const float margin_cm = MAX(_fence.get_margin() * 100.0f, 0.0f);
+        const AC_PolyFence_index *zones = _fence.get_polygon_index();
+        if (zones != nullptr) {
+            _obstacles.add_zones(*zones, margin_cm);
+        } else {
+            // Note: first point in list is the return-point (which copter does not use)
+            uint16_t num_points;
+            const Vector2f* boundary = _fence.get_polygon_points(num_points);
+            if (boundary != nullptr && num_points > 1) {
+                _obstacles.add_polygon(&boundary[1], num_points-1, margin_cm);
+            }
+        }
     }
-
-    // get boundary from proximity sensor
-    uint16_t num_points;
-    const Vector2f *boundary = _proximity.get_boundary_points(num_points);
-    adjust_velocity_polygon(kP, accel_cmss, desired_vel_cms, boundary, num_points, false, _margin, dt);
-}
-
-/*
- * Adjusts the desired velocity for the polygon fence.
- */
-void AC_Avoid::adjust_velocity_polygon(float kP, float accel_cmss, Vector2f &desired_vel_cms, const Vector2f* boundary, uint16_t num_points, bool earth_frame, float margin, float dt)
-{
-    // exit if there are no points
-    if (boundary == nullptr || num_points == 0) {
-        return;
+    if (use_beacon && have_position) {
+        _obstacles.add_beacon(*_beacon, MAX(_fence.get_margin() * 100.0f, 0.0f));
     }
-
-    // do not adjust velocity if vehicle is outside the polygon fence
-    Vector2f position_xy;
-    if (earth_frame) {
-        if (!_ahrs.get_relative_position_NE_origin(position_xy)) {
-            // boundary is in earth frame but we have no idea
-            // where we are
-            return;
-        }
-        position_xy = position_xy * 100.0f;  // m to cm
+    if (use_proximity) {
+        uint16_t num_points;
+        const Vector2f *boundary = _proximity.get_boundary_points(num_points);
+        _obstacles.add_proximity(boundary, num_points, MAX(_margin * 100.0f, 0.0f));
     }
 
-    if (_fence.boundary_breached(position_xy, num_points, boundary)) {
+    if (_obstacles.overflowed()) {
+        // too many obstacles ahead to be sure of the nearest, so stop
+        desired_vel_cms.zero();
         return;
     }
 
-    // Safe_vel will be adjusted to remain within fence.
-    // We need a separate vector in case adjustment fails,
-    // e.g. if we are exactly on the boundary.
-    Vector2f safe_vel(desired_vel_cms);
-
-    // if boundary points are in body-frame, rotate velocity vector from earth frame to body-frame
-    if (!earth_frame) {
-        safe_vel.x = desired_vel_cms.y * _ahrs.sin_yaw() + desired_vel_cms.x * _ahrs.cos_yaw(); // right
-        safe_vel.y = desired_vel_cms.y * _ahrs.cos_yaw() - desired_vel_cms.x * _ahrs.sin_yaw(); // forward
-    }
-
-    // calc margin in cm
-    float margin_cm = MAX(margin * 100.0f, 0.0f);
-
-    // for stopping
-    float speed = safe_vel.length();
-    Vector2f stopping_point = position_xy + safe_vel*((2.0f + get_stopping_distance(kP, accel_cmss, speed))/speed);
-
-    uint16_t i, j;
-    for (i = 1, j = num_points-1; i < num_points; j = i++) {
-        // end points of current edge
-        Vector2f start = boundary[j];
-        Vector2f end = boundary[i];
-        if ((AC_Avoid::BehaviourType)_behavior.get() == BEHAVIOR_SLIDE) {
-            // vector from current position to closest point on current edge
-            Vector2f limit_direction = Vector2f::closest_point(position_xy, start, end) - position_xy;
-            // distance to closest point
+    // obstacles are relative to the vehicle.  Each source limits the
+    // velocity in turn, and is ignored if we are exactly on one of its
+    // boundaries
+    for (uint8_t source = 0; source < AC_Avoid_Obstacles::SOURCE_COUNT; source++) {
+        Vector2f safe_vel(desired_vel_cms);
+        bool on_boundary = false;
+        for (uint8_t i = 0; i < _obstacles.num_obstacles(); i++) {
+            const AC_Avoid_Obstacles::obstacle &ob = _obstacles.get_obstacle(i);
+            if (ob.source != source) {
+                continue;
+            }
+            Vector2f limit_direction;
+            if (slide) {
+                limit_direction = AC_Avoid_Obstacles::closest_point(ob);
+            } else if (!AC_Avoid_Obstacles::intersection(ob, stopping_vector, limit_direction)) {
+                continue;
+            }
             const float limit_distance_cm = limit_direction.length();
-            if (!is_zero(limit_distance_cm)) {
-                // We are strictly inside the given edge.
-                // Adjust velocity to not violate this edge.
-                limit_direction /= limit_distance_cm;
-                limit_velocity(kP, accel_cmss, safe_vel, limit_direction, MAX(limit_distance_cm - margin_cm, 0.0f), dt);
-            } else {
-                // We are exactly on the edge - treat this as a fence breach.
+            if (is_zero(limit_distance_cm)) {
+                // We are exactly on the boundary - treat this as a breach
                 // i.e. do not adjust velocity.
-                return;
+                on_boundary = true;
+                break;
             }
-        } else {
-            // find intersection with line segment
-            Vector2f intersection;
-            if (Vector2f::segment_intersection(position_xy, stopping_point, start, end, intersection)) {
-                // vector from current position to point on current edge
-                Vector2f limit_direction = intersection - position_xy;
-                const float limit_distance_cm = limit_direction.length();
-                if (!is_zero(limit_distance_cm)) {
-                    if (limit_distance_cm <= margin_cm) {
-                        // we are within the margin so stop vehicle
-                        safe_vel.zero();
-                    } else {
-                        // vehicle inside the given edge, adjust velocity to not violate this edge
-                        limit_direction /= limit_distance_cm;
-                        limit_velocity(kP, accel_cmss, safe_vel, limit_direction, MAX(limit_distance_cm - margin_cm, 0.0f), dt);
-                    }
-                } else {
-                    // We are exactly on the edge - treat this as a fence breach.
-                    // i.e. do not adjust velocity.
-                    return;
-                }
+            if (!slide && limit_distance_cm <= ob.margin) {
+                // we are within the margin so stop vehicle
+                safe_vel.zero();
+            } else {
+                // vehicle inside the given boundary, adjust velocity to not violate it
+                limit_direction /= limit_distance_cm;
+                limit_velocity(kP, accel_cmss, safe_vel, limit_direction, MAX(limit_distance_cm - ob.margin, 0.0f), dt);
             }
         }
-    }
-
-    // set modified desired velocity vector
-    if (earth_frame) {
-        desired_vel_cms = safe_vel;
-    } else {
-        // if points were in body-frame, rotate resulting vector back to earth-frame
-        desired_vel_cms.x = safe_vel.x * _ahrs.cos_yaw() - safe_vel.y * _ahrs.sin_yaw();
-        desired_vel_cms.y = safe_vel.x * _ahrs.sin_yaw() + safe_vel.y * _ahrs.cos_yaw();
+        if (!on_boundary) {
+            desired_vel_cms = safe_vel;
+        }
     }
 }
 
@@ -8,6 +8,7 @@
 #include <AC_Fence/AC_Fence.h>         // Failsafe fence library
 #include <AP_Proximity/AP_Proximity.h>
 #include <AP_Beacon/AP_Beacon.h>
+#include "AC_Avoid_Obstacles.h"
 
 #define AC_AVOID_ACCEL_CMSS_MAX         100.0f  // maximum acceleration/deceleration in cm/s/s used to avoid hitting fence
 
@@ -90,26 +91,10 @@ private:
     void adjust_velocity_circle_fence(float kP, float accel_cmss, Vector2f &desired_vel_cms, float dt);
 
     /*
-     * Adjusts the desired velocity for the polygon fence.
+     * Adjusts the desired velocity for the polygon fence, beacon fence
+     * and proximity sensor, in one pass over the obstacles near the vehicle.
      */
-    void adjust_velocity_polygon_fence(float kP, float accel_cmss, Vector2f &desired_vel_cms, float dt);
-
-    /*
-     * Adjusts the desired velocity for the beacon fence.
-     */
-    void adjust_velocity_beacon_fence(float kP, float accel_cmss, Vector2f &desired_vel_cms, float dt);
-
-    /*
-     * Adjusts the desired velocity based on output from the proximity sensor
-     */
-    void adjust_velocity_proximity(float kP, float accel_cmss, Vector2f &desired_vel_cms, float dt);
-
-    /*
-     * Adjusts the desired velocity given an array of boundary points
-     *   earth_frame should be true if boundary is in earth-frame, false for body-frame
-     *   margin is the distance (in meters) that the vehicle should stop short of the polygon
-     */
-    void adjust_velocity_polygon(float kP, float accel_cmss, Vector2f &desired_vel_cms, const Vector2f* boundary, uint16_t num_points, bool earth_frame, float margin, float dt);
+    void adjust_velocity_obstacles(float kP, float accel_cmss, Vector2f &desired_vel_cms, float dt);
 
     /*
      * Computes distance required to stop, given current speed.
@@ -132,6 +117,9 @@ private:
     const AP_Proximity& _proximity;
     const AP_Beacon* _beacon;
 
+    // obstacles near the vehicle, gathered on each call to adjust_velocity
+    AC_Avoid_Obstacles _obstacles;
+
     // parameters
     AP_Int8 _enabled;
     AP_Int16 _angle_max;        // maximum lean angle to avoid obstacles (only used in non-GPS flight modes)
@@ -0,0 +1,230 @@
+#include "AC_Avoid_Obstacles.h"
+
+/*
+ * Start gathering the obstacles that could limit the velocity
+ */
+void AC_Avoid_Obstacles::begin(const Vector2f &position, float cos_yaw, float sin_yaw, const Vector2f &stopping_vector, bool slide)
+{
+    _position = position;
+    _cos_yaw = cos_yaw;
+    _sin_yaw = sin_yaw;
+    _stopping_vector = stopping_vector;
+    _range = stopping_vector.length();
+    _slide = slide;
+    _complete_range = _range;
+    _num_obstacles = 0;
+}
+
+/*
+ * distance the vehicle can move along its velocity before reaching an
+ * obstacle's margin, false if the obstacle can't limit the velocity.
+ * In STOP mode only the obstacles the stopping vector hits limit the
+ * velocity, all in the same direction.  In SLIDE mode an obstacle limits
+ * the part of the velocity towards its closest point, which the vehicle
+ * reaches after moving this far along its velocity
+ */
+bool AC_Avoid_Obstacles::distance_along_velocity(const struct obstacle &ob, float &distance) const
+{
+    if (!_slide) {
+        Vector2f hit;
+        if (!intersection(ob, _stopping_vector, hit)) {
+            return false;
+        }
+        distance = MAX(hit.length() - ob.margin, 0.0f);
+        return true;
+    }
+    const Vector2f closest = closest_point(ob);
+    const float closest_distance = closest.length();
+    if (closest_distance <= ob.margin) {
+        // on the boundary or within the margin
+        distance = 0.0f;
+        return true;
+    }
+    const float along = (closest * _stopping_vector) / (closest_distance * _range);
+    if (along <= 0.0f) {
+        // heading away from it
+        return false;
+    }
+    distance = (closest_distance - ob.margin) / along;
+    return distance <= _range;
+}
+
+/*
+ * add an obstacle in earth frame relative to the EKF origin, if it could
+ * limit the velocity.  When there are more than can be held the nearest
+ * along the velocity are kept, as they are the ones that limit it most
+ */
+void AC_Avoid_Obstacles::add(const Vector2f &start, const Vector2f &end, float radius, float margin, Source source)
+{
+    struct obstacle ob;
+    ob.start = start - _position;
+    ob.end = end - _position;
+    ob.radius = radius;
+    ob.margin = margin;
+    ob.source = source;
+    if (!distance_along_velocity(ob, ob.distance)) {
+        return;
+    }
+    if (_num_obstacles < AC_AVOID_OBSTACLES_MAX) {
+        _obstacles[_num_obstacles++] = ob;
+        return;
+    }
+    uint8_t furthest = 0;
+    for (uint8_t i = 1; i < _num_obstacles; i++) {
+        if (_obstacles[i].distance > _obstacles[furthest].distance) {
+            furthest = i;
+        }
+    }
+    if (ob.distance < _obstacles[furthest].distance) {
+        _complete_range = MIN(_complete_range, _obstacles[furthest].distance);
+        _obstacles[furthest] = ob;
+    } else {
+        _complete_range = MIN(_complete_range, ob.distance);
+    }
+}
+
+/*
+ * true if there were too many obstacles to be sure those kept are the
+ * ones that limit velocity.  In SLIDE mode every obstacle kept or dropped
+ * could limit the velocity.  In STOP mode only the nearest hit does, so
+ * it is enough that no obstacle nearer than that was dropped
+ */
+bool AC_Avoid_Obstacles::overflowed() const
+{
+    if (_complete_range >= _range) {
+        return false;
+    }
+    if (_slide) {
+        return true;
+    }
+    for (uint8_t i = 0; i < _num_obstacles; i++) {
+        if (_obstacles[i].distance <= _complete_range) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Add the boundaries of indexed fence zones, unless the vehicle is outside them
+ */
+void AC_Avoid_Obstacles::add_zones(const AC_PolyFence_index &zones, float margin, Source source)
+{
+    if (zones.breached(_position)) {
+        return;
+    }
+    // if there are more boundaries in range than can be looked at then
+    // look closer in.  Those further out are at least that far along
+    // the velocity
+    uint16_t items[AC_AVOID_ZONE_ITEMS_MAX];
+    uint16_t num_items;
+    float radius = _range + margin;
+    while (!zones.find_boundaries(_position, radius, items, num_items, ARRAY_SIZE(items)) && radius > 1.0f) {
+        radius *= 0.5f;
+        _complete_range = MIN(_complete_range, MAX(radius - margin, 0.0f));
+    }
+    for (uint16_t i = 0; i < num_items; i++) {
+        Vector2f start, end;
+        float radius_cm;
+        zones.get_boundary(items[i], start, end, radius_cm);
+        add(start, end, radius_cm, margin, source);
+    }
+}
+
+/*
+ * Add the edges of an earth-frame polygon, unless the vehicle is outside it
+ */
+void AC_Avoid_Obstacles::add_polygon(const Vector2f *points, uint16_t num_points, float margin, Source source)
+{
+    if (points == nullptr || num_points < 4 || Polygon_outside(_position, points, num_points)) {
+        return;
+    }
+    for (uint16_t i = 1; i < num_points; i++) {
+        add(points[i-1], points[i], 0.0f, margin, source);
+    }
+}
+
+/*
+ * Add the beacon fence, re-indexing it if the beacons have changed.  The
+ * beacon library only rebuilds its boundary when beacons are added, so
+ * this is rare
+ */
+void AC_Avoid_Obstacles::add_beacon(const AP_Beacon &beacon, float margin)
+{
+    uint16_t num_points;
+    const Vector2f* boundary = beacon.get_boundary_points(num_points);
+    if (boundary == nullptr || num_points == 0) {
+        return;
+    }
+    num_points = MIN(num_points, ARRAY_SIZE(_beacon_points));
+
+    if (num_points != _beacon_num_points ||
+        memcmp(boundary, _beacon_points, num_points * sizeof(Vector2f)) != 0) {
+        memcpy(_beacon_points, boundary, num_points * sizeof(Vector2f));
+        _beacon_num_points = num_points;
+        _beacon_zones.clear();
+        _beacon_zones.add_polygon(AC_PolyFence_index::ZONE_INCLUSION, _beacon_points, _beacon_num_points);
+        _beacon_zones.build();
+    }
+
+    if (_beacon_zones.ready()) {
+        add_zones(_beacon_zones, margin, SOURCE_BEACON);
+    } else {
+        add_polygon(_beacon_points, _beacon_num_points, margin, SOURCE_BEACON);
+    }
+}
+
+/*
+ * Add the boundary around the vehicle from a proximity sensor, in body frame
+ */
+void AC_Avoid_Obstacles::add_proximity(const Vector2f *points, uint16_t num_points, float margin)
+{
+    if (points == nullptr || num_points < 3) {
+        return;
+    }
+
+    // the vehicle should be inside the boundary, but if it is not then
+    // the sensor is not giving a useful boundary
+    if (Polygon_outside(Vector2f(), points, num_points)) {
+        return;
+    }
+
+    // rotate into earth frame about the vehicle
+    Vector2f prev;
+    for (uint16_t i = 0; i <= num_points; i++) {
+        const Vector2f &p = points[i % num_points];
+        const Vector2f point = _position + Vector2f(p.x * _cos_yaw - p.y * _sin_yaw,
+                                                    p.x * _sin_yaw + p.y * _cos_yaw);
+        if (i > 0) {
+            add(prev, point, 0.0f, margin, SOURCE_PROXIMITY);
+        }
+        prev = point;
+    }
+}
+
+/*
+ * point on an obstacle closest to the vehicle
+ */
+Vector2f AC_Avoid_Obstacles::closest_point(const struct obstacle &ob)
+{
+    if (is_zero(ob.radius)) {
+        return Vector2f::closest_point(Vector2f(), ob.start, ob.end);
+    }
+    const float dist = ob.start.length();
+    if (is_zero(dist)) {
+        // vehicle is at the center, every point is as close
+        return Vector2f(ob.radius, 0.0f);
+    }
+    return ob.start * (1.0f - ob.radius / dist);
+}
+
+/*
+ * intersection of an obstacle with the line from the vehicle to a point, closest to the vehicle
+ */
+bool AC_Avoid_Obstacles::intersection(const struct obstacle &ob, const Vector2f &end, Vector2f &intersection)
+{
+    if (is_zero(ob.radius)) {
+        return Vector2f::segment_intersection(Vector2f(), end, ob.start, ob.end, intersection);
+    }
+    return Vector2f::circle_segment_intersection(Vector2f(), end, ob.start, ob.radius, intersection);
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <AP_Common/AP_Common.h>
+#include <AP_Math/AP_Math.h>
+#include <AC_Fence/AC_PolyFence_index.h>
+#include <AP_Beacon/AP_Beacon.h>
+
+#define AC_AVOID_OBSTACLES_MAX      32      // most obstacles near the vehicle that are looked at in one pass, the nearest are kept
+#define AC_AVOID_ZONE_ITEMS_MAX     128     // most fence zone boundaries looked at before filtering them down to obstacles
+
+/*
+ * Boundaries the vehicle must not cross, from the polygon fence and
+ * its zones, the beacon fence and the proximity sensor, gathered so
+ * that avoidance can limit velocity in one pass over just the ones
+ * near the vehicle.
+ *
+ * Earth-frame boundaries are kept in grid indexes which are only rebuilt
+ * when their source changes: AC_Fence keeps the fence zones, and the
+ * beacon fence is kept here. Body-frame boundaries from the proximity
+ * sensor move with the vehicle, so the few points of the sensor's
+ * boundary are rotated into earth frame as they are gathered.
+ *
+ * Obstacles are held in earth frame in cm relative to the vehicle. Only
+ * those which can limit the velocity are kept: in STOP mode those the
+ * stopping vector hits, ranked by how far along it they are, and in
+ * SLIDE mode those the velocity is heading towards, ranked by the
+ * distance along the velocity to the line through their closest point.
+ */
+class AC_Avoid_Obstacles {
+public:
+    AC_Avoid_Obstacles() {}
+
+    /* Do not allow copies */
+    AC_Avoid_Obstacles(const AC_Avoid_Obstacles &other) = delete;
+    AC_Avoid_Obstacles &operator=(const AC_Avoid_Obstacles&) = delete;
+
+    // where obstacles came from, in the order avoidance applies them
+    enum Source : uint8_t {
+        SOURCE_FENCE = 0,
+        SOURCE_BEACON,
+        SOURCE_PROXIMITY,
+        SOURCE_COUNT
+    };
+
+    struct obstacle {
+        Vector2f start;     // cm from the vehicle, earth frame
+        Vector2f end;       // same as start for a circle
+        float radius;       // circle radius in cm, zero for a line
+        float margin;       // distance in cm the vehicle should stop short of the obstacle
+        float distance;     // cm the vehicle can move along its velocity before reaching the obstacle's margin
+        Source source;
+    };
+
+    /*
+     * Start gathering the obstacles that could limit the velocity before
+     * the vehicle reaches the end of the stopping vector, in cm.  position
+     * is in cm from the EKF origin
+     */
+    void begin(const Vector2f &position, float cos_yaw, float sin_yaw, const Vector2f &stopping_vector, bool slide);
+
+    /*
+     * Add the boundaries of indexed fence zones, unless the vehicle is outside them
+     */
+    void add_zones(const AC_PolyFence_index &zones, float margin, Source source = SOURCE_FENCE);
+
+    /*
+     * Add the edges of an earth-frame polygon, unless the vehicle is outside it.
+     * Used for the fence when it could not be indexed.  The last point
+     * must repeat the first
+     */
+    void add_polygon(const Vector2f *points, uint16_t num_points, float margin, Source source = SOURCE_FENCE);
+
+    /*
+     * Add the beacon fence, re-indexing it if the beacons have changed
+     */
+    void add_beacon(const AP_Beacon &beacon, float margin);
+
+    /*
+     * Add the boundary around the vehicle from a proximity sensor, in body frame
+     */
+    void add_proximity(const Vector2f *points, uint16_t num_points, float margin);
+
+    // number of obstacles gathered and access to them
+    uint8_t num_obstacles() const { return _num_obstacles; }
+
+    // true if there were too many obstacles to be sure those kept are the ones that limit velocity
+    bool overflowed() const;
+    const struct obstacle &get_obstacle(uint8_t i) const { return _obstacles[i]; }
+
+    // point on an obstacle closest to the vehicle
+    static Vector2f closest_point(const struct obstacle &ob);
+
+    // intersection of an obstacle with the line from the vehicle to a point, closest to the vehicle
+    static bool intersection(const struct obstacle &ob, const Vector2f &end, Vector2f &intersection);
+
+private:
+    // add an obstacle in earth frame relative to the EKF origin, if it
+    // could limit velocity and is nearer than the furthest one held
+    void add(const Vector2f &start, const Vector2f &end, float radius, float margin, Source source);
+
+    // distance the vehicle can move along its velocity before reaching an
+    // obstacle's margin, false if the obstacle can't limit the velocity
+    bool distance_along_velocity(const struct obstacle &ob, float &distance) const;
+
+    // vehicle state for this pass
+    Vector2f _position;
+    float _cos_yaw = 1.0f;
+    float _sin_yaw = 0.0f;
+    Vector2f _stopping_vector;
+    float _range = 0.0f;            // length of the stopping vector
+    bool _slide = false;
+    float _complete_range = 0.0f;   // every obstacle nearer than this along the velocity has been kept
+
+    // obstacles found in range
+    struct obstacle _obstacles[AC_AVOID_OBSTACLES_MAX];
+    uint8_t _num_obstacles = 0;
+
+    // beacon fence, as last indexed
+    AC_PolyFence_index _beacon_zones;
+    Vector2f _beacon_points[AP_BEACON_MAX_BEACONS+1];
+    uint16_t _beacon_num_points = 0;
+};
@@ -0,0 +1,112 @@
+#include <AP_gtest.h>
+
+#include <AC_Avoidance/AC_Avoid_Obstacles.h>
+
+const AP_HAL::HAL &hal = AP_HAL::get_HAL();
+
+// the vehicle is at the origin heading north, and can stop within 80m
+static const Vector2f stopping_vector(8000, 0);
+
+// a large inclusion zone holding many small exclusion circles, those
+// ahead of the vehicle in a line along its path and the rest to its side
+// or behind it
+static void add_circles(AC_PolyFence_index &zones, uint16_t num_ahead, uint16_t num_side, uint16_t num_behind)
+{
+    zones.add_circle(AC_PolyFence_index::ZONE_INCLUSION, Vector2f(0, 0), 100000);
+    for (uint16_t i=0; i<num_ahead; i++) {
+        zones.add_circle(AC_PolyFence_index::ZONE_EXCLUSION, Vector2f(1000 + i * 100, 0), 40);
+    }
+    for (uint16_t i=0; i<num_side; i++) {
+        zones.add_circle(AC_PolyFence_index::ZONE_EXCLUSION, Vector2f(1000 + (i / 2) * 200, (i % 2) ? 1000 : -1000), 40);
+    }
+    for (uint16_t i=0; i<num_behind; i++) {
+        zones.add_circle(AC_PolyFence_index::ZONE_EXCLUSION, Vector2f(-1000 - (i / 2) * 200, (i % 2) ? 200 : -200), 40);
+    }
+    ASSERT_TRUE(zones.build());
+}
+
+static float nearest_distance(const AC_Avoid_Obstacles &obstacles)
+{
+    float nearest = FLT_MAX;
+    for (uint8_t i=0; i<obstacles.num_obstacles(); i++) {
+        nearest = MIN(nearest, obstacles.get_obstacle(i).distance);
+    }
+    return nearest;
+}
+
+// obstacles beside the path don't fill the obstacles ahead
+TEST(AvoidObstaclesTest, StopKeepsObstaclesHit)
+{
+    AC_PolyFence_index zones;
+    add_circles(zones, 5, 60, 0);
+    AC_Avoid_Obstacles obstacles;
+    obstacles.begin(Vector2f(0, 0), 1, 0, stopping_vector, false);
+    obstacles.add_zones(zones, 0);
+    EXPECT_EQ(5, obstacles.num_obstacles());
+    EXPECT_FALSE(obstacles.overflowed());
+    EXPECT_NEAR(960, nearest_distance(obstacles), 1);
+}
+
+// with more obstacles ahead than can be held the nearest are kept, and
+// as only the nearest limits the velocity that is not an overflow
+TEST(AvoidObstaclesTest, StopKeepsNearestHits)
+{
+    AC_PolyFence_index zones;
+    add_circles(zones, 50, 0, 0);
+    AC_Avoid_Obstacles obstacles;
+    obstacles.begin(Vector2f(0, 0), 1, 0, stopping_vector, false);
+    obstacles.add_zones(zones, 100);
+    EXPECT_EQ(AC_AVOID_OBSTACLES_MAX, obstacles.num_obstacles());
+    EXPECT_FALSE(obstacles.overflowed());
+    EXPECT_NEAR(860, nearest_distance(obstacles), 1);
+    for (uint8_t i=0; i<obstacles.num_obstacles(); i++) {
+        EXPECT_LT(obstacles.get_obstacle(i).distance, 860 + AC_AVOID_OBSTACLES_MAX * 100);
+    }
+}
+
+// obstacles behind the vehicle can't limit its velocity when sliding
+TEST(AvoidObstaclesTest, SlideIgnoresObstaclesBehind)
+{
+    AC_PolyFence_index zones;
+    add_circles(zones, 3, 0, 60);
+    AC_Avoid_Obstacles obstacles;
+    obstacles.begin(Vector2f(0, 0), 1, 0, stopping_vector, true);
+    obstacles.add_zones(zones, 0);
+    EXPECT_EQ(3, obstacles.num_obstacles());
+    EXPECT_FALSE(obstacles.overflowed());
+}
+
+// obstacles to the side are further along the velocity than those
+// straight ahead at the same distance
+TEST(AvoidObstaclesTest, SlideRanksAlongVelocity)
+{
+    AC_Avoid_Obstacles obstacles;
+    obstacles.begin(Vector2f(0, 0), 1, 0, stopping_vector, true);
+    const Vector2f proximity[] = { Vector2f(2000, 0), Vector2f(0, 2000), Vector2f(-2000, 0), Vector2f(0, -2000) };
+    obstacles.add_proximity(proximity, ARRAY_SIZE(proximity), 0);
+    ASSERT_EQ(2, obstacles.num_obstacles());
+    // the closest points of the two forward edges are 45 degrees off the velocity
+    EXPECT_NEAR(2000, obstacles.get_obstacle(0).distance, 1);
+    EXPECT_NEAR(2000, obstacles.get_obstacle(1).distance, 1);
+}
+
+// when sliding every obstacle ahead could limit the velocity, so
+// dropping any of them is an overflow
+TEST(AvoidObstaclesTest, SlideOverflows)
+{
+    AC_PolyFence_index zones;
+    add_circles(zones, 50, 0, 0);
+    AC_Avoid_Obstacles obstacles;
+    obstacles.begin(Vector2f(0, 0), 1, 0, stopping_vector, true);
+    obstacles.add_zones(zones, 0);
+    EXPECT_EQ(AC_AVOID_OBSTACLES_MAX, obstacles.num_obstacles());
+    EXPECT_TRUE(obstacles.overflowed());
+
+    // heading the other way none of them matter
+    obstacles.begin(Vector2f(0, 0), 1, 0, -stopping_vector, true);
+    obstacles.add_zones(zones, 0);
+    EXPECT_EQ(0, obstacles.num_obstacles());
+    EXPECT_FALSE(obstacles.overflowed());
+}
+
+AP_GTEST_MAIN()
@@ -3,6 +3,10 @@
 #include <GCS_MAVLink/GCS_MAVLink.h>
 #include <GCS_MAVLink/GCS.h>
 
+#ifdef AC_FENCE_ZONE_FILE
+#include <stdio.h>
+#endif
+
 extern const AP_HAL::HAL& hal;
 
 const AP_Param::GroupInfo AC_Fence::var_info[] = {
@@ -104,7 +108,7 @@ bool AC_Fence::pre_arm_check_polygon(const char* &fail_msg) const
         return true;
     }
 
-    if (!_boundary_valid) {
+    if (!polygon_valid()) {
         fail_msg = "Polygon boundary invalid";
         return false;
     }
@@ -229,17 +233,18 @@ bool AC_Fence::check_fence_polygon()
         return false;
     }
 
-    // check consistency of number of points
-    if (_boundary_num_points != _total) {
+    // check consistency of number of points.  Without any points the load still reads the zone file
+    if (!_boundary_loaded || _boundary_num_points != _total) {
         // Fence is currently not completely loaded.  Can't breach it?!
         _boundary_loaded = false;
         load_polygon_from_eeprom();
         return false;
     }
-    if (!_boundary_valid) {
+    if (!polygon_valid()) {
         // fence isn't valid - can't breach it?!
         return false;
     }
+    update_polygon_index();
 
     // check if vehicle is outside the polygon fence
     Vector2f position;
@@ -249,7 +254,7 @@ bool AC_Fence::check_fence_polygon()
     }
 
     position = position * 100.0f;  // m to cm
-    if (_poly_loader.boundary_breached(position, _boundary_num_points, _boundary, true)) {
+    if (polygon_breached(position)) {
         // check if this is a new breach
         if (_breached_fences & AC_FENCE_TYPE_POLYGON) {
             // not a new breach
@@ -373,11 +378,12 @@ bool AC_Fence::check_destination_within_fence(const Location_Class& loc)
     }
 
     // polygon fence check
-    if ((get_enabled_fences() & AC_FENCE_TYPE_POLYGON) && _boundary_num_points > 0) {
+    if ((get_enabled_fences() & AC_FENCE_TYPE_POLYGON) && polygon_valid()) {
+        update_polygon_index();
         // check ekf has a good location
         Vector2f posNE;
         if (loc.get_vector_xy_from_origin_NE(posNE)) {
-            if (_poly_loader.boundary_breached(posNE, _boundary_num_points, _boundary, true)) {
+            if (polygon_breached(posNE)) {
                 return false;
             }
         }
@@ -459,6 +465,110 @@ bool AC_Fence::boundary_breached(const Vector2f& location, uint16_t num_points,
     return _poly_loader.boundary_breached(location, num_points, points, true);
 }
 
+/// add_polygon_zone - add an inclusion or exclusion polygon, held in RAM and checked along with the polygon boundary
+bool AC_Fence::add_polygon_zone(bool exclusion, const Location *points, uint16_t num_points)
+{
+    struct Location ekf_origin {};
+    if (points == nullptr || num_points > AC_POLYFENCE_INDEX_MAX_ITEMS || !_ahrs.get_origin(ekf_origin)) {
+        return false;
+    }
+    if (hal.util->available_memory() < 100U + num_points * sizeof(Vector2f)) {
+        return false;
+    }
+    Vector2f *points_cm = (Vector2f *)calloc(num_points, sizeof(Vector2f));
+    if (points_cm == nullptr) {
+        return false;
+    }
+    for (uint16_t i=0; i<num_points; i++) {
+        points_cm[i] = location_diff(ekf_origin, points[i]) * 100.0f;
+    }
+    const bool ret = _poly_index.add_polygon(exclusion ? AC_PolyFence_index::ZONE_EXCLUSION : AC_PolyFence_index::ZONE_INCLUSION,
+                                             points_cm, num_points);
+    free(points_cm);
+    _poly_index_changed = true;
+    return ret;
+}
+
+/// add_circle_zone - add an inclusion or exclusion circle, radius in meters
+bool AC_Fence::add_circle_zone(bool exclusion, const Location &center, float radius)
+{
+    struct Location ekf_origin {};
+    if (!_ahrs.get_origin(ekf_origin)) {
+        return false;
+    }
+    const bool ret = _poly_index.add_circle(exclusion ? AC_PolyFence_index::ZONE_EXCLUSION : AC_PolyFence_index::ZONE_INCLUSION,
+                                            location_diff(ekf_origin, center) * 100.0f, radius * 100.0f);
+    _poly_index_changed = true;
+    return ret;
+}
+
+/// clear_zones - remove all zones added with add_polygon_zone and add_circle_zone
+void AC_Fence::clear_zones()
+{
+    // remove from the end so the polygon boundary, if there is one, ends up as zone zero
+    for (int32_t i=_poly_index.num_zones()-1; i>=0; i--) {
+        if (i != _boundary_zone) {
+            _poly_index.remove_zone(i);
+        }
+    }
+    if (_boundary_zone != AC_FENCE_ZONE_NONE) {
+        _boundary_zone = 0;
+    }
+    _poly_index_changed = true;
+}
+
+/// get_polygon_index - returns the index of the polygon boundary and zones, or nullptr if it is not available
+const AC_PolyFence_index *AC_Fence::get_polygon_index() const
+{
+    if (!polygon_valid() || !polygon_index_usable()) {
+        return nullptr;
+    }
+    return &_poly_index;
+}
+
+/// polygon_valid - true if there is a valid polygon boundary or zones to check.  An invalid boundary
+/// from eeprom makes the whole polygon fence invalid, as it did before there were zones
+bool AC_Fence::polygon_valid() const
+{
+    if (_boundary_valid) {
+        return true;
+    }
+    const uint16_t num_zones = _poly_index.num_zones() - ((_boundary_zone != AC_FENCE_ZONE_NONE) ? 1 : 0);
+    return _total == 0 && num_zones > 0;
+}
+
+/// polygon_index_usable - true if the zone index is built and includes the polygon boundary
+bool AC_Fence::polygon_index_usable() const
+{
+    if (!_poly_index.ready()) {
+        return false;
+    }
+    // the boundary may not have fitted in the index
+    return !_boundary_valid || _boundary_zone != AC_FENCE_ZONE_NONE;
+}
+
+/// polygon_breached - true if a position (in cm from the EKF origin) is outside the polygon boundary and zones
+bool AC_Fence::polygon_breached(const Vector2f &position) const
+{
+    if (polygon_index_usable()) {
+        return _poly_index.breached(position);
+    }
+    // without the index only the boundary can be checked
+    return _boundary_valid && _poly_loader.boundary_breached(position, _boundary_num_points, _boundary, true);
+}
+
+/// update_polygon_index - rebuild the zone index if the boundary or zones have changed
+void AC_Fence::update_polygon_index()
+{
+    if (!_poly_index_changed) {
+        return;
+    }
+    // only try once per change, if there isn't the memory for the index
+    // then the boundary is checked on its own
+    _poly_index_changed = false;
+    _poly_index.build();
+}
+
 /// handler for polygon fence messages with GCS
 void AC_Fence::handle_msg(GCS_MAVLINK &link, mavlink_message_t* msg)
 {
@@ -554,9 +664,123 @@ bool AC_Fence::load_polygon_from_eeprom(bool force_reload)
     // update validity of polygon
     _boundary_valid = _poly_loader.boundary_valid(_boundary_num_points, _boundary, true);
 
+    // replace the boundary in the zone index.  Note: the return point is not part of the boundary
+    if (_boundary_zone != AC_FENCE_ZONE_NONE) {
+        _poly_index.remove_zone(_boundary_zone);
+        _boundary_zone = AC_FENCE_ZONE_NONE;
+    }
+    if (_boundary_valid &&
+        _poly_index.add_polygon(AC_PolyFence_index::ZONE_INCLUSION, &_boundary[1], _boundary_num_points-1)) {
+        _boundary_zone = _poly_index.num_zones() - 1;
+    }
+
+#ifdef AC_FENCE_ZONE_FILE
+    // zones are offsets from the EKF origin like the boundary, so the file is read once the origin is known
+    if (!_zones_loaded) {
+        _zones_loaded = true;
+        load_zones_from_file();
+    }
+#endif
+
+    _poly_index_changed = true;
+    update_polygon_index();
+
+    return true;
+}
+
+#ifdef AC_FENCE_ZONE_FILE
+// parse a zone file latitude and longitude, in degrees
+static bool parse_zone_point(const char *lat_s, const char *lng_s, Location &loc)
+{
+    if (lat_s == nullptr || lng_s == nullptr) {
+        return false;
+    }
+    const double lat = atof(lat_s);
+    const double lng = atof(lng_s);
+    if (!check_latlng((float)lat, (float)lng)) {
+        return false;
+    }
+    loc = {};
+    loc.lat = lat * 1.0e7;
+    loc.lng = lng * 1.0e7;
     return true;
 }
 
+/// load_zones_from_file - add the zones listed in AC_FENCE_ZONE_FILE.  Each zone starts with an INCLUDE or
+///     EXCLUDE line.  A circle has its center and radius on that line ("EXCLUDE lat lng radius", in degrees and
+///     meters), a polygon is followed by a "lat lng" line for each vertex.  Lines starting with # are comments
+void AC_Fence::load_zones_from_file()
+{
+    FILE *f = fopen(AC_FENCE_ZONE_FILE, "r");
+    if (f == nullptr) {
+        // no zones
+        return;
+    }
+    Location *points = (Location *)calloc(AC_FENCE_ZONE_FILE_MAX_POINTS, sizeof(Location));
+    if (points == nullptr) {
+        fclose(f);
+        gcs().send_text(MAV_SEVERITY_WARNING, "Fence zones: out of memory");
+        return;
+    }
+
+    bool ok = true;
+    bool in_polygon = false;
+    bool exclusion = false;
+    uint16_t num_points = 0;
+    uint16_t num_zones = 0;
+    uint16_t line_num = 0;
+    char line[100];
+    while (ok && fgets(line, sizeof(line), f)) {
+        line_num++;
+        char *saveptr = nullptr;
+        const char *tok = strtok_r(line, " \t\r\n", &saveptr);
+        if (tok == nullptr || tok[0] == '#') {
+            continue;
+        }
+        if (strcmp(tok, "INCLUDE") != 0 && strcmp(tok, "EXCLUDE") != 0) {
+            // a polygon vertex
+            ok = in_polygon && num_points < AC_FENCE_ZONE_FILE_MAX_POINTS &&
+                parse_zone_point(tok, strtok_r(nullptr, " \t\r\n", &saveptr), points[num_points]);
+            num_points++;
+            continue;
+        }
+        // the start of a zone finishes any polygon before it
+        if (in_polygon) {
+            ok = add_polygon_zone(exclusion, points, num_points);
+            num_zones++;
+            in_polygon = false;
+        }
+        exclusion = (strcmp(tok, "EXCLUDE") == 0);
+        const char *lat_s = strtok_r(nullptr, " \t\r\n", &saveptr);
+        if (lat_s == nullptr) {
+            in_polygon = true;
+            num_points = 0;
+            continue;
+        }
+        const char *lng_s = strtok_r(nullptr, " \t\r\n", &saveptr);
+        const char *radius_s = strtok_r(nullptr, " \t\r\n", &saveptr);
+        Location center;
+        ok = ok && radius_s != nullptr && parse_zone_point(lat_s, lng_s, center) &&
+            add_circle_zone(exclusion, center, atof(radius_s));
+        num_zones++;
+    }
+    if (ok && in_polygon) {
+        ok = add_polygon_zone(exclusion, points, num_points);
+        num_zones++;
+    }
+    fclose(f);
+    free(points);
+
+    if (!ok) {
+        // don't fly with part of the zones
+        clear_zones();
+        gcs().send_text(MAV_SEVERITY_WARNING, "Fence zones: error at line %u", (unsigned)line_num);
+        return;
+    }
+    gcs().send_text(MAV_SEVERITY_INFO, "Fence zones: loaded %u", (unsigned)num_zones);
+}
+#endif // AC_FENCE_ZONE_FILE
+
 // methods for mavlink SYS_STATUS message (send_extended_status1)
 bool AC_Fence::sys_status_present() const
 {
@@ -584,7 +808,7 @@ bool AC_Fence::sys_status_failed() const
         return true;
     }
     if (_enabled_fences & AC_FENCE_TYPE_POLYGON) {
-        if (!_boundary_valid) {
+        if (!polygon_valid()) {
             return true;
         }
     }
@@ -7,6 +7,7 @@
 #include <GCS_MAVLink/GCS_MAVLink.h>
 #include <AP_AHRS/AP_AHRS.h>
 #include <AC_Fence/AC_PolyFence_loader.h>
+#include <AC_Fence/AC_PolyFence_index.h>
 #include <AP_Common/Location.h>
 
 // bit masks for enabled fence types.  Used for TYPE parameter
@@ -30,6 +31,22 @@
 #define AC_FENCE_GIVE_UP_DISTANCE                   100.0f  // distance outside the fence at which we should give up and just land.  Note: this is not used by library directly but is intended to be used by the main code
 #define AC_FENCE_MANUAL_RECOVERY_TIME_MIN           10000   // pilot has 10seconds to recover during which time the autopilot will not attempt to re-take control
 
+#define AC_FENCE_ZONE_NONE                          0xFFFF  // polygon boundary is not in the zone index
+
+// file of inclusion and exclusion zones, checked along with the polygon boundary.  Only boards with an sdcard or filesystem
+#ifndef AC_FENCE_ZONE_FILE
+#if HAL_OS_POSIX_IO && defined(HAL_BOARD_TERRAIN_DIRECTORY)
+#if CONFIG_HAL_BOARD == HAL_BOARD_PX4 || CONFIG_HAL_BOARD == HAL_BOARD_VRBRAIN
+#define AC_FENCE_ZONE_FILE                          "/fs/microsd/APM/FENCE.TXT"
+#elif defined(HAL_BOARD_STORAGE_DIRECTORY)
+#define AC_FENCE_ZONE_FILE                          HAL_BOARD_STORAGE_DIRECTORY "/fence_zones.txt"
+#else
+#define AC_FENCE_ZONE_FILE                          "fence_zones.txt"
+#endif
+#endif
+#endif
+#define AC_FENCE_ZONE_FILE_MAX_POINTS               100     // maximum number of vertices of a polygon zone in the zone file
+
 class AC_Fence
 {
 public:
@@ -103,6 +120,9 @@ public:
     /// returns true if we've breached the polygon boundary.  simple passthrough to underlying _poly_loader object
     bool boundary_breached(const Vector2f& location, uint16_t num_points, const Vector2f* points) const;
 
+    /// get_polygon_index - returns the index of the polygon boundary and zones, or nullptr if it is not available
+    const AC_PolyFence_index *get_polygon_index() const;
+
     /// handler for polygon fence messages with GCS
     void handle_msg(GCS_MAVLINK &link, mavlink_message_t* msg);
 
@@ -138,6 +158,33 @@ private:
     /// load polygon points stored in eeprom into boundary array and perform validation.  returns true if load successfully completed
     bool load_polygon_from_eeprom(bool force_reload = false);
 
+#ifdef AC_FENCE_ZONE_FILE
+    /// load_zones_from_file - add the zones listed in AC_FENCE_ZONE_FILE.  A bad file loads no zones
+    void load_zones_from_file();
+#endif
+
+    /// add_polygon_zone - add an inclusion or exclusion polygon, held in RAM and checked along with the polygon boundary
+    ///     returns false if there is no EKF origin or not enough memory
+    bool add_polygon_zone(bool exclusion, const Location *points, uint16_t num_points);
+
+    /// add_circle_zone - add an inclusion or exclusion circle, radius in meters
+    bool add_circle_zone(bool exclusion, const Location &center, float radius);
+
+    /// clear_zones - remove all zones added with add_polygon_zone and add_circle_zone
+    void clear_zones();
+
+    /// polygon_valid - true if there is a valid polygon boundary or zones to check
+    bool polygon_valid() const;
+
+    /// polygon_breached - true if a position (in cm from the EKF origin) is outside the polygon boundary and zones
+    bool polygon_breached(const Vector2f &position) const;
+
+    /// polygon_index_usable - true if the zone index is built and includes the polygon boundary
+    bool polygon_index_usable() const;
+
+    /// update_polygon_index - rebuild the zone index if the boundary or zones have changed
+    void update_polygon_index();
+
     // pointers to other objects we depend upon
     const AP_AHRS_NavEKF& _ahrs;
 
@@ -178,4 +225,10 @@ private:
     bool            _boundary_create_attempted = false; // true if we have attempted to create the boundary array
     bool            _boundary_loaded = false;       // true if boundary array has been loaded from eeprom
     bool            _boundary_valid = false;        // true if boundary forms a closed polygon
+
+    // zones, with the polygon boundary, indexed for fast checks
+    AC_PolyFence_index _poly_index;
+    uint16_t        _boundary_zone = AC_FENCE_ZONE_NONE;    // zone in _poly_index holding the polygon boundary
+    bool            _poly_index_changed = false;    // true if the index needs rebuilding
+    bool            _zones_loaded = false;          // true once the zone file has been read
 };
@@ -0,0 +1,607 @@
+#include <AP_HAL/AP_HAL.h>
+#include "AC_PolyFence_index.h"
+
+extern const AP_HAL::HAL& hal;
+
+AC_PolyFence_index::~AC_PolyFence_index()
+{
+    free_index();
+    free(_zones);
+    free(_items);
+    free(_item_zone);
+}
+
+// remove all zones
+void AC_PolyFence_index::clear()
+{
+    _num_zones = 0;
+    _num_items = 0;
+    _num_inclusions = 0;
+    _index_valid = false;
+}
+
+// make room for more zones and items, growing the arrays by at least
+// half again so adding many zones one at a time doesn't copy each time
+bool AC_PolyFence_index::reserve(uint32_t zones, uint32_t items)
+{
+    if (items > AC_POLYFENCE_INDEX_MAX_ITEMS || zones > UINT16_MAX) {
+        return false;
+    }
+    if (zones > _max_zones) {
+        const uint16_t new_max = MIN(MAX(zones, _max_zones + _max_zones/2 + 4U), 0xFFFFU);
+        const uint32_t size = new_max * sizeof(struct zone);
+        if (hal.util->available_memory() < 100U + size) {
+            return false;
+        }
+        struct zone *new_zones = (struct zone *)calloc(new_max, sizeof(struct zone));
+        if (new_zones == nullptr) {
+            return false;
+        }
+        if (_zones != nullptr) {
+            memcpy(new_zones, _zones, _num_zones * sizeof(struct zone));
+            free(_zones);
+        }
+        _zones = new_zones;
+        _max_zones = new_max;
+    }
+    if (items > _max_items) {
+        const uint16_t new_max = MIN(MAX(items, _max_items + _max_items/2 + 16U), (uint32_t)AC_POLYFENCE_INDEX_MAX_ITEMS);
+        const uint32_t size = new_max * (sizeof(Vector2f) + sizeof(uint16_t));
+        if (hal.util->available_memory() < 100U + size) {
+            return false;
+        }
+        Vector2f *new_items = (Vector2f *)calloc(new_max, sizeof(Vector2f));
+        uint16_t *new_item_zone = (uint16_t *)calloc(new_max, sizeof(uint16_t));
+        if (new_items == nullptr || new_item_zone == nullptr) {
+            free(new_items);
+            free(new_item_zone);
+            return false;
+        }
+        if (_items != nullptr) {
+            memcpy(new_items, _items, _num_items * sizeof(Vector2f));
+            memcpy(new_item_zone, _item_zone, _num_items * sizeof(uint16_t));
+            free(_items);
+            free(_item_zone);
+        }
+        _items = new_items;
+        _item_zone = new_item_zone;
+        _max_items = new_max;
+    }
+    return true;
+}
+
+// add a polygon zone
+bool AC_PolyFence_index::add_polygon(ZoneType type, const Vector2f *points, uint16_t num_points)
+{
+    if (points == nullptr) {
+        return false;
+    }
+    // the closing point is implied
+    if (num_points > 1 && points[num_points-1] == points[0]) {
+        num_points--;
+    }
+    if (num_points < 3) {
+        return false;
+    }
+    if (!reserve(_num_zones+1, _num_items+num_points)) {
+        return false;
+    }
+    struct zone &z = _zones[_num_zones];
+    z.first = _num_items;
+    z.num_items = num_points;
+    z.radius = 0;
+    z.type = type;
+    for (uint16_t i=0; i<num_points; i++) {
+        _items[_num_items] = points[i];
+        _item_zone[_num_items] = _num_zones;
+        _num_items++;
+    }
+    _num_zones++;
+    if (type == ZONE_INCLUSION) {
+        _num_inclusions++;
+    }
+    _index_valid = false;
+    return true;
+}
+
+// add a circle zone
+bool AC_PolyFence_index::add_circle(ZoneType type, const Vector2f &center, float radius)
+{
+    if (!is_positive(radius)) {
+        return false;
+    }
+    if (!reserve(_num_zones+1, _num_items+1)) {
+        return false;
+    }
+    struct zone &z = _zones[_num_zones];
+    z.first = _num_items;
+    z.num_items = 1;
+    z.radius = radius;
+    z.type = type;
+    _items[_num_items] = center;
+    _item_zone[_num_items] = _num_zones;
+    _num_items++;
+    _num_zones++;
+    if (type == ZONE_INCLUSION) {
+        _num_inclusions++;
+    }
+    _index_valid = false;
+    return true;
+}
+
+// remove a zone, later zones move down one place
+void AC_PolyFence_index::remove_zone(uint16_t zone)
+{
+    if (zone >= _num_zones) {
+        return;
+    }
+    const uint16_t first = _zones[zone].first;
+    const uint16_t count = _zones[zone].num_items;
+    if (_zones[zone].type == ZONE_INCLUSION) {
+        _num_inclusions--;
+    }
+
+    const uint16_t items_after = _num_items - (first + count);
+    memmove(&_items[first], &_items[first+count], items_after * sizeof(Vector2f));
+    memmove(&_item_zone[first], &_item_zone[first+count], items_after * sizeof(uint16_t));
+    _num_items -= count;
+    for (uint16_t i=first; i<_num_items; i++) {
+        _item_zone[i]--;
+    }
+
+    memmove(&_zones[zone], &_zones[zone+1], (_num_zones - (zone+1)) * sizeof(struct zone));
+    _num_zones--;
+    for (uint16_t i=zone; i<_num_zones; i++) {
+        _zones[i].first -= count;
+    }
+    _index_valid = false;
+}
+
+// free the grid
+void AC_PolyFence_index::free_index()
+{
+    free(_cell_start);
+    free(_cell_entries);
+    free(_cell_flags);
+    _cell_start = nullptr;
+    _cell_entries = nullptr;
+    _cell_flags = nullptr;
+    _cells_x = 0;
+    _cells_y = 0;
+    _index_valid = false;
+}
+
+// far end of a polygon edge starting at an item
+const Vector2f &AC_PolyFence_index::edge_end(uint16_t item) const
+{
+    const struct zone &z = _zones[_item_zone[item]];
+    if (item+1 == z.first + z.num_items) {
+        return _items[z.first];
+    }
+    return _items[item+1];
+}
+
+// true if a boundary may cross a cell. The cell is grown a little so
+// that boundaries along the cell's sides are included in both cells
+bool AC_PolyFence_index::item_crosses(uint16_t item, const Vector2f &cmin, const Vector2f &cmax) const
+{
+    const float eps = _cell_size * 1.0e-3f;
+    const Vector2f rmin(cmin.x - eps, cmin.y - eps);
+    const Vector2f rmax(cmax.x + eps, cmax.y + eps);
+    const Vector2f &a = _items[item];
+
+    if (is_circle(item)) {
+        // the circle crosses the cell if the nearest point of the cell
+        // is inside it. Cells wholly inside are found by circle_contains()
+        const Vector2f nearest(constrain_float(a.x, rmin.x, rmax.x), constrain_float(a.y, rmin.y, rmax.y));
+        return (nearest - a).length_squared() <= sq(_zones[_item_zone[item]].radius);
+    }
+
+    // bounding box check of the edge
+    const Vector2f &b = edge_end(item);
+    if (MAX(a.x, b.x) < rmin.x || MIN(a.x, b.x) > rmax.x ||
+        MAX(a.y, b.y) < rmin.y || MIN(a.y, b.y) > rmax.y) {
+        return false;
+    }
+
+    // the edge misses the cell if all the cell's corners are on one side of it
+    const Vector2f ab = b - a;
+    const float c1 = ab % (Vector2f(rmin.x, rmin.y) - a);
+    const float c2 = ab % (Vector2f(rmin.x, rmax.y) - a);
+    const float c3 = ab % (Vector2f(rmax.x, rmin.y) - a);
+    const float c4 = ab % (Vector2f(rmax.x, rmax.y) - a);
+    if ((c1 > 0 && c2 > 0 && c3 > 0 && c4 > 0) ||
+        (c1 < 0 && c2 < 0 && c3 < 0 && c4 < 0)) {
+        return false;
+    }
+    return true;
+}
+
+// true if a circle zone contains the whole of a cell
+bool AC_PolyFence_index::circle_contains(uint16_t item, const Vector2f &cmin, const Vector2f &cmax) const
+{
+    const Vector2f &c = _items[item];
+    const Vector2f farthest(MAX(fabsf(c.x - cmin.x), fabsf(c.x - cmax.x)),
+                            MAX(fabsf(c.y - cmin.y), fabsf(c.y - cmax.y)));
+    return farthest.length_squared() < sq(_zones[_item_zone[item]].radius);
+}
+
+// range of cells covered by a rectangle, clamped to the grid
+void AC_PolyFence_index::cell_range(const Vector2f &rmin, const Vector2f &rmax, uint8_t &x1, uint8_t &y1, uint8_t &x2, uint8_t &y2) const
+{
+    x1 = constrain_float((rmin.x - _grid_origin.x) / _cell_size, 0, _cells_x-1);
+    y1 = constrain_float((rmin.y - _grid_origin.y) / _cell_size, 0, _cells_y-1);
+    x2 = constrain_float((rmax.x - _grid_origin.x) / _cell_size, 0, _cells_x-1);
+    y2 = constrain_float((rmax.y - _grid_origin.y) / _cell_size, 0, _cells_y-1);
+}
+
+// add an entry to each cell for every boundary crossing it, and flag
+// the cells inside circles. The first pass, before _cell_entries is
+// allocated, counts the entries of each cell into _cell_start[cell+1]
+uint32_t AC_PolyFence_index::fill_cells()
+{
+    uint32_t total = 0;
+    for (uint16_t item=0; item<_num_items; item++) {
+        const struct zone &z = _zones[_item_zone[item]];
+        Vector2f rmin, rmax;
+        if (z.radius > 0) {
+            rmin = _items[item] - Vector2f(z.radius, z.radius);
+            rmax = _items[item] + Vector2f(z.radius, z.radius);
+        } else {
+            const Vector2f &a = _items[item];
+            const Vector2f &b = edge_end(item);
+            rmin = Vector2f(MIN(a.x, b.x), MIN(a.y, b.y));
+            rmax = Vector2f(MAX(a.x, b.x), MAX(a.y, b.y));
+        }
+        uint8_t x1, y1, x2, y2;
+        cell_range(rmin, rmax, x1, y1, x2, y2);
+        // an edge along a cell side must be in the cells on both sides
+        x1 = MAX(x1, 1) - 1;
+        y1 = MAX(y1, 1) - 1;
+        x2 = MIN(x2+1, _cells_x-1);
+        y2 = MIN(y2+1, _cells_y-1);
+        for (uint8_t x=x1; x<=x2; x++) {
+            for (uint8_t y=y1; y<=y2; y++) {
+                const uint16_t cell = x*_cells_y + y;
+                const Vector2f cmin(_grid_origin.x + x*_cell_size, _grid_origin.y + y*_cell_size);
+                const Vector2f cmax(cmin.x + _cell_size, cmin.y + _cell_size);
+                if (z.radius > 0 && circle_contains(item, cmin, cmax)) {
+                    _cell_flags[cell] |= (z.type == ZONE_INCLUSION) ? CELL_INCLUDED : CELL_EXCLUDED;
+                    continue;
+                }
+                if (!item_crosses(item, cmin, cmax)) {
+                    continue;
+                }
+                if (_cell_entries == nullptr) {
+                    _cell_start[cell+1]++;
+                } else {
+                    _cell_entries[_cell_start[cell]++] = item;
+                }
+                total++;
+                if (total > UINT16_MAX) {
+                    return total;
+                }
+            }
+        }
+    }
+    return total;
+}
+
+/*
+  work out whether each cell's corner is inside the polygons crossing
+  the cell, and whether it is inside any zone that doesn't. Each column
+  of cells is walked from the south side of the grid, which is outside
+  every zone, keeping the parity of the number of edges of each polygon
+  crossed
+ */
+bool AC_PolyFence_index::fill_corners()
+{
+    uint8_t *inside = (uint8_t *)calloc(_num_zones, 1);
+    if (inside == nullptr) {
+        return false;
+    }
+
+    for (uint8_t y=0; y<_cells_y; y++) {
+        const float line_y = _grid_origin.y + y*_cell_size;
+        memset(inside, 0, _num_zones);
+        uint16_t inside_inclusions = 0;
+        uint16_t inside_exclusions = 0;
+
+        for (uint8_t x=0; x<_cells_x; x++) {
+            const uint16_t cell = x*_cells_y + y;
+            const float corner_x = _grid_origin.x + x*_cell_size;
+
+            // mark the polygons crossing this cell which hold the corner,
+            // and count them, once each
+            uint16_t crossing_inclusions = 0;
+            uint16_t crossing_exclusions = 0;
+            uint16_t last_zone = UINT16_MAX;
+            for (uint16_t e=_cell_start[cell]; e<_cell_start[cell+1]; e++) {
+                const uint16_t item = _cell_entries[e];
+                const uint16_t zone = _item_zone[item];
+                if (is_circle(item) || !inside[zone]) {
+                    continue;
+                }
+                _cell_entries[e] |= ENTRY_CORNER_INSIDE;
+                if (zone != last_zone) {
+                    last_zone = zone;
+                    if (_zones[zone].type == ZONE_INCLUSION) {
+                        crossing_inclusions++;
+                    } else {
+                        crossing_exclusions++;
+                    }
+                }
+            }
+            if (inside_inclusions > crossing_inclusions) {
+                _cell_flags[cell] |= CELL_INCLUDED;
+            }
+            if (inside_exclusions > crossing_exclusions) {
+                _cell_flags[cell] |= CELL_EXCLUDED;
+            }
+
+            // move to the next corner north, flipping the polygons whose
+            // edges are crossed on the way
+            const float next_x = corner_x + _cell_size;
+            for (uint16_t e=_cell_start[cell]; e<_cell_start[cell+1]; e++) {
+                const uint16_t item = _cell_entries[e] & ~ENTRY_CORNER_INSIDE;
+                if (is_circle(item)) {
+                    continue;
+                }
+                const Vector2f &a = _items[item];
+                const Vector2f &b = edge_end(item);
+                if ((a.y > line_y) == (b.y > line_y)) {
+                    continue;
+                }
+                const float cross_x = a.x + (line_y - a.y) * (b.x - a.x) / (b.y - a.y);
+                if (cross_x < corner_x || cross_x >= next_x) {
+                    continue;
+                }
+                const uint16_t zone = _item_zone[item];
+                inside[zone] = !inside[zone];
+                const int8_t change = inside[zone] ? 1 : -1;
+                if (_zones[zone].type == ZONE_INCLUSION) {
+                    inside_inclusions += change;
+                } else {
+                    inside_exclusions += change;
+                }
+            }
+        }
+    }
+
+    free(inside);
+    return true;
+}
+
+// build the index over the current zones
+bool AC_PolyFence_index::build()
+{
+    free_index();
+
+    if (_num_zones == 0) {
+        _index_valid = true;
+        return true;
+    }
+
+    // bounds of all zones
+    Vector2f bmin(FLT_MAX, FLT_MAX);
+    Vector2f bmax(-FLT_MAX, -FLT_MAX);
+    for (uint16_t i=0; i<_num_items; i++) {
+        const float r = _zones[_item_zone[i]].radius;
+        bmin.x = MIN(bmin.x, _items[i].x - r);
+        bmin.y = MIN(bmin.y, _items[i].y - r);
+        bmax.x = MAX(bmax.x, _items[i].x + r);
+        bmax.y = MAX(bmax.y, _items[i].y + r);
+    }
+
+    // aim for about one boundary per cell, within the grid size limit
+    const Vector2f size = bmax - bmin;
+    _cell_size = sqrtf(size.x * size.y / _num_items);
+    _cell_size = MAX(_cell_size, size.x / (AC_POLYFENCE_INDEX_GRID_MAX-1));
+    _cell_size = MAX(_cell_size, size.y / (AC_POLYFENCE_INDEX_GRID_MAX-1));
+    _cell_size = MAX(_cell_size, 100.0f);
+
+    // half a cell of margin to the south and west keeps the first
+    // corners of each column outside all the zones
+    _grid_origin = bmin - Vector2f(_cell_size, _cell_size) * 0.5f;
+    _cells_x = MIN((bmax.x - _grid_origin.x) / _cell_size + 1, AC_POLYFENCE_INDEX_GRID_MAX);
+    _cells_y = MIN((bmax.y - _grid_origin.y) / _cell_size + 1, AC_POLYFENCE_INDEX_GRID_MAX);
+    const uint16_t num_cells = _cells_x * _cells_y;
+
+    if (hal.util->available_memory() < 100U + num_cells * (sizeof(uint16_t) + sizeof(uint8_t))) {
+        free_index();
+        return false;
+    }
+    _cell_start = (uint16_t *)calloc(num_cells+1, sizeof(uint16_t));
+    _cell_flags = (uint8_t *)calloc(num_cells, sizeof(uint8_t));
+    if (_cell_start == nullptr || _cell_flags == nullptr) {
+        free_index();
+        return false;
+    }
+
+    // count the entries of each cell, then place them
+    const uint32_t num_entries = fill_cells();
+    if (num_entries > UINT16_MAX ||
+        hal.util->available_memory() < 100U + num_entries * sizeof(uint16_t)) {
+        free_index();
+        return false;
+    }
+    for (uint16_t c=0; c<num_cells; c++) {
+        _cell_start[c+1] += _cell_start[c];
+    }
+    _cell_entries = (uint16_t *)calloc(MAX(num_entries, 1U), sizeof(uint16_t));
+    if (_cell_entries == nullptr) {
+        free_index();
+        return false;
+    }
+    fill_cells();
+    // placing the entries moved each cell's start on to the next cell's
+    for (uint16_t c=num_cells; c>0; c--) {
+        _cell_start[c] = _cell_start[c-1];
+    }
+    _cell_start[0] = 0;
+
+    if (!fill_corners()) {
+        free_index();
+        return false;
+    }
+
+    _index_valid = true;
+    return true;
+}
+
+/*
+  returns true if a point is outside the fence made by the zones. The
+  point's cell corner is known to be inside or outside each zone, and
+  only polygons crossing the cell can change between the corner and the
+  point, so the edges of those are counted along a path going east from
+  the corner then north to the point
+ */
+bool AC_PolyFence_index::breached(const Vector2f &point) const
+{
+    const bool need_inclusion = _num_inclusions > 0;
+    if (_cell_start == nullptr) {
+        return need_inclusion;
+    }
+    const float fx = (point.x - _grid_origin.x) / _cell_size;
+    const float fy = (point.y - _grid_origin.y) / _cell_size;
+    if (!(fx >= 0 && fy >= 0 && fx <= _cells_x && fy <= _cells_y)) {
+        // outside the grid is outside every zone
+        return need_inclusion;
+    }
+    const uint8_t x = MIN((uint16_t)fx, _cells_x-1);
+    const uint8_t y = MIN((uint16_t)fy, _cells_y-1);
+    const uint16_t cell = x*_cells_y + y;
+
+    if (_cell_flags[cell] & CELL_EXCLUDED) {
+        return true;
+    }
+    bool included = (_cell_flags[cell] & CELL_INCLUDED) != 0;
+
+    const float corner_x = _grid_origin.x + x*_cell_size;
+    const float corner_y = _grid_origin.y + y*_cell_size;
+
+    // state of the polygon whose edges are being counted
+    uint16_t zone = UINT16_MAX;
+    bool inside = false;
+
+    for (uint16_t e=_cell_start[cell]; e<_cell_start[cell+1]; e++) {
+        const uint16_t item = _cell_entries[e] & ~ENTRY_CORNER_INSIDE;
+        const Vector2f &a = _items[item];
+        const struct zone &z = _zones[_item_zone[item]];
+        if (z.radius > 0) {
+            if ((point - a).length_squared() < sq(z.radius)) {
+                if (z.type == ZONE_EXCLUSION) {
+                    return true;
+                }
+                included = true;
+            }
+            continue;
+        }
+
+        if (_item_zone[item] != zone) {
+            // first edge of the next polygon
+            if (inside) {
+                if (_zones[zone].type == ZONE_EXCLUSION) {
+                    return true;
+                }
+                included = true;
+            }
+            zone = _item_zone[item];
+            inside = (_cell_entries[e] & ENTRY_CORNER_INSIDE) != 0;
+        }
+        const Vector2f &b = edge_end(item);
+
+        // east along the south side of the cell
+        if ((a.x > corner_x) != (b.x > corner_x)) {
+            const float cross_y = a.y + (corner_x - a.x) * (b.y - a.y) / (b.x - a.x);
+            if (cross_y >= corner_y && cross_y < point.y) {
+                inside = !inside;
+            }
+        }
+        // north to the point
+        if ((a.y > point.y) != (b.y > point.y)) {
+            const float cross_x = a.x + (point.y - a.y) * (b.x - a.x) / (b.y - a.y);
+            if (cross_x >= corner_x && cross_x < point.x) {
+                inside = !inside;
+            }
+        }
+    }
+    if (inside) {
+        if (_zones[zone].type == ZONE_EXCLUSION) {
+            return true;
+        }
+        included = true;
+    }
+
+    return need_inclusion && !included;
+}
+
+// find the zone boundaries passing within radius of a point
+bool AC_PolyFence_index::find_boundaries(const Vector2f &point, float radius, uint16_t items[], uint16_t &num_items, uint16_t max_items) const
+{
+    num_items = 0;
+    if (_cell_start == nullptr) {
+        return true;
+    }
+    uint8_t x1, y1, x2, y2;
+    cell_range(point - Vector2f(radius, radius), point + Vector2f(radius, radius), x1, y1, x2, y2);
+    const float radius_sq = sq(radius);
+
+    for (uint8_t x=x1; x<=x2; x++) {
+        for (uint8_t y=y1; y<=y2; y++) {
+            const uint16_t cell = x*_cells_y + y;
+            for (uint16_t e=_cell_start[cell]; e<_cell_start[cell+1]; e++) {
+                const uint16_t item = _cell_entries[e] & ~ENTRY_CORNER_INSIDE;
+                if ((closest_point(item, point) - point).length_squared() > radius_sq) {
+                    continue;
+                }
+                // boundaries crossing several cells are listed in each
+                bool found = false;
+                for (uint16_t i=0; i<num_items; i++) {
+                    if (items[i] == item) {
+                        found = true;
+                        break;
+                    }
+                }
+                if (found) {
+                    continue;
+                }
+                if (num_items >= max_items) {
+                    return false;
+                }
+                items[num_items++] = item;
+            }
+        }
+    }
+    return true;
+}
+
+// point on a boundary closest to the given point
+Vector2f AC_PolyFence_index::closest_point(uint16_t item, const Vector2f &point) const
+{
+    const Vector2f &a = _items[item];
+    if (!is_circle(item)) {
+        return Vector2f::closest_point(point, a, edge_end(item));
+    }
+    const float radius = _zones[_item_zone[item]].radius;
+    const Vector2f ofs = point - a;
+    const float dist = ofs.length();
+    if (is_zero(dist)) {
+        // every point of the circle is as close
+        return a + Vector2f(radius, 0);
+    }
+    return a + ofs * (radius / dist);
+}
+
+// get a boundary, either an edge or a circle
+void AC_PolyFence_index::get_boundary(uint16_t item, Vector2f &start, Vector2f &end, float &radius) const
+{
+    start = _items[item];
+    if (is_circle(item)) {
+        end = start;
+        radius = _zones[_item_zone[item]].radius;
+    } else {
+        end = edge_end(item);
+        radius = 0;
+    }
+}
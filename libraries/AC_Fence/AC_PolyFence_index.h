@@ -0,0 +1,160 @@
+#pragma once
+
+#include <AP_Common/AP_Common.h>
+#include <AP_Math/AP_Math.h>
+
+// maximum number of polygon vertices plus circles held across all zones
+#ifndef AC_POLYFENCE_INDEX_MAX_ITEMS
+#define AC_POLYFENCE_INDEX_MAX_ITEMS    4000
+#endif
+
+#if AC_POLYFENCE_INDEX_MAX_ITEMS >= 0x8000
+#error "AC_POLYFENCE_INDEX_MAX_ITEMS must leave the top bit of cell entries free"
+#endif
+
+// maximum number of grid cells along each side of the index
+#ifndef AC_POLYFENCE_INDEX_GRID_MAX
+#define AC_POLYFENCE_INDEX_GRID_MAX     32
+#endif
+
+/*
+  a set of inclusion and exclusion zones, each a polygon or a circle,
+  with their boundaries indexed by a uniform grid.
+
+  Points are in cm, north-east from the EKF origin like the polygon
+  fence boundary. A point is within the fence if it is inside at least
+  one inclusion zone (when there are any) and inside no exclusion zone.
+
+  Each grid cell lists the edges and circles crossing it, and for each
+  polygon listed whether the cell's south-west corner is inside that
+  polygon. Whether the corner is inside the zones which don't cross the
+  cell is kept as cell flags. A point is tested by walking from its
+  cell's corner to it, so only the boundaries in one cell are looked
+  at, however many zones there are.
+
+  Zones are added then build() is called to make the index. Building
+  walks every cell, so it should be done when the zones change, not on
+  every check.
+ */
+class AC_PolyFence_index
+{
+public:
+    AC_PolyFence_index() {}
+    ~AC_PolyFence_index();
+
+    /* Do not allow copies */
+    AC_PolyFence_index(const AC_PolyFence_index &other) = delete;
+    AC_PolyFence_index &operator=(const AC_PolyFence_index&) = delete;
+
+    enum ZoneType : uint8_t {
+        ZONE_INCLUSION = 0,
+        ZONE_EXCLUSION = 1,
+    };
+
+    // remove all zones. The index must be rebuilt
+    void clear();
+
+    // add a polygon zone. The last point may repeat the first. The
+    // index must be rebuilt. Returns false if the polygon isn't valid
+    // or there isn't the memory for it
+    bool add_polygon(ZoneType type, const Vector2f *points, uint16_t num_points);
+
+    // add a circle zone, radius in cm. The index must be rebuilt
+    bool add_circle(ZoneType type, const Vector2f &center, float radius);
+
+    // remove a zone, later zones move down one place. The index must
+    // be rebuilt
+    void remove_zone(uint16_t zone);
+
+    // number of zones
+    uint16_t num_zones() const { return _num_zones; }
+
+    // build the index over the current zones, returns false if there
+    // isn't the memory for it
+    bool build();
+
+    // true if the index has been built over the current zones
+    bool ready() const { return _index_valid; }
+
+    // returns true if a point is outside the fence made by the zones
+    bool breached(const Vector2f &point) const;
+
+    // find the zone boundaries (polygon edges and circles) passing within
+    // radius of a point. The boundaries are returned as item numbers
+    // for closest_point() and get_boundary(). Returns false if there
+    // were more than max_items of them
+    bool find_boundaries(const Vector2f &point, float radius, uint16_t items[], uint16_t &num_items, uint16_t max_items) const;
+
+    // point on a boundary closest to the given point
+    Vector2f closest_point(uint16_t item, const Vector2f &point) const;
+
+    // get a boundary, either the edge from start to end, or a circle
+    // of the given radius around start, with end equal to start
+    void get_boundary(uint16_t item, Vector2f &start, Vector2f &end, float &radius) const;
+
+private:
+    struct zone {
+        uint16_t first;         // first item of the zone
+        uint16_t num_items;     // number of vertices, one for a circle
+        float radius;           // circle radius, zero for a polygon
+        ZoneType type;
+    };
+
+    // cell flags
+    enum {
+        CELL_INCLUDED = (1U<<0),    // inside an inclusion zone not crossing the cell
+        CELL_EXCLUDED = (1U<<1),    // inside an exclusion zone not crossing the cell
+    };
+
+    // set on a cell entry when the cell's corner is inside the entry's polygon
+    static const uint16_t ENTRY_CORNER_INSIDE = 0x8000;
+
+    // make room for more zones and items
+    bool reserve(uint32_t zones, uint32_t items);
+
+    // free the grid
+    void free_index();
+
+    bool is_circle(uint16_t item) const { return _zones[_item_zone[item]].radius > 0; }
+
+    // far end of a polygon edge starting at an item
+    const Vector2f &edge_end(uint16_t item) const;
+
+    // true if a boundary may cross a cell, given the cell's bounds
+    bool item_crosses(uint16_t item, const Vector2f &cmin, const Vector2f &cmax) const;
+
+    // true if a circle zone contains the whole of a cell
+    bool circle_contains(uint16_t item, const Vector2f &cmin, const Vector2f &cmax) const;
+
+    // range of cells covered by a rectangle, clamped to the grid
+    void cell_range(const Vector2f &rmin, const Vector2f &rmax, uint8_t &x1, uint8_t &y1, uint8_t &x2, uint8_t &y2) const;
+
+    // add entries for every boundary crossing a cell, or just count them
+    // if _cell_entries is not yet allocated. Returns the number of entries
+    uint32_t fill_cells();
+
+    // work out the corner flags, walking each column of cells south to north
+    bool fill_corners();
+
+    // zones
+    struct zone *_zones = nullptr;
+    uint16_t _num_zones = 0;
+    uint16_t _max_zones = 0;
+    uint16_t _num_inclusions = 0;
+
+    // polygon vertices and circle centers, with the zone of each
+    Vector2f *_items = nullptr;
+    uint16_t *_item_zone = nullptr;
+    uint16_t _num_items = 0;
+    uint16_t _max_items = 0;
+
+    // grid over all zones
+    Vector2f _grid_origin;          // south-west corner of the grid
+    float _cell_size = 0;           // cell side in cm
+    uint8_t _cells_x = 0;           // cells north
+    uint8_t _cells_y = 0;           // cells east
+    uint16_t *_cell_start = nullptr;    // first entry of each cell, and one past the last
+    uint16_t *_cell_entries = nullptr;  // items crossing each cell, with ENTRY_CORNER_INSIDE
+    uint8_t *_cell_flags = nullptr;
+    bool _index_valid = false;
+};
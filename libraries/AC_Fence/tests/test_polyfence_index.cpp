@@ -0,0 +1,192 @@
+#include <AP_gtest.h>
+
+#include <AC_Fence/AC_PolyFence_index.h>
+
+const AP_HAL::HAL &hal = AP_HAL::get_HAL();
+
+#define MAX_TEST_ZONES  100
+#define MAX_TEST_POINTS 20
+
+// a zone as added to the index, kept for the brute force checks
+struct test_zone {
+    AC_PolyFence_index::ZoneType type;
+    Vector2f points[MAX_TEST_POINTS];
+    uint16_t num_points;        // zero for a circle
+    float radius;
+};
+
+// repeatable pseudo-random numbers
+static uint32_t seed;
+
+static float rand_float(float min, float max)
+{
+    seed = seed * 1103515245U + 12345U;
+    return min + (max - min) * ((seed >> 8) & 0xFFFF) / 65535.0f;
+}
+
+// even-odd test of a point against a polygon
+static bool inside_polygon(const Vector2f &p, const Vector2f *points, uint16_t num_points)
+{
+    bool inside = false;
+    for (uint16_t i=0, j=num_points-1; i<num_points; j=i++) {
+        if ((points[i].y > p.y) != (points[j].y > p.y)) {
+            const float x = points[j].x + (p.y - points[j].y) * (points[i].x - points[j].x) / (points[i].y - points[j].y);
+            if (p.x < x) {
+                inside = !inside;
+            }
+        }
+    }
+    return inside;
+}
+
+static bool breached_brute_force(const Vector2f &p, const test_zone *zones, uint16_t num_zones)
+{
+    bool any_inclusion = false;
+    bool included = false;
+    for (uint16_t i=0; i<num_zones; i++) {
+        const test_zone &z = zones[i];
+        const bool inside = z.num_points == 0 ?
+            (p - z.points[0]).length_squared() < sq(z.radius) :
+            inside_polygon(p, z.points, z.num_points);
+        if (z.type == AC_PolyFence_index::ZONE_EXCLUSION) {
+            if (inside) {
+                return true;
+            }
+        } else {
+            any_inclusion = true;
+            included |= inside;
+        }
+    }
+    return any_inclusion && !included;
+}
+
+// add star shaped polygons and circles scattered over a square km,
+// the first an inclusion zone and most of the rest exclusions.
+// Returns the number of boundary items added
+static uint16_t add_zones(AC_PolyFence_index &index, test_zone *zones, uint16_t num_zones)
+{
+    uint16_t num_items = 0;
+    for (uint16_t i=0; i<num_zones; i++) {
+        test_zone &z = zones[i];
+        z.type = (i == 0 || rand_float(0, 1) < 0.2f) ? AC_PolyFence_index::ZONE_INCLUSION : AC_PolyFence_index::ZONE_EXCLUSION;
+        const Vector2f center(rand_float(-50000, 50000), rand_float(-50000, 50000));
+        const float size = rand_float(300, 8000);
+        if (rand_float(0, 1) < 0.3f) {
+            z.points[0] = center;
+            z.num_points = 0;
+            z.radius = size;
+            EXPECT_TRUE(index.add_circle(z.type, center, size));
+            num_items++;
+        } else {
+            z.num_points = 3 + (uint16_t)rand_float(0, MAX_TEST_POINTS - 3.01f);
+            z.radius = 0;
+            for (uint16_t j=0; j<z.num_points; j++) {
+                const float angle = M_2PI * j / z.num_points;
+                const float r = size * rand_float(0.3f, 1.0f);
+                z.points[j] = center + Vector2f(r * cosf(angle), r * sinf(angle));
+            }
+            EXPECT_TRUE(index.add_polygon(z.type, z.points, z.num_points));
+            num_items += z.num_points;
+        }
+    }
+    return num_items;
+}
+
+TEST(PolyFenceIndexTest, BreachedMatchesBruteForce)
+{
+    seed = 1;
+    static test_zone zones[MAX_TEST_ZONES];
+    for (uint8_t set=0; set<10; set++) {
+        AC_PolyFence_index index;
+        const uint16_t num_zones = 1 + (uint16_t)rand_float(0, MAX_TEST_ZONES - 1.01f);
+        add_zones(index, zones, num_zones);
+        ASSERT_TRUE(index.build());
+        ASSERT_TRUE(index.ready());
+        for (uint16_t i=0; i<2000; i++) {
+            const Vector2f p(rand_float(-70000, 70000), rand_float(-70000, 70000));
+            EXPECT_EQ(breached_brute_force(p, zones, num_zones), index.breached(p));
+        }
+    }
+}
+
+TEST(PolyFenceIndexTest, FindBoundariesMatchesBruteForce)
+{
+    seed = 2;
+    static test_zone zones[MAX_TEST_ZONES];
+    AC_PolyFence_index index;
+    const uint16_t num_items = add_zones(index, zones, MAX_TEST_ZONES);
+    ASSERT_TRUE(index.build());
+
+    for (uint16_t i=0; i<200; i++) {
+        const Vector2f p(rand_float(-60000, 60000), rand_float(-60000, 60000));
+        const float radius = rand_float(100, 3000);
+        uint16_t items[AC_POLYFENCE_INDEX_MAX_ITEMS];
+        uint16_t num_found;
+        ASSERT_TRUE(index.find_boundaries(p, radius, items, num_found, ARRAY_SIZE(items)));
+
+        uint16_t num_expected = 0;
+        for (uint16_t item=0; item<num_items; item++) {
+            if ((index.closest_point(item, p) - p).length() > radius) {
+                continue;
+            }
+            num_expected++;
+            bool found = false;
+            for (uint16_t j=0; j<num_found; j++) {
+                found |= items[j] == item;
+            }
+            EXPECT_TRUE(found);
+        }
+        EXPECT_EQ(num_expected, num_found);
+    }
+}
+
+TEST(PolyFenceIndexTest, EmptyAndExclusionOnly)
+{
+    AC_PolyFence_index index;
+    ASSERT_TRUE(index.build());
+    EXPECT_FALSE(index.breached(Vector2f(0, 0)));
+
+    // a lone exclusion zone breaches only inside it
+    EXPECT_TRUE(index.add_circle(AC_PolyFence_index::ZONE_EXCLUSION, Vector2f(0, 0), 1000));
+    EXPECT_FALSE(index.ready());
+    ASSERT_TRUE(index.build());
+    EXPECT_TRUE(index.breached(Vector2f(0, 0)));
+    EXPECT_FALSE(index.breached(Vector2f(2000, 0)));
+
+    index.clear();
+    ASSERT_TRUE(index.build());
+    EXPECT_FALSE(index.breached(Vector2f(0, 0)));
+}
+
+TEST(PolyFenceIndexTest, RemoveZone)
+{
+    seed = 3;
+    static test_zone zones[MAX_TEST_ZONES];
+    AC_PolyFence_index index;
+    uint16_t num_zones = 40;
+    add_zones(index, zones, num_zones);
+
+    // remove a zone from the middle, then the last and the first, so
+    // the items of the zones after each one move down
+    const uint16_t remove[] = { 17, 38, 0 };
+    for (uint8_t r=0; r<ARRAY_SIZE(remove); r++) {
+        index.remove_zone(remove[r]);
+        EXPECT_FALSE(index.ready());
+        num_zones--;
+        memmove(&zones[remove[r]], &zones[remove[r]+1], (num_zones - remove[r]) * sizeof(zones[0]));
+        ASSERT_EQ(num_zones, index.num_zones());
+
+        ASSERT_TRUE(index.build());
+        for (uint16_t i=0; i<2000; i++) {
+            const Vector2f p(rand_float(-70000, 70000), rand_float(-70000, 70000));
+            EXPECT_EQ(breached_brute_force(p, zones, num_zones), index.breached(p));
+        }
+    }
+
+    // removing a zone past the end does nothing
+    index.remove_zone(num_zones);
+    EXPECT_EQ(num_zones, index.num_zones());
+    EXPECT_TRUE(index.ready());
+}
+
+AP_GTEST_MAIN()
@@ -96,6 +96,16 @@ public:
         return sum;
     }
 
+    // return the lowest set bit number, or -1 if all bits are clear
+    int32_t first_set(void) const {
+        for (uint16_t i=0; i<numwords; i++) {
+            if (bits[i] != 0) {
+                return i*32 + __builtin_ctz(bits[i]);
+            }
+        }
+        return -1;
+    }
+
     // return number of bits available
     uint16_t size() const {
         return numbits;
@@ -347,6 +347,7 @@ private:
     bool _start_calibration(uint8_t i, bool retry=false, float delay_sec=0.0f);
     bool _start_calibration_mask(uint8_t mask, bool retry=false, bool autosave=false, float delay_sec=0.0f, bool autoreboot=false);
     bool _auto_reboot() { return _compass_cal_autoreboot; }
+    void _calibration_thread(void);
 
     // see if we already have probed a i2c driver by bus number and address
     bool _have_i2c_driver(uint8_t bus_num, uint8_t address) const;
@@ -360,6 +361,9 @@ private:
     bool _cal_complete_requires_reboot;
     bool _cal_has_run;
 
+    // fits run on their own thread where the board supports one
+    bool _cal_thread_started;
+
     // enum of drivers for COMPASS_TYPEMASK
     enum DriverType {
         DRIVER_HMC5883  =0,
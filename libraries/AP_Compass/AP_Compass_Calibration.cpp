@@ -6,12 +6,20 @@
 
 extern AP_HAL::HAL& hal;
 
+// sleep between passes of the calibration thread while nothing needs fitting
+#define COMPASS_CAL_THREAD_IDLE_MS 20
+
 void
 Compass::compass_cal_update()
 {
     bool running = false;
 
     for (uint8_t i=0; i<COMPASS_MAX_INSTANCES; i++) {
+        if (!_cal_thread_started) {
+            // no calibration thread, so fit from the main loop
+            _calibrator[i].fit_step();
+        }
+
         bool failure;
         _calibrator[i].update(failure);
         if (failure) {
@@ -41,6 +49,24 @@ Compass::compass_cal_update()
     }
 }
 
+/*
+  calibration thread. Each pass runs one fit step for every compass
+  being calibrated, so all compasses converge together, then yields
+ */
+void
+Compass::_calibration_thread(void)
+{
+    while (true) {
+        bool fitting = false;
+        for (uint8_t i=0; i<COMPASS_MAX_INSTANCES; i++) {
+            if (_calibrator[i].fit_step()) {
+                fitting = true;
+            }
+        }
+        hal.scheduler->delay(fitting ? 1 : COMPASS_CAL_THREAD_IDLE_MS);
+    }
+}
+
 bool
 Compass::_start_calibration(uint8_t i, bool retry, float delay)
 {
@@ -67,6 +93,10 @@ Compass::_start_calibration(uint8_t i, bool retry, float delay)
             _calibrator[i].set_orientation(r, _state[i].external, _rotate_auto>=2);
         }
     }
+    if (!_cal_thread_started) {
+        _cal_thread_started = hal.scheduler->thread_create(FUNCTOR_BIND_MEMBER(&Compass::_calibration_thread, void),
+                                                           "COMPASS_CAL", 2048, AP_HAL::Scheduler::PRIORITY_IO, -1);
+    }
     _cal_saved[i] = false;
     _calibrator[i].start(retry, delay, get_offsets_max(), i);
 
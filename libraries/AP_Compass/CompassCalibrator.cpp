@@ -55,16 +55,26 @@
  *
  * The fitting algorithm used is Levenberg-Marquardt. See also:
  * http://en.wikipedia.org/wiki/Levenberg%E2%80%93Marquardt_algorithm
+ *
+ * The driver only queues samples; sample acceptance and the fit run in
+ * fit_step(), one Levenberg-Marquardt step per call, normally on the
+ * compass calibration thread so that fitting several compasses doesn't
+ * load the main loop.
  */
 
 #include "CompassCalibrator.h"
 #include <AP_HAL/AP_HAL.h>
+#include <AP_Common/Semaphore.h>
 #include <AP_Math/AP_GeodesicGrid.h>
+#include <AP_Math/vectorN.h>
 #include <AP_AHRS/AP_AHRS.h>
 #include <GCS_MAVLink/GCS.h>
 
 extern const AP_HAL::HAL& hal;
 
+#define COMPASS_CAL_SAMPLE_SCALE_TO_FIXED(__X) ((int16_t)constrain_float(roundf(__X*8.0f), INT16_MIN, INT16_MAX))
+#define COMPASS_CAL_SAMPLE_SCALE_TO_FLOAT(__X) (__X/8.0f)
+
 ////////////////////////////////////////////////////////////
 ///////////////////// PUBLIC INTERFACE /////////////////////
 ////////////////////////////////////////////////////////////
@@ -73,15 +83,18 @@ CompassCalibrator::CompassCalibrator():
 _tolerance(COMPASS_CAL_DEFAULT_TOLERANCE),
 _sample_buffer(nullptr)
 {
-    clear();
+    // not clear(), as semaphores may not be usable yet
+    set_status(COMPASS_CAL_NOT_STARTED);
 }
 
 void CompassCalibrator::clear() {
+    WITH_SEMAPHORE(_sem);
     set_status(COMPASS_CAL_NOT_STARTED);
 }
 
 void CompassCalibrator::start(bool retry, float delay, uint16_t offset_max, uint8_t compass_idx)
 {
+    WITH_SEMAPHORE(_sem);
     if(running()) {
         return;
     }
@@ -95,6 +108,7 @@ void CompassCalibrator::start(bool retry, float delay, uint16_t offset_max, uint
 }
 
 void CompassCalibrator::get_calibration(Vector3f &offsets, Vector3f &diagonals, Vector3f &offdiagonals) {
+    WITH_SEMAPHORE(_sem);
     if (_status != COMPASS_CAL_SUCCESS) {
         return;
     }
@@ -105,16 +119,20 @@ void CompassCalibrator::get_calibration(Vector3f &offsets, Vector3f &diagonals,
 }
 
 float CompassCalibrator::get_completion_percent() const {
-    // first sampling step is 1/3rd of the progress bar
+    // first sampling step and its fit are 1/3rd of the progress bar,
+    // the fit taking the last 3.3%. The second fit takes the last 5%
+    // of the remainder
     // never return more than 99% unless _status is COMPASS_CAL_SUCCESS
     switch(_status) {
         case COMPASS_CAL_NOT_STARTED:
         case COMPASS_CAL_WAITING_TO_START:
             return 0.0f;
         case COMPASS_CAL_RUNNING_STEP_ONE:
-            return 33.3f * _samples_collected/COMPASS_CAL_NUM_SAMPLES;
+            return 30.0f * _samples_collected/COMPASS_CAL_NUM_SAMPLES +
+                   3.3f * MIN(_fit_step, 10U) / 10;
         case COMPASS_CAL_RUNNING_STEP_TWO:
-            return 33.3f + 65.7f*((float)(_samples_collected-_samples_thinned)/(COMPASS_CAL_NUM_SAMPLES-_samples_thinned));
+            return 33.3f + 60.7f*((float)(_samples_collected-_samples_thinned)/(COMPASS_CAL_NUM_SAMPLES-_samples_thinned)) +
+                   5.0f * MIN(_fit_step, 35U) / 35;
         case COMPASS_CAL_SUCCESS:
             return 100.0f;
         case COMPASS_CAL_FAILED:
@@ -143,7 +161,7 @@ void CompassCalibrator::update_completion_mask()
 {
     memset(_completion_mask, 0, sizeof(_completion_mask));
     for (int i = 0; i < _samples_collected; i++) {
-        update_completion_mask(_sample_buffer[i].get());
+        update_completion_mask(get_sample(i));
     }
 }
 
@@ -155,6 +173,7 @@ CompassCalibrator::completion_mask_t& CompassCalibrator::get_completion_mask()
 bool CompassCalibrator::check_for_timeout() {
     uint32_t tnow = AP_HAL::millis();
     if(running() && tnow - _last_sample_ms > 1000) {
+        WITH_SEMAPHORE(_sem);
         _retry = false;
         set_status(COMPASS_CAL_FAILED);
         return true;
@@ -165,30 +184,37 @@ bool CompassCalibrator::check_for_timeout() {
 void CompassCalibrator::new_sample(const Vector3f& sample) {
     _last_sample_ms = AP_HAL::millis();
 
+    if(_status == COMPASS_CAL_WAITING_TO_START ||
+       (running() && _samples_collected < COMPASS_CAL_NUM_SAMPLES)) {
+        PendingSample pending;
+        pending.field = sample;
+        pending.att.set_from_ahrs();
+        // if the fit is behind the sample is dropped, as if not accepted
+        _pending.push(pending);
+    }
+}
+
+bool CompassCalibrator::fit_step() {
+    WITH_SEMAPHORE(_sem);
+
     if(_status == COMPASS_CAL_WAITING_TO_START) {
         set_status(COMPASS_CAL_RUNNING_STEP_ONE);
     }
 
-    if(running() && _samples_collected < COMPASS_CAL_NUM_SAMPLES && accept_sample(sample)) {
-        update_completion_mask(sample);
-        _sample_buffer[_samples_collected].set(sample);
-        _sample_buffer[_samples_collected].att.set_from_ahrs();
-        _samples_collected++;
+    PendingSample sample;
+    while (_pending.pop(sample)) {
+        add_sample(sample);
     }
-}
-
-void CompassCalibrator::update(bool &failure) {
-    failure = false;
 
     if(!fitting()) {
-        return;
+        return false;
     }
 
     if(_status == COMPASS_CAL_RUNNING_STEP_ONE) {
         if (_fit_step >= 10) {
             if(is_equal(_fitness,_initial_fitness) || isnan(_fitness)) {           //if true, means that fitness is diverging instead of converging
                 set_status(COMPASS_CAL_FAILED);
-                failure = true;
+                _fail_count++;
             }
             set_status(COMPASS_CAL_RUNNING_STEP_TWO);
         } else {
@@ -204,7 +230,7 @@ void CompassCalibrator::update(bool &failure) {
                 set_status(COMPASS_CAL_SUCCESS);
             } else {
                 set_status(COMPASS_CAL_FAILED);
-                failure = true;
+                _fail_count++;
             }
         } else if (_fit_step < 15) {
             run_sphere_fit();
@@ -214,6 +240,14 @@ void CompassCalibrator::update(bool &failure) {
             _fit_step++;
         }
     }
+    return true;
+}
+
+void CompassCalibrator::update(bool &failure) {
+    // only fit_step() changes _fail_count, so no semaphore is needed
+    const uint8_t fail_count = _fail_count;
+    failure = fail_count != _fail_count_reported;
+    _fail_count_reported = fail_count;
 }
 
 /////////////////////////////////////////////////////////////
@@ -252,6 +286,34 @@ void CompassCalibrator::reset_state() {
     initialize_fit();
 }
 
+Vector3f CompassCalibrator::get_sample(uint16_t i) const {
+    return Vector3f(COMPASS_CAL_SAMPLE_SCALE_TO_FLOAT(_sample_buffer->x[i]),
+                    COMPASS_CAL_SAMPLE_SCALE_TO_FLOAT(_sample_buffer->y[i]),
+                    COMPASS_CAL_SAMPLE_SCALE_TO_FLOAT(_sample_buffer->z[i]));
+}
+
+void CompassCalibrator::set_sample(uint16_t i, const Vector3f &v) {
+    _sample_buffer->x[i] = COMPASS_CAL_SAMPLE_SCALE_TO_FIXED(v.x);
+    _sample_buffer->y[i] = COMPASS_CAL_SAMPLE_SCALE_TO_FIXED(v.y);
+    _sample_buffer->z[i] = COMPASS_CAL_SAMPLE_SCALE_TO_FIXED(v.z);
+}
+
+void CompassCalibrator::move_sample(uint16_t to, uint16_t from) {
+    _sample_buffer->x[to] = _sample_buffer->x[from];
+    _sample_buffer->y[to] = _sample_buffer->y[from];
+    _sample_buffer->z[to] = _sample_buffer->z[from];
+    _sample_buffer->att[to] = _sample_buffer->att[from];
+}
+
+void CompassCalibrator::add_sample(const PendingSample &sample) {
+    if(running() && _samples_collected < COMPASS_CAL_NUM_SAMPLES && accept_sample(sample.field)) {
+        update_completion_mask(sample.field);
+        set_sample(_samples_collected, sample.field);
+        _sample_buffer->att[_samples_collected] = sample.att;
+        _samples_collected++;
+    }
+}
+
 bool CompassCalibrator::set_status(compass_cal_status_t status) {
     if (status != COMPASS_CAL_NOT_STARTED && _status == status) {
         return true;
@@ -285,8 +347,7 @@ bool CompassCalibrator::set_status(compass_cal_status_t status) {
             }
 
             if (_sample_buffer == nullptr) {
-                _sample_buffer =
-                    (CompassSample*) calloc(COMPASS_CAL_NUM_SAMPLES, sizeof(CompassSample));
+                _sample_buffer = (SampleBuffer *)calloc(1, sizeof(SampleBuffer));
             }
 
             if(_sample_buffer != nullptr) {
@@ -377,14 +438,16 @@ void CompassCalibrator::thin_samples() {
     // this is so that adjacent samples don't get sequentially eliminated
     for(uint16_t i=_samples_collected-1; i>=1; i--) {
         uint16_t j = get_random16() % (i+1);
-        CompassSample temp = _sample_buffer[i];
-        _sample_buffer[i] = _sample_buffer[j];
-        _sample_buffer[j] = temp;
+        const Vector3f temp = get_sample(i);
+        const AttitudeSample temp_att = _sample_buffer->att[i];
+        move_sample(i, j);
+        set_sample(j, temp);
+        _sample_buffer->att[j] = temp_att;
     }
 
     for(uint16_t i=0; i < _samples_collected; i++) {
-        if(!accept_sample(_sample_buffer[i])) {
-            _sample_buffer[i] = _sample_buffer[_samples_collected-1];
+        if(!accept_sample(get_sample(i))) {
+            move_sample(i, _samples_collected-1);
             _samples_collected --;
             _samples_thinned ++;
         }
@@ -419,21 +482,27 @@ bool CompassCalibrator::accept_sample(const Vector3f& sample)
         return false;
     }
 
-    float min_distance = _params.radius * 2*sinf(theta/2);
+    // compare squared distances in fixed point units, a component at a time
+    const float min_distance = _params.radius * 2*sinf(theta/2);
+    const float min_distance_sq = sq(COMPASS_CAL_SAMPLE_SCALE_TO_FIXED(min_distance));
+    const int16_t sx = COMPASS_CAL_SAMPLE_SCALE_TO_FIXED(sample.x);
+    const int16_t sy = COMPASS_CAL_SAMPLE_SCALE_TO_FIXED(sample.y);
+    const int16_t sz = COMPASS_CAL_SAMPLE_SCALE_TO_FIXED(sample.z);
+    const int16_t *x = _sample_buffer->x;
+    const int16_t *y = _sample_buffer->y;
+    const int16_t *z = _sample_buffer->z;
 
     for (uint16_t i = 0; i<_samples_collected; i++){
-        float distance = (sample - _sample_buffer[i].get()).length();
-        if(distance < min_distance) {
+        const float dx = sx - x[i];
+        const float dy = sy - y[i];
+        const float dz = sz - z[i];
+        if(dx*dx + dy*dy + dz*dz < min_distance_sq) {
             return false;
         }
     }
     return true;
 }
 
-bool CompassCalibrator::accept_sample(const CompassSample& sample) {
-    return accept_sample(sample.get());
-}
-
 float CompassCalibrator::calc_residual(const Vector3f& sample, const param_t& params) const {
     Matrix3f softiron(
         params.diag.x    , params.offdiag.x , params.offdiag.y,
@@ -455,7 +524,7 @@ float CompassCalibrator::calc_mean_squared_residuals(const param_t& params) cons
     }
     float sum = 0.0f;
     for(uint16_t i=0; i < _samples_collected; i++){
-        Vector3f sample = _sample_buffer[i].get();
+        Vector3f sample = get_sample(i);
         float resid = calc_residual(sample, params);
         sum += sq(resid);
     }
@@ -463,7 +532,7 @@ float CompassCalibrator::calc_mean_squared_residuals(const param_t& params) cons
     return sum;
 }
 
-void CompassCalibrator::calc_sphere_jacob(const Vector3f& sample, const param_t& params, float* ret) const{
+float CompassCalibrator::calc_sphere_jacob(const Vector3f& sample, const param_t& params, float* ret) const{
     const Vector3f &offset = params.offset;
     const Vector3f &diag = params.diag;
     const Vector3f &offdiag = params.offdiag;
@@ -484,6 +553,8 @@ void CompassCalibrator::calc_sphere_jacob(const Vector3f& sample, const param_t&
     ret[1] = -1.0f * (((diag.x    * A) + (offdiag.x * B) + (offdiag.y * C))/length);
     ret[2] = -1.0f * (((offdiag.x * A) + (diag.y    * B) + (offdiag.z * C))/length);
     ret[3] = -1.0f * (((offdiag.y * A) + (offdiag.z * B) + (diag.z    * C))/length);
+
+    return params.radius - length;
 }
 
 void CompassCalibrator::calc_initial_offset()
@@ -491,7 +562,7 @@ void CompassCalibrator::calc_initial_offset()
     // Set initial offset to the average value of the samples
     _params.offset.zero();
     for(uint16_t k = 0; k<_samples_collected; k++) {
-        _params.offset -= _sample_buffer[k].get();
+        _params.offset -= get_sample(k);
     }
     _params.offset /= _samples_collected;
 }
@@ -509,50 +580,43 @@ void CompassCalibrator::run_sphere_fit()
     param_t fit1_params, fit2_params;
     fit1_params = fit2_params = _params;
 
-    float JTJ[COMPASS_CAL_NUM_SPHERE_PARAMS*COMPASS_CAL_NUM_SPHERE_PARAMS] = { };
-    float JTJ2[COMPASS_CAL_NUM_SPHERE_PARAMS*COMPASS_CAL_NUM_SPHERE_PARAMS] = { };
-    float JTFI[COMPASS_CAL_NUM_SPHERE_PARAMS] = { };
+    MatrixN<float,COMPASS_CAL_NUM_SPHERE_PARAMS> JTJ;
+    VectorN<float,COMPASS_CAL_NUM_SPHERE_PARAMS> JTFI;
 
     // Gauss Newton Part common for all kind of extensions including LM
     for(uint16_t k = 0; k<_samples_collected; k++) {
-        Vector3f sample = _sample_buffer[k].get();
+        Vector3f sample = get_sample(k);
 
         float sphere_jacob[COMPASS_CAL_NUM_SPHERE_PARAMS];
 
-        calc_sphere_jacob(sample, fit1_params, sphere_jacob);
+        const float residual = calc_sphere_jacob(sample, fit1_params, sphere_jacob);
 
-        for(uint8_t i = 0;i < COMPASS_CAL_NUM_SPHERE_PARAMS; i++) {
-            // compute JTJ
-            for(uint8_t j = 0; j < COMPASS_CAL_NUM_SPHERE_PARAMS; j++) {
-                JTJ[i*COMPASS_CAL_NUM_SPHERE_PARAMS+j] += sphere_jacob[i] * sphere_jacob[j];
-                JTJ2[i*COMPASS_CAL_NUM_SPHERE_PARAMS+j] += sphere_jacob[i] * sphere_jacob[j];   //a backup JTJ for LM
-            }
-            // compute JTFI
-            JTFI[i] += sphere_jacob[i] * calc_residual(sample, fit1_params);
-        }
+        const VectorN<float,COMPASS_CAL_NUM_SPHERE_PARAMS> jacob(sphere_jacob);
+        // compute JTJ
+        JTJ.add_outer_lower(jacob);
+        // compute JTFI
+        JTFI += jacob * residual;
     }
 
 
     //------------------------Levenberg-Marquardt-part-starts-here---------------------------------//
     //refer: http://en.wikipedia.org/wiki/Levenberg%E2%80%93Marquardt_algorithm#Choice_of_damping_parameter
-    for(uint8_t i = 0; i < COMPASS_CAL_NUM_SPHERE_PARAMS; i++) {
-        JTJ[i*COMPASS_CAL_NUM_SPHERE_PARAMS+i] += _sphere_lambda;
-        JTJ2[i*COMPASS_CAL_NUM_SPHERE_PARAMS+i] += _sphere_lambda/lma_damping;
-    }
+    MatrixN<float,COMPASS_CAL_NUM_SPHERE_PARAMS> JTJ2 = JTJ;   //a backup JTJ for LM
+    JTJ.add_diagonal(_sphere_lambda);
+    JTJ2.add_diagonal(_sphere_lambda/lma_damping);
 
-    if(!inverse(JTJ, JTJ, 4)) {
-        return;
-    }
-
-    if(!inverse(JTJ2, JTJ2, 4)) {
+    // solve JTJ * delta = JTFI for both dampings
+    if(!JTJ.ldlt_decompose() || !JTJ2.ldlt_decompose()) {
         return;
     }
+    VectorN<float,COMPASS_CAL_NUM_SPHERE_PARAMS> delta1 = JTFI;
+    VectorN<float,COMPASS_CAL_NUM_SPHERE_PARAMS> delta2 = JTFI;
+    JTJ.ldlt_solve(delta1);
+    JTJ2.ldlt_solve(delta2);
 
     for(uint8_t row=0; row < COMPASS_CAL_NUM_SPHERE_PARAMS; row++) {
-        for(uint8_t col=0; col < COMPASS_CAL_NUM_SPHERE_PARAMS; col++) {
-            fit1_params.get_sphere_params()[row] -= JTFI[col] * JTJ[row*COMPASS_CAL_NUM_SPHERE_PARAMS+col];
-            fit2_params.get_sphere_params()[row] -= JTFI[col] * JTJ2[row*COMPASS_CAL_NUM_SPHERE_PARAMS+col];
-        }
+        fit1_params.get_sphere_params()[row] -= delta1[row];
+        fit2_params.get_sphere_params()[row] -= delta2[row];
     }
 
     fit1 = calc_mean_squared_residuals(fit1_params);
@@ -578,7 +642,7 @@ void CompassCalibrator::run_sphere_fit()
 
 
 
-void CompassCalibrator::calc_ellipsoid_jacob(const Vector3f& sample, const param_t& params, float* ret) const{
+float CompassCalibrator::calc_ellipsoid_jacob(const Vector3f& sample, const param_t& params, float* ret) const{
     const Vector3f &offset = params.offset;
     const Vector3f &diag = params.diag;
     const Vector3f &offdiag = params.offdiag;
@@ -605,6 +669,8 @@ void CompassCalibrator::calc_ellipsoid_jacob(const Vector3f& sample, const param
     ret[6] = -1.0f * (((sample.y + offset.y) * A) + ((sample.x + offset.x) * B))/length;
     ret[7] = -1.0f * (((sample.z + offset.z) * A) + ((sample.x + offset.x) * C))/length;
     ret[8] = -1.0f * (((sample.z + offset.z) * B) + ((sample.y + offset.y) * C))/length;
+
+    return params.radius - length;
 }
 
 void CompassCalibrator::run_ellipsoid_fit()
@@ -622,51 +688,43 @@ void CompassCalibrator::run_ellipsoid_fit()
     fit1_params = fit2_params = _params;
 
 
-    float JTJ[COMPASS_CAL_NUM_ELLIPSOID_PARAMS*COMPASS_CAL_NUM_ELLIPSOID_PARAMS] = { };
-    float JTJ2[COMPASS_CAL_NUM_ELLIPSOID_PARAMS*COMPASS_CAL_NUM_ELLIPSOID_PARAMS] = { };
-    float JTFI[COMPASS_CAL_NUM_ELLIPSOID_PARAMS] = { };
+    MatrixN<float,COMPASS_CAL_NUM_ELLIPSOID_PARAMS> JTJ;
+    VectorN<float,COMPASS_CAL_NUM_ELLIPSOID_PARAMS> JTFI;
 
     // Gauss Newton Part common for all kind of extensions including LM
     for(uint16_t k = 0; k<_samples_collected; k++) {
-        Vector3f sample = _sample_buffer[k].get();
+        Vector3f sample = get_sample(k);
 
         float ellipsoid_jacob[COMPASS_CAL_NUM_ELLIPSOID_PARAMS];
 
-        calc_ellipsoid_jacob(sample, fit1_params, ellipsoid_jacob);
+        const float residual = calc_ellipsoid_jacob(sample, fit1_params, ellipsoid_jacob);
 
-        for(uint8_t i = 0;i < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; i++) {
-            // compute JTJ
-            for(uint8_t j = 0; j < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; j++) {
-                JTJ [i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+j] += ellipsoid_jacob[i] * ellipsoid_jacob[j];
-                JTJ2[i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+j] += ellipsoid_jacob[i] * ellipsoid_jacob[j];
-            }
-            // compute JTFI
-            JTFI[i] += ellipsoid_jacob[i] * calc_residual(sample, fit1_params);
-        }
+        const VectorN<float,COMPASS_CAL_NUM_ELLIPSOID_PARAMS> jacob(ellipsoid_jacob);
+        // compute JTJ
+        JTJ.add_outer_lower(jacob);
+        // compute JTFI
+        JTFI += jacob * residual;
     }
 
 
-
     //------------------------Levenberg-Marquardt-part-starts-here---------------------------------//
     //refer: http://en.wikipedia.org/wiki/Levenberg%E2%80%93Marquardt_algorithm#Choice_of_damping_parameter
-    for(uint8_t i = 0; i < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; i++) {
-        JTJ[i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+i] += _ellipsoid_lambda;
-        JTJ2[i*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+i] += _ellipsoid_lambda/lma_damping;
-    }
+    MatrixN<float,COMPASS_CAL_NUM_ELLIPSOID_PARAMS> JTJ2 = JTJ;   //a backup JTJ for LM
+    JTJ.add_diagonal(_ellipsoid_lambda);
+    JTJ2.add_diagonal(_ellipsoid_lambda/lma_damping);
 
-    if(!inverse(JTJ, JTJ, 9)) {
-        return;
-    }
-
-    if(!inverse(JTJ2, JTJ2, 9)) {
+    // solve JTJ * delta = JTFI for both dampings
+    if(!JTJ.ldlt_decompose() || !JTJ2.ldlt_decompose()) {
         return;
     }
+    VectorN<float,COMPASS_CAL_NUM_ELLIPSOID_PARAMS> delta1 = JTFI;
+    VectorN<float,COMPASS_CAL_NUM_ELLIPSOID_PARAMS> delta2 = JTFI;
+    JTJ.ldlt_solve(delta1);
+    JTJ2.ldlt_solve(delta2);
 
     for(uint8_t row=0; row < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; row++) {
-        for(uint8_t col=0; col < COMPASS_CAL_NUM_ELLIPSOID_PARAMS; col++) {
-            fit1_params.get_ellipsoid_params()[row] -= JTFI[col] * JTJ[row*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+col];
-            fit2_params.get_ellipsoid_params()[row] -= JTFI[col] * JTJ2[row*COMPASS_CAL_NUM_ELLIPSOID_PARAMS+col];
-        }
+        fit1_params.get_ellipsoid_params()[row] -= delta1[row];
+        fit2_params.get_ellipsoid_params()[row] -= delta2[row];
     }
 
     fit1 = calc_mean_squared_residuals(fit1_params);
@@ -692,25 +750,9 @@ void CompassCalibrator::run_ellipsoid_fit()
 
 
 //////////////////////////////////////////////////////////
-//////////// CompassSample public interface //////////////
+/////////// AttitudeSample public interface //////////////
 //////////////////////////////////////////////////////////
 
-#define COMPASS_CAL_SAMPLE_SCALE_TO_FIXED(__X) ((int16_t)constrain_float(roundf(__X*8.0f), INT16_MIN, INT16_MAX))
-#define COMPASS_CAL_SAMPLE_SCALE_TO_FLOAT(__X) (__X/8.0f)
-
-Vector3f CompassCalibrator::CompassSample::get() const {
-    return Vector3f(COMPASS_CAL_SAMPLE_SCALE_TO_FLOAT(x),
-                    COMPASS_CAL_SAMPLE_SCALE_TO_FLOAT(y),
-                    COMPASS_CAL_SAMPLE_SCALE_TO_FLOAT(z));
-}
-
-void CompassCalibrator::CompassSample::set(const Vector3f &in) {
-    x = COMPASS_CAL_SAMPLE_SCALE_TO_FIXED(in.x);
-    y = COMPASS_CAL_SAMPLE_SCALE_TO_FIXED(in.y);
-    z = COMPASS_CAL_SAMPLE_SCALE_TO_FIXED(in.z);
-}
-
-
 void CompassCalibrator::AttitudeSample::set_from_ahrs(void) {
     const Matrix3f &dcm = AP::ahrs().get_DCM_rotation_body_to_ned();
     float roll_rad, pitch_rad, yaw_rad;
@@ -741,9 +783,9 @@ Matrix3f CompassCalibrator::AttitudeSample::get_rotmat(void) {
   Note that this earth field uses an arbitrary north reference, so it
   may not match the true earth field.
  */
-Vector3f CompassCalibrator::calculate_earth_field(CompassSample &sample, enum Rotation r)
+Vector3f CompassCalibrator::calculate_earth_field(uint16_t i, enum Rotation r)
 {
-    Vector3f v = sample.get();
+    Vector3f v = get_sample(i);
 
     // convert the sample back to sensor frame
     v.rotate_inverse(_orientation);
@@ -760,7 +802,7 @@ Vector3f CompassCalibrator::calculate_earth_field(CompassSample &sample, enum Ro
     v += rot_offsets;
 
     // rotate the sample from body frame back to earth frame
-    Matrix3f rot = sample.att.get_rotmat();
+    Matrix3f rot = _sample_buffer->att[i].get_rotmat();
 
     Vector3f efield = rot * v;
 
@@ -786,14 +828,14 @@ bool CompassCalibrator::calculate_orientation(void)
         // calculate the average implied earth field across all samples
         Vector3f total_ef {};
         for (uint32_t i=0; i<_samples_collected; i++) {
-            Vector3f efield = calculate_earth_field(_sample_buffer[i], r);
+            Vector3f efield = calculate_earth_field(i, r);
             total_ef += efield;
         }
         Vector3f avg_efield = total_ef / _samples_collected;
 
         // now calculate the square error for this rotation against the average earth field
         for (uint32_t i=0; i<_samples_collected; i++) {
-            Vector3f efield = calculate_earth_field(_sample_buffer[i], r);
+            Vector3f efield = calculate_earth_field(i, r);
             float err = (efield - avg_efield).length_squared();
             // divide by number of samples collected to get the variance
             variance[r] += err / _samples_collected;
@@ -872,10 +914,10 @@ bool CompassCalibrator::calculate_orientation(void)
 
     // rotate the samples for the new orientation
     for (uint32_t i=0; i<_samples_collected; i++) {
-        Vector3f s = _sample_buffer[i].get();
+        Vector3f s = get_sample(i);
         s.rotate_inverse(_orientation);
         s.rotate(besti);
-        _sample_buffer[i].set(s);
+        set_sample(i, s);
     }
 
     _orientation = besti;
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <AP_HAL/AP_HAL.h>
+#include <AP_HAL/utility/RingBuffer.h>
 #include <AP_Math/AP_Math.h>
 
 #define COMPASS_CAL_NUM_SPHERE_PARAMS 4
 #define COMPASS_CAL_NUM_ELLIPSOID_PARAMS 9
 #define COMPASS_CAL_NUM_SAMPLES 300
 
+// samples queued between the compass driver and the fit
+#define COMPASS_CAL_SAMPLE_QUEUE_SIZE 16
+
 //RMS tolerance
 #define COMPASS_CAL_DEFAULT_TOLERANCE 5.0f
 
@@ -19,6 +24,15 @@ enum compass_cal_status_t {
     COMPASS_CAL_BAD_ORIENTATION=6,
 };
 
+/*
+  Threading: new_sample() is called by the compass driver and only
+  queues the sample. fit_step() takes the queued samples and runs one
+  Levenberg-Marquardt step; it is called by the compass calibration
+  thread, or from the main loop on boards without one. The remaining
+  methods are for the main thread. State shared with fit_step() is
+  protected by a semaphore which fit_step() holds for one step at a
+  time; update() and the status getters don't need it.
+ */
 class CompassCalibrator {
 public:
     typedef uint8_t completion_mask_t[10];
@@ -28,6 +42,11 @@ public:
     void start(bool retry, float delay, uint16_t offset_max, uint8_t compass_idx);
     void clear();
 
+    // take queued samples and run one step of the fit. Returns true
+    // if a fit step ran
+    bool fit_step();
+
+    // failure is set if a fit has failed since the last call
     void update(bool &failure);
     void new_sample(const Vector3f &sample);
 
@@ -84,15 +103,21 @@ private:
         int8_t yaw;
     };
 
-    class CompassSample {
-    public:
-        Vector3f get() const;
-        void set(const Vector3f &in);
+    // a sample on its way from the driver to the fit
+    struct PendingSample {
+        Vector3f field;
         AttitudeSample att;
-    private:
-        int16_t x;
-        int16_t y;
-        int16_t z;
+    };
+
+    /*
+      collected samples, as fixed point in structure of arrays form so
+      the fit loops stream through each component
+     */
+    struct SampleBuffer {
+        int16_t x[COMPASS_CAL_NUM_SAMPLES];
+        int16_t y[COMPASS_CAL_NUM_SAMPLES];
+        int16_t z[COMPASS_CAL_NUM_SAMPLES];
+        AttitudeSample att[COMPASS_CAL_NUM_SAMPLES];
     };
 
     enum Rotation _orientation;
@@ -120,7 +145,7 @@ private:
     //fit state
     class param_t _params;
     uint16_t _fit_step;
-    CompassSample *_sample_buffer;
+    SampleBuffer *_sample_buffer;
     float _fitness; // mean squared residuals
     float _initial_fitness;
     float _sphere_lambda;
@@ -129,11 +154,26 @@ private:
     uint16_t _samples_thinned;
     float _orientation_confidence;
 
+    // driver to fit handoff
+    SPSCObjectBuffer<PendingSample> _pending{COMPASS_CAL_SAMPLE_QUEUE_SIZE};
+
+    // fit failures, counted by fit_step() and reported by update()
+    uint8_t _fail_count;
+    uint8_t _fail_count_reported;
+
+    HAL_Semaphore _sem;
+
     bool set_status(compass_cal_status_t status);
 
+    Vector3f get_sample(uint16_t i) const;
+    void set_sample(uint16_t i, const Vector3f &v);
+    void move_sample(uint16_t to, uint16_t from);
+
+    // add a queued sample to the buffer if it is accepted
+    void add_sample(const PendingSample &sample);
+
     // returns true if sample should be added to buffer
     bool accept_sample(const Vector3f &sample);
-    bool accept_sample(const CompassSample &sample);
 
     // returns true if fit is acceptable
     bool fit_acceptable();
@@ -151,10 +191,12 @@ private:
     float calc_mean_squared_residuals() const;
 
     void calc_initial_offset();
-    void calc_sphere_jacob(const Vector3f& sample, const param_t& params, float* ret) const;
+    // the jacobians return the residual as well, as they share most
+    // of the work
+    float calc_sphere_jacob(const Vector3f& sample, const param_t& params, float* ret) const;
     void run_sphere_fit();
 
-    void calc_ellipsoid_jacob(const Vector3f& sample, const param_t& params, float* ret) const;
+    float calc_ellipsoid_jacob(const Vector3f& sample, const param_t& params, float* ret) const;
     void run_ellipsoid_fit();
 
     /**
@@ -169,6 +211,6 @@ private:
      */
     void update_completion_mask();
 
-    Vector3f calculate_earth_field(CompassSample &sample, enum Rotation r);
+    Vector3f calculate_earth_field(uint16_t i, enum Rotation r);
     bool calculate_orientation();
 };
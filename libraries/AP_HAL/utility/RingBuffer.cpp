@@ -250,3 +250,204 @@ int16_t ByteBuffer::peek(uint32_t ofs) const
     }
     return buf[(head+ofs)%size];
 }
+
+/*
+  single-producer/single-consumer byte buffer
+ */
+static uint32_t spsc_round_size(uint32_t _size)
+{
+    if (_size == 0) {
+        return 0;
+    }
+    uint32_t ret = 1;
+    while (ret <= _size / 2) {
+        ret <<= 1;
+    }
+    return ret;
+}
+
+SPSCByteBuffer::SPSCByteBuffer(uint32_t _size)
+{
+    size = spsc_round_size(_size);
+    buf = size ? (uint8_t*)calloc(1, size) : nullptr;
+    if (buf == nullptr) {
+        size = 0;
+    }
+    mask = size ? size - 1 : 0;
+}
+
+SPSCByteBuffer::~SPSCByteBuffer(void)
+{
+    free(buf);
+}
+
+/*
+ * Caller is responsible for making sure neither side is in use
+ */
+bool SPSCByteBuffer::set_size(uint32_t _size)
+{
+    head = tail = 0;
+    tail_cache = head_cache = 0;
+    reserved = 0;
+    _size = spsc_round_size(_size);
+    if (_size != size) {
+        free(buf);
+        buf = _size ? (uint8_t*)calloc(1, _size) : nullptr;
+        if (!buf) {
+            size = mask = 0;
+            return false;
+        }
+        size = _size;
+        mask = size - 1;
+    }
+    return true;
+}
+
+void SPSCByteBuffer::clear(void)
+{
+    const uint32_t t = tail.load(std::memory_order_relaxed);
+    head.store(t, std::memory_order_relaxed);
+    tail_cache = head_cache = t;
+    reserved = 0;
+}
+
+uint32_t SPSCByteBuffer::available(void) const
+{
+    tail_cache = tail.load(std::memory_order_acquire);
+    return tail_cache - head.load(std::memory_order_relaxed);
+}
+
+uint32_t SPSCByteBuffer::space(void) const
+{
+    head_cache = head.load(std::memory_order_acquire);
+    return size - (tail.load(std::memory_order_relaxed) - head_cache);
+}
+
+uint8_t SPSCByteBuffer::peekiovec(ByteBuffer::IoVec vec[2], uint32_t len) const
+{
+    const uint32_t h = head.load(std::memory_order_relaxed);
+    if (tail_cache - h < len) {
+        tail_cache = tail.load(std::memory_order_acquire);
+    }
+    const uint32_t avail = tail_cache - h;
+    if (len > avail) {
+        len = avail;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    const uint32_t ofs = h & mask;
+    const uint32_t n = size - ofs;
+    vec[0].data = &buf[ofs];
+    if (len <= n) {
+        vec[0].len = len;
+        return 1;
+    }
+    vec[0].len = n;
+    vec[1].data = buf;
+    vec[1].len = len - n;
+    return 2;
+}
+
+uint32_t SPSCByteBuffer::peekbytes(uint8_t *data, uint32_t len) const
+{
+    ByteBuffer::IoVec vec[2];
+    const uint8_t n_vec = peekiovec(vec, len);
+    uint32_t ret = 0;
+
+    for (uint8_t i = 0; i < n_vec; i++) {
+        memcpy(data + ret, vec[i].data, vec[i].len);
+        ret += vec[i].len;
+    }
+    return ret;
+}
+
+const uint8_t *SPSCByteBuffer::readptr(uint32_t &available_bytes) const
+{
+    const uint32_t h = head.load(std::memory_order_relaxed);
+    const uint32_t avail = available();
+    const uint32_t ofs = h & mask;
+    available_bytes = (avail < size - ofs) ? avail : size - ofs;
+    return available_bytes ? &buf[ofs] : nullptr;
+}
+
+bool SPSCByteBuffer::advance(uint32_t n)
+{
+    const uint32_t h = head.load(std::memory_order_relaxed);
+    if (tail_cache - h < n && available() < n) {
+        return false;
+    }
+    head.store(h + n, std::memory_order_release);
+    return true;
+}
+
+uint32_t SPSCByteBuffer::read(uint8_t *data, uint32_t len)
+{
+    const uint32_t ret = peekbytes(data, len);
+    advance(ret);
+    return ret;
+}
+
+uint8_t SPSCByteBuffer::reserve(ByteBuffer::IoVec vec[2], uint32_t len)
+{
+    if (reserved != 0) {
+        // anything written now would be overwritten by the open
+        // reservation when it is committed
+        return 0;
+    }
+    const uint32_t t = tail.load(std::memory_order_relaxed);
+    if (size - (t - head_cache) < len) {
+        head_cache = head.load(std::memory_order_acquire);
+    }
+    const uint32_t free_space = size - (t - head_cache);
+    if (len > free_space) {
+        len = free_space;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    reserved = len;
+    const uint32_t ofs = t & mask;
+    const uint32_t n = size - ofs;
+    vec[0].data = &buf[ofs];
+    if (len <= n) {
+        vec[0].len = len;
+        return 1;
+    }
+    vec[0].len = n;
+    vec[1].data = buf;
+    vec[1].len = len - n;
+    return 2;
+}
+
+bool SPSCByteBuffer::commit(uint32_t len)
+{
+    if (len > reserved) {
+        return false; // more than was reserved
+    }
+    reserved = 0;
+    if (len == 0) {
+        return true;
+    }
+    const uint32_t t = tail.load(std::memory_order_relaxed);
+    tail.store(t + len, std::memory_order_release);
+    return true;
+}
+
+uint32_t SPSCByteBuffer::write(const uint8_t *data, uint32_t len)
+{
+    ByteBuffer::IoVec vec[2];
+    const uint8_t n_vec = reserve(vec, len);
+    if (n_vec == 0) {
+        // full, or a reservation is open
+        return 0;
+    }
+    uint32_t ret = 0;
+
+    for (uint8_t i = 0; i < n_vec; i++) {
+        memcpy(vec[i].data, data + ret, vec[i].len);
+        ret += vec[i].len;
+    }
+    commit(ret);
+    return ret;
+}
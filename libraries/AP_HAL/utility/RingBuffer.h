@@ -200,6 +200,257 @@ private:
 
 
 
+/*
+  size of a cache line, used to keep the producer and consumer state
+  of the SPSC buffers apart so the two threads do not false-share
+ */
+#ifndef AP_HAL_CACHE_LINE_SIZE
+#define AP_HAL_CACHE_LINE_SIZE 64
+#endif
+
+/*
+  Single-producer/single-consumer circular buffer of bytes.
+
+  Exactly one thread may use the write side (space, write, reserve,
+  commit) and exactly one thread may use the read side (available,
+  read, peekbytes, peekiovec, readptr, advance). No lock is needed
+  between the two: indexes are published with release stores and
+  observed with acquire loads, and each side keeps a cached copy of
+  the other side's index so it only touches the other cache line when
+  it appears to be out of data or space.
+
+  The size is rounded down to a power of two, so a buffer never takes
+  more memory than asked for, and the whole buffer is usable.
+ */
+class SPSCByteBuffer {
+public:
+    SPSCByteBuffer(uint32_t size);
+    ~SPSCByteBuffer(void);
+
+    /* Do not allow copies */
+    SPSCByteBuffer(const SPSCByteBuffer &other) = delete;
+    SPSCByteBuffer &operator=(const SPSCByteBuffer&) = delete;
+
+    // set size of ringbuffer, caller responsible for making sure
+    // neither side is in use
+    bool set_size(uint32_t size);
+
+    // return size of ringbuffer
+    uint32_t get_size(void) const { return size; }
+
+    // Discards the buffer content. Caller responsible for making
+    // sure neither side is in use
+    void clear(void);
+
+    /*
+      reader side
+     */
+
+    // number of bytes available to be read
+    uint32_t available(void) const;
+
+    // true if available() is zero
+    bool empty(void) const { return available() == 0; }
+
+    // read bytes from ringbuffer. Returns number of bytes read
+    uint32_t read(uint8_t *data, uint32_t len);
+
+    // read len bytes without advancing the read pointer
+    uint32_t peekbytes(uint8_t *data, uint32_t len) const;
+
+    // fill out vec with up to len readable bytes in one or two
+    // parts, without advancing the read pointer. Returns the number
+    // of parts filled out. Follow with advance() to consume them
+    uint8_t peekiovec(ByteBuffer::IoVec vec[2], uint32_t len) const;
+
+    // Returns the pointer and size to a contiguous read of the next available data
+    const uint8_t *readptr(uint32_t &available_bytes) const;
+
+    // advance the read pointer (discarding bytes)
+    bool advance(uint32_t n);
+
+    /*
+      writer side
+     */
+
+    // number of bytes space available to write
+    uint32_t space(void) const;
+
+    // write bytes to ringbuffer. Returns number of bytes written
+    uint32_t write(const uint8_t *data, uint32_t len);
+
+    // Reserve up to `len` bytes and fill out `vec` with one or two
+    // parts of the ring buffer. Returns the number of parts filled
+    // out. Nothing is visible to the reader until commit(). Only one
+    // reservation may be open: reserve() and write() return 0 until
+    // it is committed
+    uint8_t reserve(ByteBuffer::IoVec vec[2], uint32_t len);
+
+    // publish `len` bytes previously reserved to the reader and close
+    // the reservation. commit(0) abandons it
+    bool commit(uint32_t len);
+
+    // true if there is a reservation not yet committed
+    bool reserve_open(void) const { return reserved != 0; }
+
+private:
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t mask;
+    uint8_t _pad0[AP_HAL_CACHE_LINE_SIZE];
+
+    // reader state. head is free-running; tail_cache is the reader's
+    // last view of tail
+    std::atomic<uint32_t> head{0};
+    mutable uint32_t tail_cache = 0;
+    uint8_t _pad1[AP_HAL_CACHE_LINE_SIZE];
+
+    // writer state. tail is free-running; head_cache is the writer's
+    // last view of head
+    std::atomic<uint32_t> tail{0};
+    mutable uint32_t head_cache = 0;
+    uint32_t reserved = 0;
+    uint8_t _pad2[AP_HAL_CACHE_LINE_SIZE];
+};
+
+/*
+  Single-producer/single-consumer ring buffer class for objects of
+  fixed size, with the same threading rules as SPSCByteBuffer. The
+  number of objects is rounded up to a power of two.
+ */
+template <class T>
+class SPSCObjectBuffer {
+public:
+    SPSCObjectBuffer(uint32_t _size) {
+        size = 1;
+        while (size < _size) {
+            size <<= 1;
+        }
+        mask = size - 1;
+        buffer = new T[size];
+        if (buffer == nullptr) {
+            size = mask = 0;
+        }
+    }
+    ~SPSCObjectBuffer(void) {
+        delete[] buffer;
+    }
+
+    /* Do not allow copies */
+    SPSCObjectBuffer(const SPSCObjectBuffer &other) = delete;
+    SPSCObjectBuffer &operator=(const SPSCObjectBuffer&) = delete;
+
+    // return total number of objects
+    uint32_t get_size(void) const { return size; }
+
+    // Discards the buffer content. Caller responsible for making
+    // sure neither side is in use
+    void clear(void) {
+        head.store(tail.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        head_cache = tail_cache = head.load(std::memory_order_relaxed);
+    }
+
+    // return number of objects available to be read (reader side)
+    uint32_t available(void) const {
+        tail_cache = tail.load(std::memory_order_acquire);
+        return tail_cache - head.load(std::memory_order_relaxed);
+    }
+
+    // true is available() == 0 (reader side)
+    bool empty(void) const {
+        return available() == 0;
+    }
+
+    // return number of objects that could be written (writer side)
+    uint32_t space(void) const {
+        head_cache = head.load(std::memory_order_acquire);
+        return size - (tail.load(std::memory_order_relaxed) - head_cache);
+    }
+
+    // push one object (writer side)
+    bool push(const T &object) {
+        return push(&object, 1) == 1;
+    }
+
+    // push up to n objects, returning the number pushed (writer side)
+    uint32_t push(const T *objects, uint32_t n) {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        if (size - (t - head_cache) < n) {
+            head_cache = head.load(std::memory_order_acquire);
+        }
+        const uint32_t free = size - (t - head_cache);
+        if (n > free) {
+            n = free;
+        }
+        for (uint32_t i=0; i<n; i++) {
+            buffer[(t + i) & mask] = objects[i];
+        }
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // pop earliest object off the queue (reader side)
+    bool pop(T &object) {
+        return pop(&object, 1) == 1;
+    }
+
+    // pop up to n objects, returning the number popped (reader side)
+    uint32_t pop(T *objects, uint32_t n) {
+        n = peek(objects, n);
+        head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+        return n;
+    }
+
+    // throw away an object (reader side)
+    bool pop(void) {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (tail_cache == h) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (tail_cache == h) {
+                return false;
+            }
+        }
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // peek copies an object out without advancing the read pointer (reader side)
+    bool peek(T &object) const {
+        return peek(&object, 1) == 1;
+    }
+
+    // copy out up to n objects without advancing the read pointer,
+    // returning the number copied (reader side)
+    uint32_t peek(T *objects, uint32_t n) const {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (tail_cache - h < n) {
+            tail_cache = tail.load(std::memory_order_acquire);
+        }
+        const uint32_t avail = tail_cache - h;
+        if (n > avail) {
+            n = avail;
+        }
+        for (uint32_t i=0; i<n; i++) {
+            objects[i] = buffer[(h + i) & mask];
+        }
+        return n;
+    }
+
+private:
+    T *buffer;
+    uint32_t size;
+    uint32_t mask;
+    uint8_t _pad0[AP_HAL_CACHE_LINE_SIZE];
+
+    std::atomic<uint32_t> head{0};
+    mutable uint32_t tail_cache = 0;
+    uint8_t _pad1[AP_HAL_CACHE_LINE_SIZE];
+
+    std::atomic<uint32_t> tail{0};
+    mutable uint32_t head_cache = 0;
+    uint8_t _pad2[AP_HAL_CACHE_LINE_SIZE];
+};
+
 /*
   ring buffer class for objects of fixed size with pointer
   access. Note that this is not thread safe, buf offers efficient
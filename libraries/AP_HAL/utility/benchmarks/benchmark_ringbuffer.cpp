@@ -0,0 +1,152 @@
+/*
+ * Compare the semaphore guarded ByteBuffer, as used by DataFlash_File
+ * for its write buffer, with the lock-free SPSCByteBuffer. A consumer
+ * thread drains the buffer in 512 byte chunks, like the DataFlash IO
+ * thread, while the benchmark thread writes blocks of the given size.
+ *
+ * Throughput counts only the bytes written; blocks that did not fit
+ * are counted as drops. Each run reports the drops and the 99th
+ * percentile and worst write latency in its label.
+ */
+#include <AP_gbenchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <pthread.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include <AP_HAL/utility/RingBuffer.h>
+
+static const uint32_t buffer_size = 16384;
+static const uint32_t drain_chunk = 512;
+
+typedef std::chrono::steady_clock bm_clock;
+
+static void report(benchmark::State& state, std::vector<uint32_t> &latency_ns,
+                   uint64_t written, uint64_t dropped)
+{
+    state.SetBytesProcessed(int64_t(written));
+    if (latency_ns.empty()) {
+        return;
+    }
+    std::sort(latency_ns.begin(), latency_ns.end());
+    char label[80];
+    snprintf(label, sizeof(label), "drops=%llu p99=%uns max=%uns",
+             (unsigned long long)dropped,
+             (unsigned)latency_ns[latency_ns.size() * 99 / 100],
+             (unsigned)latency_ns.back());
+    state.SetLabel(label);
+}
+
+/*
+  ByteBuffer with a mutex around every write and every read, the
+  equivalent of DataFlash_File::semaphore on Linux
+ */
+static void BM_ByteBufferLocked(benchmark::State& state)
+{
+    ByteBuffer buf(buffer_size);
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    std::atomic<bool> done{false};
+    std::vector<uint32_t> latency_ns;
+    latency_ns.reserve(1 << 20);
+
+    std::thread consumer([&buf, &lock, &done]() {
+        while (!done) {
+            pthread_mutex_lock(&lock);
+            uint32_t n;
+            const bool got = buf.readptr(n) != nullptr;
+            if (got) {
+                buf.advance(std::min(n, drain_chunk));
+            }
+            pthread_mutex_unlock(&lock);
+            if (!got) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    std::vector<uint8_t> block(state.range_x(), 0x55);
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    while (state.KeepRunning()) {
+        const auto t0 = bm_clock::now();
+        pthread_mutex_lock(&lock);
+        if (buf.space() >= block.size()) {
+            buf.write(block.data(), block.size());
+            written += block.size();
+        } else {
+            dropped++;
+        }
+        pthread_mutex_unlock(&lock);
+        const auto t1 = bm_clock::now();
+        if (latency_ns.size() < latency_ns.capacity()) {
+            latency_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        }
+    }
+
+    done = true;
+    consumer.join();
+    report(state, latency_ns, written, dropped);
+}
+
+/*
+  SPSCByteBuffer with a single writer, filling the message in place
+  with reserve/commit
+ */
+static void BM_SPSCByteBuffer(benchmark::State& state)
+{
+    SPSCByteBuffer buf(buffer_size);
+    std::atomic<bool> done{false};
+    std::vector<uint32_t> latency_ns;
+    latency_ns.reserve(1 << 20);
+
+    std::thread consumer([&buf, &done]() {
+        while (!done) {
+            uint32_t n;
+            if (buf.readptr(n) != nullptr) {
+                buf.advance(std::min(n, drain_chunk));
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    const uint32_t len = state.range_x();
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    while (state.KeepRunning()) {
+        const auto t0 = bm_clock::now();
+        ByteBuffer::IoVec vec[2];
+        const uint8_t n_vec = buf.reserve(vec, len);
+        uint32_t reserved = 0;
+        for (uint8_t i = 0; i < n_vec; i++) {
+            reserved += vec[i].len;
+        }
+        if (reserved == len) {
+            for (uint8_t i = 0; i < n_vec; i++) {
+                memset(vec[i].data, 0x55, vec[i].len);
+            }
+            buf.commit(len);
+            written += len;
+        } else {
+            buf.commit(0);
+            dropped++;
+        }
+        const auto t1 = bm_clock::now();
+        if (latency_ns.size() < latency_ns.capacity()) {
+            latency_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        }
+    }
+
+    done = true;
+    consumer.join();
+    report(state, latency_ns, written, dropped);
+}
+
+BENCHMARK(BM_ByteBufferLocked)->Arg(32)->Arg(128)->Arg(512);
+BENCHMARK(BM_SPSCByteBuffer)->Arg(32)->Arg(128)->Arg(512);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,186 @@
+/*
+ * This file is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This file is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <AP_gtest.h>
+
+#include <thread>
+#include <AP_HAL/utility/RingBuffer.h>
+
+TEST(SPSCByteBufferTest, RoundsSizeDown)
+{
+    SPSCByteBuffer buf(100);
+    EXPECT_EQ(64U, buf.get_size());
+    EXPECT_EQ(64U, buf.space());
+    EXPECT_TRUE(buf.empty());
+
+    EXPECT_TRUE(buf.set_size(48*1024));
+    EXPECT_EQ(32U*1024, buf.get_size());
+    EXPECT_TRUE(buf.set_size(64*1024));
+    EXPECT_EQ(64U*1024, buf.get_size());
+}
+
+TEST(SPSCByteBufferTest, WriteReadWrap)
+{
+    SPSCByteBuffer buf(16);
+    uint8_t in[12], out[12];
+    for (uint8_t i = 0; i < sizeof(in); i++) {
+        in[i] = i + 1;
+    }
+
+    // move the indexes so the next write wraps
+    EXPECT_EQ(10U, buf.write(in, 10));
+    EXPECT_EQ(10U, buf.read(out, 10));
+
+    EXPECT_EQ(12U, buf.write(in, 12));
+    EXPECT_EQ(4U, buf.space());
+    EXPECT_EQ(12U, buf.available());
+
+    ByteBuffer::IoVec vec[2];
+    EXPECT_EQ(2, buf.peekiovec(vec, 12));
+    EXPECT_EQ(6U, vec[0].len);
+    EXPECT_EQ(6U, vec[1].len);
+
+    EXPECT_EQ(12U, buf.read(out, sizeof(out)));
+    EXPECT_EQ(0, memcmp(in, out, sizeof(in)));
+    EXPECT_TRUE(buf.empty());
+}
+
+TEST(SPSCByteBufferTest, ReserveCommit)
+{
+    SPSCByteBuffer buf(8);
+    ByteBuffer::IoVec vec[2];
+
+    EXPECT_EQ(1, buf.reserve(vec, 5));
+    EXPECT_EQ(5U, vec[0].len);
+    memset(vec[0].data, 0x55, 3);
+    // nothing visible until commit
+    EXPECT_EQ(0U, buf.available());
+    EXPECT_TRUE(buf.commit(3));
+    EXPECT_EQ(3U, buf.available());
+
+    // can't reserve more than the space left
+    EXPECT_EQ(1, buf.reserve(vec, 20));
+    EXPECT_EQ(5U, vec[0].len);
+    EXPECT_FALSE(buf.commit(6));
+}
+
+TEST(SPSCByteBufferTest, NestedWriteRefused)
+{
+    SPSCByteBuffer buf(16);
+    ByteBuffer::IoVec vec[2];
+    const uint8_t nested[4] { 1, 2, 3, 4 };
+
+    EXPECT_EQ(1, buf.reserve(vec, 6));
+    EXPECT_TRUE(buf.reserve_open());
+    memset(vec[0].data, 0x55, 6);
+
+    // a write while the reservation is open must not land in the
+    // reserved space, nor close the reservation
+    EXPECT_EQ(0U, buf.write(nested, sizeof(nested)));
+    ByteBuffer::IoVec vec2[2];
+    EXPECT_EQ(0, buf.reserve(vec2, 2));
+    EXPECT_TRUE(buf.reserve_open());
+    EXPECT_EQ(0U, buf.available());
+
+    EXPECT_TRUE(buf.commit(6));
+    EXPECT_FALSE(buf.reserve_open());
+    uint8_t out[6];
+    const uint8_t expected[6] { 0x55, 0x55, 0x55, 0x55, 0x55, 0x55 };
+    EXPECT_EQ(6U, buf.read(out, sizeof(out)));
+    EXPECT_EQ(0, memcmp(expected, out, sizeof(out)));
+
+    // writes work again once it is committed
+    EXPECT_EQ(4U, buf.write(nested, sizeof(nested)));
+}
+
+TEST(SPSCByteBufferTest, AbandonReservation)
+{
+    SPSCByteBuffer buf(8);
+    ByteBuffer::IoVec vec[2];
+    const uint8_t in[3] { 7, 8, 9 };
+
+    EXPECT_EQ(1, buf.reserve(vec, 5));
+    EXPECT_TRUE(buf.commit(0));
+    EXPECT_FALSE(buf.reserve_open());
+    EXPECT_EQ(0U, buf.available());
+    EXPECT_EQ(3U, buf.write(in, sizeof(in)));
+    EXPECT_EQ(3U, buf.available());
+}
+
+TEST(SPSCByteBufferTest, Full)
+{
+    SPSCByteBuffer buf(8);
+    const uint8_t in[10] {};
+    EXPECT_EQ(8U, buf.write(in, sizeof(in)));
+    EXPECT_EQ(0U, buf.space());
+    EXPECT_EQ(0U, buf.write(in, 1));
+    EXPECT_TRUE(buf.advance(8));
+    EXPECT_FALSE(buf.advance(1));
+}
+
+TEST(SPSCObjectBufferTest, PushPopBatch)
+{
+    SPSCObjectBuffer<uint32_t> buf(5);
+    EXPECT_EQ(8U, buf.get_size());
+
+    const uint32_t in[10] { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    EXPECT_EQ(8U, buf.push(in, 10));
+    EXPECT_FALSE(buf.push(in[0]));
+
+    uint32_t v;
+    EXPECT_TRUE(buf.peek(v));
+    EXPECT_EQ(1U, v);
+    EXPECT_TRUE(buf.pop());
+
+    uint32_t out[10];
+    EXPECT_EQ(7U, buf.pop(out, 10));
+    EXPECT_EQ(2U, out[0]);
+    EXPECT_EQ(8U, out[6]);
+    EXPECT_FALSE(buf.pop(v));
+    EXPECT_TRUE(buf.empty());
+}
+
+TEST(SPSCObjectBufferTest, TwoThreads)
+{
+    SPSCObjectBuffer<uint32_t> buf(64);
+    const uint32_t count = 100000;
+
+    std::thread producer([&buf, count]() {
+        for (uint32_t i = 0; i < count; ) {
+            if (buf.push(i)) {
+                i++;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t expected = 0;
+    bool in_order = true;
+    while (expected < count) {
+        uint32_t v;
+        if (buf.pop(v)) {
+            in_order &= (v == expected);
+            expected++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    EXPECT_TRUE(in_order);
+    EXPECT_TRUE(buf.empty());
+}
+
+AP_GTEST_MAIN()
@@ -26,6 +26,8 @@
 #include <Filter/LowPassFilter2p.h>
 #include <Filter/LowPassFilter.h>
 #include <Filter/NotchFilter.h>
+#include <Filter/HarmonicNotchFilter.h>
+#include <AP_Math/fft.h>
 
 class AP_InertialSensor_Backend;
 class AuxiliaryBus;
@@ -212,6 +214,13 @@ public:
     // get the accel filter rate in Hz
     uint8_t get_accel_filter_hz(void) const { return _accel_filter_cutoff; }
 
+    // harmonic notch parameters, used by the vehicle to work out the
+    // tracked frequency
+    const HarmonicNotchFilterParams &get_gyro_harmonic_notch_params(void) const { return _harmonic_notch_filter; }
+
+    // set the base frequency of the gyro harmonic notch
+    void update_harmonic_notch_freq_hz(float freq_hz) { _calculated_harmonic_notch_freq_hz = freq_hz; }
+
     // indicate which bit in LOG_BITMASK indicates raw logging enabled
     void set_log_raw_bit(uint32_t log_raw_bit) { _log_raw_bit = log_raw_bit; }
 
@@ -321,13 +330,33 @@ public:
 
         enum batch_opt_t {
             BATCH_OPT_SENSOR_RATE = (1<<0),
+            BATCH_OPT_FFT         = (1<<1),
+            BATCH_OPT_FFT_ONLY    = (1<<2),
         };
 
+        // number of peaks reported per axis by the spectral analysis
+        static const uint8_t FFT_NUM_PEAKS = 3;
+        // number of bands in the coarse spectrum
+        static const uint8_t FFT_NUM_BANDS = 10;
+
         void rotate_to_next_sensor();
         void update_doing_sensor_rate_logging();
 
         bool should_log(uint8_t instance, IMU_SENSOR_TYPE type);
         void push_data_to_log();
+        void batch_complete();
+        float get_sample_rate() const;
+
+        // onboard spectral analysis of each batch
+        bool fft_enabled() const { return fft != nullptr && (_batch_options_mask & (BATCH_OPT_FFT|BATCH_OPT_FFT_ONLY)); }
+        bool raw_logging_enabled() const { return !(_batch_options_mask & BATCH_OPT_FFT_ONLY); }
+        void init_fft();
+        void update_fft();
+        void analyse_spectrum();
+
+        RealFFT *fft;
+        uint8_t fft_axis;         // axis being analysed, 3 when the batch is done
+        bool fft_running;         // a transform has been loaded
 
         uint64_t measurement_started_us;
 
@@ -405,6 +434,13 @@ private:
     // optional notch filter on gyro
     NotchFilterVector3fParam _notch_filter;
 
+    // optional harmonic notch filter on gyro, applied at the backend rate
+    HarmonicNotchFilterParams _harmonic_notch_filter;
+    HarmonicNotchFilterVector3f _gyro_harmonic_notch_filter[INS_MAX_INSTANCES];
+
+    // base frequency of the harmonic notch, as set by the vehicle
+    float _calculated_harmonic_notch_freq_hz;
+
     // Most recent gyro reading
     Vector3f _gyro[INS_MAX_INSTANCES];
     Vector3f _delta_angle[INS_MAX_INSTANCES];
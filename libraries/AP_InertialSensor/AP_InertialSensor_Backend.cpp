@@ -17,6 +17,14 @@ AP_InertialSensor_Backend::AP_InertialSensor_Backend(AP_InertialSensor &imu) :
     _sem = hal.util->new_semaphore();
 }
 
+AP_InertialSensor_Backend::~AP_InertialSensor_Backend(void)
+{
+    for (uint8_t i=0; i<INS_MAX_INSTANCES; i++) {
+        delete _gyro_pipeline[i];
+        delete _accel_pipeline[i];
+    }
+}
+
 /*
   notify of a FIFO reset so we don't use bad data to update observed sensor rate
  */
@@ -178,7 +186,59 @@ void AP_InertialSensor_Backend::_notify_new_gyro_raw_sample(uint8_t instance,
     // push gyros if optical flow present
     if (hal.opticalflow)
         hal.opticalflow->push_gyro(gyro.x, gyro.y, dt);
-    
+
+    if (_sem->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        _accumulate_gyro_sample(instance, gyro, dt);
+        _sem->give();
+    }
+
+    log_gyro_raw(instance, sample_us, gyro);
+}
+
+/*
+  pass a burst of FIFO gyro samples to the frontend
+ */
+void AP_InertialSensor_Backend::_notify_new_gyro_raw_samples(uint8_t instance,
+                                                             const Vector3f *gyro,
+                                                             uint16_t n)
+{
+    for (uint16_t i=0; i<n; i++) {
+        _update_sensor_rate(_imu._sample_gyro_count[instance], _imu._sample_gyro_start_us[instance],
+                            _imu._gyro_raw_sample_rates[instance]);
+    }
+
+    // don't accept below 100Hz
+    if (_imu._gyro_raw_sample_rates[instance] < 100) {
+        return;
+    }
+    const float dt = 1.0f / _imu._gyro_raw_sample_rates[instance];
+    _imu._gyro_last_sample_us[instance] = 0;
+
+    for (uint16_t i=0; i<n; i++) {
+#if AP_MODULE_SUPPORTED
+        // call gyro_sample hook if any
+        AP_Module::call_hook_gyro_sample(instance, dt, gyro[i]);
+#endif
+        // push gyros if optical flow present
+        if (hal.opticalflow) {
+            hal.opticalflow->push_gyro(gyro[i].x, gyro[i].y, dt);
+        }
+    }
+
+    if (_sem->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        for (uint16_t i=0; i<n; i++) {
+            _accumulate_gyro_sample(instance, gyro[i], dt);
+        }
+        _sem->give();
+    }
+
+    for (uint16_t i=0; i<n; i++) {
+        log_gyro_raw(instance, 0, gyro[i]);
+    }
+}
+
+void AP_InertialSensor_Backend::_accumulate_gyro_sample(uint8_t instance, const Vector3f &gyro, float dt)
+{
     // compute delta angle
     Vector3f delta_angle = (gyro + _imu._last_raw_gyro[instance]) * 0.5f * dt;
 
@@ -192,27 +252,28 @@ void AP_InertialSensor_Backend::_notify_new_gyro_raw_sample(uint8_t instance,
     delta_coning = delta_coning % delta_angle;
     delta_coning *= 0.5f;
 
-    if (_sem->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
-        // integrate delta angle accumulator
-        // the angles and coning corrections are accumulated separately in the
-        // referenced paper, but in simulation little difference was found between
-        // integrating together and integrating separately (see examples/coning.py)
-        _imu._delta_angle_acc[instance] += delta_angle + delta_coning;
-        _imu._delta_angle_acc_dt[instance] += dt;
-
-        // save previous delta angle for coning correction
-        _imu._last_delta_angle[instance] = delta_angle;
-        _imu._last_raw_gyro[instance] = gyro;
-
-        _imu._gyro_filtered[instance] = _imu._gyro_filter[instance].apply(gyro);
-        if (_imu._gyro_filtered[instance].is_nan() || _imu._gyro_filtered[instance].is_inf()) {
-            _imu._gyro_filter[instance].reset();
-        }
-        _imu._new_gyro_data[instance] = true;
-        _sem->give();
-    }
+    // integrate delta angle accumulator
+    // the angles and coning corrections are accumulated separately in the
+    // referenced paper, but in simulation little difference was found between
+    // integrating together and integrating separately (see examples/coning.py)
+    _imu._delta_angle_acc[instance] += delta_angle + delta_coning;
+    _imu._delta_angle_acc_dt[instance] += dt;
 
-    log_gyro_raw(instance, sample_us, gyro);
+    // save previous delta angle for coning correction
+    _imu._last_delta_angle[instance] = delta_angle;
+    _imu._last_raw_gyro[instance] = gyro;
+
+    Vector3f gyro_filtered = gyro;
+    if (_imu._harmonic_notch_filter.enabled() && !_pipeline_notch[instance].active) {
+        gyro_filtered = _imu._gyro_harmonic_notch_filter[instance].apply(gyro_filtered);
+    }
+    _imu._gyro_filtered[instance] = _imu._gyro_filter[instance].apply(gyro_filtered);
+    if (_imu._gyro_filtered[instance].is_nan() || _imu._gyro_filtered[instance].is_inf()) {
+        _imu._gyro_filter[instance].reset();
+        _imu._gyro_harmonic_notch_filter[instance].reset();
+        _last_harmonic_notch[instance].initialised = false;
+    }
+    _imu._new_gyro_data[instance] = true;
 }
 
 void AP_InertialSensor_Backend::log_gyro_raw(uint8_t instance, const uint64_t sample_us, const Vector3f &gyro)
@@ -311,22 +372,66 @@ void AP_InertialSensor_Backend::_notify_new_accel_raw_sample(uint8_t instance,
     _imu.calc_vibration_and_clipping(instance, accel, dt);
 
     if (_sem->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
-        // delta velocity
-        _imu._delta_velocity_acc[instance] += accel * dt;
-        _imu._delta_velocity_acc_dt[instance] += dt;
+        _accumulate_accel_sample(instance, accel, dt);
+        _sem->give();
+    }
 
-        _imu._accel_filtered[instance] = _imu._accel_filter[instance].apply(accel);
-        if (_imu._accel_filtered[instance].is_nan() || _imu._accel_filtered[instance].is_inf()) {
-            _imu._accel_filter[instance].reset();
-        }
+    log_accel_raw(instance, sample_us, accel);
+}
+
+/*
+  pass a burst of FIFO accel samples to the frontend
+ */
+void AP_InertialSensor_Backend::_notify_new_accel_raw_samples(uint8_t instance,
+                                                              const Vector3f *accel,
+                                                              uint16_t n)
+{
+    for (uint16_t i=0; i<n; i++) {
+        _update_sensor_rate(_imu._sample_accel_count[instance], _imu._sample_accel_start_us[instance],
+                            _imu._accel_raw_sample_rates[instance]);
+    }
+
+    // don't accept below 100Hz
+    if (_imu._accel_raw_sample_rates[instance] < 100) {
+        return;
+    }
+    const float dt = 1.0f / _imu._accel_raw_sample_rates[instance];
+    _imu._accel_last_sample_us[instance] = 0;
 
-        _imu.set_accel_peak_hold(instance, _imu._accel_filtered[instance]);
+    for (uint16_t i=0; i<n; i++) {
+#if AP_MODULE_SUPPORTED
+        // call accel_sample hook if any
+        AP_Module::call_hook_accel_sample(instance, dt, accel[i], false);
+#endif
+        _imu.calc_vibration_and_clipping(instance, accel[i], dt);
+    }
 
-        _imu._new_accel_data[instance] = true;
+    if (_sem->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        for (uint16_t i=0; i<n; i++) {
+            _accumulate_accel_sample(instance, accel[i], dt);
+        }
         _sem->give();
     }
 
-    log_accel_raw(instance, sample_us, accel);
+    for (uint16_t i=0; i<n; i++) {
+        log_accel_raw(instance, 0, accel[i]);
+    }
+}
+
+void AP_InertialSensor_Backend::_accumulate_accel_sample(uint8_t instance, const Vector3f &accel, float dt)
+{
+    // delta velocity
+    _imu._delta_velocity_acc[instance] += accel * dt;
+    _imu._delta_velocity_acc_dt[instance] += dt;
+
+    _imu._accel_filtered[instance] = _imu._accel_filter[instance].apply(accel);
+    if (_imu._accel_filtered[instance].is_nan() || _imu._accel_filtered[instance].is_inf()) {
+        _imu._accel_filter[instance].reset();
+    }
+
+    _imu.set_accel_peak_hold(instance, _imu._accel_filtered[instance]);
+
+    _imu._new_accel_data[instance] = true;
 }
 
 void AP_InertialSensor_Backend::_notify_new_accel_sensor_rate_sample(uint8_t instance, const Vector3f &accel)
@@ -346,6 +451,158 @@ void AP_InertialSensor_Backend::_notify_new_gyro_sensor_rate_sample(uint8_t inst
     _imu.batchsampler.sample(instance, AP_InertialSensor::IMU_SENSOR_TYPE_GYRO, AP_HAL::micros64(), gyro);
 }
 
+bool AP_InertialSensor_Backend::_setup_pipeline(AP_InertialSensor_SamplePipeline *&pipeline, float sensor_rate_hz,
+                                                uint8_t decimation, float lpf_cutoff_hz)
+{
+    if (pipeline == nullptr) {
+        pipeline = new AP_InertialSensor_SamplePipeline();
+        if (pipeline == nullptr) {
+            return false;
+        }
+    }
+    return pipeline->init(sensor_rate_hz, decimation, lpf_cutoff_hz);
+}
+
+bool AP_InertialSensor_Backend::_setup_gyro_pipeline(uint8_t instance, float sensor_rate_hz,
+                                                     uint8_t decimation, float lpf_cutoff_hz)
+{
+    if (instance >= INS_MAX_INSTANCES) {
+        return false;
+    }
+    return _setup_pipeline(_gyro_pipeline[instance], sensor_rate_hz, decimation, lpf_cutoff_hz);
+}
+
+bool AP_InertialSensor_Backend::_setup_accel_pipeline(uint8_t instance, float sensor_rate_hz,
+                                                      uint8_t decimation, float lpf_cutoff_hz)
+{
+    if (instance >= INS_MAX_INSTANCES) {
+        return false;
+    }
+    return _setup_pipeline(_accel_pipeline[instance], sensor_rate_hz, decimation, lpf_cutoff_hz);
+}
+
+/*
+  a fixed frequency harmonic notch is moved into the gyro pipeline,
+  one notch stage per harmonic, so it filters at the sensor rate
+  ahead of the decimator. A tracking notch stays at the raw sample
+  rate, where moving it is cheaper
+ */
+void AP_InertialSensor_Backend::_update_pipeline_notch(uint8_t instance)
+{
+    AP_InertialSensor_SamplePipeline *pipeline = _gyro_pipeline[instance];
+    const HarmonicNotchFilterParams &params = _imu._harmonic_notch_filter;
+
+    const bool want = params.enabled() &&
+        params.tracking_mode() == HarmonicNotchFilterParams::TRACKING_FIXED;
+    if (!want) {
+        if (_pipeline_notch[instance].active) {
+            for (uint8_t s=0; s<INS_PIPELINE_MAX_NOTCHES; s++) {
+                pipeline->set_notch(s, 0, 0, 0);
+            }
+            _pipeline_notch[instance].active = false;
+        }
+        return;
+    }
+
+    if (_pipeline_notch[instance].active &&
+        is_equal(_pipeline_notch[instance].center_freq_hz, params.center_freq_hz()) &&
+        is_equal(_pipeline_notch[instance].bandwidth_hz, params.bandwidth_hz()) &&
+        is_equal(_pipeline_notch[instance].attenuation_dB, params.attenuation_dB()) &&
+        _pipeline_notch[instance].harmonics == params.harmonics()) {
+        return;
+    }
+
+    // each harmonic's bandwidth scales with its frequency, as in
+    // HarmonicNotchFilter
+    for (uint8_t s=0; s<INS_PIPELINE_MAX_NOTCHES; s++) {
+        if (params.harmonics() & (1U<<s)) {
+            pipeline->set_notch(s, params.center_freq_hz() * (s+1),
+                                params.bandwidth_hz() * (s+1), params.attenuation_dB());
+        } else {
+            pipeline->set_notch(s, 0, 0, 0);
+        }
+    }
+    _pipeline_notch[instance].center_freq_hz = params.center_freq_hz();
+    _pipeline_notch[instance].bandwidth_hz = params.bandwidth_hz();
+    _pipeline_notch[instance].attenuation_dB = params.attenuation_dB();
+    _pipeline_notch[instance].harmonics = params.harmonics();
+    _pipeline_notch[instance].active = true;
+}
+
+/*
+  run a burst of sensor rate gyro samples through the pipeline for
+  the instance and pass the decimated samples to the frontend
+ */
+void AP_InertialSensor_Backend::_notify_new_gyro_sensor_rate_samples(uint8_t instance, const Vector3f *gyro, uint16_t n)
+{
+    AP_InertialSensor_SamplePipeline *pipeline = _gyro_pipeline[instance];
+    if (pipeline == nullptr) {
+        return;
+    }
+
+    _update_pipeline_notch(instance);
+
+    if (_imu.batchsampler.doing_sensor_rate_logging()) {
+        const uint64_t now = AP_HAL::micros64();
+        for (uint16_t i=0; i<n; i++) {
+            _imu.batchsampler.sample(instance, AP_InertialSensor::IMU_SENSOR_TYPE_GYRO, now, gyro[i]);
+        }
+    }
+
+    // push in ring sized pieces so a large burst is never dropped
+    Vector3f out[INS_PIPELINE_BLOCK_SIZE];
+    while (n > 0) {
+        const uint16_t burst = MIN(n, INS_PIPELINE_RING_SIZE);
+        pipeline->push(gyro, burst);
+        gyro += burst;
+        n -= burst;
+
+        uint16_t n_out;
+        while ((n_out = pipeline->process(out, ARRAY_SIZE(out))) > 0) {
+            for (uint16_t i=0; i<n_out; i++) {
+                _rotate_and_correct_gyro(instance, out[i]);
+            }
+            _notify_new_gyro_raw_samples(instance, out, n_out);
+        }
+    }
+}
+
+/*
+  run a burst of sensor rate accel samples through the pipeline for
+  the instance and pass the decimated samples to the frontend
+ */
+void AP_InertialSensor_Backend::_notify_new_accel_sensor_rate_samples(uint8_t instance, const Vector3f *accel, uint16_t n)
+{
+    AP_InertialSensor_SamplePipeline *pipeline = _accel_pipeline[instance];
+    if (pipeline == nullptr) {
+        return;
+    }
+
+    if (_imu.batchsampler.doing_sensor_rate_logging()) {
+        const uint64_t now = AP_HAL::micros64();
+        for (uint16_t i=0; i<n; i++) {
+            _imu.batchsampler.sample(instance, AP_InertialSensor::IMU_SENSOR_TYPE_ACCEL, now, accel[i]);
+        }
+    }
+
+    // push in ring sized pieces so a large burst is never dropped
+    Vector3f out[INS_PIPELINE_BLOCK_SIZE];
+    while (n > 0) {
+        const uint16_t burst = MIN(n, INS_PIPELINE_RING_SIZE);
+        pipeline->push(accel, burst);
+        accel += burst;
+        n -= burst;
+
+        uint16_t n_out;
+        while ((n_out = pipeline->process(out, ARRAY_SIZE(out))) > 0) {
+            for (uint16_t i=0; i<n_out; i++) {
+                _rotate_and_correct_accel(instance, out[i]);
+            }
+            _notify_new_accel_raw_samples(instance, out, n_out);
+        }
+    }
+}
+
 void AP_InertialSensor_Backend::log_accel_raw(uint8_t instance, const uint64_t sample_us, const Vector3f &accel)
 {
     DataFlash_Class *dataflash = DataFlash_Class::instance();
@@ -441,9 +698,55 @@ void AP_InertialSensor_Backend::update_gyro(uint8_t instance)
         _last_gyro_filter_hz[instance] = _gyro_filter_cutoff();
     }
 
+    update_harmonic_notch(instance);
+
     _sem->give();
 }
 
+/*
+  setup the harmonic notch of a gyro when its parameters change, or
+  move it to the frequency last given by the vehicle. Moving the
+  frequency only marks the coefficients as stale, they are recomputed
+  one harmonic per sample as the filter is applied
+ */
+void AP_InertialSensor_Backend::update_harmonic_notch(uint8_t instance)
+{
+    const HarmonicNotchFilterParams &params = _imu._harmonic_notch_filter;
+    HarmonicNotchFilterVector3f &filter = _imu._gyro_harmonic_notch_filter[instance];
+
+    if (!params.enabled()) {
+        if (_last_harmonic_notch[instance].initialised) {
+            filter.reset();
+            _last_harmonic_notch[instance].initialised = false;
+        }
+        return;
+    }
+
+    float center_freq_hz = _imu._calculated_harmonic_notch_freq_hz;
+    if (params.tracking_mode() == HarmonicNotchFilterParams::TRACKING_FIXED ||
+        center_freq_hz <= 0) {
+        center_freq_hz = params.center_freq_hz();
+    }
+
+    if (!_last_harmonic_notch[instance].initialised ||
+        !is_equal(_last_harmonic_notch[instance].bandwidth_hz, params.bandwidth_hz()) ||
+        !is_equal(_last_harmonic_notch[instance].attenuation_dB, params.attenuation_dB()) ||
+        _last_harmonic_notch[instance].harmonics != params.harmonics()) {
+        const float sample_rate = _gyro_raw_sample_rate(instance);
+        if (sample_rate <= 0) {
+            return;
+        }
+        filter.init(sample_rate, center_freq_hz, params.bandwidth_hz(),
+                    params.attenuation_dB(), params.harmonics());
+        _last_harmonic_notch[instance].bandwidth_hz = params.bandwidth_hz();
+        _last_harmonic_notch[instance].attenuation_dB = params.attenuation_dB();
+        _last_harmonic_notch[instance].harmonics = params.harmonics();
+        _last_harmonic_notch[instance].initialised = true;
+    } else {
+        filter.update(center_freq_hz);
+    }
+}
+
 /*
   common accel update function for all backends
  */
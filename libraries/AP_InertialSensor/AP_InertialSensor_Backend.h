@@ -27,6 +27,7 @@
 #include <AP_Math/AP_Math.h>
 
 #include "AP_InertialSensor.h"
+#include "AP_InertialSensor_SamplePipeline.h"
 
 #if CONFIG_HAL_BOARD == HAL_BOARD_F4LIGHT
 #include <AP_HAL_F4Light/AP_HAL_F4Light.h>
@@ -46,7 +47,7 @@ public:
 
     // we declare a virtual destructor so that drivers can
     // override with a custom destructor if need be.
-    virtual ~AP_InertialSensor_Backend(void) {}
+    virtual ~AP_InertialSensor_Backend(void);
 
     /*
      * Update the sensor data. Called by the frontend to transfer
@@ -140,6 +141,25 @@ protected:
     // sensors, and should be set to zero for FIFO based sensors
     void _notify_new_accel_raw_sample(uint8_t instance, const Vector3f &accel, uint64_t sample_us=0, bool fsync_set=false);
 
+    // FIFO based sensors can pass a whole burst of samples to the
+    // frontend, taking the semaphore once. The samples must be
+    // rotated and corrected and arrive at the raw sample rate
+    void _notify_new_gyro_raw_samples(uint8_t instance, const Vector3f *gyro, uint16_t n);
+    void _notify_new_accel_raw_samples(uint8_t instance, const Vector3f *accel, uint16_t n);
+
+    /*
+      sensor rate sample pipelines. A backend reading bursts of
+      samples faster than its raw sample rate sets up a pipeline per
+      instance, then pushes each burst in sensor frame. The burst is
+      filtered and decimated in one pass and the decimated samples
+      are rotated, corrected and given to the frontend with
+      _notify_new_gyro_raw_samples()
+     */
+    bool _setup_gyro_pipeline(uint8_t instance, float sensor_rate_hz, uint8_t decimation, float lpf_cutoff_hz);
+    bool _setup_accel_pipeline(uint8_t instance, float sensor_rate_hz, uint8_t decimation, float lpf_cutoff_hz);
+    void _notify_new_gyro_sensor_rate_samples(uint8_t instance, const Vector3f *gyro, uint16_t n);
+    void _notify_new_accel_sensor_rate_samples(uint8_t instance, const Vector3f *accel, uint16_t n);
+
     // set the amount of oversamping a accel is doing
     void _set_accel_oversampling(uint8_t instance, uint8_t n);
 
@@ -235,6 +255,17 @@ protected:
     int8_t _last_accel_filter_hz[INS_MAX_INSTANCES];
     int8_t _last_gyro_filter_hz[INS_MAX_INSTANCES];
 
+    // harmonic notch settings each gyro's filter was last set up with
+    struct {
+        float bandwidth_hz;
+        float attenuation_dB;
+        uint8_t harmonics;
+        bool initialised;
+    } _last_harmonic_notch[INS_MAX_INSTANCES] {};
+
+    // setup or move the harmonic notch of a gyro, called with _sem held
+    void update_harmonic_notch(uint8_t instance);
+
     void set_gyro_orientation(uint8_t instance, enum Rotation rotation) {
         _imu._gyro_orientation[instance] = rotation;
     }
@@ -271,6 +302,31 @@ protected:
 
 private:
 
+    // integrate and filter one raw sample, called with _sem held
+    void _accumulate_gyro_sample(uint8_t instance, const Vector3f &gyro, float dt);
+    void _accumulate_accel_sample(uint8_t instance, const Vector3f &accel, float dt);
+
+    bool _setup_pipeline(AP_InertialSensor_SamplePipeline *&pipeline, float sensor_rate_hz, uint8_t decimation, float lpf_cutoff_hz);
+
+    AP_InertialSensor_SamplePipeline *_gyro_pipeline[INS_MAX_INSTANCES] {};
+    AP_InertialSensor_SamplePipeline *_accel_pipeline[INS_MAX_INSTANCES] {};
+
+    // harmonic notch settings each gyro pipeline's notch stages were
+    // last set up with. While active the fixed frequency harmonic
+    // notch runs at the sensor rate in the pipeline, rather than at
+    // the raw sample rate
+    struct {
+        float center_freq_hz;
+        float bandwidth_hz;
+        float attenuation_dB;
+        uint8_t harmonics;
+        bool active;
+    } _pipeline_notch[INS_MAX_INSTANCES] {};
+
+    // setup the notch stages of a gyro pipeline from the harmonic
+    // notch parameters, called from the backend thread
+    void _update_pipeline_notch(uint8_t instance);
+
     bool should_log_imu_raw() const;
     void log_accel_raw(uint8_t instance, const uint64_t sample_us, const Vector3f &accel);
     void log_gyro_raw(uint8_t instance, const uint64_t sample_us, const Vector3f &gryo);
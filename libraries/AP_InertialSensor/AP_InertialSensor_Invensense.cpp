@@ -327,10 +327,17 @@ void AP_InertialSensor_Invensense::start()
     set_gyro_orientation(_gyro_instance, _rotation);
     set_accel_orientation(_accel_instance, _rotation);
 
-    // setup scale factors for fifo data after downsampling
-    _fifo_accel_scale = _accel_scale / (MAX(_fifo_downsample_rate,2)/2);
-    _fifo_gyro_scale = GYRO_SCALE / _fifo_downsample_rate;
-    
+    if (_fast_sampling) {
+        // gyros are sampled at 8kHz and accels at 4kHz, then low
+        // pass filtered and averaged down to the backend rate
+        if (!_setup_gyro_pipeline(_gyro_instance, _backend_rate_hz * _fifo_downsample_rate,
+                                  _fifo_downsample_rate, 188) ||
+            !_setup_accel_pipeline(_accel_instance, _backend_rate_hz * _fifo_downsample_rate / 2,
+                                   MAX(_fifo_downsample_rate,2)/2, 188)) {
+            AP_HAL::panic("Invensense: Unable to allocate sample pipeline");
+        }
+    }
+
     // allocate fifo buffer
     _fifo_buffer = (uint8_t *)hal.util->malloc_type(MPU_FIFO_BUFFER_LEN * MPU_SAMPLE_SIZE, AP_HAL::Util::MEM_DMA_SAFE);
     if (_fifo_buffer == nullptr) {
@@ -442,7 +449,8 @@ bool AP_InertialSensor_Invensense::_accumulate(uint8_t *samples, uint8_t n_sampl
 /*
   when doing fast sampling the sensor gives us 8k samples/second. Every 2nd accel sample is a duplicate.
 
-  To filter this we first apply a 1p low pass filter at 188Hz, then we
+  The samples of each FIFO burst are handed to the backend sample
+  pipelines, which apply a 1p low pass filter at 188Hz and then
   average over 8 samples to bring the data rate down to 1kHz. This
   gives very good aliasing rejection at frequencies well above what
   can be handled with 1kHz sample rates.
@@ -453,7 +461,11 @@ bool AP_InertialSensor_Invensense::_accumulate_sensor_rate_sampling(uint8_t *sam
     const int32_t clip_limit = AP_INERTIAL_SENSOR_ACCEL_CLIP_THRESH_MSS / _accel_scale;
     bool clipped = false;
     bool ret = true;
-    
+    Vector3f accel[MPU_FIFO_BUFFER_LEN];
+    Vector3f gyro[MPU_FIFO_BUFFER_LEN];
+    uint8_t n_accel = 0;
+    uint8_t n_gyro = 0;
+
     for (uint8_t i = 0; i < n_samples; i++) {
         const uint8_t *data = samples + MPU_SAMPLE_SIZE * i;
 
@@ -467,7 +479,7 @@ bool AP_InertialSensor_Invensense::_accumulate_sensor_rate_sampling(uint8_t *sam
         }
         tsum += t2;
 
-        if ((_accum.count & 1) == 0) {
+        if ((_fifo_sample_count & 1) == 0) {
             // accel data is at 4kHz
             Vector3f a(int16_val(data, 1),
                        int16_val(data, 0),
@@ -477,38 +489,20 @@ bool AP_InertialSensor_Invensense::_accumulate_sensor_rate_sampling(uint8_t *sam
                 fabsf(a.z) > clip_limit) {
                 clipped = true;
             }
-            _accum.accel += _accum.accel_filter.apply(a);
-            Vector3f a2 = a * _accel_scale;
-            _notify_new_accel_sensor_rate_sample(_accel_instance, a2);
+            accel[n_accel++] = a * _accel_scale;
         }
 
         Vector3f g(int16_val(data, 5),
                    int16_val(data, 4),
                    -int16_val(data, 6));
+        gyro[n_gyro++] = g * GYRO_SCALE;
 
-        Vector3f g2 = g * GYRO_SCALE;
-        _notify_new_gyro_sensor_rate_sample(_gyro_instance, g2);
-
-        _accum.gyro += _accum.gyro_filter.apply(g);
-        _accum.count++;
-
-        if (_accum.count == _fifo_downsample_rate) {
-
-            _accum.accel *= _fifo_accel_scale;
-            _accum.gyro *= _fifo_gyro_scale;
-            
-            _rotate_and_correct_accel(_accel_instance, _accum.accel);
-            _rotate_and_correct_gyro(_gyro_instance, _accum.gyro);
-            
-            _notify_new_accel_raw_sample(_accel_instance, _accum.accel, 0, false);
-            _notify_new_gyro_raw_sample(_gyro_instance, _accum.gyro);
-            
-            _accum.accel.zero();
-            _accum.gyro.zero();
-            _accum.count = 0;
-        }
+        _fifo_sample_count++;
     }
 
+    _notify_new_accel_sensor_rate_samples(_accel_instance, accel, n_accel);
+    _notify_new_gyro_sensor_rate_samples(_gyro_instance, gyro, n_gyro);
+
     if (clipped) {
         increment_clip_count(_accel_instance);
     }
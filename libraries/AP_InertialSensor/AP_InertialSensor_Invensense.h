@@ -117,8 +117,6 @@ private:
     float _temp_filtered;
     float _accel_scale;
 
-    float _fifo_accel_scale;
-    float _fifo_gyro_scale;
     LowPassFilter2pFloat _temp_filter;
 
     enum Rotation _rotation;
@@ -146,16 +144,11 @@ private:
     uint8_t *_fifo_buffer;
 
     /*
-      accumulators for sensor_rate sampling
+      count of samples read when doing sensor rate sampling, used to
+      pick out the 4kHz accel samples
       See description in _accumulate_sensor_rate_sampling()
     */
-    struct {
-        Vector3f accel;
-        Vector3f gyro;
-        uint8_t count;
-        LowPassFilterVector3f accel_filter{4000, 188};
-        LowPassFilterVector3f gyro_filter{8000, 188};
-    } _accum;
+    uint8_t _fifo_sample_count = 0;
 };
 
 class AP_Invensense_AuxiliaryBusSlave : public AuxiliaryBusSlave
@@ -0,0 +1,110 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AP_InertialSensor_SamplePipeline.h"
+
+AP_InertialSensor_SamplePipeline::~AP_InertialSensor_SamplePipeline(void)
+{
+    delete _ring;
+}
+
+bool AP_InertialSensor_SamplePipeline::init(float sensor_rate_hz, uint8_t decimation, float lpf_cutoff_hz)
+{
+    if (_ring == nullptr) {
+        _ring = new SPSCObjectBuffer<Vector3f>(INS_PIPELINE_RING_SIZE);
+        if (_ring == nullptr || _ring->get_size() == 0) {
+            delete _ring;
+            _ring = nullptr;
+            return false;
+        }
+    }
+
+    _sensor_rate_hz = sensor_rate_hz;
+    _decimation = MAX(decimation, 1);
+    _lpf.set_cutoff_frequency(sensor_rate_hz, lpf_cutoff_hz);
+    _sum.zero();
+    _count = 0;
+    return true;
+}
+
+void AP_InertialSensor_SamplePipeline::set_notch(uint8_t stage, float center_freq_hz, float bandwidth_hz, float attenuation_dB)
+{
+    if (stage >= INS_PIPELINE_MAX_NOTCHES) {
+        return;
+    }
+    const uint8_t bit = 1U<<stage;
+    // the notch design needs the lower edge of the band to be above
+    // zero and the center to be below the nyquist frequency
+    if (center_freq_hz <= bandwidth_hz * 0.5f ||
+        center_freq_hz >= _sensor_rate_hz * 0.5f) {
+        _notch_mask &= ~bit;
+        return;
+    }
+    _notch[stage].init(_sensor_rate_hz, center_freq_hz, bandwidth_hz, attenuation_dB);
+    _notch_mask |= bit;
+}
+
+bool AP_InertialSensor_SamplePipeline::push(const Vector3f *samples, uint16_t n)
+{
+    if (_ring == nullptr) {
+        return false;
+    }
+    const uint32_t pushed = _ring->push(samples, n);
+    if (pushed < n) {
+        _dropped += n - pushed;
+        return false;
+    }
+    return true;
+}
+
+uint16_t AP_InertialSensor_SamplePipeline::process(Vector3f *out, uint16_t max_out)
+{
+    if (_ring == nullptr) {
+        return 0;
+    }
+
+    uint16_t n_out = 0;
+    Vector3f block[INS_PIPELINE_BLOCK_SIZE];
+
+    while (n_out < max_out) {
+        // don't take more samples than we have room to output
+        const uint32_t room = (max_out - n_out) * (uint32_t)_decimation - _count;
+        const uint32_t n = _ring->pop(block, MIN(room, (uint32_t)INS_PIPELINE_BLOCK_SIZE));
+        if (n == 0) {
+            break;
+        }
+
+        for (uint8_t s=0; s<INS_PIPELINE_MAX_NOTCHES; s++) {
+            if (!(_notch_mask & (1U<<s))) {
+                continue;
+            }
+            NotchFilterVector3f &notch = _notch[s];
+            for (uint32_t i=0; i<n; i++) {
+                block[i] = notch.apply(block[i]);
+            }
+        }
+
+        for (uint32_t i=0; i<n; i++) {
+            _sum += _lpf.apply(block[i]);
+            if (++_count == _decimation) {
+                out[n_out++] = _sum / _decimation;
+                _sum.zero();
+                _count = 0;
+            }
+        }
+    }
+
+    return n_out;
+}
@@ -0,0 +1,102 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  sample pipeline for IMUs whose FIFO runs faster than the rate at
+  which samples are given to the frontend, such as the 8kHz gyro of
+  the Invensense parts.
+
+  The driver pushes each FIFO burst into a per-instance ring, and
+  process() then runs the queued samples through the filter chain a
+  block at a time: each enabled notch stage runs over the whole block,
+  followed by the anti-alias low pass filter and an averaging
+  decimator. Keeping each stage in its own loop over a contiguous
+  block avoids per-sample call and locking overhead and keeps the
+  inner loops simple enough for the compiler to vectorise.
+ */
+#pragma once
+
+#include <AP_Math/AP_Math.h>
+#include <AP_HAL/utility/RingBuffer.h>
+#include <Filter/LowPassFilter.h>
+#include <Filter/NotchFilter.h>
+
+// number of notch stages ahead of the decimator
+#define INS_PIPELINE_MAX_NOTCHES 4
+
+// number of samples run through the chain in one block
+#define INS_PIPELINE_BLOCK_SIZE 16
+
+// largest burst that can be queued before process() is called
+#define INS_PIPELINE_RING_SIZE 64
+
+class AP_InertialSensor_SamplePipeline
+{
+public:
+    AP_InertialSensor_SamplePipeline(void) {}
+    ~AP_InertialSensor_SamplePipeline(void);
+
+    /* Do not allow copies */
+    AP_InertialSensor_SamplePipeline(const AP_InertialSensor_SamplePipeline &other) = delete;
+    AP_InertialSensor_SamplePipeline &operator=(const AP_InertialSensor_SamplePipeline&) = delete;
+
+    /*
+      setup for samples arriving at sensor_rate_hz, to be low pass
+      filtered at lpf_cutoff_hz and averaged over decimation
+      samples. Returns false if the ring can't be allocated
+     */
+    bool init(float sensor_rate_hz, uint8_t decimation, float lpf_cutoff_hz);
+
+    /*
+      configure a notch stage, running at the sensor rate. A center
+      frequency of zero disables the stage
+     */
+    void set_notch(uint8_t stage, float center_freq_hz, float bandwidth_hz, float attenuation_dB);
+
+    // queue a burst of samples. Returns false if some were dropped
+    bool push(const Vector3f *samples, uint16_t n);
+
+    /*
+      run queued samples through the filter chain, writing at most
+      max_out decimated samples to out. Returns the number written
+     */
+    uint16_t process(Vector3f *out, uint16_t max_out);
+
+    // rate of the samples pushed into the pipeline
+    float get_sensor_rate_hz(void) const { return _sensor_rate_hz; }
+
+    // number of input samples per output sample
+    uint8_t get_decimation(void) const { return _decimation; }
+
+    // number of samples dropped because the ring was full
+    uint32_t get_dropped(void) const { return _dropped; }
+
+private:
+    SPSCObjectBuffer<Vector3f> *_ring = nullptr;
+
+    float _sensor_rate_hz = 0;
+    uint8_t _decimation = 1;
+
+    NotchFilterVector3f _notch[INS_PIPELINE_MAX_NOTCHES];
+    uint8_t _notch_mask = 0;
+
+    LowPassFilterVector3f _lpf;
+
+    // decimator state
+    Vector3f _sum;
+    uint8_t _count = 0;
+
+    uint32_t _dropped = 0;
+};
@@ -20,8 +20,8 @@ const AP_Param::GroupInfo AP_InertialSensor::BatchSampler::var_info[] = {
 
     // @Param: BAT_OPT
     // @DisplayName: Batch Logging Options Mask
-    // @Description: Options for the BatchSampler
-    // @Bitmask: 0:Sensor-Rate Logging (sample at full sensor rate seen by AP)
+    // @Description: Options for the BatchSampler. Onboard FFT analyses each batch on the vehicle, logging and sending over MAVLink the peak frequencies and a coarse spectrum. FFT only does the analysis without logging the raw samples. The FFT options take effect after a reboot
+    // @Bitmask: 0:Sensor-Rate Logging (sample at full sensor rate seen by AP),1:Onboard FFT,2:FFT only
     // @User: Advanced
     AP_GROUPINFO("BAT_OPT",  3, AP_InertialSensor::BatchSampler, _batch_options_mask, 0),
 
@@ -71,17 +71,181 @@ void AP_InertialSensor::BatchSampler::init()
         return;
     }
 
+    init_fft();
+
     rotate_to_next_sensor();
 
     initialised = true;
 }
 
+/*
+  allocate the FFT used for onboard analysis. The transform size is
+  the largest power of two which fits in a batch
+ */
+void AP_InertialSensor::BatchSampler::init_fft()
+{
+    if (!(_batch_options_mask & (BATCH_OPT_FFT|BATCH_OPT_FFT_ONLY))) {
+        return;
+    }
+    uint16_t n = FFT_MAX_SIZE;
+    while (n > _required_count) {
+        n /= 2;
+    }
+    fft = new RealFFT();
+    if (fft == nullptr || !fft->init(n)) {
+        delete fft;
+        fft = nullptr;
+        gcs().send_text(MAV_SEVERITY_WARNING, "Failed to allocate IMU batch FFT");
+    }
+}
+
 void AP_InertialSensor::BatchSampler::periodic()
 {
     if (_sensor_mask == 0) {
         return;
     }
+    if (!initialised) {
+        return;
+    }
+    update_fft();
     push_data_to_log();
+
+    // move on once the batch has been both logged and analysed
+    if (data_read_offset >= _required_count &&
+        (!fft_enabled() || fft_axis >= 3)) {
+        batch_complete();
+    }
+}
+
+void AP_InertialSensor::BatchSampler::batch_complete()
+{
+    data_read_offset = 0;
+    isb_seqnum++;
+    isbh_sent = false;
+    fft_axis = 0;
+    fft_running = false;
+    // rotate to next instance:
+    rotate_to_next_sensor();
+    data_write_offset = 0; // unlocks writing process
+}
+
+float AP_InertialSensor::BatchSampler::get_sample_rate() const
+{
+    float sample_rate = 0; // avoid warning about uninitialised values
+    switch(type) {
+    case IMU_SENSOR_TYPE_GYRO:
+        sample_rate = _imu._gyro_raw_sample_rates[instance];
+        if (_doing_sensor_rate_logging) {
+            sample_rate *= _imu._gyro_over_sampling[instance];
+        }
+        break;
+    case IMU_SENSOR_TYPE_ACCEL:
+        sample_rate = _imu._accel_raw_sample_rates[instance];
+        if (_doing_sensor_rate_logging) {
+            sample_rate *= _imu._accel_over_sampling[instance];
+        }
+        break;
+    }
+    return sample_rate;
+}
+
+/*
+  run one step of the spectral analysis of a complete batch. Each call
+  either windows one axis into the FFT, runs one butterfly stage, or
+  finishes the transform and reports on the spectrum, so the cost per
+  call stays small
+ */
+void AP_InertialSensor::BatchSampler::update_fft()
+{
+    if (!fft_enabled() || fft_axis >= 3) {
+        return;
+    }
+    if (data_write_offset < _required_count) {
+        // batch still being collected
+        return;
+    }
+    if (!fft_running) {
+        const int16_t *data[3] { data_x, data_y, data_z };
+        fft->load(data[fft_axis], 1.0f / multiplier);
+        fft_running = true;
+        return;
+    }
+    if (!fft->step()) {
+        return;
+    }
+    analyse_spectrum();
+    fft_running = false;
+    fft_axis++;
+}
+
+/*
+  find the strongest peaks and the energy in each band of the
+  spectrum of the current axis, then log them and send them to the
+  GCS
+ */
+void AP_InertialSensor::BatchSampler::analyse_spectrum()
+{
+    const float *power = fft->get_power();
+    const uint16_t num_bins = fft->get_num_bins();
+    const float sample_rate = get_sample_rate();
+    const float bin_hz = sample_rate / fft->get_size();
+
+    // skip the DC bin and its window leakage
+    const uint16_t first_bin = 2;
+
+    float peak_freq[FFT_NUM_PEAKS] {};
+    float peak_energy[FFT_NUM_PEAKS] {};
+    float bands[FFT_NUM_BANDS] {};
+    float total_energy = 0;
+
+    for (uint16_t k=first_bin; k<num_bins; k++) {
+        total_energy += power[k];
+        bands[(uint32_t)(k-first_bin) * FFT_NUM_BANDS / (num_bins-first_bin)] += power[k];
+
+        if (k+1 >= num_bins || power[k] <= power[k-1] || power[k] < power[k+1]) {
+            continue;
+        }
+        // local maximum. The Hann window spreads a tone over three
+        // bins, so sum those for its energy and interpolate its
+        // frequency with a parabola through them
+        const float energy = power[k-1] + power[k] + power[k+1];
+        const float denom = power[k-1] - 2*power[k] + power[k+1];
+        const float delta = is_zero(denom) ? 0 : 0.5f * (power[k-1] - power[k+1]) / denom;
+        for (uint8_t p=0; p<FFT_NUM_PEAKS; p++) {
+            if (energy > peak_energy[p]) {
+                for (uint8_t q=FFT_NUM_PEAKS-1; q>p; q--) {
+                    peak_energy[q] = peak_energy[q-1];
+                    peak_freq[q] = peak_freq[q-1];
+                }
+                peak_energy[p] = energy;
+                peak_freq[p] = (k + delta) * bin_hz;
+                break;
+            }
+        }
+    }
+
+    DataFlash_Class *dataflash = DataFlash_Class::instance();
+    if (dataflash != nullptr) {
+        dataflash->Log_Write_ISFP(isb_seqnum, type, instance, fft_axis, sample_rate,
+                                  peak_freq, peak_energy, total_energy);
+        dataflash->Log_Write_ISFB(isb_seqnum, type, instance, fft_axis, bands);
+    }
+
+    // e.g. FFTG0X for the first gyro's X axis
+    const char sensor = type == IMU_SENSOR_TYPE_GYRO ? 'G' : 'A';
+    const char axis = "XYZ"[fft_axis];
+    char name[10];
+    hal.util->snprintf(name, sizeof(name), "FFT%c%u%c", sensor, (unsigned)instance, axis);
+    gcs().send_named_float(name, peak_freq[0]);
+    hal.util->snprintf(name, sizeof(name), "FFT%c%u%cE", sensor, (unsigned)instance, axis);
+    gcs().send_named_float(name, peak_energy[0]);
+
+    // the coarse spectrum, one value per band, e.g. FFTG0XB0 to
+    // FFTG0XB9, each band covering an equal share of the bins above DC
+    for (uint8_t b=0; b<FFT_NUM_BANDS; b++) {
+        hal.util->snprintf(name, sizeof(name), "FFT%c%u%cB%u", sensor, (unsigned)instance, axis, (unsigned)b);
+        gcs().send_named_float(name, bands[b]);
+    }
 }
 
 void AP_InertialSensor::BatchSampler::update_doing_sensor_rate_logging()
@@ -168,6 +332,13 @@ void AP_InertialSensor::BatchSampler::push_data_to_log()
     if (_sensor_mask == 0) {
         return;
     }
+    if (!raw_logging_enabled()) {
+        // the batch is only used for the onboard FFT
+        if (data_write_offset >= _required_count) {
+            data_read_offset = _required_count;
+        }
+        return;
+    }
     if (data_write_offset - data_read_offset < samples_per_msg) {
         // insuffucient data to pack a packet
         return;
@@ -184,28 +355,13 @@ void AP_InertialSensor::BatchSampler::push_data_to_log()
 
     // possibly send isb header:
     if (!isbh_sent && data_read_offset == 0) {
-        float sample_rate = 0; // avoid warning about uninitialised values
-        switch(type) {
-        case IMU_SENSOR_TYPE_GYRO:
-            sample_rate = _imu._gyro_raw_sample_rates[instance];
-            if (_doing_sensor_rate_logging) {
-                sample_rate *= _imu._gyro_over_sampling[instance];
-            }
-            break;
-        case IMU_SENSOR_TYPE_ACCEL:
-            sample_rate = _imu._accel_raw_sample_rates[instance];
-            if (_doing_sensor_rate_logging) {
-                sample_rate *= _imu._accel_over_sampling[instance];
-            }
-            break;
-        }
         if (!dataflash->Log_Write_ISBH(isb_seqnum,
                                        type,
                                        instance,
                                        multiplier,
                                        _required_count,
                                        measurement_started_us,
-                                       sample_rate)) {
+                                       get_sample_rate())) {
             // buffer full?
             return;
         }
@@ -222,15 +378,6 @@ void AP_InertialSensor::BatchSampler::push_data_to_log()
     }
     data_read_offset += samples_per_msg;
     last_sent_ms = AP_HAL::millis();
-    if (data_read_offset >= _required_count) {
-        // that was the last one.  Clean up:
-        data_read_offset = 0;
-        isb_seqnum++;
-        isbh_sent = false;
-        // rotate to next instance:
-        rotate_to_next_sensor();
-        data_write_offset = 0; // unlocks writing process
-    }
 }
 
 bool AP_InertialSensor::BatchSampler::should_log(uint8_t _instance, IMU_SENSOR_TYPE _type)
@@ -255,7 +402,7 @@ bool AP_InertialSensor::BatchSampler::should_log(uint8_t _instance, IMU_SENSOR_T
         return false;
     }
 #define MASK_LOG_ANY                    0xFFFF
-    if (!dataflash->should_log(MASK_LOG_ANY)) {
+    if (raw_logging_enabled() && !dataflash->should_log(MASK_LOG_ANY)) {
         return false;
     }
     return true;
@@ -90,6 +90,9 @@ bool inverse4x4(float m[],float invOut[]);
 // matrix multiplication of two NxN matrices
 float *mat_mul(float *A, float *B, uint8_t n);
 
+// largest matrix inverse() accepts
+#define MATRIX_INVERSE_MAX_DIM 16
+
 // matrix algebra
 bool inverse(float x[], float y[], uint16_t dim);
 
@@ -0,0 +1,48 @@
+#include <AP_gbenchmark.h>
+
+#include <AP_Math/AP_Math.h>
+#include <AP_Math/fft.h>
+
+static int16_t samples[FFT_MAX_SIZE];
+
+static void fill_samples(uint16_t n)
+{
+    for (uint16_t i=0; i<n; i++) {
+        samples[i] = 1000 * sinf(2 * M_PI * 80 * i / 1000.0f) +
+                     300 * sinf(2 * M_PI * 160 * i / 1000.0f);
+    }
+}
+
+// a complete transform, including windowing the batch
+static void BM_RealFFT(benchmark::State& state)
+{
+    const uint16_t n = state.range_x();
+    RealFFT fft;
+    fft.init(n);
+    fill_samples(n);
+
+    while (state.KeepRunning()) {
+        fft.load(samples, 0.001f);
+        fft.run();
+        gbenchmark_escape(const_cast<float *>(fft.get_power()));
+    }
+}
+
+// windowing a batch into the transform, the first time sliced step
+static void BM_RealFFTLoad(benchmark::State& state)
+{
+    const uint16_t n = state.range_x();
+    RealFFT fft;
+    fft.init(n);
+    fill_samples(n);
+
+    while (state.KeepRunning()) {
+        fft.load(samples, 0.001f);
+        gbenchmark_escape(&fft);
+    }
+}
+
+BENCHMARK(BM_RealFFT)->Arg(256)->Arg(512)->Arg(1024);
+BENCHMARK(BM_RealFFTLoad)->Arg(256)->Arg(512)->Arg(1024);
+
+BENCHMARK_MAIN()
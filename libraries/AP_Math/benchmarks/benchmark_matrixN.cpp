@@ -0,0 +1,105 @@
+#include <AP_gbenchmark.h>
+
+#include <AP_Math/AP_Math.h>
+#include <AP_Math/vectorN.h>
+
+// normal equations as built by the calibrators
+template <uint8_t N>
+static void make_normal_equations(MatrixN<float,N> &A, VectorN<float,N> &b)
+{
+    for (uint16_t s = 0; s < 100; s++) {
+        VectorN<float,N> jacob;
+        for (uint8_t i = 0; i < N; i++) {
+            jacob[i] = sinf(1.3f * s + 0.7f * i) + (i == s % N ? 1.0f : 0.0f);
+        }
+        A.add_outer_lower(jacob);
+        b += jacob * cosf(0.1f * s);
+    }
+    A.add_diagonal(1.0f);
+    A.mirror_lower();
+}
+
+// the solve the calibrators did before: invert, then multiply
+template <uint8_t N>
+static void BM_InverseSolve(benchmark::State& state)
+{
+    MatrixN<float,N> A;
+    VectorN<float,N> b;
+    make_normal_equations(A, b);
+    float a[N*N];
+    for (uint8_t i = 0; i < N; i++) {
+        for (uint8_t j = 0; j < N; j++) {
+            a[i*N+j] = A[i][j];
+        }
+    }
+
+    while (state.KeepRunning()) {
+        float inv[N*N];
+        VectorN<float,N> x;
+        inverse(a, inv, N);
+        for (uint8_t i = 0; i < N; i++) {
+            for (uint8_t j = 0; j < N; j++) {
+                x[i] += inv[i*N+j] * b[j];
+            }
+        }
+        gbenchmark_escape(&x);
+    }
+}
+
+template <uint8_t N>
+static void BM_LDLTSolve(benchmark::State& state)
+{
+    MatrixN<float,N> A;
+    VectorN<float,N> b;
+    make_normal_equations(A, b);
+
+    while (state.KeepRunning()) {
+        MatrixN<float,N> f = A;
+        VectorN<float,N> x = b;
+        f.ldlt_decompose();
+        f.ldlt_solve(x);
+        gbenchmark_escape(&x);
+    }
+}
+
+template <uint8_t N>
+static void BM_CholeskySolve(benchmark::State& state)
+{
+    MatrixN<float,N> A;
+    VectorN<float,N> b;
+    make_normal_equations(A, b);
+
+    while (state.KeepRunning()) {
+        MatrixN<float,N> f = A;
+        VectorN<float,N> x = b;
+        f.cholesky_decompose();
+        f.cholesky_solve(x);
+        gbenchmark_escape(&x);
+    }
+}
+
+// accumulating JTJ for one sample
+template <uint8_t N>
+static void BM_AddOuterLower(benchmark::State& state)
+{
+    MatrixN<float,N> A;
+    VectorN<float,N> jacob;
+    for (uint8_t i = 0; i < N; i++) {
+        jacob[i] = 0.1f * i;
+    }
+
+    while (state.KeepRunning()) {
+        A.add_outer_lower(jacob);
+        gbenchmark_escape(&A);
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_InverseSolve, 4);
+BENCHMARK_TEMPLATE(BM_LDLTSolve, 4);
+BENCHMARK_TEMPLATE(BM_CholeskySolve, 4);
+BENCHMARK_TEMPLATE(BM_InverseSolve, 9);
+BENCHMARK_TEMPLATE(BM_LDLTSolve, 9);
+BENCHMARK_TEMPLATE(BM_CholeskySolve, 9);
+BENCHMARK_TEMPLATE(BM_AddOuterLower, 9);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,198 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AP_Math.h"
+#include "fft.h"
+
+RealFFT::~RealFFT(void)
+{
+    delete[] _buf;
+    delete[] _twiddle;
+    delete[] _power;
+    delete[] _bitrev;
+}
+
+bool RealFFT::init(uint16_t n)
+{
+    if (n < 16 || n > FFT_MAX_SIZE || (n & (n-1)) != 0) {
+        return false;
+    }
+    if (n == _n) {
+        return true;
+    }
+
+    delete[] _buf;
+    delete[] _twiddle;
+    delete[] _power;
+    delete[] _bitrev;
+    _n = 0;
+
+    const uint16_t m = n / 2;
+    _buf = new float[2*m];
+    _twiddle = new float[2*m];
+    _power = new float[m];
+    _bitrev = new uint16_t[m];
+    if (_buf == nullptr || _twiddle == nullptr || _power == nullptr || _bitrev == nullptr) {
+        delete[] _buf;
+        delete[] _twiddle;
+        delete[] _power;
+        delete[] _bitrev;
+        _buf = _twiddle = _power = nullptr;
+        _bitrev = nullptr;
+        return false;
+    }
+
+    for (uint16_t k=0; k<m; k++) {
+        const float angle = 2 * M_PI * k / n;
+        _twiddle[2*k] = cosf(angle);
+        _twiddle[2*k+1] = sinf(angle);
+        _power[k] = 0;
+    }
+
+    _log2m = 0;
+    while ((1U<<_log2m) < m) {
+        _log2m++;
+    }
+    for (uint16_t j=0; j<m; j++) {
+        uint16_t r = 0;
+        for (uint8_t b=0; b<_log2m; b++) {
+            r |= ((j >> b) & 1) << (_log2m - 1 - b);
+        }
+        _bitrev[j] = r;
+    }
+    _n = n;
+    _stage = _log2m + 1;
+    return true;
+}
+
+/*
+  periodic Hann window, built from the twiddle table
+ */
+float RealFFT::window(uint16_t i) const
+{
+    const uint16_t m = _n / 2;
+    const float c = i < m ? _twiddle[2*i] : -_twiddle[2*(i-m)];
+    return 0.5f * (1 - c);
+}
+
+/*
+  window the samples and pack even samples into the real and odd
+  samples into the imaginary parts of the complex input, in bit
+  reversed order ready for the butterflies
+ */
+void RealFFT::load(const int16_t *samples, float scale)
+{
+    if (_n == 0) {
+        return;
+    }
+    const uint16_t m = _n / 2;
+    for (uint16_t j=0; j<m; j++) {
+        const uint16_t r = _bitrev[j];
+        _buf[2*r] = samples[2*j] * scale * window(2*j);
+        _buf[2*r+1] = samples[2*j+1] * scale * window(2*j+1);
+    }
+    _stage = 0;
+}
+
+void RealFFT::load(const float *samples)
+{
+    if (_n == 0) {
+        return;
+    }
+    const uint16_t m = _n / 2;
+    for (uint16_t j=0; j<m; j++) {
+        const uint16_t r = _bitrev[j];
+        _buf[2*r] = samples[2*j] * window(2*j);
+        _buf[2*r+1] = samples[2*j+1] * window(2*j+1);
+    }
+    _stage = 0;
+}
+
+/*
+  one radix 2 stage of the n/2 point complex transform
+ */
+void RealFFT::butterflies(uint8_t stage)
+{
+    const uint16_t m = _n / 2;
+    const uint16_t half = 1U << stage;
+    const uint16_t len = half * 2;
+    // twiddle for butterfly j of this stage is exp(-2*pi*i*j/len),
+    // which is entry j*n/len of the table
+    const uint16_t tw_step = _n / len;
+
+    for (uint16_t start=0; start<m; start+=len) {
+        float *a = &_buf[2*start];
+        float *b = &_buf[2*(start+half)];
+        for (uint16_t j=0; j<half; j++) {
+            const float wr = _twiddle[2*j*tw_step];
+            const float wi = -_twiddle[2*j*tw_step+1];
+            const float br = b[2*j];
+            const float bi = b[2*j+1];
+            const float tr = br*wr - bi*wi;
+            const float ti = br*wi + bi*wr;
+            b[2*j]   = a[2*j] - tr;
+            b[2*j+1] = a[2*j+1] - ti;
+            a[2*j]   += tr;
+            a[2*j+1] += ti;
+        }
+    }
+}
+
+/*
+  recover the spectrum of the real input from the complex transform
+  Z of the packed samples:
+    X[k] = (Z[k] + conj(Z[m-k]))/2 - i*exp(-2*pi*i*k/n)*(Z[k] - conj(Z[m-k]))/2
+ */
+void RealFFT::split(void)
+{
+    const uint16_t m = _n / 2;
+    // amplitude of a sine is |X| * 4 / n with a Hann window
+    const float scale = sq(4.0f / _n);
+
+    for (uint16_t k=0; k<m; k++) {
+        const uint16_t k2 = k == 0 ? 0 : m - k;
+        const float zr = _buf[2*k];
+        const float zi = _buf[2*k+1];
+        const float cr = _buf[2*k2];
+        const float ci = -_buf[2*k2+1];
+
+        // even and odd sample spectra
+        const float er = 0.5f * (zr + cr);
+        const float ei = 0.5f * (zi + ci);
+        const float dr = 0.5f * (zr - cr);
+        const float di = 0.5f * (zi - ci);
+        const float or_ = di;
+        const float oi = -dr;
+
+        const float wr = _twiddle[2*k];
+        const float wi = -_twiddle[2*k+1];
+        const float xr = er + or_*wr - oi*wi;
+        const float xi = ei + or_*wi + oi*wr;
+        _power[k] = (xr*xr + xi*xi) * scale;
+    }
+}
+
+bool RealFFT::step(void)
+{
+    if (_stage < _log2m) {
+        butterflies(_stage++);
+        return false;
+    }
+    if (_stage == _log2m) {
+        split();
+        _stage++;
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+
+// largest transform supported, in real samples
+#define FFT_MAX_SIZE 1024
+
+/*
+  power spectrum of a block of real samples, using a Hann window.
+
+  The n real samples are packed into an n/2 point complex transform
+  (radix 2, decimation in time) which is then split into the spectrum
+  of the real input. The work is broken into steps of one butterfly
+  stage each, so the transform can be spread over several calls from
+  a periodic task: step() returns true once the spectrum is ready.
+
+  Bin k of the spectrum is at k * sample_rate / n Hz. Powers are
+  scaled so that a sine wave of amplitude A centred on a bin gives a
+  power of A^2 in that bin.
+ */
+class RealFFT {
+public:
+    RealFFT(void) {}
+    ~RealFFT(void);
+
+    /* Do not allow copies */
+    RealFFT(const RealFFT &other) = delete;
+    RealFFT &operator=(const RealFFT&) = delete;
+
+    // allocate tables for n point transforms. n must be a power of
+    // two between 16 and FFT_MAX_SIZE
+    bool init(uint16_t n);
+
+    // number of real samples per transform
+    uint16_t get_size(void) const { return _n; }
+
+    // number of bins in the power spectrum
+    uint16_t get_num_bins(void) const { return _n / 2; }
+
+    // start a transform of n samples, each multiplied by scale
+    void load(const int16_t *samples, float scale);
+    void load(const float *samples);
+
+    // run the next step of the transform, returns true when done
+    bool step(void);
+
+    // run the remaining steps of the transform
+    void run(void) {
+        while (!step()) {}
+    }
+
+    // power spectrum, valid once step() has returned true
+    const float *get_power(void) const { return _power; }
+
+private:
+    float window(uint16_t i) const;
+    void butterflies(uint8_t stage);
+    void split(void);
+
+    uint16_t _n = 0;
+    uint8_t _log2m = 0;         // log2 of the complex transform size
+    uint8_t _stage = 0;         // next step to run
+
+    float *_buf = nullptr;      // n/2 complex values, interleaved real and imaginary
+    float *_twiddle = nullptr;  // cos and sin of 2*pi*k/n for k < n/2, interleaved
+    float *_power = nullptr;    // n/2 bins
+    uint16_t *_bitrev = nullptr;// bit reversed index of each complex input
+};
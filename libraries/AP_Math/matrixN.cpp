@@ -54,7 +54,146 @@ void MatrixN<T,N>::force_symmetry(void)
     }
 }
 
+// add A*A' to the lower triangle
+template <typename T, uint8_t N>
+void MatrixN<T,N>::add_outer_lower(const VectorN<T,N> &A)
+{
+    for (uint8_t i = 0; i < N; i++) {
+        for (uint8_t j = 0; j <= i; j++) {
+            v[i][j] += A[i] * A[j];
+        }
+    }
+}
+
+// add d to the diagonal
+template <typename T, uint8_t N>
+void MatrixN<T,N>::add_diagonal(T d)
+{
+    for (uint8_t i = 0; i < N; i++) {
+        v[i][i] += d;
+    }
+}
+
+// copy the lower triangle into the upper triangle
+template <typename T, uint8_t N>
+void MatrixN<T,N>::mirror_lower(void)
+{
+    for (uint8_t i = 0; i < N; i++) {
+        for (uint8_t j = 0; j < i; j++) {
+            v[j][i] = v[i][j];
+        }
+    }
+}
+
+/*
+  LDL' factorisation, column by column:
+    D[j] = A[j][j] - sum(L[j][k]^2 * D[k])
+    L[i][j] = (A[i][j] - sum(L[i][k] * L[j][k] * D[k])) / D[j]
+ */
+template <typename T, uint8_t N>
+bool MatrixN<T,N>::ldlt_decompose(void)
+{
+    for (uint8_t j = 0; j < N; j++) {
+        // L[j][k] * D[k] for this row, so it is computed once
+        T ld[N];
+        T d = v[j][j];
+        for (uint8_t k = 0; k < j; k++) {
+            ld[k] = v[j][k] * v[k][k];
+            d -= v[j][k] * ld[k];
+        }
+        if (!(d > 0) || isinf(d)) {
+            return false;
+        }
+        v[j][j] = d;
+        const T inv_d = 1 / d;
+        for (uint8_t i = j+1; i < N; i++) {
+            T sum = v[i][j];
+            for (uint8_t k = 0; k < j; k++) {
+                sum -= v[i][k] * ld[k];
+            }
+            v[i][j] = sum * inv_d;
+        }
+    }
+    return true;
+}
+
+// forward substitution with L, scaling by D, then back substitution with L'
+template <typename T, uint8_t N>
+void MatrixN<T,N>::ldlt_solve(VectorN<T,N> &x) const
+{
+    for (uint8_t i = 0; i < N; i++) {
+        for (uint8_t k = 0; k < i; k++) {
+            x[i] -= v[i][k] * x[k];
+        }
+    }
+    for (uint8_t i = 0; i < N; i++) {
+        x[i] /= v[i][i];
+    }
+    for (int8_t i = N-1; i >= 0; i--) {
+        for (uint8_t k = i+1; k < N; k++) {
+            x[i] -= v[k][i] * x[k];
+        }
+    }
+}
+
+// Cholesky-Banachiewicz, row by row
+template <typename T, uint8_t N>
+bool MatrixN<T,N>::cholesky_decompose(void)
+{
+    for (uint8_t i = 0; i < N; i++) {
+        for (uint8_t j = 0; j < i; j++) {
+            T sum = v[i][j];
+            for (uint8_t k = 0; k < j; k++) {
+                sum -= v[i][k] * v[j][k];
+            }
+            v[i][j] = sum / v[j][j];
+        }
+        T d = v[i][i];
+        for (uint8_t k = 0; k < i; k++) {
+            d -= v[i][k] * v[i][k];
+        }
+        if (!(d > 0) || isinf(d)) {
+            return false;
+        }
+        v[i][i] = sqrtf(d);
+    }
+    return true;
+}
+
+// forward substitution with L then back substitution with L'
+template <typename T, uint8_t N>
+void MatrixN<T,N>::cholesky_solve(VectorN<T,N> &x) const
+{
+    for (uint8_t i = 0; i < N; i++) {
+        for (uint8_t k = 0; k < i; k++) {
+            x[i] -= v[i][k] * x[k];
+        }
+        x[i] /= v[i][i];
+    }
+    for (int8_t i = N-1; i >= 0; i--) {
+        for (uint8_t k = i+1; k < N; k++) {
+            x[i] -= v[k][i] * x[k];
+        }
+        x[i] /= v[i][i];
+    }
+}
+
 template void MatrixN<float,4>::mult(const VectorN<float,4> &A, const VectorN<float,4> &B);
 template MatrixN<float,4> &MatrixN<float,4>::operator -=(const MatrixN<float,4> &B);
 template MatrixN<float,4> &MatrixN<float,4>::operator +=(const MatrixN<float,4> &B);
 template void MatrixN<float,4>::force_symmetry(void);
+template void MatrixN<float,4>::add_outer_lower(const VectorN<float,4> &A);
+template void MatrixN<float,4>::add_diagonal(float d);
+template void MatrixN<float,4>::mirror_lower(void);
+template bool MatrixN<float,4>::ldlt_decompose(void);
+template void MatrixN<float,4>::ldlt_solve(VectorN<float,4> &x) const;
+template bool MatrixN<float,4>::cholesky_decompose(void);
+template void MatrixN<float,4>::cholesky_solve(VectorN<float,4> &x) const;
+
+template void MatrixN<float,9>::add_outer_lower(const VectorN<float,9> &A);
+template void MatrixN<float,9>::add_diagonal(float d);
+template void MatrixN<float,9>::mirror_lower(void);
+template bool MatrixN<float,9>::ldlt_decompose(void);
+template void MatrixN<float,9>::ldlt_solve(VectorN<float,9> &x) const;
+template bool MatrixN<float,9>::cholesky_decompose(void);
+template void MatrixN<float,9>::cholesky_solve(VectorN<float,9> &x) const;
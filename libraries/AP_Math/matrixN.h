@@ -43,6 +43,38 @@ public:
     // Matrix symmetry routine
     void force_symmetry(void);
 
+    // row access
+    T *operator[](uint8_t i) {
+        return v[i];
+    }
+    const T *operator[](uint8_t i) const {
+        return v[i];
+    }
+
+    // add A*A' to the lower triangle. Used to build the normal
+    // equations of a least squares fit one sample at a time
+    void add_outer_lower(const VectorN<T,N> &A);
+
+    // add d to each element of the diagonal
+    void add_diagonal(T d);
+
+    // copy the lower triangle into the upper triangle
+    void mirror_lower(void);
+
+    /*
+      factorise a symmetric positive definite matrix in place, reading
+      only the lower triangle. LDLT leaves L (unit diagonal) below the
+      diagonal and D on it; Cholesky leaves L with L*L' = A in the
+      lower triangle. Both return false if the matrix is not positive
+      definite, leaving it partly factorised
+     */
+    bool ldlt_decompose(void);
+    bool cholesky_decompose(void);
+
+    // solve A*x = b in place in x, using a factorised matrix
+    void ldlt_solve(VectorN<T,N> &x) const;
+    void cholesky_solve(VectorN<T,N> &x) const;
+
 private:
     T v[N][N];
 };
@@ -39,18 +39,24 @@ extern const AP_HAL::HAL& hal;
  *    @returns                multiplied matrix i.e. A*B
  */
 
-float* mat_mul(float *A, float *B, uint8_t n)
+static void mat_mul(const float *A, const float *B, float *ret, uint8_t n)
 {
-    float* ret = new float[n*n];
     memset(ret,0.0f,n*n*sizeof(float));
 
     for(uint8_t i = 0; i < n; i++) {
-        for(uint8_t j = 0; j < n; j++) {
-            for(uint8_t k = 0;k < n; k++) {
-                ret[i*n + j] += A[i*n + k] * B[k*n + j];
+        for(uint8_t k = 0;k < n; k++) {
+            const float a = A[i*n + k];
+            for(uint8_t j = 0; j < n; j++) {
+                ret[i*n + j] += a * B[k*n + j];
             }
         }
     }
+}
+
+float* mat_mul(float *A, float *B, uint8_t n)
+{
+    float* ret = new float[n*n];
+    mat_mul(A, B, ret, n);
     return ret;
 }
 
@@ -145,17 +151,18 @@ static void mat_back_sub(float *U, float *out, uint8_t n)
  *    ref: http://rosettacode.org/wiki/LU_decomposition
  *    @param     U,           upper triangular matrix
  *    @param     out,         Output inverted upper triangular matrix
+ *    @param     APrime,      n*n scratch space
  *    @param     n,           dimension of matrix
  */
 
-static void mat_LU_decompose(float* A, float* L, float* U, float *P, uint8_t n)
+static void mat_LU_decompose(float* A, float* L, float* U, float *P, float *APrime, uint8_t n)
 {
     memset(L,0,n*n*sizeof(float));
     memset(U,0,n*n*sizeof(float));
     memset(P,0,n*n*sizeof(float));
     mat_pivot(A,P,n);
 
-    float *APrime = mat_mul(P,A,n);
+    mat_mul(P,A,APrime,n);
     for(uint8_t i = 0; i < n; i++) {
         L[i*n + i] = 1;
     }
@@ -176,7 +183,6 @@ static void mat_LU_decompose(float* A, float* L, float* U, float *P, uint8_t n)
             }
         }
     }
-    delete[] APrime;
 }
 
 /*
@@ -190,15 +196,21 @@ static void mat_LU_decompose(float* A, float* L, float* U, float *P, uint8_t n)
  */
 static bool mat_inverse(float* A, float* inv, uint8_t n)
 {
-    float *L, *U, *P;
+    // one scratch allocation for all the intermediate matrices
+    const uint16_t nn = n*n;
+    float *scratch = new float[5*nn];
+    if (scratch == nullptr) {
+        return false;
+    }
+    float *L = &scratch[0];
+    float *U = &scratch[nn];
+    float *P = &scratch[2*nn];
+    float *L_inv = &scratch[3*nn];
+    float *U_inv = &scratch[4*nn];
     bool ret = true;
-    L = new float[n*n];
-    U = new float[n*n];
-    P = new float[n*n];
-    mat_LU_decompose(A,L,U,P,n);
 
-    float *L_inv = new float[n*n];
-    float *U_inv = new float[n*n];
+    // L_inv is free until the substitutions below
+    mat_LU_decompose(A,L,U,P,L_inv,n);
 
     memset(L_inv,0,n*n*sizeof(float));
     mat_forward_sub(L,L_inv,n);
@@ -206,12 +218,11 @@ static bool mat_inverse(float* A, float* inv, uint8_t n)
     memset(U_inv,0,n*n*sizeof(float));
     mat_back_sub(U,U_inv,n);
 
-    // decomposed matrices no longer required
-    delete[] L;
-    delete[] U;
-
-    float *inv_unpivoted = mat_mul(U_inv,L_inv,n);
-    float *inv_pivoted = mat_mul(inv_unpivoted, P, n);
+    // L and U are reused for the products
+    float *inv_unpivoted = L;
+    float *inv_pivoted = U;
+    mat_mul(U_inv,L_inv,inv_unpivoted,n);
+    mat_mul(inv_unpivoted,P,inv_pivoted,n);
 
     //check sanity of results
     for(uint8_t i = 0; i < n; i++) {
@@ -222,13 +233,7 @@ static bool mat_inverse(float* A, float* inv, uint8_t n)
         }
     }
     memcpy(inv,inv_pivoted,n*n*sizeof(float));
-
-    //free memory
-    delete[] inv_pivoted;
-    delete[] inv_unpivoted;
-    delete[] P;
-    delete[] U_inv;
-    delete[] L_inv;
+    delete[] scratch;
     return ret;
 }
 
@@ -432,6 +437,9 @@ bool inverse4x4(float m[],float invOut[])
  */
 bool inverse(float x[], float y[], uint16_t dim)
 {
+    if (dim == 0 || dim > MATRIX_INVERSE_MAX_DIM) {
+        return false;
+    }
     switch(dim){
         case 3: return inverse3x3(x,y);
         case 4: return inverse4x4(x,y);
@@ -0,0 +1,82 @@
+#include <AP_gtest.h>
+
+#include <AP_Math/AP_Math.h>
+#include <AP_Math/fft.h>
+
+static void make_sine(float *samples, uint16_t n, float sample_rate, float freq, float amplitude)
+{
+    for (uint16_t i=0; i<n; i++) {
+        samples[i] = amplitude * sinf(2 * M_PI * freq * i / sample_rate);
+    }
+}
+
+TEST(RealFFTTest, InitSizes)
+{
+    RealFFT fft;
+    EXPECT_FALSE(fft.init(8));
+    EXPECT_FALSE(fft.init(100));
+    EXPECT_FALSE(fft.init(2*FFT_MAX_SIZE));
+    EXPECT_TRUE(fft.init(256));
+    EXPECT_EQ(256, fft.get_size());
+    EXPECT_EQ(128, fft.get_num_bins());
+}
+
+TEST(RealFFTTest, SinePeak)
+{
+    const uint16_t n = 512;
+    const float sample_rate = 1000;
+    float samples[n];
+    RealFFT fft;
+    ASSERT_TRUE(fft.init(n));
+
+    // a sine centred on bin 41
+    const float freq = 41 * sample_rate / n;
+    make_sine(samples, n, sample_rate, freq, 2.0f);
+    fft.load(samples);
+    fft.run();
+
+    const float *power = fft.get_power();
+    uint16_t peak = 0;
+    for (uint16_t k=1; k<fft.get_num_bins(); k++) {
+        if (power[k] > power[peak]) {
+            peak = k;
+        }
+    }
+    EXPECT_EQ(41, peak);
+    EXPECT_NEAR(4.0f, power[peak], 0.01f);
+    // the Hann window leaks into the neighbouring bins only
+    EXPECT_LT(power[45], 1e-4f);
+    EXPECT_LT(power[37], 1e-4f);
+}
+
+TEST(RealFFTTest, StepwiseMatchesInt16)
+{
+    const uint16_t n = 256;
+    const float sample_rate = 2000;
+    float samples[n];
+    int16_t isamples[n];
+    make_sine(samples, n, sample_rate, 300, 1.0f);
+    for (uint16_t i=0; i<n; i++) {
+        isamples[i] = samples[i] * 1000;
+    }
+
+    RealFFT f1, f2;
+    ASSERT_TRUE(f1.init(n));
+    ASSERT_TRUE(f2.init(n));
+    f1.load(samples);
+    f1.run();
+
+    // one butterfly stage per step, then the split
+    f2.load(isamples, 0.001f);
+    uint8_t steps = 1;
+    while (!f2.step()) {
+        steps++;
+    }
+    EXPECT_EQ(8, steps);
+
+    for (uint16_t k=0; k<f1.get_num_bins(); k++) {
+        EXPECT_NEAR(f1.get_power()[k], f2.get_power()[k], 1e-3f);
+    }
+}
+
+AP_GTEST_MAIN()
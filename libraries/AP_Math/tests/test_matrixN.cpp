@@ -0,0 +1,116 @@
+#include <AP_gtest.h>
+
+#include <AP_Math/AP_Math.h>
+#include <AP_Math/vectorN.h>
+
+// normal equations of a fixed, well conditioned set of samples
+template <uint8_t N>
+static void make_spd(MatrixN<float,N> &A)
+{
+    for (uint8_t s = 0; s < 3*N; s++) {
+        VectorN<float,N> row;
+        for (uint8_t i = 0; i < N; i++) {
+            row[i] = sinf(1.3f * s + 0.7f * i) + (i == s % N ? 1.0f : 0.0f);
+        }
+        A.add_outer_lower(row);
+    }
+    A.add_diagonal(0.1f);
+    A.mirror_lower();
+}
+
+template <uint8_t N>
+static void make_x(VectorN<float,N> &x)
+{
+    for (uint8_t i = 0; i < N; i++) {
+        x[i] = 0.5f * i - 1.0f;
+    }
+}
+
+template <uint8_t N>
+static void check_solvers(void)
+{
+    MatrixN<float,N> A;
+    make_spd(A);
+    VectorN<float,N> x;
+    make_x(x);
+    VectorN<float,N> b;
+    b.mult(A, x);
+
+    MatrixN<float,N> ldlt = A;
+    ASSERT_TRUE(ldlt.ldlt_decompose());
+    VectorN<float,N> x_ldlt = b;
+    ldlt.ldlt_solve(x_ldlt);
+
+    MatrixN<float,N> chol = A;
+    ASSERT_TRUE(chol.cholesky_decompose());
+    VectorN<float,N> x_chol = b;
+    chol.cholesky_solve(x_chol);
+
+    for (uint8_t i = 0; i < N; i++) {
+        EXPECT_NEAR(x[i], x_ldlt[i], 1e-3f);
+        EXPECT_NEAR(x[i], x_chol[i], 1e-3f);
+    }
+}
+
+TEST(MatrixNTest, SolveSPD4)
+{
+    check_solvers<4>();
+}
+
+TEST(MatrixNTest, SolveSPD9)
+{
+    check_solvers<9>();
+}
+
+// the solvers should agree with the general inverse
+TEST(MatrixNTest, MatchesInverse)
+{
+    MatrixN<float,9> A;
+    make_spd(A);
+    VectorN<float,9> b;
+    make_x(b);
+
+    float a[81], inv[81];
+    for (uint8_t i = 0; i < 9; i++) {
+        for (uint8_t j = 0; j < 9; j++) {
+            a[i*9+j] = A[i][j];
+        }
+    }
+    ASSERT_TRUE(inverse(a, inv, 9));
+
+    VectorN<float,9> x = b;
+    ASSERT_TRUE(A.ldlt_decompose());
+    A.ldlt_solve(x);
+
+    for (uint8_t i = 0; i < 9; i++) {
+        float expected = 0;
+        for (uint8_t j = 0; j < 9; j++) {
+            expected += inv[i*9+j] * b[j];
+        }
+        EXPECT_NEAR(expected, x[i], 1e-3f);
+    }
+}
+
+TEST(MatrixNTest, InverseRejectsLargeSizes)
+{
+    float a[1], inv[1];
+    EXPECT_FALSE(inverse(a, inv, 0));
+    EXPECT_FALSE(inverse(a, inv, MATRIX_INVERSE_MAX_DIM+1));
+    EXPECT_FALSE(inverse(a, inv, 255));
+}
+
+TEST(MatrixNTest, NotPositiveDefinite)
+{
+    MatrixN<float,4> A;
+    A.add_diagonal(1.0f);
+    A[2][2] = -1.0f;
+    MatrixN<float,4> B = A;
+    EXPECT_FALSE(A.ldlt_decompose());
+    EXPECT_FALSE(B.cholesky_decompose());
+
+    // singular
+    MatrixN<float,4> C;
+    EXPECT_FALSE(C.ldlt_decompose());
+}
+
+AP_GTEST_MAIN()
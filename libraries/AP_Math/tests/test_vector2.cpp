@@ -15,4 +15,22 @@ TEST(Vector2Test, IsEqual)
     EXPECT_TRUE(v_float1 == v_float1);
 }
 
+TEST(Vector2Test, CircleSegmentIntersection)
+{
+    Vector2f intersection;
+
+    // through the circle, the near side is hit
+    EXPECT_TRUE(Vector2f::circle_segment_intersection(Vector2f(0, 0), Vector2f(10, 0), Vector2f(5, 0), 1, intersection));
+    EXPECT_FLOAT_EQ(4.0f, intersection.x);
+    EXPECT_FLOAT_EQ(0.0f, intersection.y);
+
+    // from inside, where the segment leaves
+    EXPECT_TRUE(Vector2f::circle_segment_intersection(Vector2f(0, 0), Vector2f(10, 0), Vector2f(0, 0), 3, intersection));
+    EXPECT_FLOAT_EQ(3.0f, intersection.x);
+
+    // falling short and completely inside
+    EXPECT_FALSE(Vector2f::circle_segment_intersection(Vector2f(0, 0), Vector2f(3, 0), Vector2f(5, 0), 1, intersection));
+    EXPECT_FALSE(Vector2f::circle_segment_intersection(Vector2f(0, 0), Vector2f(1, 0), Vector2f(0, 0), 3, intersection));
+}
+
 AP_GTEST_MAIN()
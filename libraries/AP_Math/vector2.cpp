@@ -204,8 +204,8 @@ bool Vector2<T>::circle_segment_intersection(const Vector2<T>& seg_start, const
     }
 
     const float delta_sqrt = safe_sqrt(delta);
-    const float t1 = (-b + delta_sqrt) / (2.0f * a);
-    const float t2 = (-b - delta_sqrt) / (2.0f * a);
+    const float t1 = (-b - delta_sqrt) / (2.0f * a);
+    const float t2 = (-b + delta_sqrt) / (2.0f * a);
 
     // Three hit cases:
     //          -o->             --|-->  |            |  --|->
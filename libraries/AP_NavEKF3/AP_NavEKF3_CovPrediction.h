@@ -0,0 +1,232 @@
+// EKF covariance prediction kernel
+
+#pragma once
+
+#include <AP_Math/AP_Math.h>
+
+/*
+  Propagates the 24 state covariance through the inertial state
+  transition, nextP = F*P*transpose(F) + G*Q*transpose(G)
+
+  The transition matrix F only differs from identity in rows 0 to 9
+  (quaternion, velocity and position), and each of those rows only
+  has a few non-zero terms. Rather than expanding the product for
+  every element as the generated code does, F*P is formed once for
+  the ten kinematic rows using the sparse rows of F, and the result
+  is multiplied by transpose(F) again using the sparse rows.
+
+  Only the upper triangle (nextP[i][j] with i <= j) of the states up
+  to stateIndexLim is written, matching the layout expected by
+  NavEKF3_core::CovariancePrediction(). Bias terms are skipped when
+  the corresponding states are inhibited as their covariances are
+  held at zero.
+ */
+class ekf3_cov_prediction_t
+{
+public:
+    struct inputs_t {
+        Quaternion quat;        // attitude quaternion
+        Vector3f delAng;        // delta angle (rad)
+        Vector3f delVel;        // delta velocity (m/s)
+        Vector3f delAngBias;    // delta angle bias (rad)
+        Vector3f delVelBias;    // delta velocity bias (m/s)
+        float dt;               // prediction time step (sec)
+        float dAngVar;          // delta angle noise variance (rad^2)
+        float dVelVar;          // delta velocity noise variance (m/s)^2
+        bool delAngBiasActive;  // true when the delta angle bias states are being estimated
+        bool delVelBiasActive;  // true when the delta velocity bias states are being estimated
+    };
+
+    // predict the upper triangle of nextP from P for states 0 to stateIndexLim
+    template <typename matrix_type>
+    void predict(const matrix_type &P, matrix_type &nextP, const inputs_t &in, uint8_t stateIndexLim)
+    {
+        set_transition(in);
+
+        // F*P for the kinematic rows. P is symmetric so column j of P
+        // can be read from row j
+        float col[10];
+        for (uint8_t j=0; j<=stateIndexLim; j++) {
+            transition(P[j], col);
+            for (uint8_t i=0; i<=9; i++) {
+                FP[i][j] = col[i];
+            }
+        }
+
+        // F*P*transpose(F) for the kinematic block. Column i of the
+        // result is F applied to row i of F*P
+        for (uint8_t i=0; i<=9; i++) {
+            transition(FP[i], col);
+            for (uint8_t k=0; k<=i; k++) {
+                nextP[k][i] = col[k];
+            }
+        }
+
+        // the remaining states have an identity transition
+        for (uint8_t j=10; j<=stateIndexLim; j++) {
+            for (uint8_t i=0; i<=9; i++) {
+                nextP[i][j] = FP[i][j];
+            }
+            for (uint8_t i=10; i<=j; i++) {
+                nextP[i][j] = P[i][j];
+            }
+        }
+
+        add_imu_noise(nextP, in);
+    }
+
+private:
+    // rows 0 to 9 of F*P, only columns up to stateIndexLim are valid
+    float FP[10][24];
+
+    // non-unity terms of the kinematic rows of the state transition matrix
+    float SF[6];
+    float SPP[10];
+    float halfQuat[4];
+    float dt;
+    bool delAngBiasActive;
+    bool delVelBiasActive;
+
+    void set_transition(const inputs_t &in)
+    {
+        const float q0 = in.quat[0];
+        const float q1 = in.quat[1];
+        const float q2 = in.quat[2];
+        const float q3 = in.quat[3];
+        const Vector3f dAng = in.delAng - in.delAngBias;
+        const Vector3f dVel = in.delVel - in.delVelBias;
+
+        // half the corrected delta angle
+        SF[0] = 0.5f*dAng.x;
+        SF[1] = 0.5f*dAng.y;
+        SF[2] = 0.5f*dAng.z;
+
+        // derivative of the rotated delta velocity with respect to the quaternion
+        SF[3] = 2*q1*dVel.x + 2*q2*dVel.y + 2*q3*dVel.z;
+        SF[4] = 2*q0*dVel.y - 2*q1*dVel.z + 2*q3*dVel.x;
+        SF[5] = 2*q0*dVel.x + 2*q2*dVel.z - 2*q3*dVel.y;
+
+        SPP[0] = 2*q1*dVel.y + 2*q0*dVel.z - 2*q2*dVel.x;
+
+        // body to earth rotation matrix terms
+        const float q0sq = sq(q0);
+        const float q1sq = sq(q1);
+        const float q2sq = sq(q2);
+        const float q3sq = sq(q3);
+        SPP[1] = q3sq - q2sq - q1sq + q0sq;
+        SPP[2] = q3sq - q2sq + q1sq - q0sq;
+        SPP[3] = q3sq + q2sq - q1sq - q0sq;
+        SPP[4] = 2*q0*q2 - 2*q1*q3;
+        SPP[5] = 2*q0*q1 - 2*q2*q3;
+        SPP[6] = 2*q0*q3 - 2*q1*q2;
+        SPP[7] = 2*q0*q1 + 2*q2*q3;
+        SPP[8] = 2*q0*q3 + 2*q1*q2;
+        SPP[9] = 2*q0*q2 + 2*q1*q3;
+
+        halfQuat[0] = 0.5f*q0;
+        halfQuat[1] = 0.5f*q1;
+        halfQuat[2] = 0.5f*q2;
+        halfQuat[3] = 0.5f*q3;
+
+        dt = in.dt;
+        delAngBiasActive = in.delAngBiasActive;
+        delVelBiasActive = in.delVelBiasActive;
+    }
+
+    // out = F*v for the kinematic rows, where v is a column of the
+    // matrix being propagated
+    template <typename vector_type>
+    void transition(const vector_type &v, float out[10]) const
+    {
+        const float hx = SF[0];
+        const float hy = SF[1];
+        const float hz = SF[2];
+
+        out[0] = v[0] - v[1]*hx - v[2]*hy - v[3]*hz;
+        out[1] = v[0]*hx + v[1] + v[2]*hz - v[3]*hy;
+        out[2] = v[0]*hy - v[1]*hz + v[2] + v[3]*hx;
+        out[3] = v[0]*hz + v[1]*hy - v[2]*hx + v[3];
+        out[4] = v[4] + v[0]*SF[5] + v[1]*SF[3] + v[2]*SPP[0] - v[3]*SF[4];
+        out[5] = v[5] + v[0]*SF[4] - v[1]*SPP[0] + v[2]*SF[3] + v[3]*SF[5];
+        out[6] = v[6] + v[0]*SPP[0] + v[1]*SF[4] - v[2]*SF[5] + v[3]*SF[3];
+        out[7] = v[7] + v[4]*dt;
+        out[8] = v[8] + v[5]*dt;
+        out[9] = v[9] + v[6]*dt;
+
+        if (delAngBiasActive) {
+            const float b0 = v[10];
+            const float b1 = v[11];
+            const float b2 = v[12];
+            out[0] += b0*halfQuat[1] + b1*halfQuat[2] + b2*halfQuat[3];
+            out[1] += -b0*halfQuat[0] + b1*halfQuat[3] - b2*halfQuat[2];
+            out[2] += -b0*halfQuat[3] - b1*halfQuat[0] + b2*halfQuat[1];
+            out[3] += b0*halfQuat[2] - b1*halfQuat[1] - b2*halfQuat[0];
+        }
+
+        if (delVelBiasActive) {
+            const float b0 = v[13];
+            const float b1 = v[14];
+            const float b2 = v[15];
+            out[4] += b0*SPP[3] + b1*SPP[6] - b2*SPP[9];
+            out[5] += -b0*SPP[8] + b1*SPP[2] + b2*SPP[5];
+            out[6] += b0*SPP[4] - b1*SPP[7] - b2*SPP[1];
+        }
+    }
+
+    // add the delta angle and delta velocity noise to the quaternion
+    // and velocity blocks
+    template <typename matrix_type>
+    void add_imu_noise(matrix_type &nextP, const inputs_t &in) const
+    {
+        const float q0 = in.quat[0];
+        const float q1 = in.quat[1];
+        const float q2 = in.quat[2];
+        const float q3 = in.quat[3];
+        const float daxVar = in.dAngVar;
+        const float dayVar = in.dAngVar;
+        const float dazVar = in.dAngVar;
+        const float dvxVar = in.dVelVar;
+        const float dvyVar = in.dVelVar;
+        const float dvzVar = in.dVelVar;
+
+        float SG[8];
+        SG[0] = q0/2;
+        SG[1] = sq(q3);
+        SG[2] = sq(q2);
+        SG[3] = sq(q1);
+        SG[4] = sq(q0);
+        SG[5] = 2*q2*q3;
+        SG[6] = 2*q1*q3;
+        SG[7] = 2*q1*q2;
+
+        float SQ[11];
+        SQ[0] = dvzVar*(SG[5] - 2*q0*q1)*(SG[1] - SG[2] - SG[3] + SG[4]) - dvyVar*(SG[5] + 2*q0*q1)*(SG[1] - SG[2] + SG[3] - SG[4]) + dvxVar*(SG[6] - 2*q0*q2)*(SG[7] + 2*q0*q3);
+        SQ[1] = dvzVar*(SG[6] + 2*q0*q2)*(SG[1] - SG[2] - SG[3] + SG[4]) - dvxVar*(SG[6] - 2*q0*q2)*(SG[1] + SG[2] - SG[3] - SG[4]) + dvyVar*(SG[5] + 2*q0*q1)*(SG[7] - 2*q0*q3);
+        SQ[2] = dvzVar*(SG[5] - 2*q0*q1)*(SG[6] + 2*q0*q2) - dvyVar*(SG[7] - 2*q0*q3)*(SG[1] - SG[2] + SG[3] - SG[4]) - dvxVar*(SG[7] + 2*q0*q3)*(SG[1] + SG[2] - SG[3] - SG[4]);
+        SQ[3] = (dayVar*q1*SG[0])/2 - (dazVar*q1*SG[0])/2 - (daxVar*q2*q3)/4;
+        SQ[4] = (dazVar*q2*SG[0])/2 - (daxVar*q2*SG[0])/2 - (dayVar*q1*q3)/4;
+        SQ[5] = (daxVar*q3*SG[0])/2 - (dayVar*q3*SG[0])/2 - (dazVar*q1*q2)/4;
+        SQ[6] = (daxVar*q1*q2)/4 - (dazVar*q3*SG[0])/2 - (dayVar*q1*q2)/4;
+        SQ[7] = (dazVar*q1*q3)/4 - (daxVar*q1*q3)/4 - (dayVar*q2*SG[0])/2;
+        SQ[8] = (dayVar*q2*q3)/4 - (daxVar*q1*SG[0])/2 - (dazVar*q2*q3)/4;
+        SQ[9] = sq(SG[0]);
+        SQ[10] = sq(q1);
+
+        nextP[0][0] += (daxVar*SQ[10])/4 + (dayVar*sq(q2))/4 + (dazVar*sq(q3))/4;
+        nextP[0][1] += SQ[8];
+        nextP[1][1] += daxVar*SQ[9] + (dayVar*sq(q3))/4 + (dazVar*sq(q2))/4;
+        nextP[0][2] += SQ[7];
+        nextP[1][2] += SQ[5];
+        nextP[2][2] += dayVar*SQ[9] + (dazVar*SQ[10])/4 + (daxVar*sq(q3))/4;
+        nextP[0][3] += SQ[6];
+        nextP[1][3] += SQ[4];
+        nextP[2][3] += SQ[3];
+        nextP[3][3] += (dayVar*SQ[10])/4 + dazVar*SQ[9] + (daxVar*sq(q2))/4;
+        nextP[4][4] += dvyVar*sq(SG[7] - 2*q0*q3) + dvzVar*sq(SG[6] + 2*q0*q2) + dvxVar*sq(SG[1] + SG[2] - SG[3] - SG[4]);
+        nextP[4][5] += SQ[2];
+        nextP[5][5] += dvxVar*sq(SG[7] + 2*q0*q3) + dvzVar*sq(SG[5] - 2*q0*q1) + dvyVar*sq(SG[1] - SG[2] + SG[3] - SG[4]);
+        nextP[4][6] += SQ[1];
+        nextP[5][6] += SQ[0];
+        nextP[6][6] += dvxVar*sq(SG[6] - 2*q0*q2) + dvyVar*sq(SG[5] + 2*q0*q1) + dvzVar*sq(SG[1] - SG[2] - SG[3] + SG[4]);
+    }
+};
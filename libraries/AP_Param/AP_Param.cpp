@@ -65,10 +65,25 @@ uint16_t AP_Param::_parameter_count;
 // storage and naming information about all types that can be saved
 const AP_Param::Info *AP_Param::_var_info;
 
+#if AP_PARAM_INDEX_ENABLED
+// lookup index for find() and find_by_index()
+struct AP_Param::param_index_entry *AP_Param::_index;
+struct AP_Param::param_hash_entry *AP_Param::_index_hash;
+uint16_t AP_Param::_index_size;
+uint16_t AP_Param::_index_count;
+volatile bool AP_Param::_index_valid;
+AP_HAL::Semaphore *AP_Param::_index_sem;
+#endif
+
 struct AP_Param::param_override *AP_Param::param_overrides = nullptr;
 uint16_t AP_Param::num_param_overrides = 0;
 
-ObjectBuffer<AP_Param::param_save> AP_Param::save_queue{30};
+struct AP_Param::param_save AP_Param::save_queue[AP_PARAM_SAVE_QUEUE_SIZE];
+uint16_t AP_Param::save_queue_head;
+uint16_t AP_Param::save_queue_count;
+bool AP_Param::save_in_progress;
+struct AP_Param::save_stats AP_Param::_save_stats;
+AP_HAL::Semaphore *AP_Param::save_sem;
 bool AP_Param::registered_save_handler;
 
 // we need a dummy object for the parameter save callback
@@ -95,7 +110,27 @@ uint16_t AP_Param::_frame_type_flags;
 // write to EEPROM
 void AP_Param::eeprom_write_check(const void *ptr, uint16_t ofs, uint8_t size)
 {
-    _storage.write_block(ofs, ptr, size);
+    const uint8_t *b = (const uint8_t *)ptr;
+    uint8_t old[24];
+    if (size > sizeof(old)) {
+        _storage.write_block(ofs, ptr, size);
+        return;
+    }
+
+    // only write the bytes that changed, so unchanged values don't
+    // dirty storage lines
+    _storage.read_block(old, ofs, size);
+    uint8_t start = 0;
+    uint8_t end = size;
+    while (start < end && old[start] == b[start]) {
+        start++;
+    }
+    while (end > start && old[end-1] == b[end-1]) {
+        end--;
+    }
+    if (start < end) {
+        _storage.write_block(ofs+start, &b[start], end-start);
+    }
 }
 
 bool AP_Param::_hide_disabled_groups = true;
@@ -257,6 +292,15 @@ bool AP_Param::check_var_info(void)
 {
     uint16_t total_size = sizeof(struct EEPROM_header);
 
+#if AP_PARAM_INDEX_ENABLED
+    if (_index_sem == nullptr) {
+        _index_sem = hal.util->new_semaphore();
+    }
+#endif
+    if (save_sem == nullptr) {
+        save_sem = hal.util->new_semaphore();
+    }
+
     for (uint16_t i=0; i<_num_vars; i++) {
         uint8_t type = _var_info[i].type;
         uint16_t key = _var_info[i].key;
@@ -294,6 +338,8 @@ bool AP_Param::check_var_info(void)
     // as we allow for more variables than could fit, relying on not
     // saving default values
 
+    invalidate_count();
+
     return true;
 }
 
@@ -314,6 +360,17 @@ bool AP_Param::setup(void)
         erase_all();
     }
 
+#if AP_PARAM_INDEX_ENABLED
+    if (_index_sem == nullptr) {
+        _index_sem = hal.util->new_semaphore();
+    }
+#endif
+    if (save_sem == nullptr) {
+        save_sem = hal.util->new_semaphore();
+    }
+
+    invalidate_count();
+
     return true;
 }
 
@@ -826,6 +883,12 @@ AP_Param::find_group(const char *name, uint16_t vindex, ptrdiff_t group_offset,
 AP_Param *
 AP_Param::find(const char *name, enum ap_var_type *ptype)
 {
+#if AP_PARAM_INDEX_ENABLED
+    AP_Param *ret;
+    if (index_find(name, ptype, ret)) {
+        return ret;
+    }
+#endif
     for (uint16_t i=0; i<_num_vars; i++) {
         uint8_t type = _var_info[i].type;
         if (type == AP_PARAM_GROUP) {
@@ -856,12 +919,18 @@ AP_Param::find(const char *name, enum ap_var_type *ptype)
     return nullptr;
 }
 
-// Find a variable by index. Note that this is quite slow.
+// Find a variable by index. Note that this is quite slow without the
+// lookup index.
 //
 AP_Param *
 AP_Param::find_by_index(uint16_t idx, enum ap_var_type *ptype, ParamToken *token)
 {
     AP_Param *ap;
+#if AP_PARAM_INDEX_ENABLED
+    if (index_find_by_index(idx, ptype, token, ap)) {
+        return ap;
+    }
+#endif
     uint16_t count=0;
     for (ap=AP_Param::first(token, ptype);
          ap && count < idx;
@@ -872,6 +941,169 @@ AP_Param::find_by_index(uint16_t idx, enum ap_var_type *ptype, ParamToken *token
 }
 
 
+#if AP_PARAM_INDEX_ENABLED
+/*
+  FNV-1a hash of a parameter name
+ */
+uint32_t AP_Param::name_hash(const char *name)
+{
+    uint32_t h = 2166136261U;
+    for (uint8_t i=0; i<AP_MAX_NAME_SIZE && name[i]; i++) {
+        h ^= (uint8_t)name[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+/*
+  (re)build the lookup index. Must be called with _index_sem held. This
+  walks the whole parameter tree, so is only called from
+  invalidate_count()
+ */
+bool AP_Param::build_index(void)
+{
+    AP_Param *ap;
+    ParamToken token;
+    enum ap_var_type type;
+
+    // mark valid before walking the tree, so an invalidate_count()
+    // from another thread while we build forces a rebuild
+    _index_valid = true;
+
+    uint16_t count = 0;
+    for (ap=first(&token, &type); ap; ap=next_scalar(&token, &type)) {
+        count++;
+    }
+
+    if (count > _index_size) {
+        free(_index);
+        free(_index_hash);
+        _index = (struct param_index_entry *)calloc(count, sizeof(struct param_index_entry));
+        _index_hash = (struct param_hash_entry *)calloc(count, sizeof(struct param_hash_entry));
+        if (_index == nullptr || _index_hash == nullptr) {
+            free(_index);
+            free(_index_hash);
+            _index = nullptr;
+            _index_hash = nullptr;
+            _index_size = 0;
+            _index_count = 0;
+            _index_valid = false;
+            return false;
+        }
+        _index_size = count;
+    }
+
+    uint16_t n = 0;
+    for (ap=first(&token, &type); ap && n < count; ap=next_scalar(&token, &type)) {
+        char name[AP_MAX_NAME_SIZE+1];
+        ap->copy_name_token(token, name, AP_MAX_NAME_SIZE, true);
+        name[AP_MAX_NAME_SIZE] = 0;
+
+        _index[n].ap = ap;
+        _index[n].token = token;
+        _index[n].type = type;
+
+        _index_hash[n].hash = name_hash(name);
+        _index_hash[n].index = n;
+        n++;
+    }
+    qsort(_index_hash, n, sizeof(_index_hash[0]), compare_hash);
+    _index_count = n;
+    return true;
+}
+
+/*
+  qsort comparison of hash table entries
+ */
+int AP_Param::compare_hash(const void *a, const void *b)
+{
+    const uint32_t ha = ((const struct param_hash_entry *)a)->hash;
+    const uint32_t hb = ((const struct param_hash_entry *)b)->hash;
+    if (ha < hb) {
+        return -1;
+    }
+    return ha > hb ? 1 : 0;
+}
+
+/*
+  find a parameter by name using the lookup index. Returns false if
+  the index could not answer the query, in which case the caller
+  should fall back to a linear search. Names not in the index (such
+  as parameters in disabled groups, or names that differ in case) are
+  also left to the linear search
+ */
+bool AP_Param::index_find(const char *name, enum ap_var_type *ptype, AP_Param *&ret)
+{
+    if (_index_sem == nullptr || strnlen(name, AP_MAX_NAME_SIZE+1) > AP_MAX_NAME_SIZE) {
+        return false;
+    }
+    if (!_index_sem->take_nonblocking()) {
+        return false;
+    }
+    if (!_index_valid) {
+        _index_sem->give();
+        return false;
+    }
+
+    const uint32_t h = name_hash(name);
+
+    // binary search for the first entry with this hash
+    uint16_t lo = 0, hi = _index_count;
+    while (lo < hi) {
+        const uint16_t mid = (lo + hi) / 2;
+        if (_index_hash[mid].hash < h) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // check the name to cope with hash collisions
+    bool found = false;
+    for (; lo < _index_count && _index_hash[lo].hash == h; lo++) {
+        const struct param_index_entry &e = _index[_index_hash[lo].index];
+        char ename[AP_MAX_NAME_SIZE+1];
+        e.ap->copy_name_token(e.token, ename, AP_MAX_NAME_SIZE, true);
+        ename[AP_MAX_NAME_SIZE] = 0;
+        if (strcmp(name, ename) == 0) {
+            *ptype = (enum ap_var_type)e.type;
+            ret = e.ap;
+            found = true;
+            break;
+        }
+    }
+    _index_sem->give();
+    return found;
+}
+
+/*
+  find a parameter by index using the lookup index. Returns false if
+  the index is not available
+ */
+bool AP_Param::index_find_by_index(uint16_t idx, enum ap_var_type *ptype, ParamToken *token, AP_Param *&ret)
+{
+    if (_index_sem == nullptr || !_index_sem->take_nonblocking()) {
+        return false;
+    }
+    if (!_index_valid) {
+        _index_sem->give();
+        return false;
+    }
+    if (idx >= _index_count) {
+        ret = nullptr;
+    } else {
+        const struct param_index_entry &e = _index[idx];
+        *token = e.token;
+        if (ptype != nullptr) {
+            *ptype = (enum ap_var_type)e.type;
+        }
+        ret = e.ap;
+    }
+    _index_sem->give();
+    return true;
+}
+#endif // AP_PARAM_INDEX_ENABLED
+
 /*
   Find a variable by pointer, returning key. This is used for loading pointer variables
 */
@@ -1022,7 +1254,7 @@ void AP_Param::save_sync(bool force_save)
 
     if (phdr.type == AP_PARAM_INT8 && ginfo != nullptr && (ginfo->flags & AP_PARAM_FLAG_ENABLE)) {
         // clear cached parameter count
-        _parameter_count = 0;
+        invalidate_count();
     }
     
     char name[AP_MAX_NAME_SIZE+1];
@@ -1078,14 +1310,77 @@ void AP_Param::save_sync(bool force_save)
 }
 
 /*
-  put variable into queue to be saved
+  add this variable to the save queue, merging with a queued save of
+  the same variable. Returns false if the queue is full
 */
-void AP_Param::save(bool force_save)
+bool AP_Param::save_enqueue(bool force_save)
 {
-    struct param_save p;
+    save_sem->take_blocking();
+
+    for (uint16_t i=0; i<save_queue_count; i++) {
+        struct param_save &p = save_queue[(save_queue_head + i) % AP_PARAM_SAVE_QUEUE_SIZE];
+        if (p.param == this) {
+            p.force_save |= force_save;
+            _save_stats.queued++;
+            _save_stats.coalesced++;
+            save_sem->give();
+            return true;
+        }
+    }
+    if (save_queue_count >= AP_PARAM_SAVE_QUEUE_SIZE) {
+        save_sem->give();
+        return false;
+    }
+    struct param_save &p = save_queue[(save_queue_head + save_queue_count) % AP_PARAM_SAVE_QUEUE_SIZE];
     p.param = this;
+    p.queued_ms = AP_HAL::millis();
     p.force_save = force_save;
-    while (!save_queue.push(p)) {
+    save_queue_count++;
+    _save_stats.queued++;
+    _save_stats.depth = save_queue_count;
+    if (save_queue_count > _save_stats.max_depth) {
+        _save_stats.max_depth = save_queue_count;
+    }
+    save_sem->give();
+    return true;
+}
+
+/*
+  take the oldest save from the queue
+*/
+bool AP_Param::save_dequeue(struct param_save &p)
+{
+    save_sem->take_blocking();
+
+    if (save_queue_count == 0) {
+        save_in_progress = false;
+        save_sem->give();
+        return false;
+    }
+    p = save_queue[save_queue_head];
+    save_queue_head = (save_queue_head + 1) % AP_PARAM_SAVE_QUEUE_SIZE;
+    save_queue_count--;
+    _save_stats.depth = save_queue_count;
+    save_in_progress = true;
+    save_sem->give();
+    return true;
+}
+
+/*
+  put variable into queue to be saved
+*/
+void AP_Param::save(bool force_save)
+{
+    if (save_sem == nullptr) {
+        // AP_Param hasn't been setup, so there is no save queue
+        save_sync(force_save);
+        return;
+    }
+    if (save_enqueue(force_save)) {
+        return;
+    }
+    _save_stats.blocked++;
+    while (!save_enqueue(force_save)) {
         // if we can't save to the queue
         if (hal.util->get_soft_armed()) {
             // if we are armed then don't sleep, instead we lose the
@@ -1104,9 +1399,21 @@ void AP_Param::save(bool force_save)
  */
 void AP_Param::save_io_handler(void)
 {
+    if (save_sem == nullptr) {
+        // nothing can have been queued
+        return;
+    }
     struct param_save p;
-    while (save_queue.pop(p)) {
+    while (save_dequeue(p)) {
         p.param->save_sync(p.force_save);
+        const uint32_t latency_ms = AP_HAL::millis() - p.queued_ms;
+        save_sem->take_blocking();
+        _save_stats.saved++;
+        _save_stats.latency_sum_ms += latency_ms;
+        if (latency_ms > _save_stats.max_latency_ms) {
+            _save_stats.max_latency_ms = latency_ms;
+        }
+        save_sem->give();
     }
 }
 
@@ -1116,11 +1423,31 @@ void AP_Param::save_io_handler(void)
 void AP_Param::flush(void)
 {
     uint16_t counter = 200; // 2 seconds max
-    while (counter-- && save_queue.available()) {
+    while (counter-- && (save_queue_count != 0 || save_in_progress)) {
         hal.scheduler->delay(10);
     }
 }
 
+/*
+  get save queue statistics
+*/
+void AP_Param::get_save_stats(struct save_stats &stats, bool reset)
+{
+    if (save_sem == nullptr) {
+        // setup() or check_var_info() not called yet
+        memset(&stats, 0, sizeof(stats));
+        return;
+    }
+    save_sem->take_blocking();
+    stats = _save_stats;
+    if (reset) {
+        memset(&_save_stats, 0, sizeof(_save_stats));
+        _save_stats.depth = save_queue_count;
+        _save_stats.max_depth = save_queue_count;
+    }
+    save_sem->give();
+}
+
 // Load the variable from EEPROM, if supported
 //
 bool AP_Param::load(void)
@@ -1336,7 +1663,9 @@ bool AP_Param::load_all()
         // note that this is an || not an && for robustness
         // against power off while adding a variable
         if (is_sentinal(phdr)) {
-            // we've reached the sentinal
+            // we've reached the sentinal. Loaded enable parameters
+            // may have changed which parameters are visible
+            invalidate_count();
             return true;
         }
 
@@ -1353,6 +1682,7 @@ bool AP_Param::load_all()
 
     // we didn't find the sentinal
     Debug("no sentinal in load_all");
+    invalidate_count();
     return false;
 }
 
@@ -1394,9 +1724,6 @@ void AP_Param::load_object_from_eeprom(const void *object_pointer, const struct
     struct Param_header phdr;
     uint16_t key;
 
-    // reset cached param counter as we may be loading a dynamic var_info
-    _parameter_count = 0;
-    
     if (!find_key_by_pointer(object_pointer, key)) {
         hal.console->printf("ERROR: Unable to find param pointer\n");
         return;
@@ -1437,6 +1764,10 @@ void AP_Param::load_object_from_eeprom(const void *object_pointer, const struct
             ofs += type_size((enum ap_var_type)phdr.type) + sizeof(phdr);
         }
     }
+
+    // reset cached param counter and index, as we may have loaded a
+    // dynamic var_info
+    invalidate_count();
 }
 
 
@@ -2167,6 +2498,23 @@ uint16_t AP_Param::count_parameters(void)
     return ret;
 }
 
+/*
+  forget the cached parameter count and rebuild the lookup index. While
+  the index is being rebuilt, lookups from other threads fall back to a
+  linear search
+ */
+void AP_Param::invalidate_count(void)
+{
+    _parameter_count = 0;
+#if AP_PARAM_INDEX_ENABLED
+    _index_valid = false;
+    if (_index_sem != nullptr && _index_sem->take(HAL_SEMAPHORE_BLOCK_FOREVER)) {
+        build_index();
+        _index_sem->give();
+    }
+#endif
+}
+
 /*
   set a default value by name
  */
@@ -42,6 +42,25 @@
 #define AP_PARAM_MAX_EMBEDDED_PARAM 8192
 #endif
 
+/*
+  enable a lookup index for find() and find_by_index(). This costs
+  around 20 bytes of RAM per parameter on 32 bit boards
+ */
+#ifndef AP_PARAM_INDEX_ENABLED
+#define AP_PARAM_INDEX_ENABLED !HAL_MINIMIZE_FEATURES
+#endif
+
+/*
+  number of distinct parameters that can be waiting to be saved
+ */
+#ifndef AP_PARAM_SAVE_QUEUE_SIZE
+#if HAL_MINIMIZE_FEATURES
+#define AP_PARAM_SAVE_QUEUE_SIZE 30
+#else
+#define AP_PARAM_SAVE_QUEUE_SIZE 128
+#endif
+#endif
+
 /*
   flags for variables in var_info and group tables
  */
@@ -319,6 +338,22 @@ public:
     /// @param  force_save     If true then force save even if default
     ///
     void save(bool force_save=false);
+
+    // statistics on the background save queue
+    struct save_stats {
+        uint16_t depth;             // saves currently queued
+        uint16_t max_depth;         // maximum queue depth
+        uint32_t queued;            // calls to save()
+        uint32_t coalesced;         // saves merged into an already queued one
+        uint32_t blocked;           // saves that had to wait for queue space
+        uint32_t saved;             // saves written to storage
+        uint32_t latency_sum_ms;    // total time from save() to storage
+        uint32_t max_latency_ms;    // worst time from save() to storage
+    };
+
+    /// get save queue statistics, optionally resetting all but the
+    /// current depth
+    static void get_save_stats(struct save_stats &stats, bool reset);
     
     /// Load the variable from EEPROM.
     ///
@@ -418,11 +453,19 @@ public:
     // count of parameters in tree
     static uint16_t count_parameters(void);
 
-    static void set_hide_disabled_groups(bool value) { _hide_disabled_groups = value; }
+    // forget the cached parameter count and lookup index. Needed when
+    // the set of visible parameters changes
+    static void invalidate_count(void);
+
+    static void set_hide_disabled_groups(bool value) {
+        _hide_disabled_groups = value;
+        invalidate_count();
+    }
 
     // set frame type flags. Used to unhide frame specific parameters
     static void set_frame_type_flags(uint16_t flags_to_set) {
         _frame_type_flags |= flags_to_set;
+        invalidate_count();
     }
 
     // check if a given frame type should be included
@@ -620,15 +663,57 @@ private:
 
     static bool _hide_disabled_groups;
 
-    // support for background saving of parameters. We pack it to reduce memory for the
-    // queue
+#if AP_PARAM_INDEX_ENABLED
+    /*
+      lookup index over all visible scalar parameters, built in
+      setup() and rebuilt by invalidate_count(). Entries are
+      in first()/next_scalar() order, so find_by_index() is a direct
+      array access. The hash table is sorted by name hash, giving a
+      binary search for find()
+     */
+    struct param_index_entry {
+        AP_Param *ap;
+        ParamToken token;
+        uint8_t type;
+    };
+    struct param_hash_entry {
+        uint32_t hash;
+        uint16_t index;
+    };
+    static struct param_index_entry *_index;
+    static struct param_hash_entry *_index_hash;
+    static uint16_t _index_size;
+    static uint16_t _index_count;
+    static volatile bool _index_valid;
+    static AP_HAL::Semaphore *_index_sem;
+
+    static uint32_t name_hash(const char *name);
+    static bool build_index(void);
+    static int compare_hash(const void *a, const void *b);
+    static bool index_find(const char *name, enum ap_var_type *ptype, AP_Param *&ret);
+    static bool index_find_by_index(uint16_t idx, enum ap_var_type *ptype, ParamToken *token, AP_Param *&ret);
+#endif
+
+    // support for background saving of parameters. Saves of a
+    // parameter that is already queued are merged into the queued
+    // entry, so bulk loads which touch a parameter repeatedly only
+    // write it once
     struct PACKED param_save {
         AP_Param *param;
+        uint32_t queued_ms;
         bool force_save;
     };
-    static ObjectBuffer<struct param_save> save_queue;
+    static struct param_save save_queue[AP_PARAM_SAVE_QUEUE_SIZE];
+    static uint16_t save_queue_head;
+    static uint16_t save_queue_count;
+    static bool save_in_progress;
+    static struct save_stats _save_stats;
+    static AP_HAL::Semaphore *save_sem;
     static bool registered_save_handler;
 
+    bool save_enqueue(bool force_save);
+    static bool save_dequeue(struct param_save &p);
+
     // background function for saving parameters
     void save_io_handler(void);
 };
@@ -0,0 +1,179 @@
+/*
+ * Benchmark AP_Param::find() and AP_Param::find_by_index() over a
+ * parameter tree sized and shaped like the Copter one: a few top level
+ * scalars followed by library groups with nested PID subgroups and
+ * Vector3f parameters, roughly 1100 scalar parameters in total.
+ *
+ * The linear benchmarks are registered first and run before the lookup
+ * index exists. The indexed benchmarks then enable the index via
+ * AP_Param::check_var_info().
+ */
+#include <AP_gbenchmark.h>
+
+#include <stdio.h>
+
+#include <AP_HAL/AP_HAL.h>
+#include <AP_Param/AP_Param.h>
+#include <GCS_MAVLink/GCS_Dummy.h>
+
+const AP_HAL::HAL &hal = AP_HAL::get_HAL();
+
+GCS_Dummy _gcs;
+
+class BenchPID {
+public:
+    AP_Float kp;
+    AP_Float ki;
+    AP_Float kd;
+    AP_Float imax;
+    AP_Float filt;
+    AP_Float ff;
+
+    static const struct AP_Param::GroupInfo var_info[];
+};
+
+const AP_Param::GroupInfo BenchPID::var_info[] = {
+    AP_GROUPINFO("P",    0, BenchPID, kp,   0),
+    AP_GROUPINFO("I",    1, BenchPID, ki,   0),
+    AP_GROUPINFO("D",    2, BenchPID, kd,   0),
+    AP_GROUPINFO("IMAX", 3, BenchPID, imax, 0),
+    AP_GROUPINFO("FILT", 4, BenchPID, filt, 0),
+    AP_GROUPINFO("FF",   5, BenchPID, ff,   0),
+    AP_GROUPEND
+};
+
+class BenchLibrary {
+public:
+    AP_Int8 enable;
+    AP_Int8 type;
+    AP_Int16 rate;
+    AP_Int32 options;
+    AP_Float gain;
+    AP_Float limit;
+    AP_Float filter;
+    AP_Float timeout;
+    AP_Vector3f offsets;
+    BenchPID rll;
+    BenchPID pit;
+    BenchPID yaw;
+
+    static const struct AP_Param::GroupInfo var_info[];
+};
+
+const AP_Param::GroupInfo BenchLibrary::var_info[] = {
+    AP_GROUPINFO("ENABLE",  0, BenchLibrary, enable,  1),
+    AP_GROUPINFO("TYPE",    1, BenchLibrary, type,    0),
+    AP_GROUPINFO("RATE",    2, BenchLibrary, rate,    50),
+    AP_GROUPINFO("OPTIONS", 3, BenchLibrary, options, 0),
+    AP_GROUPINFO("GAIN",    4, BenchLibrary, gain,    1),
+    AP_GROUPINFO("LIMIT",   5, BenchLibrary, limit,   0),
+    AP_GROUPINFO("FILTER",  6, BenchLibrary, filter,  20),
+    AP_GROUPINFO("TIMEOUT", 7, BenchLibrary, timeout, 1),
+    AP_GROUPINFO("OFS",     8, BenchLibrary, offsets, 0),
+    AP_SUBGROUPINFO(rll, "RLL_", 9,  BenchLibrary, BenchPID),
+    AP_SUBGROUPINFO(pit, "PIT_", 10, BenchLibrary, BenchPID),
+    AP_SUBGROUPINFO(yaw, "YAW_", 11, BenchLibrary, BenchPID),
+    AP_GROUPEND
+};
+
+#define BENCH_NUM_SCALARS 8
+#define BENCH_NUM_LIBRARIES 38
+
+static AP_Int16 format_version;
+static AP_Float scalars[BENCH_NUM_SCALARS];
+static BenchLibrary libraries[BENCH_NUM_LIBRARIES];
+
+static char names[BENCH_NUM_SCALARS + BENCH_NUM_LIBRARIES][AP_MAX_NAME_SIZE+1];
+static AP_Param::Info var_info[1 + BENCH_NUM_SCALARS + BENCH_NUM_LIBRARIES + 1];
+
+static char all_names[1200][AP_MAX_NAME_SIZE+1];
+static uint16_t num_names;
+
+static void setup_var_info()
+{
+    static bool done;
+    if (done) {
+        return;
+    }
+    done = true;
+
+    uint16_t n = 0;
+    var_info[n++] = { AP_PARAM_INT16, "FORMAT_VERSION", 0, &format_version, {def_value : 0} };
+    for (uint8_t i=0; i<BENCH_NUM_SCALARS; i++, n++) {
+        snprintf(names[n-1], sizeof(names[0]), "SCALAR%u", i);
+        var_info[n] = { AP_PARAM_FLOAT, names[n-1], n, &scalars[i], {def_value : 0} };
+    }
+    for (uint8_t i=0; i<BENCH_NUM_LIBRARIES; i++, n++) {
+        snprintf(names[n-1], sizeof(names[0]), "L%c%c_", 'A' + i / 26, 'A' + i % 26);
+        var_info[n] = { AP_PARAM_GROUP, names[n-1], n, &libraries[i], {group_info : BenchLibrary::var_info} };
+    }
+    var_info[n] = AP_VAREND;
+
+    new AP_Param(var_info);
+
+    // collect the full names of all scalars for the lookup benchmarks
+    AP_Param::ParamToken token;
+    enum ap_var_type type;
+    for (AP_Param *ap = AP_Param::first(&token, &type);
+         ap != nullptr && num_names < ARRAY_SIZE(all_names);
+         ap = AP_Param::next_scalar(&token, &type)) {
+        ap->copy_name_token(token, all_names[num_names], AP_MAX_NAME_SIZE, true);
+        num_names++;
+    }
+}
+
+static void find_by_name(benchmark::State& state)
+{
+    uint16_t i = 0;
+    enum ap_var_type type;
+    while (state.KeepRunning()) {
+        AP_Param *ap = AP_Param::find(all_names[i], &type);
+        gbenchmark_escape(ap);
+        i = (i + 1) % num_names;
+    }
+}
+
+static void find_by_index(benchmark::State& state)
+{
+    uint16_t i = 0;
+    enum ap_var_type type;
+    AP_Param::ParamToken token;
+    while (state.KeepRunning()) {
+        AP_Param *ap = AP_Param::find_by_index(i, &type, &token);
+        gbenchmark_escape(ap);
+        i = (i + 1) % num_names;
+    }
+}
+
+static void BM_ParamFindLinear(benchmark::State& state)
+{
+    setup_var_info();
+    find_by_name(state);
+}
+
+static void BM_ParamFindByIndexLinear(benchmark::State& state)
+{
+    setup_var_info();
+    find_by_index(state);
+}
+
+static void BM_ParamFindIndexed(benchmark::State& state)
+{
+    setup_var_info();
+    AP_Param::check_var_info();
+    find_by_name(state);
+}
+
+static void BM_ParamFindByIndexIndexed(benchmark::State& state)
+{
+    setup_var_info();
+    AP_Param::check_var_info();
+    find_by_index(state);
+}
+
+BENCHMARK(BM_ParamFindLinear);
+BENCHMARK(BM_ParamFindByIndexLinear);
+BENCHMARK(BM_ParamFindIndexed);
+BENCHMARK(BM_ParamFindByIndexIndexed);
+
+BENCHMARK_MAIN()
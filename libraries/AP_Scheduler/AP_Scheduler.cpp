@@ -25,6 +25,7 @@
 #include <AP_Vehicle/AP_Vehicle.h>
 #include <DataFlash/DataFlash.h>
 #include <AP_InertialSensor/AP_InertialSensor.h>
+#include <GCS_MAVLink/GCS.h>
 
 #include <stdio.h>
 
@@ -56,6 +57,20 @@ const AP_Param::GroupInfo AP_Scheduler::var_info[] = {
     // @User: Advanced
     AP_GROUPINFO("LOOP_RATE",  1, AP_Scheduler, _loop_rate_hz, SCHEDULER_DEFAULT_LOOP_RATE),
 
+    // @Param: OPTIONS
+    // @DisplayName: Scheduler options
+    // @Description: This controls optional aspects of the scheduler. When task statistics are enabled the scheduler keeps a run time histogram plus overrun, skip and slip counts for every task, and logs them as TSK messages alongside PM messages. Deadline scheduling runs the due tasks ordered by priority class and then by how late they are relative to their rate, promoting tasks that have slipped whole intervals so that background tasks are not starved.
+    // @Bitmask: 0:Enable task statistics,1:Deadline scheduling
+    // @User: Advanced
+    AP_GROUPINFO("OPTIONS",  2, AP_Scheduler, _options, 0),
+
+    // @Param: TSK_RPT
+    // @DisplayName: Scheduler task statistics report
+    // @Description: Set to the number of tasks to report. The tasks with the most overruns since boot, then the longest run times, are sent to the GCS as text messages, and the parameter is set back to zero. Needs task statistics enabled in SCHED_OPTIONS.
+    // @Range: 0 20
+    // @User: Advanced
+    AP_GROUPINFO("TSK_RPT",  3, AP_Scheduler, _report_tasks, 0),
+
     AP_GROUPEND
 };
 
@@ -98,6 +113,7 @@ void AP_Scheduler::init(const AP_Scheduler::Task *tasks, uint8_t num_tasks, uint
     _num_tasks = num_tasks;
     _last_run = new uint16_t[_num_tasks];
     memset(_last_run, 0, sizeof(_last_run[0]) * _num_tasks);
+    _task_continuing = new Bitmask(_num_tasks);
     _tick_counter = 0;
 
     // setup initial performance counters
@@ -122,6 +138,13 @@ void AP_Scheduler::run(uint32_t time_available)
     uint32_t run_started_usec = AP_HAL::micros();
     uint32_t now = run_started_usec;
 
+    if ((_options & OPTION_TASK_STATS) && _task_stats == nullptr) {
+        _task_stats = new TaskStats[_num_tasks];
+        if (_task_stats != nullptr) {
+            memset(_task_stats, 0, sizeof(_task_stats[0]) * _num_tasks);
+        }
+    }
+
     if (_debug > 1 && _perf_counters == nullptr) {
         _perf_counters = new AP_HAL::Util::perf_counter_t[_num_tasks];
         if (_perf_counters != nullptr) {
@@ -131,21 +154,39 @@ void AP_Scheduler::run(uint32_t time_available)
         }
     }
     
-    for (uint8_t i=0; i<_num_tasks; i++) {
-        uint16_t dt = _tick_counter - _last_run[i];
-        uint16_t interval_ticks = _loop_rate_hz / _tasks[i].rate_hz;
-        if (interval_ticks < 1) {
-            interval_ticks = 1;
+    if ((_options & OPTION_DEADLINE_SCHED) && _due_tasks == nullptr) {
+        _due_tasks = new uint8_t[_num_tasks];
+        _due_keys = new uint16_t[_num_tasks];
+        if (_due_tasks == nullptr || _due_keys == nullptr) {
+            delete[] _due_tasks;
+            delete[] _due_keys;
+            _due_tasks = nullptr;
+            _due_keys = nullptr;
         }
-        if (dt < interval_ticks) {
+    }
+
+    // in deadline mode we walk the due tasks in deadline order,
+    // otherwise we walk the task table in order
+    const bool deadline_order = (_options & OPTION_DEADLINE_SCHED) && _due_tasks != nullptr;
+    const uint8_t num_to_check = deadline_order ? order_due_tasks() : _num_tasks;
+
+    for (uint8_t n=0; n<num_to_check; n++) {
+        const uint8_t i = deadline_order ? _due_tasks[n] : n;
+        uint16_t dt = _tick_counter - _last_run[i];
+        uint16_t interval_ticks = task_interval_ticks(i);
+        const bool continuing = _task_continuing != nullptr && _task_continuing->get(i);
+        if (dt < interval_ticks && !continuing) {
             // this task is not yet scheduled to run again
             continue;
         }
         // this task is due to run. Do we have enough time to run it?
         _task_time_allowed = _tasks[i].max_time_micros;
 
-        if (dt >= interval_ticks*2) {
+        if (dt >= interval_ticks*2 && !continuing) {
             // we've slipped a whole run of this task!
+            if (_task_stats != nullptr) {
+                _task_stats[i].counts.slip_count++;
+            }
             debug(2, "Scheduler slip task[%u-%s] (%u/%u/%u)\n",
                   (unsigned)i,
                   _tasks[i].name,
@@ -157,11 +198,15 @@ void AP_Scheduler::run(uint32_t time_available)
         if (_task_time_allowed > time_available) {
             // not enough time to run this task.  Continue loop -
             // maybe another task will fit into time remaining
+            if (_task_stats != nullptr) {
+                _task_stats[i].counts.skip_count++;
+            }
             continue;
         }
 
         // run it
         _task_time_started = now;
+        _task_wants_slice = false;
         current_task = i;
         if (_debug > 1 && _perf_counters && _perf_counters[i]) {
             hal.util->perf_begin(_perf_counters[i]);
@@ -172,9 +217,18 @@ void AP_Scheduler::run(uint32_t time_available)
         }
         current_task = -1;
 
-        // record the tick counter when we ran. This drives
-        // when we next run the event
-        _last_run[i] = _tick_counter;
+        if (_task_wants_slice && _task_continuing != nullptr) {
+            // the task has more work to do. It stays due, and its
+            // interval restarts once it completes
+            _task_continuing->set(i);
+        } else {
+            if (_task_continuing != nullptr) {
+                _task_continuing->clear(i);
+            }
+            // record the tick counter when we ran. This drives
+            // when we next run the event
+            _last_run[i] = _tick_counter;
+        }
 
         // work out how long the event actually took
         now = AP_HAL::micros();
@@ -188,6 +242,9 @@ void AP_Scheduler::run(uint32_t time_available)
                   (unsigned)time_taken,
                   (unsigned)_task_time_allowed);
         }
+        if (_task_stats != nullptr) {
+            update_task_stats(i, time_taken);
+        }
         if (time_taken >= time_available) {
             time_available = 0;
             break;
@@ -205,6 +262,105 @@ void AP_Scheduler::run(uint32_t time_available)
     }
 }
 
+/*
+  return the number of ticks between runs of a task
+ */
+uint16_t AP_Scheduler::task_interval_ticks(uint8_t i) const
+{
+    uint16_t interval_ticks = _loop_rate_hz / _tasks[i].rate_hz;
+    if (interval_ticks < 1) {
+        interval_ticks = 1;
+    }
+    return interval_ticks;
+}
+
+/*
+  return the priority class of a task. Tasks without an explicit
+  priority are classed by rate, so the fast control tasks stay ahead
+  of the housekeeping tasks
+ */
+uint8_t AP_Scheduler::task_priority(uint8_t i) const
+{
+    if (_tasks[i].priority != PRIORITY_AUTO) {
+        return _tasks[i].priority;
+    }
+    if (_tasks[i].rate_hz >= 50) {
+        return PRIORITY_HIGH;
+    }
+    if (_tasks[i].rate_hz >= 5) {
+        return PRIORITY_NORMAL;
+    }
+    return PRIORITY_LOW;
+}
+
+/*
+  build the list of tasks due on this tick, ordered by priority class
+  and then by lateness. Lateness is measured in 64ths of the task
+  interval so tasks of different rates compare fairly, and a task is
+  promoted one class for each whole interval it has slipped so low
+  priority tasks cannot be starved indefinitely
+ */
+uint8_t AP_Scheduler::order_due_tasks(void)
+{
+    uint8_t num_due = 0;
+    for (uint8_t i=0; i<_num_tasks; i++) {
+        const uint16_t dt = _tick_counter - _last_run[i];
+        const uint16_t interval_ticks = task_interval_ticks(i);
+        const bool continuing = _task_continuing != nullptr && _task_continuing->get(i);
+        if (dt < interval_ticks && !continuing) {
+            continue;
+        }
+
+        uint8_t prio = task_priority(i);
+        const uint16_t slipped = dt / interval_ticks;
+        if (slipped > 1) {
+            const uint16_t promote = slipped - 1;
+            prio = (prio > promote + PRIORITY_HIGH) ? (prio - promote) : PRIORITY_HIGH;
+        }
+        const uint32_t lateness = MIN((uint32_t)dt * 64U / interval_ticks, 0xFFFU);
+        const uint16_t key = (uint16_t)((prio << 12) | (0xFFFU - lateness));
+
+        // insertion sort; only a handful of tasks are due per tick
+        uint8_t j = num_due;
+        while (j > 0 && _due_keys[j-1] > key) {
+            _due_tasks[j] = _due_tasks[j-1];
+            _due_keys[j] = _due_keys[j-1];
+            j--;
+        }
+        _due_tasks[j] = i;
+        _due_keys[j] = key;
+        num_due++;
+    }
+    return num_due;
+}
+
+/*
+  record the run time of a task in its histogram and counters
+ */
+void AP_Scheduler::update_task_stats(uint8_t i, uint32_t time_taken)
+{
+    TaskStats &ts = _task_stats[i];
+    ts.counts.run_count++;
+    ts.elapsed_time_us += time_taken;
+    if (time_taken > ts.max_time_us) {
+        ts.max_time_us = time_taken;
+    }
+    if (time_taken > ts.period_max_time_us) {
+        ts.period_max_time_us = time_taken;
+    }
+    if (time_taken > _tasks[i].max_time_micros) {
+        ts.counts.overrun_count++;
+    }
+    // bucket b holds times below (32 << b) microseconds
+    uint8_t b = 0;
+    uint32_t limit = 32;
+    while (b < AP_SCHEDULER_TASK_HIST_BUCKETS-1 && time_taken >= limit) {
+        limit <<= 1;
+        b++;
+    }
+    ts.counts.hist[b]++;
+}
+
 /*
   return number of micros until the current task reaches its deadline
  */
@@ -275,15 +431,32 @@ void AP_Scheduler::loop()
 
 void AP_Scheduler::update_logging()
 {
-    if (debug_flags()) {
-        perf_info.update_logging();
+    if (_task_stats_next == 0) {
+        // start of a logging period
+        if (debug_flags()) {
+            perf_info.update_logging();
+        }
+        _log_task_stats = false;
+        if (_log_performance_bit != (uint32_t)-1 &&
+            DataFlash_Class::instance()->should_log(_log_performance_bit)) {
+            Log_Write_Performance();
+            DataFlash_Class::instance()->Log_Write_Param_Save_Stats();
+            _log_task_stats = true;
+        }
+        perf_info.set_loop_rate(get_loop_rate_hz());
+        perf_info.reset();
+        if (_report_tasks > 0) {
+            if (!send_task_stats(MIN(_report_tasks.get(), 20))) {
+                gcs().send_text(MAV_SEVERITY_WARNING, "Task stats disabled (SCHED_OPTIONS)");
+            }
+            _report_tasks.set_and_notify(0);
+        }
     }
-    if (_log_performance_bit != (uint32_t)-1 &&
-        DataFlash_Class::instance()->should_log(_log_performance_bit)) {
-        Log_Write_Performance();
+    // one TSK message per task doesn't fit in one run of this task
+    // on a copter, so they are spread over as many slices as needed
+    if (!end_task_stats_period()) {
+        request_another_slice();
     }
-    perf_info.set_loop_rate(get_loop_rate_hz());
-    perf_info.reset();
 }
 
 // Write a performance monitoring packet
@@ -301,6 +474,103 @@ void AP_Scheduler::Log_Write_Performance()
     DataFlash_Class::instance()->WriteCriticalBlock(&pkt, sizeof(pkt));
 }
 
+/*
+  start a new task statistics period for as many tasks as fit in the
+  time available, first writing a TSK packet holding the change in
+  the task's counts over the period if it was due and TSK logging is
+  on. The period restarts whether or not it was logged, so each TSK
+  message covers one period. Returns true once all tasks are done
+ */
+bool AP_Scheduler::end_task_stats_period()
+{
+    if (_task_stats == nullptr || _num_tasks == 0) {
+        return true;
+    }
+    DataFlash_Class *df = DataFlash_Class::instance();
+    const uint64_t now = AP_HAL::micros64();
+    do {
+        const uint8_t i = _task_stats_next++;
+        TaskStats &ts = _task_stats[i];
+        const TaskCounts &c = ts.counts;
+        const TaskCounts &p = ts.period_start;
+        if (_log_task_stats &&
+            (c.run_count != p.run_count || c.skip_count != p.skip_count)) {
+            struct log_Task_Stats pkt = {
+                LOG_PACKET_HEADER_INIT(LOG_SCHED_TASK_MSG),
+                time_us   : now,
+                name      : {},
+                run_count : (uint16_t)(c.run_count - p.run_count),
+                overruns  : (uint16_t)(c.overrun_count - p.overrun_count),
+                skipped   : (uint16_t)(c.skip_count - p.skip_count),
+                slipped   : (uint16_t)(c.slip_count - p.slip_count),
+                max_time  : ts.period_max_time_us,
+                hist      : {}
+            };
+            static_assert(ARRAY_SIZE(pkt.hist) == ARRAY_SIZE(c.hist), "TSK histogram size mismatch");
+            strncpy(pkt.name, _tasks[i].name, sizeof(pkt.name));
+            for (uint8_t b=0; b<ARRAY_SIZE(pkt.hist); b++) {
+                pkt.hist[b] = c.hist[b] - p.hist[b];
+            }
+            df->WriteBlock(&pkt, sizeof(pkt));
+        }
+        ts.period_start = ts.counts;
+        ts.period_max_time_us = 0;
+    } while (_task_stats_next < _num_tasks && time_available_usec() > 0);
+
+    if (_task_stats_next < _num_tasks) {
+        return false;
+    }
+    _task_stats_next = 0;
+    return true;
+}
+
+/*
+  send the tasks with the most overruns since boot, then the longest
+  run times, to the GCS as text messages
+ */
+bool AP_Scheduler::send_task_stats(uint8_t max_tasks) const
+{
+    if (_task_stats == nullptr) {
+        return false;
+    }
+    // simple selection of the worst tasks; the task table is small
+    // and this only runs on request
+    uint8_t sent = 0;
+    uint32_t sent_mask[(UINT8_MAX+1)/32] {};
+    while (sent < max_tasks) {
+        int16_t worst = -1;
+        for (uint8_t i=0; i<_num_tasks; i++) {
+            if (sent_mask[i/32] & (1U<<(i%32))) {
+                continue;
+            }
+            const TaskStats &ts = _task_stats[i];
+            if (ts.counts.run_count == 0) {
+                continue;
+            }
+            if (worst == -1 ||
+                ts.counts.overrun_count > _task_stats[worst].counts.overrun_count ||
+                (ts.counts.overrun_count == _task_stats[worst].counts.overrun_count &&
+                 ts.max_time_us > _task_stats[worst].max_time_us)) {
+                worst = i;
+            }
+        }
+        if (worst == -1) {
+            break;
+        }
+        sent_mask[worst/32] |= 1U<<(worst%32);
+        const TaskStats &ts = _task_stats[worst];
+        gcs().send_text(MAV_SEVERITY_INFO, "%s n=%u o=%u s=%u max=%u avg=%u",
+                        _tasks[worst].name,
+                        (unsigned)ts.counts.run_count,
+                        (unsigned)ts.counts.overrun_count,
+                        (unsigned)ts.counts.skip_count,
+                        (unsigned)ts.max_time_us,
+                        (unsigned)(ts.elapsed_time_us / ts.counts.run_count));
+        sent++;
+    }
+    return true;
+}
+
 namespace AP {
 
 AP_Scheduler &scheduler()
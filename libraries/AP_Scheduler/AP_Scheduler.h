@@ -23,10 +23,16 @@
 #include <AP_Param/AP_Param.h>
 #include <AP_HAL/Util.h>
 #include <AP_Math/AP_Math.h>
+#include <AP_Common/Bitmask.h>
 #include "PerfInfo.h"       // loop perf monitoring
 
 #define AP_SCHEDULER_NAME_INITIALIZER(_name) .name = #_name,
 
+// number of buckets in the per-task run time histogram. Bucket 0
+// counts runs shorter than 32us, each following bucket doubles that
+// limit and the last bucket catches everything longer
+#define AP_SCHEDULER_TASK_HIST_BUCKETS 8
+
 /*
   useful macro for creating scheduler task table
  */
@@ -37,6 +43,18 @@
     .max_time_micros = _max_time_micros\
 }
 
+/*
+  as SCHED_TASK_CLASS, but with an explicit priority class used by the
+  deadline scheduling mode
+ */
+#define SCHED_TASK_CLASS_PRIO(classname, classptr, func, _rate_hz, _max_time_micros, _priority) { \
+    .function = FUNCTOR_BIND(classptr, &classname::func, void),\
+    AP_SCHEDULER_NAME_INITIALIZER(func)\
+    .rate_hz = _rate_hz,\
+    .max_time_micros = _max_time_micros,\
+    .priority = _priority\
+}
+
 /*
   A task scheduler for APM main loops
 
@@ -67,11 +85,41 @@ public:
 
     FUNCTOR_TYPEDEF(task_fn_t, void);
 
+    // priority classes for deadline scheduling. Tasks left at
+    // PRIORITY_AUTO get a class from their rate
+    enum TaskPriority : uint8_t {
+        PRIORITY_AUTO   = 0,
+        PRIORITY_HIGH   = 1,
+        PRIORITY_NORMAL = 2,
+        PRIORITY_LOW    = 3,
+    };
+
     struct Task {
         task_fn_t function;
         const char *name;
         float rate_hz;
         uint16_t max_time_micros;
+        uint8_t priority;
+    };
+
+    // counters kept for each task
+    struct TaskCounts {
+        uint32_t run_count;             // number of times the task ran
+        uint32_t overrun_count;         // runs that exceeded max_time_micros
+        uint32_t skip_count;            // due but not run for lack of time
+        uint32_t slip_count;            // whole intervals missed
+        uint32_t hist[AP_SCHEDULER_TASK_HIST_BUCKETS];
+    };
+
+    // per-task timing statistics, gathered when the task statistics
+    // option is set. The counts are cumulative since boot; TSK log
+    // messages carry the change over each update_logging() period
+    struct TaskStats {
+        TaskCounts counts;
+        TaskCounts period_start;        // counts at the start of this logging period
+        uint64_t elapsed_time_us;       // sum of all run times
+        uint32_t max_time_us;           // longest run time
+        uint32_t period_max_time_us;    // longest run time this logging period
     };
 
     // initialise scheduler
@@ -81,12 +129,32 @@ public:
     // that function does
     void loop();
 
-    // call to update any logging the scheduler might do; call at 1Hz
+    // call to update any logging the scheduler might do; call at
+    // 1Hz. It asks for further slices while writing TSK messages
     void update_logging();
 
     // write out PERF message to dataflash
     void Log_Write_Performance();
 
+    // number of tasks in the task table
+    uint8_t num_tasks() const { return _num_tasks; }
+
+    // return name of a task in the task table
+    const char *task_name(uint8_t i) const { return i < _num_tasks ? _tasks[i].name : nullptr; }
+
+    // return timing statistics for a task, or nullptr if task
+    // statistics are not enabled
+    const TaskStats *task_stats(uint8_t i) const {
+        if (_task_stats == nullptr || i >= _num_tasks) {
+            return nullptr;
+        }
+        return &_task_stats[i];
+    }
+
+    // send a summary of the tasks with the worst overruns to the GCS
+    // as text messages. Returns false if task statistics are not enabled
+    bool send_task_stats(uint8_t max_tasks) const;
+
     // call when one tick has passed
     void tick(void);
 
@@ -101,6 +169,12 @@ public:
     // return the number of microseconds available for the current task
     uint16_t time_available_usec(void);
 
+    // called by a task which has more work to do than fits in its
+    // max_time_micros. The task is called again on the next tick
+    // regardless of its rate, and should use time_available_usec()
+    // to bound each slice of work
+    void request_another_slice(void) { _task_wants_slice = true; }
+
     // return debug parameter
     uint8_t debug_flags(void) { return _debug; }
 
@@ -148,7 +222,30 @@ public:
     // loop performance monitoring:
     AP::PerfInfo perf_info;
 
+    enum Options {
+        OPTION_TASK_STATS       = (1U<<0),
+        OPTION_DEADLINE_SCHED   = (1U<<1),
+    };
+
 private:
+    // update the statistics for a task after it has run
+    void update_task_stats(uint8_t i, uint32_t time_taken);
+
+    // write out TSK messages and start a new statistics period for
+    // as many tasks as fit in the current slice. Returns true once
+    // every task is done
+    bool end_task_stats_period(void);
+
+    // number of ticks between runs of a task
+    uint16_t task_interval_ticks(uint8_t i) const;
+
+    // priority class of a task, resolving PRIORITY_AUTO
+    uint8_t task_priority(uint8_t i) const;
+
+    // fill _due_tasks with the tasks due this tick in deadline
+    // order, returning the number of due tasks
+    uint8_t order_due_tasks(void);
+
     // function that is called before anything in the scheduler table:
     scheduler_fastloop_fn_t _fastloop_fn;
 
@@ -160,6 +257,13 @@ private:
 
     // loop rate in Hz as set at startup
     AP_Int16 _active_loop_rate_hz;
+
+    // bitmask of Options
+    AP_Int8 _options;
+
+    // number of tasks to report to the GCS on the next
+    // update_logging(), cleared once reported
+    AP_Int8 _report_tasks;
     
     // calculated loop period in usec
     uint16_t _loop_period_us;
@@ -201,6 +305,25 @@ private:
     // performance counters
     AP_HAL::Util::perf_counter_t *_perf_counters;
 
+    // per-task timing statistics, allocated when enabled
+    TaskStats *_task_stats;
+
+    // next task whose statistics period end_task_stats_period()
+    // will finish, and whether it writes TSK messages this period
+    uint8_t _task_stats_next;
+    bool _log_task_stats;
+
+    // tasks due this tick and their sort keys, allocated when
+    // deadline scheduling is enabled
+    uint8_t *_due_tasks;
+    uint16_t *_due_keys;
+
+    // tasks which asked for another slice on the next tick
+    Bitmask *_task_continuing;
+
+    // set when the current task calls request_another_slice()
+    bool _task_wants_slice;
+
     // bitmask bit which indicates if we should log PERF message to dataflash
     uint32_t _log_performance_bit;
 };
@@ -46,12 +46,20 @@ const AP_Param::GroupInfo AP_Terrain::var_info[] = {
 
     // @Param: SPACING
     // @DisplayName: Terrain grid spacing
-    // @Description: Distance between terrain grid points in meters. This controls the horizontal resolution of the terrain data that is stored on te SD card and requested from the ground station. If your GCS is using the worldwide SRTM database then a resolution of 100 meters is appropriate. Some parts of the world may have higher resolution data available, such as 30 meter data available in the SRTM database in the USA. The grid spacing also controls how much data is kept in memory during flight. A larger grid spacing will allow for a larger amount of data in memory. A grid spacing of 100 meters results in the vehicle keeping 12 grid squares in memory with each grid square having a size of 2.7 kilometers by 3.2 kilometers. Any additional grid squares are stored on the SD once they are fetched from the GCS and will be demand loaded as needed.
+    // @Description: Distance between terrain grid points in meters. This controls the horizontal resolution of the terrain data that is stored on te SD card and requested from the ground station. If your GCS is using the worldwide SRTM database then a resolution of 100 meters is appropriate. Some parts of the world may have higher resolution data available, such as 30 meter data available in the SRTM database in the USA. The grid spacing also controls how much data is kept in memory during flight. A larger grid spacing will allow for a larger amount of data in memory. A grid spacing of 100 meters results in the vehicle keeping at least 12 grid squares in memory with each grid square having a size of 2.7 kilometers by 3.2 kilometers. Any additional grid squares are stored on the SD once they are fetched from the GCS and will be demand loaded as needed.
     // @Units: m
     // @Increment: 1
     // @User: Advanced
     AP_GROUPINFO("SPACING",   1, AP_Terrain, grid_spacing, 100),
 
+    // @Param: CACHE_SZ
+    // @DisplayName: Terrain cache size
+    // @Description: The number of terrain grid blocks kept in memory. Each block takes about 2k of memory and covers an area set by the grid spacing. A larger cache means fewer waits on the SD card when flying fast over terrain. Blocks ahead of the vehicle are only prefetched with a cache of at least 12 blocks. The cache is allocated when terrain is first used, so a change needs a reboot. If there isn't the memory for the cache then the default size is used.
+    // @Range: 1 48
+    // @RebootRequired: True
+    // @User: Advanced
+    AP_GROUPINFO("CACHE_SZ",  2, AP_Terrain, config_cache_size, TERRAIN_GRID_BLOCK_CACHE_SIZE),
+
     AP_GROUPEND
 };
 
@@ -60,10 +68,12 @@ AP_Terrain::AP_Terrain(AP_AHRS &_ahrs, const AP_Mission &_mission, const AP_Rall
     ahrs(_ahrs),
     mission(_mission),
     rally(_rally),
-    disk_io_state(DiskIoIdle),
-    fd(-1)
+    fd(-1),
+    file_map(nullptr),
+    file_map_size(0)
 {
     AP_Param::setup_object_defaults(this, var_info);
+    memset(cache_hash, TERRAIN_GRID_CACHE_NONE, sizeof(cache_hash));
 }
 
 /*
@@ -97,56 +107,194 @@ bool AP_Terrain::height_amsl(const Location &loc, float &height, bool corrected)
     calculate_grid_info(loc, info);
 
     // find the grid
-    const struct grid_block &grid = find_grid_cache(info).grid;
+    const struct grid_block &grid = lookup_grid_cache(info).grid;
+
+    if (!interpolate_height(grid, info.idx_x, info.idx_y, info.frac_x, info.frac_y, height)) {
+        return false;
+    }
+
+    if (loc.lat == ahrs.get_home().lat &&
+        loc.lng == ahrs.get_home().lng) {
+        // remember home altitude as a special case
+        home_height = height;
+        home_loc = loc;
+    }
+
+    // apply correction which assumes home altitude is at terrain altitude
+    if (corrected) {
+        height += (ahrs.get_home().alt * 0.01f) - home_height;
+    }
+
+    return true;
+}
+
+
+/*
+  find the cache block for a grid_info, counting cache hits and
+  misses for logging
+ */
+const AP_Terrain::grid_cache &AP_Terrain::lookup_grid_cache(const struct grid_info &info)
+{
+    const struct grid_cache &gcache = find_grid_cache(info);
+    if (gcache.state == GRID_CACHE_DISKWAIT) {
+        cache_misses++;
+    } else {
+        cache_hits++;
+    }
+    return gcache;
+}
 
+/*
+  interpolate the height at a point within a grid block. Returns false
+  if the block doesn't have the data
+ */
+bool AP_Terrain::interpolate_height(const struct grid_block &grid, uint8_t idx_x, uint8_t idx_y,
+                                    float frac_x, float frac_y, float &height)
+{
     /*
       note that we rely on the one square overlap to ensure these
       calculations don't go past the end of the arrays
      */
-    ASSERT_RANGE(info.idx_x, 0, TERRAIN_GRID_BLOCK_SIZE_X-2);
-    ASSERT_RANGE(info.idx_y, 0, TERRAIN_GRID_BLOCK_SIZE_Y-2);
+    ASSERT_RANGE(idx_x, 0, TERRAIN_GRID_BLOCK_SIZE_X-2);
+    ASSERT_RANGE(idx_y, 0, TERRAIN_GRID_BLOCK_SIZE_Y-2);
 
 
     // check we have all 4 required heights
-    if (!check_bitmap(grid, info.idx_x,   info.idx_y) ||
-        !check_bitmap(grid, info.idx_x,   info.idx_y+1) ||
-        !check_bitmap(grid, info.idx_x+1, info.idx_y) ||
-        !check_bitmap(grid, info.idx_x+1, info.idx_y+1)) {
+    if (!check_bitmap(grid, idx_x,   idx_y) ||
+        !check_bitmap(grid, idx_x,   idx_y+1) ||
+        !check_bitmap(grid, idx_x+1, idx_y) ||
+        !check_bitmap(grid, idx_x+1, idx_y+1)) {
         return false;
     }
 
     // hXY are the heights of the 4 surrounding grid points
     int16_t h00, h01, h10, h11;
 
-    h00 = grid.height[info.idx_x+0][info.idx_y+0];
-    h01 = grid.height[info.idx_x+0][info.idx_y+1];
-    h10 = grid.height[info.idx_x+1][info.idx_y+0];
-    h11 = grid.height[info.idx_x+1][info.idx_y+1];
+    h00 = grid.height[idx_x+0][idx_y+0];
+    h01 = grid.height[idx_x+0][idx_y+1];
+    h10 = grid.height[idx_x+1][idx_y+0];
+    h11 = grid.height[idx_x+1][idx_y+1];
 
     // do a simple dual linear interpolation. We could do something
     // fancier, but it probably isn't worth it as long as the
     // grid_spacing is kept small enough
-    float avg1 = (1.0f-info.frac_x) * h00  + info.frac_x * h10;
-    float avg2 = (1.0f-info.frac_x) * h01  + info.frac_x * h11;
-    float avg  = (1.0f-info.frac_y) * avg1 + info.frac_y * avg2;
+    float avg1 = (1.0f-frac_x) * h00  + frac_x * h10;
+    float avg2 = (1.0f-frac_x) * h01  + frac_x * h11;
+    height     = (1.0f-frac_y) * avg1 + frac_y * avg2;
 
-    height = avg;
+    return true;
+}
 
-    if (loc.lat == ahrs.get_home().lat &&
-        loc.lng == ahrs.get_home().lng) {
-        // remember home altitude as a special case
-        home_height = height;
-        home_loc = loc;
+/*
+  fill heights[] with terrain heights at first, first+step,
+  first+2*step... meters along a line from start, up to distance
+  meters. The grid block is found once for all the points which fall
+  in it, and each point is then placed in the block by its offset
+  from where the line entered the block, rather than by a full
+  calculate_grid_info()
+ */
+uint16_t AP_Terrain::profile_line(const Location &start, float bearing, float first, float distance,
+                                  float step, float heights[], uint16_t max_points)
+{
+    if (first > distance) {
+        return 0;
     }
-
-    // apply correction which assumes home altitude is at terrain altitude
-    if (corrected) {
-        height += (ahrs.get_home().alt * 0.01f) - home_height;
+    const uint16_t num_points = MIN((distance - first) / step, (float)(max_points-1)) + 1;
+    const float cos_bearing = cosf(radians(bearing));
+    const float sin_bearing = sinf(radians(bearing));
+
+    const struct grid_cache *gcache = nullptr;
+
+    // where the line entered the current block, as an offset from
+    // start and as grid coordinates within the block
+    Vector2f entry_ofs;
+    float entry_x = 0, entry_y = 0;
+
+    // east offsets from start are scaled at the latitude of start,
+    // the grid is scaled at the latitude of its degree reference
+    float east_scale = 1;
+
+    // extent of the current block. Blocks on the north and east edges
+    // of a degree reach past it, but points beyond the degree are
+    // looked up in the next degree's blocks, as calculate_grid_info()
+    // would
+    float max_x = 0, max_y = 0;
+
+    for (uint16_t i=0; i<num_points; i++) {
+        const float d = first + i * step;
+        const Vector2f ofs(d * cos_bearing, d * sin_bearing);
+        float x = 0, y = 0;
+        if (gcache != nullptr) {
+            x = entry_x + (ofs.x - entry_ofs.x) / grid_spacing;
+            y = entry_y + (ofs.y - entry_ofs.y) * east_scale / grid_spacing;
+        }
+        if (gcache == nullptr ||
+            x < 0 || x >= max_x ||
+            y < 0 || y >= max_y) {
+            // moved into a new block
+            Location loc = start;
+            location_offset(loc, ofs.x, ofs.y);
+            struct grid_info info;
+            calculate_grid_info(loc, info);
+            gcache = &lookup_grid_cache(info);
+            Location ref;
+            ref.lat = info.lat_degrees*10*1000*1000L;
+            ref.lng = info.lon_degrees*10*1000*1000L;
+            east_scale = longitude_scale(ref) / longitude_scale(start);
+            const float degree_x = 10*1000*1000L * LOCATION_SCALING_FACTOR / grid_spacing;
+            const float degree_y = degree_x * longitude_scale(ref);
+            max_x = MIN(TERRAIN_GRID_BLOCK_SPACING_X, degree_x - info.grid_idx_x * TERRAIN_GRID_BLOCK_SPACING_X);
+            max_y = MIN(TERRAIN_GRID_BLOCK_SPACING_Y, degree_y - info.grid_idx_y * TERRAIN_GRID_BLOCK_SPACING_Y);
+            entry_ofs = ofs;
+            entry_x = x = info.idx_x + info.frac_x;
+            entry_y = y = info.idx_y + info.frac_y;
+        }
+        const uint8_t idx_x = x;
+        const uint8_t idx_y = y;
+        if (!interpolate_height(gcache->grid, idx_x, idx_y, x - idx_x, y - idx_y, heights[i])) {
+            heights[i] = NAN;
+        }
     }
+    return num_points;
+}
 
-    return true;
+/*
+  terrain height profile along a line
+ */
+uint16_t AP_Terrain::height_profile(const Location &start, float bearing, float distance,
+                                    float step, float heights[], uint16_t max_points)
+{
+    if (!allocate() || grid_spacing <= 0 || step <= 0 || max_points == 0) {
+        return 0;
+    }
+    return profile_line(start, bearing, 0, distance, step, heights, max_points);
 }
 
+/*
+  terrain height profile along a polyline
+ */
+uint16_t AP_Terrain::height_profile(const Location points[], uint8_t num_points,
+                                    float step, float heights[], uint16_t max_points)
+{
+    if (!allocate() || grid_spacing <= 0 || step <= 0 || max_points == 0 || num_points == 0) {
+        return 0;
+    }
+    if (num_points == 1) {
+        return profile_line(points[0], 0, 0, 0, step, heights, max_points);
+    }
+    uint16_t count = 0;
+    // distance along the current leg of the next point
+    float next = 0;
+    for (uint8_t i=0; i<num_points-1 && count < max_points; i++) {
+        const float leg = get_distance(points[i], points[i+1]);
+        const float bearing = get_bearing_cd(points[i], points[i+1]) * 0.01f;
+        const uint16_t n = profile_line(points[i], bearing, next, leg, step,
+                                        &heights[count], max_points - count);
+        count += n;
+        next += n * step - leg;
+    }
+    return count;
+}
 
 /* 
    find difference between home terrain height and the terrain
@@ -264,21 +412,28 @@ float AP_Terrain::lookahead(float bearing, float distance, float climb_ratio)
         return 0;
     }
 
-    float climb = 0;
     float lookahead_estimate = 0;
 
-    // check for terrain at grid spacing intervals
-    while (distance > 0) {
-        location_update(loc, bearing, grid_spacing);
-        climb += climb_ratio * grid_spacing;
-        distance -= grid_spacing;
-        float height;
-        if (height_amsl(loc, height, false)) {
-            float rise = (height - base_height) - climb;
+    // check for terrain at grid spacing intervals, a batch of points
+    // at a time. The last point is at or just beyond distance, so a
+    // distance which isn't a multiple of the grid spacing is covered
+    const float end = ceilf(distance / grid_spacing) * grid_spacing;
+    float heights[32];
+    uint16_t done = 0;
+    uint16_t n;
+    while ((n = profile_line(loc, bearing, (done+1)*(float)grid_spacing, end,
+                             grid_spacing, heights, ARRAY_SIZE(heights))) > 0) {
+        for (uint16_t i=0; i<n; i++) {
+            if (isnan(heights[i])) {
+                continue;
+            }
+            float climb = climb_ratio * grid_spacing * (done+i+1);
+            float rise = (heights[i] - base_height) - climb;
             if (rise > lookahead_estimate) {
                 lookahead_estimate = rise;
             }
         }
+        done += n;
     }
 
     return lookahead_estimate;
@@ -292,7 +447,10 @@ float AP_Terrain::lookahead(float bearing, float distance, float climb_ratio)
  */
 void AP_Terrain::update(void)
 {
-    // just schedule any needed disk IO
+    // load the blocks we are heading for
+    update_prefetch();
+
+    // schedule any needed disk IO
     schedule_disk_io();
 
     // try to ensure the home location is populated
@@ -364,7 +522,9 @@ void AP_Terrain::log_terrain_data(DataFlash_Class &dataflash)
         terrain_height : terrain_height,
         current_height : current_height,
         pending        : pending,
-        loaded         : loaded
+        loaded         : loaded,
+        cache_hits     : cache_hits,
+        cache_misses   : cache_misses
     };
     dataflash.WriteBlock(&pkt, sizeof(pkt));
 }
@@ -381,13 +541,27 @@ bool AP_Terrain::allocate(void)
     if (cache != nullptr) {
         return true;
     }
-    cache = (struct grid_cache *)calloc(TERRAIN_GRID_BLOCK_CACHE_SIZE, sizeof(cache[0]));
+    disk_io = (struct disk_io_slot *)calloc(TERRAIN_DISK_IO_QUEUE_SIZE, sizeof(disk_io[0]));
+    if (disk_io == nullptr) {
+        enable.set(0);
+        gcs().send_text(MAV_SEVERITY_CRITICAL, "Terrain: Allocation failed");
+        return false;
+    }
+
+    uint16_t size = constrain_int16(config_cache_size, 1, TERRAIN_GRID_BLOCK_CACHE_MAX);
+    cache = (struct grid_cache *)calloc(size, sizeof(cache[0]));
+    if (cache == nullptr && size > TERRAIN_GRID_BLOCK_CACHE_SIZE) {
+        size = TERRAIN_GRID_BLOCK_CACHE_SIZE;
+        cache = (struct grid_cache *)calloc(size, sizeof(cache[0]));
+    }
     if (cache == nullptr) {
+        free(disk_io);
+        disk_io = nullptr;
         enable.set(0);
         gcs().send_text(MAV_SEVERITY_CRITICAL, "Terrain: Allocation failed");
         return false;
     }
-    cache_size = TERRAIN_GRID_BLOCK_CACHE_SIZE;
+    cache_size = size;
     return true;
 }
 
@@ -52,12 +52,44 @@
 #define TERRAIN_GRID_BLOCK_SIZE_X (TERRAIN_GRID_MAVLINK_SIZE*TERRAIN_GRID_BLOCK_MUL_X)
 #define TERRAIN_GRID_BLOCK_SIZE_Y (TERRAIN_GRID_MAVLINK_SIZE*TERRAIN_GRID_BLOCK_MUL_Y)
 
-// number of grid_blocks in the LRU memory cache
+// default number of grid_blocks in the LRU memory cache, set by the
+// TERRAIN_CACHE_SZ parameter up to the board's limit
 #define TERRAIN_GRID_BLOCK_CACHE_SIZE 12
+#ifndef TERRAIN_GRID_BLOCK_CACHE_MAX
+#define TERRAIN_GRID_BLOCK_CACHE_MAX 48
+#endif
+
+// number of hash chains for finding grid_blocks in the cache, a power of 2
+#define TERRAIN_GRID_CACHE_HASH_SIZE 128
+
+// marks the end of a hash chain
+#define TERRAIN_GRID_CACHE_NONE 0xFF
+
+#if TERRAIN_GRID_BLOCK_CACHE_MAX >= TERRAIN_GRID_CACHE_NONE
+#error "TERRAIN_GRID_BLOCK_CACHE_MAX too large"
+#endif
+
+// number of grid_blocks which can be in flight to or from disk
+#define TERRAIN_DISK_IO_QUEUE_SIZE 4
+
+// seconds of flight ahead of the vehicle to prefetch grid_blocks for
+#define TERRAIN_PREFETCH_TIME 60
+
+// minimum ground speed in m/s for velocity based prefetch
+#define TERRAIN_PREFETCH_MIN_SPEED 2
 
 // format of grid on disk
 #define TERRAIN_GRID_FORMAT_VERSION 1
 
+// map the degree files into memory rather than using read() and
+// write(), on boards with an MMU and plenty of address space
+#ifndef AP_TERRAIN_USE_MMAP
+#define AP_TERRAIN_USE_MMAP (CONFIG_HAL_BOARD == HAL_BOARD_SITL || CONFIG_HAL_BOARD == HAL_BOARD_LINUX)
+#endif
+
+// largest degree file to map, larger files use read() and write()
+#define TERRAIN_MMAP_MAX_SIZE (128*1024*1024UL)
+
 #if TERRAIN_DEBUG
 #define ASSERT_RANGE(v,minv,maxv) assert((v)<=(maxv)&&(v)>=(minv))
 #else
@@ -75,6 +107,8 @@
  */
 
 class AP_Terrain {
+    friend class AP_Terrain_Test;
+
 public:
     AP_Terrain(AP_AHRS &_ahrs, const AP_Mission &_mission, const AP_Rally &_rally);
 
@@ -167,6 +201,25 @@ public:
      */
     float lookahead(float bearing, float distance, float climb_ratio);
 
+    /*
+      terrain heights in meters above sea level at step meter
+      intervals along a line from start, starting with start itself
+      and ending at most distance meters away. This is much cheaper
+      than calling height_amsl() for each point.
+
+      heights[] has room for max_points. Returns the number of points
+      filled in. Points with no terrain data available are NaN
+     */
+    uint16_t height_profile(const Location &start, float bearing, float distance,
+                            float step, float heights[], uint16_t max_points);
+
+    /*
+      terrain heights at step meter intervals of path length along a
+      polyline through num_points points, as above
+     */
+    uint16_t height_profile(const Location points[], uint8_t num_points,
+                            float step, float heights[], uint16_t max_points);
+
     /*
       log terrain status to DataFlash
      */
@@ -241,6 +294,9 @@ private:
 
         // the last time access was requested to this block, used for LRU
         uint32_t last_access_ms;
+
+        // next block in the same hash chain
+        uint8_t hash_next;
     };
 
     /*
@@ -279,6 +335,26 @@ private:
       find a grid structure given a grid_info
     */
     struct grid_cache &find_grid_cache(const struct grid_info &info);
+    const struct grid_cache &lookup_grid_cache(const struct grid_info &info);
+
+    /*
+      interpolate a height from the 4 grid points around a point in
+      a grid block
+     */
+    bool interpolate_height(const struct grid_block &grid, uint8_t idx_x, uint8_t idx_y,
+                            float frac_x, float frac_y, float &height);
+
+    // heights along a line, see height_profile()
+    uint16_t profile_line(const Location &start, float bearing, float first, float distance,
+                          float step, float heights[], uint16_t max_points);
+
+    /*
+      hash chains of the cache, indexed by SW corner of the block
+     */
+    uint8_t cache_hash_index(int32_t lat, int32_t lon) const;
+    void cache_hash_add(uint8_t idx);
+    void cache_hash_remove(uint8_t idx);
+    int16_t find_cache_idx(int32_t lat, int32_t lon, uint16_t spacing) const;
 
     /*
       calculate bit number in grid_block bitmap. This corresponds to a
@@ -311,21 +387,35 @@ private:
     /*
       disk IO functions
      */
-    int16_t find_io_idx(enum GridCacheState state);
+    struct disk_io_slot;
+    int16_t find_io_idx(const struct grid_block &block, enum GridCacheState state);
     uint16_t get_block_crc(struct grid_block &block);
+    bool io_queued(const struct grid_cache &gcache) const;
+    struct disk_io_slot *free_io_slot(void);
     void check_disk_read(void);
     void check_disk_write(void);
+    void check_disk_done(void);
     void io_timer(void);
-    void open_file(void);
-    void seek_offset(void);
-    void write_block(void);
-    void read_block(void);
+    void open_file(struct grid_block &block);
+    void close_file(void);
+    void map_file(const struct grid_block &block);
+    uint16_t east_blocks(const struct grid_block &block) const;
+    uint32_t block_offset(const struct grid_block &block) const;
+    void seek_offset(struct grid_block &block);
+    void write_block(struct disk_io_slot &io);
+    void read_block(struct disk_io_slot &io);
 
     /*
       check for missing mission terrain data
      */
     void update_mission_data(void);
 
+    /*
+      load grid_blocks ahead of the vehicle into the cache
+     */
+    void update_prefetch(void);
+    void prefetch_along(const Location &loc, float bearing, float distance, uint8_t &budget);
+
     /*
       check for missing rally data
      */
@@ -335,6 +425,7 @@ private:
     // parameters
     AP_Int8  enable;
     AP_Int16 grid_spacing; // meters between grid points
+    AP_Int16 config_cache_size; // grid_blocks to cache in memory
 
     // reference to AHRS, so we can ask for our position,
     // heading and speed
@@ -352,7 +443,14 @@ private:
     uint8_t cache_size = 0;
     struct grid_cache *cache = nullptr;
 
-    // a grid_cache block waiting for disk IO
+    // heads of the cache hash chains
+    uint8_t cache_hash[TERRAIN_GRID_CACHE_HASH_SIZE];
+
+    // cache lookups by height_amsl(), for logging
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+
+    // grid_cache blocks waiting for disk IO
     enum DiskIoState {
         DiskIoIdle      = 0,
         DiskIoWaitWrite = 1,
@@ -360,8 +458,11 @@ private:
         DiskIoDoneRead  = 3,
         DiskIoDoneWrite = 4
     };
-    volatile enum DiskIoState disk_io_state;
-    union grid_io_block disk_block;
+    struct disk_io_slot {
+        union grid_io_block block;
+        volatile enum DiskIoState state;
+    };
+    struct disk_io_slot *disk_io = nullptr;
 
     // last time we asked for more grids
     uint32_t last_request_time_ms[MAVLINK_COMM_NUM_BUFFERS];
@@ -371,6 +472,10 @@ private:
     // open file handle on degree file
     int fd;
 
+    // the degree file mapped into memory, or nullptr
+    uint8_t *file_map;
+    uint32_t file_map_size;
+
     // has the timer been setup?
     bool timer_setup;
 
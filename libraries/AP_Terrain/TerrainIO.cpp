@@ -33,36 +33,118 @@
 #include <fcntl.h>
 #include <errno.h>
 #endif
+#if AP_TERRAIN_USE_MMAP
+#include <sys/mman.h>
+#endif
 #include <sys/types.h>
 
 extern const AP_HAL::HAL& hal;
 
 /*
-  check for blocks that need to be read from disk
+  see if a cache block already has disk IO in flight
+ */
+bool AP_Terrain::io_queued(const struct grid_cache &gcache) const
+{
+    for (uint8_t i=0; i<TERRAIN_DISK_IO_QUEUE_SIZE; i++) {
+        if (disk_io[i].state != DiskIoIdle &&
+            disk_io[i].block.block.lat == gcache.grid.lat &&
+            disk_io[i].block.block.lon == gcache.grid.lon) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+  find an IO slot owned by the main thread and not in use
+ */
+struct AP_Terrain::disk_io_slot *AP_Terrain::free_io_slot(void)
+{
+    for (uint8_t i=0; i<TERRAIN_DISK_IO_QUEUE_SIZE; i++) {
+        if (disk_io[i].state == DiskIoIdle) {
+            return &disk_io[i];
+        }
+    }
+    return nullptr;
+}
+
+/*
+  queue blocks that need to be read from disk
  */
 void AP_Terrain::check_disk_read(void)
 {
     for (uint16_t i=0; i<cache_size; i++) {
-        if (cache[i].state == GRID_CACHE_DISKWAIT) {
-            disk_block.block = cache[i].grid;
-            disk_io_state = DiskIoWaitRead;
-            return;
+        if (cache[i].state == GRID_CACHE_DISKWAIT && !io_queued(cache[i])) {
+            struct disk_io_slot *io = free_io_slot();
+            if (io == nullptr) {
+                return;
+            }
+            io->block.block = cache[i].grid;
+            io->state = DiskIoWaitRead;
         }
-    }    
+    }
 }
 
 /*
-  check for blocks that need to be written to disk
+  queue blocks that need to be written to disk
  */
 void AP_Terrain::check_disk_write(void)
 {
     for (uint16_t i=0; i<cache_size; i++) {
-        if (cache[i].state == GRID_CACHE_DIRTY) {
-            disk_block.block = cache[i].grid;
-            disk_io_state = DiskIoWaitWrite;
-            return;
+        if (cache[i].state == GRID_CACHE_DIRTY && !io_queued(cache[i])) {
+            struct disk_io_slot *io = free_io_slot();
+            if (io == nullptr) {
+                return;
+            }
+            io->block.block = cache[i].grid;
+            io->state = DiskIoWaitWrite;
+        }
+    }
+}
+
+/*
+  take the results of completed disk IO
+ */
+void AP_Terrain::check_disk_done(void)
+{
+    for (uint8_t i=0; i<TERRAIN_DISK_IO_QUEUE_SIZE; i++) {
+        struct disk_io_slot &io = disk_io[i];
+        switch (io.state) {
+        case DiskIoDoneRead: {
+            // a read has completed
+            int16_t cache_idx = find_io_idx(io.block.block, GRID_CACHE_DISKWAIT);
+            if (cache_idx != -1) {
+                if (io.block.block.bitmap != 0) {
+                    // when bitmap is zero we read an empty block
+                    cache[cache_idx].grid = io.block.block;
+                }
+                cache[cache_idx].state = GRID_CACHE_VALID;
+                cache[cache_idx].last_access_ms = AP_HAL::millis();
+            }
+            io.state = DiskIoIdle;
+            break;
         }
-    }    
+
+        case DiskIoDoneWrite: {
+            // a write has completed
+            int16_t cache_idx = find_io_idx(io.block.block, GRID_CACHE_DIRTY);
+            if (cache_idx != -1) {
+                if (cache[cache_idx].grid.bitmap == io.block.block.bitmap) {
+                    // only mark valid if more grids haven't been added
+                    cache[cache_idx].state = GRID_CACHE_VALID;
+                }
+            }
+            io.state = DiskIoIdle;
+            break;
+        }
+
+        case DiskIoIdle:
+        case DiskIoWaitWrite:
+        case DiskIoWaitRead:
+            // idle or waiting for io_timer()
+            break;
+        }
+    }
 }
 
 /*
@@ -79,61 +161,23 @@ void AP_Terrain::schedule_disk_io(void)
         hal.scheduler->register_io_process(FUNCTOR_BIND_MEMBER(&AP_Terrain::io_timer, void));
     }
 
-    switch (disk_io_state) {
-    case DiskIoIdle:
-        // look for a block that needs reading or writing
-        check_disk_read();
-        if (disk_io_state == DiskIoIdle) {
-            // still idle, check for writes
-            check_disk_write();            
-        }
-        break;
-        
-    case DiskIoDoneRead: {
-        // a read has completed
-        int16_t cache_idx = find_io_idx(GRID_CACHE_DISKWAIT);
-        if (cache_idx != -1) {
-            if (disk_block.block.bitmap != 0) {
-                // when bitmap is zero we read an empty block
-                cache[cache_idx].grid = disk_block.block;
-            }
-            cache[cache_idx].state = GRID_CACHE_VALID;
-            cache[cache_idx].last_access_ms = AP_HAL::millis();
-        }
-        disk_io_state = DiskIoIdle;
-        break;
-    }
+    check_disk_done();
 
-    case DiskIoDoneWrite: {
-        // a write has completed
-        int16_t cache_idx = find_io_idx(GRID_CACHE_DIRTY);
-        if (cache_idx != -1) {
-            if (cache[cache_idx].grid.bitmap == disk_block.block.bitmap) {
-                // only mark valid if more grids haven't been added
-                cache[cache_idx].state = GRID_CACHE_VALID;
-            }
-        }
-        disk_io_state = DiskIoIdle;
-        break;
-    }
-        
-    case DiskIoWaitWrite:
-    case DiskIoWaitRead:
-        // waiting for io_timer()
-        break;
-    }
+    // fill the free IO slots, reads first
+    check_disk_read();
+    check_disk_write();
 }
 
 
 /********************************************************
 All the functions below this point run in the IO timer context, which
-is a separate thread. The code uses the state machine controlled by
-disk_io_state to manage who has access to the structures and to
-prevent race conditions.
+is a separate thread. The code uses the state machine in each
+disk_io_slot to manage who has access to the slot and to prevent race
+conditions.
 
-The IO timer context owns the data when disk_io_state is
-DiskIoWaitWrite or DiskIoWaitRead. The main thread owns the data when
-disk_io_state is DiskIoIdle, DiskIoDoneWrite or DiskIoDoneRead
+The IO timer context owns a slot when its state is DiskIoWaitWrite or
+DiskIoWaitRead. The main thread owns it when the state is DiskIoIdle,
+DiskIoDoneWrite or DiskIoDoneRead
 
 All file operations are done by the IO thread.
 *********************************************************/
@@ -142,9 +186,8 @@ All file operations are done by the IO thread.
 /*
   open the current degree file
  */
-void AP_Terrain::open_file(void)
+void AP_Terrain::open_file(struct grid_block &block)
 {
-    struct grid_block &block = disk_block.block;
     if (fd != -1 && 
         block.lat_degrees == file_lat_degrees &&
         block.lon_degrees == file_lon_degrees) {
@@ -196,7 +239,7 @@ void AP_Terrain::open_file(void)
     }
 
     if (fd != -1) {
-        ::close(fd);
+        close_file();
     }
 #if HAL_OS_POSIX_IO
     fd = ::open(file_path, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
@@ -214,15 +257,80 @@ void AP_Terrain::open_file(void)
 
     file_lat_degrees = block.lat_degrees;
     file_lon_degrees = block.lon_degrees;
+
+#if AP_TERRAIN_USE_MMAP
+    map_file(block);
+#endif
+}
+
+/*
+  close the current degree file
+ */
+void AP_Terrain::close_file(void)
+{
+#if AP_TERRAIN_USE_MMAP
+    if (file_map != nullptr) {
+        munmap(file_map, file_map_size);
+        file_map = nullptr;
+        file_map_size = 0;
+    }
+#endif
+    ::close(fd);
+    fd = -1;
 }
 
+#if AP_TERRAIN_USE_MMAP
 /*
-  seek to the right offset for disk_block
+  map the open degree file into memory for reading. The file is
+  extended, sparsely, to hold every block of the degree so that all of
+  it can be mapped at once. If this fails then read() is used.
+
+  Blocks are always written with write(). A store into a shared
+  mapping can't report a full or failing filesystem except by raising
+  SIGBUS, while write() lets us set io_failure and carry on
  */
-void AP_Terrain::seek_offset(void)
+void AP_Terrain::map_file(const struct grid_block &block)
+{
+    // highest grid indices of blocks in this degree
+    Location ref;
+    ref.lat = block.lat_degrees*10*1000*1000L;
+    ref.lng = block.lon_degrees*10*1000*1000L;
+    const float degree_m = 10*1000*1000L * LOCATION_SCALING_FACTOR;
+    const uint32_t max_idx_x = degree_m / (grid_spacing*TERRAIN_GRID_BLOCK_SPACING_X) + 1;
+    const uint32_t max_idx_y = degree_m * longitude_scale(ref) / (grid_spacing*TERRAIN_GRID_BLOCK_SPACING_Y) + 1;
+
+    const uint64_t size = ((uint64_t)east_blocks(block) * max_idx_x + max_idx_y + 1) * sizeof(union grid_io_block);
+    if (size > TERRAIN_MMAP_MAX_SIZE) {
+        return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        return;
+    }
+    if ((uint64_t)st.st_size < size && ::ftruncate(fd, size) != 0) {
+        return;
+    }
+    void *map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+#if TERRAIN_DEBUG
+        hal.console->printf("mmap %s failed - %s\n", file_path, strerror(errno));
+#endif
+        return;
+    }
+    // start reading the file in, so blocks are in memory before they
+    // are asked for
+    ::madvise(map, size, MADV_WILLNEED);
+    file_map = (uint8_t *)map;
+    file_map_size = size;
+}
+#endif // AP_TERRAIN_USE_MMAP
+
+/*
+  work out how many longitude blocks there are at the latitude of a
+  block
+ */
+uint16_t AP_Terrain::east_blocks(const struct grid_block &block) const
 {
-    struct grid_block &block = disk_block.block;
-    // work out how many longitude blocks there are at this latitude
     Location loc1, loc2;
     loc1.lat = block.lat_degrees*10*1000*1000L;
     loc1.lng = block.lon_degrees*10*1000*1000L;
@@ -232,40 +340,53 @@ void AP_Terrain::seek_offset(void)
     // shift another two blocks east to ensure room is available
     location_offset(loc2, 0, 2*grid_spacing*TERRAIN_GRID_BLOCK_SIZE_Y);
     Vector2f offset = location_diff(loc1, loc2);
-    uint16_t east_blocks = offset.y / (grid_spacing*TERRAIN_GRID_BLOCK_SIZE_Y);
+    return offset.y / (grid_spacing*TERRAIN_GRID_BLOCK_SIZE_Y);
+}
+
+/*
+  offset of a block in its degree file
+ */
+uint32_t AP_Terrain::block_offset(const struct grid_block &block) const
+{
+    return (east_blocks(block) * block.grid_idx_x +
+            block.grid_idx_y) * sizeof(union grid_io_block);
+}
 
-    uint32_t file_offset = (east_blocks * block.grid_idx_x + 
-                            block.grid_idx_y) * sizeof(union grid_io_block);
+/*
+  seek to the right offset for a block
+ */
+void AP_Terrain::seek_offset(struct grid_block &block)
+{
+    uint32_t file_offset = block_offset(block);
     if (::lseek(fd, file_offset, SEEK_SET) != (off_t)file_offset) {
 #if TERRAIN_DEBUG
         hal.console->printf("Seek %lu failed - %s\n",
                             (unsigned long)file_offset, strerror(errno));
 #endif
-        ::close(fd);
-        fd = -1;
+        close_file();
         io_failure = true;
     }
 }
 
 /*
-  write out disk_block
+  write out the block in an IO slot
  */
-void AP_Terrain::write_block(void)
+void AP_Terrain::write_block(struct disk_io_slot &io)
 {
-    seek_offset();
+    union grid_io_block &disk_block = io.block;
+    disk_block.block.crc = get_block_crc(disk_block.block);
+
+    seek_offset(disk_block.block);
     if (io_failure) {
         return;
     }
 
-    disk_block.block.crc = get_block_crc(disk_block.block);
-
     ssize_t ret = ::write(fd, &disk_block, sizeof(disk_block));
     if (ret  != sizeof(disk_block)) {
 #if TERRAIN_DEBUG
         hal.console->printf("write failed - %s\n", strerror(errno));
 #endif
-        ::close(fd);
-        fd = -1;
+        close_file();
         io_failure = true;
     } else {
         ::fsync(fd);
@@ -277,22 +398,33 @@ void AP_Terrain::write_block(void)
                (unsigned long long)disk_block.block.bitmap);
 #endif
     }
-    disk_io_state = DiskIoDoneWrite;
+    io.state = DiskIoDoneWrite;
 }
 
 /*
-  read in disk_block
+  read in the block in an IO slot
  */
-void AP_Terrain::read_block(void)
+void AP_Terrain::read_block(struct disk_io_slot &io)
 {
-    seek_offset();
-    if (io_failure) {
-        return;
-    }
+    union grid_io_block &disk_block = io.block;
     int32_t lat = disk_block.block.lat;
     int32_t lon = disk_block.block.lon;
-
-    ssize_t ret = ::read(fd, &disk_block, sizeof(disk_block));
+    ssize_t ret;
+
+#if AP_TERRAIN_USE_MMAP
+    uint32_t file_offset = block_offset(disk_block.block);
+    if (file_map != nullptr && file_offset + sizeof(disk_block) <= file_map_size) {
+        memcpy(&disk_block, &file_map[file_offset], sizeof(disk_block));
+        ret = sizeof(disk_block);
+    } else
+#endif
+    {
+        seek_offset(disk_block.block);
+        if (io_failure) {
+            return;
+        }
+        ret = ::read(fd, &disk_block, sizeof(disk_block));
+    }
     if (ret != sizeof(disk_block) || 
         disk_block.block.lat != lat || 
         disk_block.block.lon != lon ||
@@ -321,11 +453,14 @@ void AP_Terrain::read_block(void)
                (unsigned long long)disk_block.block.bitmap);
 #endif
     }
-    disk_io_state = DiskIoDoneRead;
+    io.state = DiskIoDoneRead;
 }
 
 /*
-  timer called to do disk IO
+  timer called to do disk IO. One block is moved per call, so a full
+  queue doesn't hold up the other IO processes. The exception is reads
+  from a mapped file, which are just copies, so those continue
+  through the queue until a write or an unmapped read
  */
 void AP_Terrain::io_timer(void)
 {
@@ -335,30 +470,38 @@ void AP_Terrain::io_timer(void)
         return;
     }
 
-    switch (disk_io_state) {
-    case DiskIoIdle:
-    case DiskIoDoneRead:
-    case DiskIoDoneWrite:
-        // nothing to do
-        break;
-        
-    case DiskIoWaitWrite:
-        // need to write out the block
-        open_file();
-        if (fd == -1) {
+    for (uint8_t i=0; i<TERRAIN_DISK_IO_QUEUE_SIZE; i++) {
+        struct disk_io_slot &io = disk_io[i];
+        switch (io.state) {
+        case DiskIoIdle:
+        case DiskIoDoneRead:
+        case DiskIoDoneWrite:
+            // nothing to do
+            break;
+
+        case DiskIoWaitWrite:
+            // need to write out the block
+            open_file(io.block.block);
+            if (fd == -1) {
+                return;
+            }
+            // writes go through write() and fsync() even when the
+            // file is mapped, so only do one per call
+            write_block(io);
             return;
-        }
-        write_block();
-        break;
 
-    case DiskIoWaitRead:
-        // need to read in the block
-        open_file();
-        if (fd == -1) {
-            return;
+        case DiskIoWaitRead:
+            // need to read in the block
+            open_file(io.block.block);
+            if (fd == -1) {
+                return;
+            }
+            read_block(io);
+            if (file_map == nullptr) {
+                return;
+            }
+            break;
         }
-        read_block();
-        break;
     }
 }
 
@@ -13,7 +13,8 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 /*
-  handle checking mission points for terrain data
+  handle checking mission points for terrain data, and prefetching
+  the data ahead of the vehicle
  */
 
 #include <AP_HAL/AP_HAL.h>
@@ -157,4 +158,74 @@ void AP_Terrain::update_rally_data(void)
     }
 }
 
+/*
+  look up the grid_blocks every half block along a line, so they are
+  read from disk or requested from the GCS before they are needed.
+  budget is the number of new blocks that may be looked up
+ */
+void AP_Terrain::prefetch_along(const Location &loc, float bearing, float distance, uint8_t &budget)
+{
+    const float step = 0.5f * grid_spacing * MIN(TERRAIN_GRID_BLOCK_SPACING_X, TERRAIN_GRID_BLOCK_SPACING_Y);
+    Location loc2 = loc;
+    int32_t last_lat = 0, last_lon = 0;
+    for (float d=step; d<=distance && budget > 0; d+=step) {
+        location_update(loc2, bearing, step);
+        struct grid_info info;
+        calculate_grid_info(loc2, info);
+        if (info.grid_lat == last_lat && info.grid_lon == last_lon) {
+            continue;
+        }
+        last_lat = info.grid_lat;
+        last_lon = info.grid_lon;
+        if (find_cache_idx(info.grid_lat, info.grid_lon, grid_spacing) == -1) {
+            budget--;
+        }
+        find_grid_cache(info);
+    }
+}
+
+/*
+  prefetch the grid_blocks along our velocity vector and along the
+  current mission leg
+ */
+void AP_Terrain::update_prefetch(void)
+{
+    if (!allocate() || grid_spacing <= 0) {
+        return;
+    }
+
+    // a cache smaller than the default has little room beyond the
+    // blocks around the vehicle and the mission, and prefetching
+    // could evict the block we are flying in
+    if (cache_size < TERRAIN_GRID_BLOCK_CACHE_SIZE) {
+        return;
+    }
+
+    Location loc;
+    Vector3f vel;
+    if (!ahrs.get_position(loc) || !ahrs.get_velocity_NED(vel)) {
+        return;
+    }
+
+    // don't let prefetched blocks push out too much of the cache
+    uint8_t budget = MAX(cache_size/4, 2);
+
+    const float step = 0.5f * grid_spacing * MIN(TERRAIN_GRID_BLOCK_SPACING_X, TERRAIN_GRID_BLOCK_SPACING_Y);
+    const float max_distance = budget * step;
+    const float speed = norm(vel.x, vel.y);
+
+    if (speed > TERRAIN_PREFETCH_MIN_SPEED) {
+        float bearing = wrap_360(degrees(atan2f(vel.y, vel.x)));
+        prefetch_along(loc, bearing, MIN(speed * TERRAIN_PREFETCH_TIME, max_distance), budget);
+    }
+
+    if (mission.state() == AP_Mission::MISSION_RUNNING) {
+        const Location &next_wp = mission.get_current_nav_cmd().content.location;
+        if (next_wp.lat != 0 || next_wp.lng != 0) {
+            float bearing = get_bearing_cd(loc, next_wp) * 0.01f;
+            prefetch_along(loc, bearing, MIN(get_distance(loc, next_wp), max_distance), budget);
+        }
+    }
+}
+
 #endif // AP_TERRAIN_AVAILABLE
@@ -113,29 +113,87 @@ void AP_Terrain::calculate_grid_info(const Location &loc, struct grid_info &info
 }
 
 
+/*
+  hash chain for a block SW corner
+ */
+uint8_t AP_Terrain::cache_hash_index(int32_t lat, int32_t lon) const
+{
+    uint32_t h = ((uint32_t)lat * 0x9E3779B1U) ^ ((uint32_t)lon * 0x85EBCA6BU);
+    return (h >> 16) & (TERRAIN_GRID_CACHE_HASH_SIZE-1);
+}
+
+/*
+  add a cache block to its hash chain
+ */
+void AP_Terrain::cache_hash_add(uint8_t idx)
+{
+    uint8_t h = cache_hash_index(cache[idx].grid.lat, cache[idx].grid.lon);
+    cache[idx].hash_next = cache_hash[h];
+    cache_hash[h] = idx;
+}
+
+/*
+  remove a cache block from its hash chain
+ */
+void AP_Terrain::cache_hash_remove(uint8_t idx)
+{
+    uint8_t *p = &cache_hash[cache_hash_index(cache[idx].grid.lat, cache[idx].grid.lon)];
+    while (*p != TERRAIN_GRID_CACHE_NONE) {
+        if (*p == idx) {
+            *p = cache[idx].hash_next;
+            return;
+        }
+        p = &cache[*p].hash_next;
+    }
+}
+
+/*
+  find the cache index of a block, or -1 if it isn't cached
+ */
+int16_t AP_Terrain::find_cache_idx(int32_t lat, int32_t lon, uint16_t spacing) const
+{
+    for (uint8_t i = cache_hash[cache_hash_index(lat, lon)];
+         i != TERRAIN_GRID_CACHE_NONE;
+         i = cache[i].hash_next) {
+        if (cache[i].grid.lat == lat &&
+            cache[i].grid.lon == lon &&
+            cache[i].grid.spacing == spacing) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 /*
   find a grid structure given a grid_info
  */
 AP_Terrain::grid_cache &AP_Terrain::find_grid_cache(const struct grid_info &info)
 {
-    uint16_t oldest_i = 0;
-
     // see if we have that grid
+    int16_t idx = find_cache_idx(info.grid_lat, info.grid_lon, grid_spacing);
+    if (idx != -1) {
+        cache[idx].last_access_ms = AP_HAL::millis();
+        return cache[idx];
+    }
+
+    // Not found. Use the oldest grid and make it this grid, initially
+    // unpopulated. Blocks waiting to be written are kept if possible,
+    // as the GCS would have to send them again
+    uint16_t oldest_i = 0;
+    bool oldest_dirty = true;
     for (uint16_t i=0; i<cache_size; i++) {
-        if (cache[i].grid.lat == info.grid_lat && 
-            cache[i].grid.lon == info.grid_lon &&
-            cache[i].grid.spacing == grid_spacing) {
-            cache[i].last_access_ms = AP_HAL::millis();
-            return cache[i];
-        }
-        if (cache[i].last_access_ms < cache[oldest_i].last_access_ms) {
+        bool dirty = (cache[i].state == GRID_CACHE_DIRTY);
+        if ((oldest_dirty && !dirty) ||
+            (oldest_dirty == dirty && cache[i].last_access_ms < cache[oldest_i].last_access_ms)) {
             oldest_i = i;
+            oldest_dirty = dirty;
         }
     }
 
-    // Not found. Use the oldest grid and make it this grid,
-    // initially unpopulated
     struct grid_cache &grid = cache[oldest_i];
+    if (grid.state != GRID_CACHE_INVALID) {
+        cache_hash_remove(oldest_i);
+    }
     memset(&grid, 0, sizeof(grid));
 
     grid.grid.lat = info.grid_lat;
@@ -151,30 +209,32 @@ AP_Terrain::grid_cache &AP_Terrain::find_grid_cache(const struct grid_info &info
     // mark as waiting for disk read
     grid.state = GRID_CACHE_DISKWAIT;
 
+    cache_hash_add(oldest_i);
+
     return grid;
 }
 
 /*
-  find cache index of disk_block
+  find cache index of a block back from disk IO
  */
-int16_t AP_Terrain::find_io_idx(enum GridCacheState state)
+int16_t AP_Terrain::find_io_idx(const struct grid_block &block, enum GridCacheState state)
 {
-    // try first with given state
-    for (uint16_t i=0; i<cache_size; i++) {
-        if (disk_block.block.lat == cache[i].grid.lat &&
-            disk_block.block.lon == cache[i].grid.lon && 
-            cache[i].state == state) {
-            return i;
+    // the spacing of a block read from disk may not be filled in, so
+    // match on position. Try first with given state
+    int16_t any_idx = -1;
+    for (uint8_t i = cache_hash[cache_hash_index(block.lat, block.lon)];
+         i != TERRAIN_GRID_CACHE_NONE;
+         i = cache[i].hash_next) {
+        if (block.lat == cache[i].grid.lat &&
+            block.lon == cache[i].grid.lon) {
+            if (cache[i].state == state) {
+                return i;
+            }
+            // then any state
+            any_idx = i;
         }
-    }    
-    // then any state
-    for (uint16_t i=0; i<cache_size; i++) {
-        if (disk_block.block.lat == cache[i].grid.lat &&
-            disk_block.block.lon == cache[i].grid.lon) {
-            return i;
-        }
-    }    
-    return -1;
+    }
+    return any_idx;
 }
 
 /*
@@ -0,0 +1,157 @@
+#include <AP_gtest.h>
+
+#include <AP_AHRS/AP_AHRS.h>
+#include <AP_Mission/AP_Mission.h>
+#include <AP_Rally/AP_Rally.h>
+#include <AP_Terrain/AP_Terrain.h>
+
+const AP_HAL::HAL &hal = AP_HAL::get_HAL();
+
+// grid spacing for the tests, giving blocks of 720m by 840m
+#define TEST_GRID_SPACING 30
+
+/*
+  a terrain database whose cache is filled from a synthetic height
+  function rather than from the SD card or the GCS
+ */
+class AP_Terrain_Test
+{
+public:
+    AP_Terrain_Test() {
+        terrain.grid_spacing.set(TEST_GRID_SPACING);
+        terrain.config_cache_size.set(TERRAIN_GRID_BLOCK_CACHE_MAX);
+    }
+
+    // fill every block a line passes through
+    void fill_line(const Location &start, float bearing, float distance) {
+        const float cos_bearing = cosf(radians(bearing));
+        const float sin_bearing = sinf(radians(bearing));
+        for (float d=0; d<=distance + TEST_GRID_SPACING; d += TEST_GRID_SPACING * 0.5f) {
+            Location loc = start;
+            location_offset(loc, d * cos_bearing, d * sin_bearing);
+            fill_block(loc);
+        }
+    }
+
+    // terrain heights along a line, one height_amsl() per point, at
+    // the same locations height_profile() uses
+    uint16_t heights_by_point(const Location &start, float bearing, float distance,
+                              float step, float heights[], uint16_t max_points) {
+        const float cos_bearing = cosf(radians(bearing));
+        const float sin_bearing = sinf(radians(bearing));
+        uint16_t n = 0;
+        while (n < max_points && n * step <= distance) {
+            const float d = n * step;
+            Location loc = start;
+            location_offset(loc, d * cos_bearing, d * sin_bearing);
+            if (!terrain.height_amsl(loc, heights[n], false)) {
+                heights[n] = NAN;
+            }
+            n++;
+        }
+        return n;
+    }
+
+    AP_Terrain &get_terrain() { return terrain; }
+
+private:
+    // smooth terrain, in meters, as a function of position
+    static float height_at(const Location &loc) {
+        Location origin;
+        origin.lat = -353000000;
+        origin.lng = 1490000000;
+        const Vector2f ne = location_diff(origin, loc);
+        return 500 + 0.02f * ne.x - 0.03f * ne.y + 15 * sinf(ne.x / 250) * cosf(ne.y / 310);
+    }
+
+    void fill_block(const Location &loc) {
+        if (!terrain.allocate()) {
+            return;
+        }
+        struct AP_Terrain::grid_info info;
+        terrain.calculate_grid_info(loc, info);
+        struct AP_Terrain::grid_cache &gcache = terrain.find_grid_cache(info);
+        if (gcache.state == AP_Terrain::GRID_CACHE_VALID) {
+            return;
+        }
+        Location ref;
+        ref.lat = info.lat_degrees*10*1000*1000L;
+        ref.lng = info.lon_degrees*10*1000*1000L;
+        for (uint8_t x=0; x<TERRAIN_GRID_BLOCK_SIZE_X; x++) {
+            for (uint8_t y=0; y<TERRAIN_GRID_BLOCK_SIZE_Y; y++) {
+                Location p = ref;
+                location_offset(p,
+                                (info.grid_idx_x * TERRAIN_GRID_BLOCK_SPACING_X + x) * (float)TEST_GRID_SPACING,
+                                (info.grid_idx_y * TERRAIN_GRID_BLOCK_SPACING_Y + y) * (float)TEST_GRID_SPACING);
+                gcache.grid.height[x][y] = lrintf(height_at(p));
+            }
+        }
+        gcache.grid.bitmap = AP_Terrain::bitmap_mask;
+        gcache.state = AP_Terrain::GRID_CACHE_VALID;
+    }
+
+    AP_InertialSensor ins;
+    AP_AHRS_DCM ahrs;
+
+    bool start_cmd(const AP_Mission::Mission_Command &) { return true; }
+    bool verify_cmd(const AP_Mission::Mission_Command &) { return true; }
+    void mission_complete(void) {}
+
+    AP_Mission mission{ahrs,
+            FUNCTOR_BIND_MEMBER(&AP_Terrain_Test::start_cmd, bool, const AP_Mission::Mission_Command &),
+            FUNCTOR_BIND_MEMBER(&AP_Terrain_Test::verify_cmd, bool, const AP_Mission::Mission_Command &),
+            FUNCTOR_BIND_MEMBER(&AP_Terrain_Test::mission_complete, void)};
+    AP_Rally rally{ahrs};
+    AP_Terrain terrain{ahrs, mission, rally};
+};
+
+static AP_Terrain_Test test;
+
+#define MAX_POINTS 400
+
+// compare height_profile() with height_amsl() at each point
+static void check_line(const Location &start, float bearing, float distance, float step)
+{
+    test.fill_line(start, bearing, distance);
+
+    float profile[MAX_POINTS];
+    float by_point[MAX_POINTS];
+    const uint16_t n = test.get_terrain().height_profile(start, bearing, distance, step, profile, MAX_POINTS);
+    const uint16_t expected = test.heights_by_point(start, bearing, distance, step, by_point, MAX_POINTS);
+
+    ASSERT_EQ(expected, n);
+    for (uint16_t i=0; i<n; i++) {
+        ASSERT_FALSE(isnan(by_point[i])) << "point " << i;
+        ASSERT_FALSE(isnan(profile[i])) << "point " << i;
+        EXPECT_NEAR(by_point[i], profile[i], 0.05f) << "point " << i;
+    }
+}
+
+// a line crossing a dozen blocks within one degree
+TEST(AP_Terrain, HeightProfileCrossesBlocks)
+{
+    Location start {};
+    start.lat = -353200000;
+    start.lng = 1491500000;
+    check_line(start, 37, 6000, 17);
+}
+
+// a line crossing both a latitude and a longitude degree boundary
+TEST(AP_Terrain, HeightProfileCrossesDegrees)
+{
+    Location start {};
+    start.lat = -350030000;
+    start.lng = 1489970000;
+    check_line(start, 45, 1500, 23);
+}
+
+// heading west and south, where the block indices decrease
+TEST(AP_Terrain, HeightProfileReverse)
+{
+    Location start {};
+    start.lat = -352900000;
+    start.lng = 1491000000;
+    check_line(start, 200, 4000, 30);
+}
+
+AP_GTEST_MAIN()
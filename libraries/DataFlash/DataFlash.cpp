@@ -33,7 +33,7 @@ const AP_Param::GroupInfo DataFlash_Class::var_info[] = {
 
     // @Param: _FILE_BUFSIZE
     // @DisplayName: Maximum DataFlash File Backend buffer size (in kilobytes)
-    // @Description: The DataFlash_File backend uses a buffer to store data before writing to the block device.  Raising this value may reduce "gaps" in your SD card logging.  This buffer size may be reduced depending on available memory.  PixHawk requires at least 4 kilobytes.  Maximum value available here is 64 kilobytes.
+    // @Description: The DataFlash_File backend uses a buffer to store data before writing to the block device.  Raising this value may reduce "gaps" in your SD card logging.  This buffer size may be reduced depending on available memory, and is rounded down to a power of two.  PixHawk requires at least 4 kilobytes.  Maximum value available here is 64 kilobytes.
     // @User: Standard
     AP_GROUPINFO("_FILE_BUFSIZE",  1, DataFlash_Class, _params.file_bufsize,       HAL_DATAFLASH_FILE_BUFSIZE),
 
@@ -65,6 +65,14 @@ const AP_Param::GroupInfo DataFlash_Class::var_info[] = {
     // @Units: kB
     AP_GROUPINFO("_MAV_BUFSIZE",  5, DataFlash_Class, _params.mav_bufsize,       HAL_DATAFLASH_MAV_BUFSIZE),
 
+    // @Param: _FILE_CMPR
+    // @DisplayName: Compress DataFlash log files
+    // @Description: When set, the DataFlash_File backend writes log files as a sequence of LZ4 compressed blocks, reducing the amount of data written to the SD card and the size of the logs.  Compressed logs are read directly by Replay, but must be decompressed before other ground station tools can read them.
+    // @Values: 0:Disabled,1:Enabled
+    // @User: Advanced
+    // @RebootRequired: True
+    AP_GROUPINFO("_FILE_CMPR",  6, DataFlash_Class, _params.file_compress,       0),
+
     AP_GROUPEND
 };
 
@@ -497,6 +505,34 @@ void DataFlash_Class::WritePrioritisedBlock(const void *pBuffer, uint16_t size,
     FOR_EACH_BACKEND(WritePrioritisedBlock(pBuffer, size, is_critical));
 }
 
+void *DataFlash_Class::ReserveBlock(void *fallback, uint16_t size)
+{
+    // with more than one backend each needs its own copy anyway.
+    // Other threads always take the copying path so only the main
+    // thread ever holds a reservation
+    if (_next_backend != 1 ||
+        _reserved_block != nullptr ||
+        !hal.scheduler->in_main_thread()) {
+        return fallback;
+    }
+    void *ret = backends[0]->ReserveBlock(size, false);
+    if (ret == nullptr) {
+        return fallback;
+    }
+    _reserved_block = ret;
+    return ret;
+}
+
+void DataFlash_Class::CommitBlock(const void *ptr, uint16_t size)
+{
+    if (ptr != nullptr && ptr == _reserved_block) {
+        _reserved_block = nullptr;
+        backends[0]->CommitBlock(ptr, size);
+        return;
+    }
+    WriteBlock(ptr, size);
+}
+
 // change me to "DoTimeConsumingPreparations"?
 void DataFlash_Class::EraseAll() {
     FOR_EACH_BACKEND(EraseAll());
@@ -664,12 +700,10 @@ void DataFlash_Class::Log_WriteV(const char *name, const char *labels, const cha
         return;
     }
 
+    Log_Write_Emit_FMTs(f);
     for (uint8_t i=0; i<_next_backend; i++) {
         if (!(f->sent_mask & (1U<<i))) {
-            if (!backends[i]->Log_Write_Emit_FMT(f->msg_type)) {
-                continue;
-            }
-            f->sent_mask |= (1U<<i);
+            continue;
         }
         va_list arg_copy;
         va_copy(arg_copy, arg_list);
@@ -678,6 +712,31 @@ void DataFlash_Class::Log_WriteV(const char *name, const char *labels, const cha
     }
 }
 
+bool DataFlash_Class::Log_Write_Emit_FMTs(struct log_write_fmt *f)
+{
+    bool ret = true;
+    for (uint8_t i=0; i<_next_backend; i++) {
+        if (f->sent_mask & (1U<<i)) {
+            continue;
+        }
+        if (backends[i]->Log_Write_Emit_FMT(f->msg_type)) {
+            f->sent_mask |= (1U<<i);
+        } else {
+            ret = false;
+        }
+    }
+    return ret;
+}
+
+void DataFlash_Class::Log_Write_Block(const struct log_write_fmt *f, const void *pBuffer, uint16_t size)
+{
+    for (uint8_t i=0; i<_next_backend; i++) {
+        if (f->sent_mask & (1U<<i)) {
+            backends[i]->WriteBlock(pBuffer, size);
+        }
+    }
+}
+
 
 #if CONFIG_HAL_BOARD == HAL_BOARD_SITL
 void DataFlash_Class::assert_same_fmt_for_name(const DataFlash_Class::log_write_fmt *f,
@@ -1006,3 +1065,47 @@ bool DataFlash_Class::Log_Write_ISBD(const uint16_t isb_seqno,
 
     return backends[0]->WriteBlock(&pkt, sizeof(pkt));
 }
+
+// Write the peaks of the spectrum of one axis of an IMU batch
+void DataFlash_Class::Log_Write_ISFP(const uint16_t isb_seqno,
+                                     const AP_InertialSensor::IMU_SENSOR_TYPE sensor_type,
+                                     const uint8_t sensor_instance,
+                                     const uint8_t axis,
+                                     const float sample_rate_hz,
+                                     const float peak_freq[3],
+                                     const float peak_energy[3],
+                                     const float total_energy)
+{
+    struct log_ISFP pkt = {
+        LOG_PACKET_HEADER_INIT(LOG_ISFP_MSG),
+        time_us        : AP_HAL::micros64(),
+        isb_seqno      : isb_seqno,
+        sensor_type    : (uint8_t)sensor_type,
+        instance       : sensor_instance,
+        axis           : axis,
+        sample_rate_hz : sample_rate_hz,
+        peak_freq      : { peak_freq[0], peak_freq[1], peak_freq[2] },
+        peak_energy    : { peak_energy[0], peak_energy[1], peak_energy[2] },
+        total_energy   : total_energy,
+    };
+    WriteBlock(&pkt, sizeof(pkt));
+}
+
+// Write the coarse spectrum of one axis of an IMU batch
+void DataFlash_Class::Log_Write_ISFB(const uint16_t isb_seqno,
+                                     const AP_InertialSensor::IMU_SENSOR_TYPE sensor_type,
+                                     const uint8_t sensor_instance,
+                                     const uint8_t axis,
+                                     const float band[10])
+{
+    struct log_ISFB pkt = {
+        LOG_PACKET_HEADER_INIT(LOG_ISFB_MSG),
+        time_us     : AP_HAL::micros64(),
+        isb_seqno   : isb_seqno,
+        sensor_type : (uint8_t)sensor_type,
+        instance    : sensor_instance,
+        axis        : axis,
+    };
+    memcpy(pkt.band, band, sizeof(pkt.band));
+    WriteBlock(&pkt, sizeof(pkt));
+}
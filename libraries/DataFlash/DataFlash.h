@@ -48,6 +48,7 @@ class AC_PosControl;
 class DataFlash_Class
 {
     friend class DataFlash_Backend; // for _num_types
+    template <char... FMT> friend class DataFlash_Writer; // for log_write_fmt
 
 public:
     FUNCTOR_TYPEDEF(vehicle_startup_message_Log_Writer, void);
@@ -78,6 +79,23 @@ public:
     /* Write an *important* block of data at current offset */
     void WriteCriticalBlock(const void *pBuffer, uint16_t size);
 
+    /*
+      zero-copy writes for fast-loop messages. ReserveBlock returns a
+      pointer into the backend write buffer when there is a single
+      backend and it can give out contiguous space, otherwise it
+      returns fallback. Fill the message at the returned pointer then
+      pass it to CommitBlock, which copies only if fallback was used.
+      Other messages this thread writes before CommitBlock are written
+      after the reserved one
+     */
+    void *ReserveBlock(void *fallback, uint16_t size);
+    void CommitBlock(const void *ptr, uint16_t size);
+
+    template <typename T>
+    T *ReserveMessage(T &fallback) {
+        return (T *)ReserveBlock(&fallback, sizeof(T));
+    }
+
     // high level interface
     uint16_t find_last_log() const;
     void get_log_boundaries(uint16_t log_num, uint16_t & start_page, uint16_t & end_page);
@@ -109,10 +127,24 @@ public:
                         const int16_t x[32],
                         const int16_t y[32],
                         const int16_t z[32]);
+    void Log_Write_ISFP(uint16_t isb_seqno,
+                        AP_InertialSensor::IMU_SENSOR_TYPE sensor_type,
+                        uint8_t instance,
+                        uint8_t axis,
+                        float sample_rate_hz,
+                        const float peak_freq[3],
+                        const float peak_energy[3],
+                        float total_energy);
+    void Log_Write_ISFB(uint16_t isb_seqno,
+                        AP_InertialSensor::IMU_SENSOR_TYPE sensor_type,
+                        uint8_t instance,
+                        uint8_t axis,
+                        const float band[10]);
     void Log_Write_Vibration();
     void Log_Write_RCIN(void);
     void Log_Write_RCOUT(void);
     void Log_Write_RSSI(AP_RSSI &rssi);
+    void Log_Write_Param_Save_Stats();
     void Log_Write_Baro(uint64_t time_us=0);
     void Log_Write_Power(void);
     void Log_Write_AHRS2(AP_AHRS &ahrs);
@@ -205,6 +237,7 @@ public:
         AP_Int8 log_disarmed;
         AP_Int8 log_replay;
         AP_Int8 mav_bufsize; // in kilobytes
+        AP_Int8 file_compress;
     } _params;
 
     const struct LogStructure *structure(uint16_t num) const;
@@ -246,6 +279,9 @@ private:
     #define DATAFLASH_MAX_BACKENDS 2
     uint8_t _next_backend;
     DataFlash_Backend *backends[DATAFLASH_MAX_BACKENDS];
+
+    // message currently reserved in backends[0], if any
+    void *_reserved_block;
     const AP_Int32 &_log_bitmask;
 
     void internal_error() const;
@@ -272,6 +308,11 @@ private:
 
     // return (possibly allocating) a log_write_fmt for a name
     struct log_write_fmt *msg_fmt_for_name(const char *name, const char *labels, const char *units, const char *mults, const char *fmt);
+    // write the FMT for f to any backends which haven't had it.
+    // Returns true if every backend now has it
+    bool Log_Write_Emit_FMTs(struct log_write_fmt *f);
+    // write a packed message for f to the backends which have its FMT
+    void Log_Write_Block(const struct log_write_fmt *f, const void *pBuffer, uint16_t size);
     const struct log_write_fmt *log_write_fmt_for_msg_type(uint8_t msg_type) const;
 
     // returns true if msg_type is associated with a message
@@ -373,6 +414,21 @@ private:
 
     GCS_MAVLINK *_log_sending_link;
 
+    // blocks (LOG_DATA payloads) of the log being sent which the GCS
+    // has asked for again while the download streams, relative to
+    // block number _log_resend_base
+    class Bitmask *_log_resend;
+    uint32_t _log_resend_base;
+
+    // download throughput, reported when a download completes
+    struct {
+        uint32_t start_ms;
+        uint32_t bytes;
+        uint32_t resent;
+        uint32_t calls;
+        uint32_t link_full; // calls limited by space on the link
+    } _log_send_stats;
+
     bool should_handle_log_message();
     void handle_log_message(class GCS_MAVLINK &, mavlink_message_t *msg);
 
@@ -383,6 +439,8 @@ private:
     void handle_log_send_listing(); // handle LISTING state
     void handle_log_sending(); // handle SENDING state
     bool handle_log_send_data(); // send data chunk to client
+    void handle_log_resend_request(uint32_t ofs, uint32_t count);
+    void handle_log_send_complete();
 
     void get_log_info(uint16_t log_num, uint32_t &size, uint32_t &time_utc);
 
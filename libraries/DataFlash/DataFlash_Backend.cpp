@@ -373,6 +373,33 @@ bool DataFlash_Backend::WritePrioritisedBlock(const void *pBuffer, uint16_t size
     return _WritePrioritisedBlock(pBuffer, size, is_critical);
 }
 
+void *DataFlash_Backend::ReserveBlock(uint16_t size, bool is_critical)
+{
+    if (!ShouldLog(is_critical)) {
+        return nullptr;
+    }
+    if (StartNewLogOK()) {
+        // let the copying path start the log
+        return nullptr;
+    }
+    if (!WritesOK()) {
+        return nullptr;
+    }
+    if (!_startup_messagewriter->fmt_done()) {
+        // startup messages are interleaved through WriteBlock
+        return nullptr;
+    }
+    return _ReserveBlock(size, is_critical);
+}
+
+void DataFlash_Backend::CommitBlock(const void *ptr, uint16_t size)
+{
+#if CONFIG_HAL_BOARD == HAL_BOARD_SITL
+    validate_WritePrioritisedBlock(ptr, size);
+#endif
+    _CommitBlock(size);
+}
+
 bool DataFlash_Backend::ShouldLog(bool is_critical)
 {
     if (!_front.WritesEnabled()) {
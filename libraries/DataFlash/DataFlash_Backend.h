@@ -36,6 +36,17 @@ public:
 
     bool WritePrioritisedBlock(const void *pBuffer, uint16_t size, bool is_critical);
 
+    /*
+      zero-copy writes. ReserveBlock returns a pointer into the
+      backend's write buffer with room for a message of size bytes,
+      holding any lock until CommitBlock is called with the same
+      size. Returns nullptr if the backend can't hand out contiguous
+      space right now, in which case the caller should fill the
+      message elsewhere and use WriteBlock()
+     */
+    void *ReserveBlock(uint16_t size, bool is_critical);
+    void CommitBlock(const void *ptr, uint16_t size);
+
     // high level interface
     virtual uint16_t find_last_log() = 0;
     virtual void get_log_boundaries(uint16_t log_num, uint16_t & start_page, uint16_t & end_page) = 0;
@@ -156,6 +167,11 @@ protected:
 
     virtual bool _WritePrioritisedBlock(const void *pBuffer, uint16_t size, bool is_critical) = 0;
 
+    // backends which can give out space in their write buffer
+    // override these; by default every write is a copy
+    virtual void *_ReserveBlock(uint16_t size, bool is_critical) { return nullptr; }
+    virtual void _CommitBlock(uint16_t size) { }
+
     bool _initialised;
 
 private:
@@ -0,0 +1,253 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DataFlash_Compress.h"
+
+#include <string.h>
+#include <AP_Math/AP_Math.h>
+#include <AP_Math/crc.h>
+
+/*
+  LZ4 block format limits: the last match must start at least 12
+  bytes before the end of the block, and the last 5 bytes are always
+  literals
+ */
+#define LZ4_MIN_MATCH    4
+#define LZ4_MF_LIMIT     12
+#define LZ4_LAST_LITERALS 5
+
+DataFlash_Compressor::~DataFlash_Compressor(void)
+{
+    delete[] _hash_table;
+}
+
+bool DataFlash_Compressor::init(void)
+{
+    if (_hash_table == nullptr) {
+        _hash_table = new uint16_t[1U<<HASH_LOG];
+    }
+    return _hash_table != nullptr;
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// write a length continuation, 255 at a time
+static inline uint8_t *write_length(uint8_t *op, uint32_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+uint32_t DataFlash_Compressor::compress(const uint8_t *src, uint16_t len, uint8_t *dst)
+{
+    uint8_t *op = dst;
+    uint32_t ip = 0;
+    uint32_t anchor = 0;
+
+    if (len >= LZ4_MF_LIMIT + 1) {
+        memset(_hash_table, 0, sizeof(uint16_t) << HASH_LOG);
+        const uint32_t mf_limit = len - LZ4_MF_LIMIT;
+        const uint32_t match_limit = len - LZ4_LAST_LITERALS;
+
+        while (ip < mf_limit) {
+            const uint32_t seq = read32(&src[ip]);
+            const uint32_t h = (seq * 2654435761U) >> (32 - HASH_LOG);
+            const uint32_t ref = _hash_table[h];
+            _hash_table[h] = ip;
+
+            if (ref >= ip || read32(&src[ref]) != seq) {
+                ip++;
+                continue;
+            }
+
+            // extend the match forwards
+            uint32_t match_len = LZ4_MIN_MATCH;
+            while (ip + match_len < match_limit && src[ref + match_len] == src[ip + match_len]) {
+                match_len++;
+            }
+
+            // token, literals, offset, match length
+            const uint32_t lit_len = ip - anchor;
+            uint8_t *token = op++;
+            *token = (MIN(lit_len, 15U) << 4) | MIN(match_len - LZ4_MIN_MATCH, 15U);
+            if (lit_len >= 15) {
+                op = write_length(op, lit_len - 15);
+            }
+            memcpy(op, &src[anchor], lit_len);
+            op += lit_len;
+            const uint16_t offset = ip - ref;
+            *op++ = offset & 0xFF;
+            *op++ = offset >> 8;
+            if (match_len - LZ4_MIN_MATCH >= 15) {
+                op = write_length(op, match_len - LZ4_MIN_MATCH - 15);
+            }
+
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    // the remaining bytes are literals
+    const uint32_t lit_len = len - anchor;
+    *op++ = MIN(lit_len, 15U) << 4;
+    if (lit_len >= 15) {
+        op = write_length(op, lit_len - 15);
+    }
+    memcpy(op, &src[anchor], lit_len);
+    op += lit_len;
+
+    return op - dst;
+}
+
+int32_t DataFlash_Compressor::decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_size)
+{
+    uint32_t ip = 0;
+    uint32_t op = 0;
+
+    while (ip < src_len) {
+        const uint8_t token = src[ip++];
+
+        // literals
+        uint32_t lit_len = token >> 4;
+        if (lit_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= src_len) {
+                    return -1;
+                }
+                b = src[ip++];
+                lit_len += b;
+            } while (b == 255);
+        }
+        if (ip + lit_len > src_len || op + lit_len > dst_size) {
+            return -1;
+        }
+        memcpy(&dst[op], &src[ip], lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        if (ip == src_len) {
+            // the last sequence has no match
+            break;
+        }
+
+        // match
+        if (ip + 2 > src_len) {
+            return -1;
+        }
+        const uint16_t offset = src[ip] | (src[ip+1] << 8);
+        ip += 2;
+        uint32_t match_len = token & 0x0F;
+        if (match_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= src_len) {
+                    return -1;
+                }
+                b = src[ip++];
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ4_MIN_MATCH;
+        if (offset == 0 || offset > op || op + match_len > dst_size) {
+            return -1;
+        }
+        // copy byte by byte as the match may overlap its output
+        const uint8_t *m = &dst[op - offset];
+        for (uint32_t i=0; i<match_len; i++) {
+            dst[op + i] = m[i];
+        }
+        op += match_len;
+    }
+
+    return op;
+}
+
+uint32_t DataFlash_Compressor::frame(const uint8_t *src, uint16_t len, uint8_t *out)
+{
+    struct df_block_header hdr {};
+    hdr.magic = DF_BLOCK_MAGIC;
+    hdr.raw_length = len;
+
+    uint8_t *data = out + sizeof(hdr);
+    uint32_t data_length = 0;
+    if (_hash_table != nullptr) {
+        data_length = compress(src, len, data);
+    }
+    if (data_length > 0 && data_length < len) {
+        hdr.flags = DF_BLOCK_FLAG_COMPRESSED;
+    } else {
+        memcpy(data, src, len);
+        data_length = len;
+    }
+    hdr.data_length = data_length;
+    hdr.crc = crc_crc32(0, data, data_length);
+    memcpy(out, &hdr, sizeof(hdr));
+
+    return sizeof(hdr) + data_length;
+}
+
+bool DataFlash_Compressor::is_compressed_log(const uint8_t *src, uint64_t src_len)
+{
+    return src_len >= sizeof(struct df_block_header) && read32(src) == DF_BLOCK_MAGIC;
+}
+
+uint64_t DataFlash_Compressor::decode_log(const uint8_t *src, uint64_t src_len, uint8_t *dst)
+{
+    uint64_t ofs = 0;
+    uint64_t out = 0;
+
+    while (ofs + sizeof(struct df_block_header) <= src_len) {
+        struct df_block_header hdr;
+        memcpy(&hdr, &src[ofs], sizeof(hdr));
+        if (hdr.magic != DF_BLOCK_MAGIC) {
+            // resynchronise on the next frame
+            ofs++;
+            continue;
+        }
+        const uint8_t *data = &src[ofs + sizeof(hdr)];
+        if (ofs + sizeof(hdr) + hdr.data_length > src_len) {
+            // truncated final frame
+            break;
+        }
+        if (crc_crc32(0, data, hdr.data_length) != hdr.crc) {
+            ofs++;
+            continue;
+        }
+        if (dst != nullptr) {
+            if (hdr.flags & DF_BLOCK_FLAG_COMPRESSED) {
+                if (decompress(data, hdr.data_length, &dst[out], hdr.raw_length) != hdr.raw_length) {
+                    ofs++;
+                    continue;
+                }
+            } else {
+                memcpy(&dst[out], data, hdr.data_length);
+            }
+        }
+        out += hdr.raw_length;
+        ofs += sizeof(hdr) + hdr.data_length;
+    }
+
+    return out;
+}
@@ -0,0 +1,89 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+/*
+  block compression for log files.
+
+  A compressed log is a sequence of self contained frames, each a
+  df_block_header followed by data_length bytes. The data is either
+  the raw log bytes or an LZ4 block (the format used by lz4's
+  LZ4_compress_default(), without the frame format) which expands to
+  raw_length bytes. As every frame stands alone, a file truncated by a
+  crash or power loss can be read up to the last complete frame, and a
+  corrupted frame can be skipped by searching for the next magic.
+ */
+
+#include <AP_Common/AP_Common.h>
+#include <stdint.h>
+
+#define DF_BLOCK_MAGIC 0x315A4644 // "DFZ1"
+
+// data is an LZ4 block rather than stored bytes
+#define DF_BLOCK_FLAG_COMPRESSED 0x01
+
+struct PACKED df_block_header {
+    uint32_t magic;
+    uint16_t raw_length;
+    uint16_t data_length;
+    uint8_t flags;
+    uint8_t reserved;
+    uint32_t crc; // crc32 of the data_length bytes following the header
+};
+
+// worst case size of a frame holding raw_length bytes
+#define DF_BLOCK_MAX_FRAME(raw_length) (sizeof(struct df_block_header) + (raw_length) + (raw_length)/255 + 16)
+
+class DataFlash_Compressor {
+public:
+    DataFlash_Compressor(void) {}
+    ~DataFlash_Compressor(void);
+
+    /* Do not allow copies */
+    DataFlash_Compressor(const DataFlash_Compressor &other) = delete;
+    DataFlash_Compressor &operator=(const DataFlash_Compressor&) = delete;
+
+    // allocate the hash table. Returns false on allocation failure
+    bool init(void);
+
+    /*
+      build a frame from len raw bytes into out, which must have room
+      for DF_BLOCK_MAX_FRAME(len) bytes. Blocks which don't compress
+      are stored. Returns the frame length
+     */
+    uint32_t frame(const uint8_t *src, uint16_t len, uint8_t *out);
+
+    // LZ4 block compression, returning the compressed length
+    uint32_t compress(const uint8_t *src, uint16_t len, uint8_t *dst);
+
+    // LZ4 block decompression. Returns the decompressed length or -1
+    // if the block is corrupt or doesn't fit in dst_size bytes
+    static int32_t decompress(const uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_size);
+
+    /*
+      decode a whole compressed log held in memory into dst. Returns
+      the number of log bytes written, skipping corrupt frames and
+      stopping at a truncated one. With dst nullptr it returns the
+      size needed
+     */
+    static uint64_t decode_log(const uint8_t *src, uint64_t src_len, uint8_t *dst);
+
+    // true if a log starts with a compressed frame
+    static bool is_compressed_log(const uint8_t *src, uint64_t src_len);
+
+private:
+    static const uint8_t HASH_LOG = 11;
+    uint16_t *_hash_table = nullptr;
+};
@@ -41,6 +41,7 @@
 #endif
 
 #include <AP_Math/AP_Math.h>
+#include <AP_Math/crc.h>
 #include <GCS_MAVLink/GCS.h>
 
 
@@ -49,6 +50,8 @@ extern const AP_HAL::HAL& hal;
 #define MAX_LOG_FILES 500U
 #define DATAFLASH_PAGE_SIZE 1024UL
 
+#define LOG_INDEX_MAGIC 0x3158494C // "LIX1"
+
 /*
   constructor
  */
@@ -82,6 +85,7 @@ DataFlash_File::DataFlash_File(DataFlash_Class &front,
 #else
     _writebuf_chunk(4096),
 #endif
+    _zbuf(nullptr),
     _perf_write(hal.util->perf_alloc(AP_HAL::Util::PC_ELAPSED, "DF_write")),
     _perf_fsync(hal.util->perf_alloc(AP_HAL::Util::PC_ELAPSED, "DF_fsync")),
     _perf_errors(hal.util->perf_alloc(AP_HAL::Util::PC_COUNT, "DF_errors")),
@@ -108,6 +112,11 @@ void DataFlash_File::Init()
         AP_HAL::panic("Failed to create DataFlash_File write_fd_semaphore");
         return;
     }
+    read_fd_semaphore = hal.util->new_semaphore();
+    if (read_fd_semaphore == nullptr) {
+        AP_HAL::panic("Failed to create DataFlash_File read_fd_semaphore");
+        return;
+    }
 
 #if CONFIG_HAL_BOARD == HAL_BOARD_PX4 || CONFIG_HAL_BOARD == HAL_BOARD_VRBRAIN
     // try to cope with an existing lowercase log directory
@@ -155,7 +164,22 @@ void DataFlash_File::Init()
         return;
     }
 
-    hal.console->printf("DataFlash_File: buffer size=%u\n", (unsigned)bufsize);
+    hal.console->printf("DataFlash_File: buffer size=%u\n", (unsigned)_writebuf.get_size());
+
+    if (_front._params.file_compress) {
+        // failure to allocate leaves logs uncompressed
+        if (_compressor.init()) {
+            _zbuf = new uint8_t[DF_BLOCK_MAX_FRAME(_writebuf_chunk)];
+        }
+        if (_zbuf == nullptr) {
+            hal.console->printf("DataFlash_File: compression disabled\n");
+        }
+    }
+
+    // reading the index now saves a directory scan per listing request later
+    if (!_log_index_load()) {
+        hal.console->printf("DataFlash_File: no log index\n");
+    }
 
     _initialised = true;
     hal.scheduler->register_io_process(FUNCTOR_BIND_MEMBER(&DataFlash_File::_io_timer, void));
@@ -174,6 +198,9 @@ bool DataFlash_File::file_exists(const char *filename) const
 
 bool DataFlash_File::log_exists(const uint16_t lognum) const
 {
+    if (_log_index != nullptr) {
+        return lognum <= MAX_LOG_FILES && _log_index_exists(lognum);
+    }
     char *filename = _log_file_name(lognum);
     if (filename == nullptr) {
         return false; // ?!
@@ -293,6 +320,20 @@ uint16_t DataFlash_File::find_oldest_log()
 
     uint16_t current_oldest_log = 0; // 0 is invalid
 
+    if (_log_index != nullptr) {
+        // the oldest log is the first one after the last log,
+        // wrapping around at MAX_LOG_FILES
+        for (uint16_t i=1; i<=MAX_LOG_FILES; i++) {
+            const uint16_t log_num = (last_log_num + i - 1) % MAX_LOG_FILES + 1;
+            if (_log_index_exists(log_num)) {
+                current_oldest_log = log_num;
+                break;
+            }
+        }
+        _cached_oldest_log = current_oldest_log;
+        return current_oldest_log;
+    }
+
     // We could count up to find_last_log(), but if people start
     // relying on the min_avail_space_percent feature we could end up
     // doing a *lot* of asprintf()s and stat()s
@@ -375,7 +416,7 @@ void DataFlash_File::Prep_MinSpace()
             internal_error();
             break;
         }
-        if (file_exists(filename_to_remove)) {
+        if (log_exists(log_to_remove) && file_exists(filename_to_remove)) {
             hal.console->printf("Removing (%s) for minimum-space requirements (%.2f%% < %.0f%%)\n",
                                 filename_to_remove, (double)avail, (double)min_avail_space_percent);
             if (unlink(filename_to_remove) == -1) {
@@ -392,6 +433,9 @@ void DataFlash_File::Prep_MinSpace()
             } else {
                 free(filename_to_remove);
             }
+            _log_index_set(log_to_remove, 0, 0, 0);
+        } else {
+            free(filename_to_remove);
         }
         log_to_remove++;
         if (log_to_remove > MAX_LOG_FILES) {
@@ -461,6 +505,12 @@ char *DataFlash_File::_log_file_name_long(const uint16_t log_num) const
  */
 char *DataFlash_File::_log_file_name(const uint16_t log_num) const
 {
+    if (_log_index != nullptr && log_num <= MAX_LOG_FILES && _log_index_exists(log_num)) {
+        if (_log_index[log_num].flags & LOG_INDEX_LONG_NAME) {
+            return _log_file_name_long(log_num);
+        }
+        return _log_file_name_short(log_num);
+    }
     char *filename = _log_file_name_short(log_num);
     if (filename == nullptr) {
         return nullptr;
@@ -485,6 +535,332 @@ char *DataFlash_File::_lastlog_file_name(void) const
     return buf;
 }
 
+/*
+  return path name of the log index file
+  Note: Caller must free.
+ */
+char *DataFlash_File::_log_index_file_name(void) const
+{
+    char *buf = nullptr;
+    if (asprintf(&buf, "%s/LOGINDEX.BIN", _log_directory) == -1) {
+        return nullptr;
+    }
+    return buf;
+}
+
+/*
+  load the log index. A valid LOGINDEX.BIN is trusted, so a normal
+  boot reads one file rather than scanning the log directory. Only
+  the last log is stat()ed, as its size is recorded when it is closed
+  and a log cut short by a power loss never was. The directory is
+  scanned when the index is missing or corrupt, or doesn't know the
+  last log (e.g. logs were written by older firmware)
+ */
+bool DataFlash_File::_log_index_load(void)
+{
+    if (_log_index != nullptr) {
+        return true;
+    }
+    if (_log_index_sem == nullptr) {
+        _log_index_sem = hal.util->new_semaphore();
+    }
+    if (_log_index_dirty == nullptr) {
+        _log_index_dirty = new Bitmask(MAX_LOG_FILES+1);
+    }
+    if (_log_index_sem == nullptr || _log_index_dirty == nullptr) {
+        return false;
+    }
+    struct log_index_entry *index = new log_index_entry[MAX_LOG_FILES+1];
+    if (index == nullptr) {
+        return false;
+    }
+
+    const uint16_t last_log = find_last_log();
+    bool valid = _log_index_read(index);
+    if (valid && last_log != 0) {
+        struct log_index_entry &e = index[last_log];
+        const struct log_index_entry old = e;
+        valid = (e.flags & LOG_INDEX_EXISTS) &&
+            _log_index_fill_entry(e, last_log, e.flags & LOG_INDEX_LONG_NAME);
+        if (valid && memcmp(&old, &e, sizeof(e)) != 0) {
+            _log_index_dirty->set(last_log);
+        }
+    }
+    if (!valid) {
+        if (!_log_index_scan(index, last_log)) {
+            delete[] index;
+            return false;
+        }
+        _log_index_rewrite = true;
+    }
+
+    _log_index = index;
+    _log_index_last = last_log;
+    return true;
+}
+
+/*
+  read LOGINDEX.BIN. Entries which fail their crc are cleared, and
+  false is returned unless the header and all entries were good
+ */
+bool DataFlash_File::_log_index_read(struct log_index_entry *index)
+{
+    const ssize_t entries_size = sizeof(struct log_index_entry) * (MAX_LOG_FILES+1);
+    memset(index, 0, entries_size);
+
+    char *fname = _log_index_file_name();
+    if (fname == nullptr) {
+        return false;
+    }
+    int fd = ::open(fname, O_RDONLY|O_CLOEXEC);
+    free(fname);
+    if (fd == -1) {
+        return false;
+    }
+    struct log_index_header hdr;
+    const bool ok = ::read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+        hdr.magic == LOG_INDEX_MAGIC &&
+        hdr.num_entries == MAX_LOG_FILES+1 &&
+        hdr.crc == crc_crc8((const uint8_t *)&hdr, sizeof(hdr)-1) &&
+        ::read(fd, index, entries_size) == entries_size;
+    ::close(fd);
+    if (!ok) {
+        memset(index, 0, entries_size);
+        return false;
+    }
+
+    bool all_good = true;
+    for (uint16_t log_num=0; log_num<=MAX_LOG_FILES; log_num++) {
+        struct log_index_entry &e = index[log_num];
+        if (e.crc != crc_crc8((const uint8_t *)&e, sizeof(e)-1)) {
+            memset(&e, 0, sizeof(e));
+            all_good = false;
+        }
+    }
+    return all_good;
+}
+
+/*
+  rebuild the index from a single scan of the log directory. Logs
+  the index doesn't know about are stat()ed and added, and logs which
+  have gone are dropped. What is known about the remaining logs, such
+  as their start time, is kept
+ */
+bool DataFlash_File::_log_index_scan(struct log_index_entry *index, const uint16_t last_log)
+{
+    // mark the entries we expect to find in the directory
+    const uint8_t UNSEEN = 0x80;
+    for (uint16_t log_num=0; log_num<=MAX_LOG_FILES; log_num++) {
+        struct log_index_entry &e = index[log_num];
+        if (e.flags & LOG_INDEX_EXISTS) {
+            e.flags |= UNSEEN;
+        }
+    }
+
+    DIR *d = opendir(_log_directory);
+    if (d == nullptr) {
+        return false;
+    }
+    for (struct dirent *de=readdir(d); de; de=readdir(d)) {
+        uint8_t length = strlen(de->d_name);
+        if (length < 5 || strncmp(&de->d_name[length-4], ".BIN", 4)) {
+            // not \d+[.]BIN
+            continue;
+        }
+        const uint16_t log_num = strtoul(de->d_name, nullptr, 10);
+        if (log_num == 0 || log_num > MAX_LOG_FILES) {
+            continue;
+        }
+        struct log_index_entry &e = index[log_num];
+        e.flags &= ~UNSEEN;
+        if (!(e.flags & LOG_INDEX_EXISTS) || e.size == 0 || log_num == last_log) {
+            _log_index_fill_entry(e, log_num, de->d_name[0] == '0');
+        }
+    }
+    closedir(d);
+
+    for (uint16_t log_num=0; log_num<=MAX_LOG_FILES; log_num++) {
+        struct log_index_entry &e = index[log_num];
+        if (e.flags & UNSEEN) {
+            memset(&e, 0, sizeof(e));
+        }
+        e.crc = crc_crc8((const uint8_t *)&e, sizeof(e)-1);
+    }
+    return true;
+}
+
+/*
+  fill an index entry for an existing log from the filesystem.
+  Returns false if the log can't be stat()ed
+ */
+bool DataFlash_File::_log_index_fill_entry(struct log_index_entry &e, const uint16_t log_num, const bool long_name)
+{
+    char *fname = long_name ? _log_file_name_long(log_num) : _log_file_name_short(log_num);
+    struct stat st;
+    if (fname == nullptr || ::stat(fname, &st) != 0) {
+        free(fname);
+        return false;
+    }
+    free(fname);
+
+    // keep what we knew about a log whose size is being refreshed
+    uint8_t flags = LOG_INDEX_EXISTS | (e.flags & LOG_INDEX_COMPRESSED);
+    if (long_name) {
+        flags |= LOG_INDEX_LONG_NAME;
+    }
+    e.size = st.st_size;
+    if (e.time_utc == 0) {
+        e.time_utc = st.st_mtime;
+    }
+    e.flags = flags;
+    e.crc = crc_crc8((const uint8_t *)&e, sizeof(e)-1);
+    return true;
+}
+
+/*
+  write the whole index file, from the IO thread. The entries are
+  copied out a few at a time under _log_index_sem so the front end
+  is never held up by the write
+ */
+bool DataFlash_File::_log_index_write_all(void)
+{
+    char *fname = _log_index_file_name();
+    if (fname == nullptr) {
+        return false;
+    }
+#if HAL_OS_POSIX_IO
+    int fd = ::open(fname, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+#else
+    int fd = ::open(fname, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC);
+#endif
+    free(fname);
+    if (fd == -1) {
+        return false;
+    }
+    struct log_index_header hdr {};
+    hdr.magic = LOG_INDEX_MAGIC;
+    hdr.num_entries = MAX_LOG_FILES+1;
+    hdr.crc = crc_crc8((const uint8_t *)&hdr, sizeof(hdr)-1);
+    bool ok = ::write(fd, &hdr, sizeof(hdr)) == sizeof(hdr);
+
+    struct log_index_entry chunk[32];
+    for (uint16_t log_num=0; ok && log_num<=MAX_LOG_FILES; log_num += ARRAY_SIZE(chunk)) {
+        const uint16_t n = MIN(ARRAY_SIZE(chunk), MAX_LOG_FILES+1U - log_num);
+        _log_index_sem->take_blocking();
+        memcpy(chunk, &_log_index[log_num], n * sizeof(chunk[0]));
+        _log_index_sem->give();
+        const ssize_t len = n * sizeof(chunk[0]);
+        ok = ::write(fd, chunk, len) == len;
+    }
+    if (::close(fd) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+/*
+  rewrite a single entry of the index file in place, from the IO
+  thread
+ */
+bool DataFlash_File::_log_index_write_entry(const uint16_t log_num)
+{
+    char *fname = _log_index_file_name();
+    if (fname == nullptr) {
+        return false;
+    }
+    int fd = ::open(fname, O_WRONLY|O_CLOEXEC);
+    free(fname);
+    if (fd == -1) {
+        return false;
+    }
+    _log_index_sem->take_blocking();
+    const struct log_index_entry e = _log_index[log_num];
+    _log_index_sem->give();
+    const off_t ofs = sizeof(struct log_index_header) + log_num * sizeof(struct log_index_entry);
+    bool ok = ::lseek(fd, ofs, SEEK_SET) == ofs &&
+        ::write(fd, &e, sizeof(e)) == sizeof(e);
+    if (::close(fd) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+/*
+  update an entry of the in-memory index, leaving it to the IO
+  thread to write it out
+ */
+void DataFlash_File::_log_index_set(const uint16_t log_num, const uint32_t size, const uint32_t time_utc, const uint8_t flags)
+{
+    if (_log_index == nullptr || log_num == 0 || log_num > MAX_LOG_FILES) {
+        return;
+    }
+    _log_index_sem->take_blocking();
+    struct log_index_entry &e = _log_index[log_num];
+    e.size = size;
+    e.time_utc = time_utc;
+    e.flags = flags;
+    e.crc = crc_crc8((const uint8_t *)&e, sizeof(e)-1);
+    _log_index_dirty->set(log_num);
+    _log_index_sem->give();
+}
+
+/*
+  write out index changes, called from the IO thread. If an entry
+  can't be written the file no longer matches, so it is rewritten
+  whole. If that fails too the file is removed, leaving the next boot
+  to rebuild the index from the directory
+ */
+void DataFlash_File::_log_index_flush(void)
+{
+    if (_log_index == nullptr || _log_index_failed) {
+        return;
+    }
+
+    _log_index_sem->take_blocking();
+    bool rewrite = _log_index_rewrite;
+    if (rewrite) {
+        _log_index_rewrite = false;
+        _log_index_dirty->clearall();
+    }
+    _log_index_sem->give();
+
+    while (!rewrite) {
+        _log_index_sem->take_blocking();
+        const int32_t log_num = _log_index_dirty->first_set();
+        if (log_num != -1) {
+            _log_index_dirty->clear(log_num);
+        }
+        _log_index_sem->give();
+        if (log_num == -1) {
+            return;
+        }
+        if (!_log_index_write_entry(log_num)) {
+            rewrite = true;
+        }
+    }
+
+    if (_log_index_write_all()) {
+        return;
+    }
+    _log_index_failed = true;
+    char *fname = _log_index_file_name();
+    if (fname != nullptr) {
+        ::unlink(fname);
+        free(fname);
+    }
+    hal.console->printf("DataFlash_File: log index write failed\n");
+}
+
+// current UTC time in seconds, or 0 if not known
+uint32_t DataFlash_File::_utc_now(void)
+{
+    uint64_t utc_usec;
+    if (!AP::rtc().get_utc_usec(utc_usec)) {
+        return 0;
+    }
+    return utc_usec / 1000000U;
+}
+
 
 // remove all log files
 void DataFlash_File::EraseAll()
@@ -507,6 +883,14 @@ void DataFlash_File::EraseAll()
         free(fname);
     }
 
+    if (_log_index != nullptr) {
+        _log_index_sem->take_blocking();
+        memset(_log_index, 0, sizeof(struct log_index_entry) * (MAX_LOG_FILES+1));
+        _log_index_last = 0;
+        _log_index_rewrite = true;
+        _log_index_sem->give();
+    }
+
     _cached_oldest_log = 0;
 
     if (was_logging) {
@@ -580,17 +964,92 @@ bool DataFlash_File::_WritePrioritisedBlock(const void *pBuffer, uint16_t size,
         return false;
     }
 
+    if (_writebuf.reserve_open()) {
+        // this thread has a message reserved (the semaphore is
+        // recursive), most likely one being filled by a getter that
+        // logs. Writing now would corrupt the reserved message, so
+        // keep a copy for _CommitBlock() to write after it
+        if (_nested_len + size > sizeof(_nested_buf)) {
+            _dropped++;
+            semaphore->give();
+            return false;
+        }
+        memcpy(&_nested_buf[_nested_len], pBuffer, size);
+        _nested_len += size;
+        semaphore->give();
+        return true;
+    }
+
     _writebuf.write((uint8_t*)pBuffer, size);
     df_stats_gather(size);
     semaphore->give();
     return true;
 }
 
+/*
+  reserve space for a message directly in the write buffer. The
+  semaphore is held until _CommitBlock(), and writes made by this
+  thread in between are held back and written after the reserved
+  message. Returns
+  nullptr without counting a drop if the message should go through
+  _WritePrioritisedBlock() instead, including when the space wraps
+  around the end of the buffer
+ */
+void *DataFlash_File::_ReserveBlock(uint16_t size, bool is_critical)
+{
+    if (!semaphore->take(1)) {
+        return nullptr;
+    }
+
+    const uint32_t space = _writebuf.space();
+    if ((!is_critical && space < critical_message_reserved_space()) ||
+        space < size) {
+        semaphore->give();
+        return nullptr;
+    }
+
+    ByteBuffer::IoVec vec[2];
+    const uint8_t n_vec = _writebuf.reserve(vec, size);
+    if (n_vec != 1) {
+        if (n_vec != 0) {
+            _writebuf.commit(0);
+        }
+        semaphore->give();
+        return nullptr;
+    }
+    return vec[0].data;
+}
+
+/*
+  publish a message filled in place after _ReserveBlock()
+ */
+void DataFlash_File::_CommitBlock(uint16_t size)
+{
+    _writebuf.commit(size);
+    df_stats_gather(size);
+    if (_nested_len != 0) {
+        // space for these was checked as they were written, but the
+        // reserved message has used some of it since
+        if (_writebuf.space() >= _nested_len) {
+            _writebuf.write(_nested_buf, _nested_len);
+            df_stats_gather(_nested_len);
+        } else {
+            hal.util->perf_count(_perf_overruns);
+            _dropped++;
+        }
+        _nested_len = 0;
+    }
+    semaphore->give();
+}
+
 /*
   find the highest log number
  */
 uint16_t DataFlash_File::find_last_log()
 {
+    if (_log_index != nullptr) {
+        return _log_index_last;
+    }
     unsigned ret = 0;
     char *fname = _lastlog_file_name();
     if (fname == nullptr) {
@@ -615,6 +1074,13 @@ uint16_t DataFlash_File::find_last_log()
 
 uint32_t DataFlash_File::_get_log_size(const uint16_t log_num) const
 {
+    if (_log_index != nullptr) {
+        if (_write_fd != -1 && log_num == _write_log_num) {
+            // it is the file we are currently writing
+            return _write_offset;
+        }
+        return log_num <= MAX_LOG_FILES ? _log_index[log_num].size : 0;
+    }
     char *fname = _log_file_name(log_num);
     if (fname == nullptr) {
         return 0;
@@ -640,6 +1106,10 @@ uint32_t DataFlash_File::_get_log_size(const uint16_t log_num) const
 
 uint32_t DataFlash_File::_get_log_time(const uint16_t log_num) const
 {
+    if (_log_index != nullptr && log_num <= MAX_LOG_FILES &&
+        _log_index[log_num].time_utc != 0) {
+        return _log_index[log_num].time_utc;
+    }
     char *fname = _log_file_name(log_num);
     if (fname == nullptr) {
         return 0;
@@ -705,6 +1175,55 @@ void DataFlash_File::get_log_boundaries(const uint16_t list_entry, uint16_t & st
     end_page = _get_log_size(log_num) / DATAFLASH_PAGE_SIZE;
 }
 
+/*
+  read from the open log at ofs. Caller must hold read_fd_semaphore
+ */
+int16_t DataFlash_File::_read_log_data(const uint32_t ofs, const uint16_t len, uint8_t *data)
+{
+    if (_read_fd == -1) {
+        return -1;
+    }
+
+    /*
+      this rather strange bit of code is here to work around a bug
+      in file offsets in NuttX. Every few hundred blocks of reads
+      (starting at around 350k into a file) NuttX will get the
+      wrong offset for sequential reads. The offset it gets is
+      typically 128k earlier than it should be. It turns out that
+      calling lseek() with 0 offset and SEEK_CUR works around the
+      bug. We can remove this once we find the real bug.
+    */
+    if (ofs / 4096 != (ofs+len) / 4096) {
+        off_t seek_current = ::lseek(_read_fd, 0, SEEK_CUR);
+        if (seek_current == (off_t)-1) {
+            close(_read_fd);
+            _read_fd = -1;
+            return -1;
+        }
+        if (seek_current != (off_t)_read_offset) {
+            if (::lseek(_read_fd, _read_offset, SEEK_SET) == (off_t)-1) {
+                close(_read_fd);
+                _read_fd = -1;
+                return -1;
+            }
+        }
+    }
+
+    if (ofs != _read_offset) {
+        if (::lseek(_read_fd, ofs, SEEK_SET) == (off_t)-1) {
+            close(_read_fd);
+            _read_fd = -1;
+            return -1;
+        }
+        _read_offset = ofs;
+    }
+    int16_t ret = (int16_t)::read(_read_fd, data, len);
+    if (ret > 0) {
+        _read_offset += ret;
+    }
+    return ret;
+}
+
 /*
   retrieve data from a log file
  */
@@ -721,8 +1240,7 @@ int16_t DataFlash_File::get_log_data(const uint16_t list_entry, const uint16_t p
     }
 
     if (_read_fd != -1 && log_num != _read_fd_log_num) {
-        ::close(_read_fd);
-        _read_fd = -1;
+        _close_read_fd();
     }
     if (_read_fd == -1) {
         char *fname = _log_file_name(log_num);
@@ -747,44 +1265,144 @@ int16_t DataFlash_File::get_log_data(const uint16_t list_entry, const uint16_t p
     }
     uint32_t ofs = page * (uint32_t)DATAFLASH_PAGE_SIZE + offset;
 
-    /*
-      this rather strange bit of code is here to work around a bug
-      in file offsets in NuttX. Every few hundred blocks of reads
-      (starting at around 350k into a file) NuttX will get the
-      wrong offset for sequential reads. The offset it gets is
-      typically 128k earlier than it should be. It turns out that
-      calling lseek() with 0 offset and SEEK_CUR works around the
-      bug. We can remove this once we find the real bug.
-    */
-    if (ofs / 4096 != (ofs+len) / 4096) {
-        off_t seek_current = ::lseek(_read_fd, 0, SEEK_CUR);
-        if (seek_current == (off_t)-1) {
-            close(_read_fd);
-            _read_fd = -1;
-            return -1;
+    if (!_read_ahead_init()) {
+        // no memory for read-ahead, read each request directly
+        read_fd_semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER);
+        const int16_t ret = _read_log_data(ofs, len, data);
+        read_fd_semaphore->give();
+        return ret;
+    }
+
+    return _read_ahead_get(ofs, len, data);
+}
+
+void DataFlash_File::_close_read_fd(void)
+{
+    // wait for any read-ahead in progress on the IO thread
+    read_fd_semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER);
+    if (_read_fd != -1) {
+        ::close(_read_fd);
+        _read_fd = -1;
+    }
+    _ra[0].len = 0;
+    _ra[1].len = 0;
+    _ra_state.store(RA_IDLE, std::memory_order_relaxed);
+    read_fd_semaphore->give();
+}
+
+bool DataFlash_File::_read_ahead_init(void)
+{
+    if (_ra[0].data != nullptr) {
+        return true;
+    }
+    uint8_t *buf = new uint8_t[2*_writebuf_chunk];
+    if (buf == nullptr) {
+        return false;
+    }
+    _ra[0].data = buf;
+    _ra[1].data = buf + _writebuf_chunk;
+    _ra[0].len = 0;
+    _ra[1].len = 0;
+    _ra_state.store(RA_IDLE, std::memory_order_relaxed);
+    return true;
+}
+
+/*
+  serve a download request from the read-ahead buffers. Log download
+  asks for the log in LOG_DATA sized pieces; reading those one at a
+  time costs a seek and a read each. Instead _ra[0] holds a whole
+  chunk of the log and the IO thread reads the chunk after it into
+  _ra[1] while _ra[0] is sent, so most requests are a memcpy.
+ */
+int16_t DataFlash_File::_read_ahead_get(const uint32_t ofs, const uint16_t len, uint8_t *data)
+{
+    uint16_t copied = 0;
+    while (copied < len) {
+        const uint32_t want = ofs + copied;
+        struct read_ahead_buf &cur = _ra[0];
+        if (want >= cur.ofs && want < cur.ofs + cur.len) {
+            const uint16_t n = MIN(uint32_t(len - copied), cur.ofs + cur.len - want);
+            memcpy(&data[copied], &cur.data[want - cur.ofs], n);
+            copied += n;
+            continue;
         }
-        if (seek_current != (off_t)_read_offset) {
-            if (::lseek(_read_fd, _read_offset, SEEK_SET) == (off_t)-1) {
-                close(_read_fd);
-                _read_fd = -1;
+        if (_ra_state.load(std::memory_order_acquire) == RA_READY) {
+            // the IO thread is done with _ra[1]
+            if (want >= _ra[1].ofs && want < _ra[1].ofs + _ra[1].len) {
+                const struct read_ahead_buf tmp = _ra[0];
+                _ra[0] = _ra[1];
+                _ra[1] = tmp;
+                _ra_state.store(RA_IDLE, std::memory_order_relaxed);
+                continue;
+            }
+            if (_ra[1].len == 0 && want == _ra[1].ofs) {
+                // the read-ahead found the end of the log
+                break;
+            }
+        }
+
+        // may wait for the IO thread to finish a read-ahead
+        read_fd_semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER);
+        int16_t ret;
+        if (cur.len != 0 && want < cur.ofs) {
+            // a re-request for data we have already streamed past;
+            // read it directly rather than losing the buffered chunk
+            ret = _read_log_data(want, len - copied, &data[copied]);
+            if (ret > 0) {
+                copied += ret;
+            }
+            read_fd_semaphore->give();
+            break;
+        }
+        // miss; refill the current chunk from the requested offset
+        ret = _read_log_data(want, _writebuf_chunk, cur.data);
+        read_fd_semaphore->give();
+        if (ret <= 0) {
+            cur.len = 0;
+            if (ret < 0 && copied == 0) {
                 return -1;
             }
+            break;
         }
+        cur.ofs = want;
+        cur.len = ret;
     }
 
-    if (ofs != _read_offset) {
-        if (::lseek(_read_fd, ofs, SEEK_SET) == (off_t)-1) {
-            close(_read_fd);
-            _read_fd = -1;
-            return -1;
-        }
-        _read_offset = ofs;
+    // start reading the next chunk, unless we are at the end of the
+    // log. A read-ahead left behind by a seek is discarded
+    uint8_t state = _ra_state.load(std::memory_order_acquire);
+    if (state == RA_READY && _ra[1].ofs != _ra[0].ofs + _ra[0].len) {
+        state = RA_IDLE;
+        _ra_state.store(state, std::memory_order_relaxed);
     }
-    int16_t ret = (int16_t)::read(_read_fd, data, len);
-    if (ret > 0) {
-        _read_offset += ret;
+    if (state == RA_IDLE && _ra[0].len == _writebuf_chunk) {
+        _ra[1].ofs = _ra[0].ofs + _ra[0].len;
+        _ra_state.store(RA_REQUESTED, std::memory_order_release);
     }
-    return ret;
+
+    return copied;
+}
+
+/*
+  IO thread half of the read-ahead
+ */
+void DataFlash_File::_read_ahead_fill(void)
+{
+    if (!read_fd_semaphore->take(1)) {
+        return;
+    }
+    // the request may have been cancelled by _close_read_fd() while
+    // we waited for the semaphore
+    if (_ra_state.load(std::memory_order_acquire) != RA_REQUESTED) {
+        read_fd_semaphore->give();
+        return;
+    }
+    last_io_operation = "read";
+    const int16_t ret = _read_log_data(_ra[1].ofs, _writebuf_chunk, _ra[1].data);
+    last_io_operation = "";
+    _ra[1].len = (ret > 0) ? ret : 0;
+    _ra_state.store(RA_READY, std::memory_order_release);
+    read_fd_semaphore->give();
 }
 
 /*
@@ -842,6 +1460,11 @@ void DataFlash_File::stop_logging(void)
         int fd = _write_fd;
         _write_fd = -1;
         ::close(fd);
+        if (_log_index != nullptr) {
+            const struct log_index_entry &e = _log_index[_write_log_num];
+            _log_index_set(_write_log_num, _write_offset,
+                           e.time_utc ? e.time_utc : _utc_now(), e.flags);
+        }
     }
     if (have_sem) {
         write_fd_semaphore->give();
@@ -874,8 +1497,7 @@ uint16_t DataFlash_File::start_new_log(void)
     }
 
     if (_read_fd != -1) {
-        ::close(_read_fd);
-        _read_fd = -1;
+        _close_read_fd();
     }
 
     if (disk_space_avail() < _free_space_min_avail) {
@@ -927,9 +1549,33 @@ uint16_t DataFlash_File::start_new_log(void)
     }
     _last_write_ms = AP_HAL::millis();
     _write_offset = 0;
+    _write_log_num = log_num;
+    // discard what is left of the last log. Writers are held off by
+    // semaphore and the IO thread only consumes from the buffer while
+    // holding write_fd_semaphore, so neither side is in use
+    semaphore->take(HAL_SEMAPHORE_BLOCK_FOREVER);
     _writebuf.clear();
+    semaphore->give();
+    _zbuf_ofs = 0;
+    _zbuf_len = 0;
+    _compress_log = (_zbuf != nullptr);
     write_fd_semaphore->give();
 
+    if (_log_index != nullptr) {
+        // new logs get a zero-padded name unless an old short name
+        // existed, see _log_file_name()
+        const char *base = strrchr(_write_filename, '/');
+        uint8_t flags = LOG_INDEX_EXISTS;
+        if (base != nullptr && base[1] == '0') {
+            flags |= LOG_INDEX_LONG_NAME;
+        }
+        if (_compress_log) {
+            flags |= LOG_INDEX_COMPRESSED;
+        }
+        _log_index_last = log_num;
+        _log_index_set(log_num, 0, _utc_now(), flags);
+    }
+
     // now update lastlog.txt with the new log number
     char *fname = _lastlog_file_name();
 
@@ -966,7 +1612,8 @@ void DataFlash_File::flush(void)
 #if APM_BUILD_TYPE(APM_BUILD_Replay) || APM_BUILD_TYPE(APM_BUILD_UNKNOWN)
 {
     uint32_t tnow = AP_HAL::millis();
-    while (_write_fd != -1 && _initialised && !_open_error && _writebuf.available()) {
+    while (_write_fd != -1 && _initialised && !_open_error &&
+           (_writebuf.available() || _zbuf_ofs < _zbuf_len)) {
         // convince the IO timer that it really is OK to write out
         // less than _writebuf_chunk bytes:
         if (tnow > 2001) { // avoid resetting _last_write_time to 0
@@ -994,15 +1641,22 @@ void DataFlash_File::_io_timer(void)
 {
     uint32_t tnow = AP_HAL::millis();
     _io_timer_heartbeat = tnow;
+    if (_ra_state.load(std::memory_order_acquire) == RA_REQUESTED) {
+        _read_ahead_fill();
+    }
+    _log_index_flush();
     if (_write_fd == -1 || !_initialised || _open_error) {
         return;
     }
 
+    // a partially written compressed frame must be finished first
+    const bool frame_pending = _zbuf_ofs < _zbuf_len;
     uint32_t nbytes = _writebuf.available();
-    if (nbytes == 0) {
+    df_stats_gather_space(nbytes);
+    if (nbytes == 0 && !frame_pending) {
         return;
     }
-    if (nbytes < _writebuf_chunk && 
+    if (!frame_pending && nbytes < _writebuf_chunk &&
         tnow - _last_write_time < 2000UL) {
         // write in _writebuf_chunk-sized chunks, but always write at
         // least once per 2 seconds if data is available
@@ -1022,6 +1676,7 @@ void DataFlash_File::_io_timer(void)
     }
 
     hal.util->perf_begin(_perf_write);
+    const uint32_t tstart = AP_HAL::micros();
 
     _last_write_time = tnow;
     if (nbytes > _writebuf_chunk) {
@@ -1029,18 +1684,6 @@ void DataFlash_File::_io_timer(void)
         nbytes = _writebuf_chunk;
     }
 
-    uint32_t size;
-    const uint8_t *head = _writebuf.readptr(size);
-    nbytes = MIN(nbytes, size);
-
-    // try to align writes on a 512 byte boundary to avoid filesystem reads
-    if ((nbytes + _write_offset) % 512 != 0) {
-        uint32_t ofs = (nbytes + _write_offset) % 512;
-        if (ofs < nbytes) {
-            nbytes -= ofs;
-        }
-    }
-
     last_io_operation = "write";
     if (!write_fd_semaphore->take(1)) {
         return;
@@ -1049,6 +1692,48 @@ void DataFlash_File::_io_timer(void)
         write_fd_semaphore->give();
         return;
     }
+
+    const uint8_t *head;
+    if (_compress_log) {
+        if (!frame_pending) {
+            // compress the next chunk into a frame. The frame is
+            // written out before any more data is taken from _writebuf
+            uint32_t size;
+            const uint8_t *raw = _writebuf.readptr(size);
+            nbytes = MIN(nbytes, size);
+            if (nbytes == 0) {
+                // buffer was discarded by start_new_log()
+                write_fd_semaphore->give();
+                hal.util->perf_end(_perf_write);
+                return;
+            }
+            _zbuf_len = _compressor.frame(raw, nbytes, _zbuf);
+            _zbuf_ofs = 0;
+            _writebuf.advance(nbytes);
+            _io_stats.raw_bytes += nbytes;
+        }
+        head = &_zbuf[_zbuf_ofs];
+        nbytes = _zbuf_len - _zbuf_ofs;
+    } else {
+        uint32_t size;
+        head = _writebuf.readptr(size);
+        nbytes = MIN(nbytes, size);
+        if (nbytes == 0) {
+            // buffer was discarded by start_new_log()
+            write_fd_semaphore->give();
+            hal.util->perf_end(_perf_write);
+            return;
+        }
+
+        // try to align writes on a 512 byte boundary to avoid filesystem reads
+        if ((nbytes + _write_offset) % 512 != 0) {
+            uint32_t ofs = (nbytes + _write_offset) % 512;
+            if (ofs < nbytes) {
+                nbytes -= ofs;
+            }
+        }
+    }
+
     ssize_t nwritten = ::write(_write_fd, head, nbytes);
     last_io_operation = "";
     if (nwritten <= 0) {
@@ -1067,7 +1752,13 @@ void DataFlash_File::_io_timer(void)
     } else {
         _last_write_ms = tnow;
         _write_offset += nwritten;
-        _writebuf.advance(nwritten);
+        if (_compress_log) {
+            _zbuf_ofs += nwritten;
+        } else {
+            _writebuf.advance(nwritten);
+            _io_stats.raw_bytes += nwritten;
+        }
+        _io_stats.file_bytes += nwritten;
         /*
           the best strategy for minimizing corruption on microSD cards
           seems to be to write in 4k chunks and fsync the file on each
@@ -1081,6 +1772,7 @@ void DataFlash_File::_io_timer(void)
 #endif
     }
     write_fd_semaphore->give();
+    _io_stats.time_us += AP_HAL::micros() - tstart;
     hal.util->perf_end(_perf_write);
 }
 
@@ -1128,7 +1820,7 @@ void DataFlash_File::vehicle_was_disarmed()
     }
 }
 
-void DataFlash_File::Log_Write_DataFlash_Stats_File(const struct df_stats &_stats)
+void DataFlash_File::Log_Write_DataFlash_Stats_File(const struct df_stats &_stats, const struct df_io_stats &_io)
 {
     struct log_DSF pkt = {
         LOG_PACKET_HEADER_INIT(LOG_DF_FILE_STATS),
@@ -1139,14 +1831,24 @@ void DataFlash_File::Log_Write_DataFlash_Stats_File(const struct df_stats &_stat
         bytes           : _stats.bytes,
         buf_space_min   : _stats.buf_space_min,
         buf_space_max   : _stats.buf_space_max,
-        buf_space_avg   : (_stats.blocks) ? (_stats.buf_space_sigma / _stats.blocks) : 0,
-
+        buf_space_avg   : (_stats.buf_space_samples) ? (_stats.buf_space_sigma / _stats.buf_space_samples) : 0,
+        file_bytes      : _io.file_bytes,
+        compress_ratio  : (_io.file_bytes) ? (float(_io.raw_bytes) / _io.file_bytes) : 1.0f,
+        io_time_us      : _io.time_us,
     };
     WriteBlock(&pkt, sizeof(pkt));
 }
 
+// called by writers, under semaphore
 void DataFlash_File::df_stats_gather(const uint16_t bytes_written) {
-    const uint32_t space_remaining = _writebuf.space();
+    stats.bytes += bytes_written;
+    stats.blocks++;
+}
+
+// called by the IO thread, which is the reader of _writebuf, so the
+// space is worked out from the reader's side
+void DataFlash_File::df_stats_gather_space(const uint32_t bytes_available) {
+    const uint32_t space_remaining = _writebuf.get_size() - bytes_available;
     if (space_remaining < stats.buf_space_min) {
         stats.buf_space_min = space_remaining;
     }
@@ -1154,8 +1856,7 @@ void DataFlash_File::df_stats_gather(const uint16_t bytes_written) {
         stats.buf_space_max = space_remaining;
     }
     stats.buf_space_sigma += space_remaining;
-    stats.bytes += bytes_written;
-    stats.blocks++;
+    stats.buf_space_samples++;
 }
 
 void DataFlash_File::df_stats_clear() {
@@ -1164,7 +1865,16 @@ void DataFlash_File::df_stats_clear() {
 }
 
 void DataFlash_File::df_stats_log() {
-    Log_Write_DataFlash_Stats_File(stats);
+    // the IO thread only ever adds to its totals, so differences are
+    // safe to take without locking
+    const struct df_io_stats io_now = _io_stats;
+    const struct df_io_stats io_delta = {
+        raw_bytes  : io_now.raw_bytes - _io_stats_last.raw_bytes,
+        file_bytes : io_now.file_bytes - _io_stats_last.file_bytes,
+        time_us    : io_now.time_us - _io_stats_last.time_us,
+    };
+    _io_stats_last = io_now;
+    Log_Write_DataFlash_Stats_File(stats, io_delta);
     df_stats_clear();
 }
 
@@ -8,8 +8,11 @@
 
 #if HAL_OS_POSIX_IO || HAL_OS_FATFS_IO
 
+#include <atomic>
 #include <AP_HAL/utility/RingBuffer.h>
+#include <AP_Common/Bitmask.h>
 #include "DataFlash_Backend.h"
+#include "DataFlash_Compress.h"
 
 class DataFlash_File : public DataFlash_Backend
 {
@@ -32,6 +35,8 @@ public:
 
     /* Write a block of data at current offset */
     bool _WritePrioritisedBlock(const void *pBuffer, uint16_t size, bool is_critical) override;
+    void *_ReserveBlock(uint16_t size, bool is_critical) override;
+    void _CommitBlock(uint16_t size) override;
     uint32_t bufferspace_available() override;
 
     // high level interface
@@ -66,11 +71,34 @@ protected:
 private:
     int _write_fd;
     char *_write_filename;
+    uint16_t _write_log_num;
     uint32_t _last_write_ms;
     
     int _read_fd;
     uint16_t _read_fd_log_num;
     uint32_t _read_offset;
+
+    // log download read-ahead. Requests are served from _ra[0]; the
+    // IO thread reads the following chunk into _ra[1]
+    struct read_ahead_buf {
+        uint8_t *data;
+        uint32_t ofs;
+        uint16_t len;
+    } _ra[2];
+    enum ra_state : uint8_t {
+        RA_IDLE,      // _ra[1] is unused
+        RA_REQUESTED, // the IO thread is to fill _ra[1]
+        RA_READY,     // _ra[1] holds data (length 0 at end of log)
+    };
+    // written by the front end to request a fill and by the IO thread
+    // to publish it; acquire/release so the buffer contents are
+    // visible to whichever side sees the new state
+    std::atomic<uint8_t> _ra_state{RA_IDLE};
+    bool _read_ahead_init(void);
+    int16_t _read_ahead_get(uint32_t ofs, uint16_t len, uint8_t *data);
+    void _read_ahead_fill(void);
+    int16_t _read_log_data(uint32_t ofs, uint16_t len, uint8_t *data);
+    void _close_read_fd(void);
     uint32_t _write_offset;
     volatile bool _open_error;
     const char *_log_directory;
@@ -81,6 +109,55 @@ private:
 
     uint16_t _cached_oldest_log;
 
+    /*
+      index of the logs on the card, kept in memory and in
+      LOGINDEX.BIN so listing logs doesn't need a directory scan and a
+      stat() per log. Entries are indexed by log number and carry
+      their own crc so each can be rewritten on its own
+     */
+    struct PACKED log_index_header {
+        uint32_t magic;
+        uint16_t num_entries;
+        uint8_t reserved;
+        uint8_t crc;
+    };
+    struct PACKED log_index_entry {
+        uint32_t size;
+        uint32_t time_utc; // start of log, or its mtime if unknown
+        uint8_t flags;
+        uint8_t crc;
+    };
+    enum log_index_flags : uint8_t {
+        LOG_INDEX_EXISTS     = (1U<<0),
+        LOG_INDEX_LONG_NAME  = (1U<<1), // zero-padded file name
+        LOG_INDEX_COMPRESSED = (1U<<2),
+    };
+    struct log_index_entry *_log_index; // nullptr if not loaded
+    uint16_t _log_index_last;
+    char *_log_index_file_name() const;
+    bool _log_index_load(void);
+    bool _log_index_read(struct log_index_entry *index);
+    bool _log_index_scan(struct log_index_entry *index, uint16_t last_log);
+    bool _log_index_fill_entry(struct log_index_entry &e, uint16_t log_num, bool long_name);
+    bool _log_index_write_all(void);
+    bool _log_index_write_entry(uint16_t log_num);
+    void _log_index_set(uint16_t log_num, uint32_t size, uint32_t time_utc, uint8_t flags);
+
+    /*
+      LOGINDEX.BIN is only written by the IO thread. Changes to the
+      in-memory index are marked here under _log_index_sem and
+      written out by _log_index_flush()
+     */
+    AP_HAL::Semaphore *_log_index_sem;
+    Bitmask *_log_index_dirty;    // entries to rewrite in place
+    bool _log_index_rewrite;      // whole file to rewrite
+    bool _log_index_failed;       // file given up on until reboot
+    void _log_index_flush(void);
+    static uint32_t _utc_now(void);
+    bool _log_index_exists(uint16_t log_num) const {
+        return _log_index[log_num].flags & LOG_INDEX_EXISTS;
+    }
+
     uint16_t _log_num_from_list_entry(const uint16_t list_entry);
 
     // possibly time-consuming preparations handling
@@ -99,11 +176,26 @@ private:
 #else
     const float min_avail_space_percent = 10.0f;
 #endif
-    // write buffer
-    ByteBuffer _writebuf;
+    // write buffer. Filled by the front end under semaphore and
+    // drained lock-free by the IO thread
+    SPSCByteBuffer _writebuf;
     const uint16_t _writebuf_chunk;
     uint32_t _last_write_time;
 
+    // messages written by the thread holding a reservation, most
+    // likely from a getter filling the reserved message. They are
+    // written after it by _CommitBlock()
+    uint8_t _nested_buf[256];
+    uint16_t _nested_len;
+
+    // optional block compression, done by the IO thread. _zbuf holds
+    // the frame being written, from _zbuf_ofs to _zbuf_len
+    DataFlash_Compressor _compressor;
+    uint8_t *_zbuf;
+    uint32_t _zbuf_ofs;
+    uint32_t _zbuf_len;
+    bool _compress_log; // current log file is compressed
+
     /* construct a file name given a log number. Caller must free. */
     char *_log_file_name(const uint16_t log_num) const;
     char *_log_file_name_long(const uint16_t log_num) const;
@@ -145,12 +237,16 @@ private:
     const uint32_t _free_space_check_interval = 1000UL; // milliseconds
     const uint32_t _free_space_min_avail = 8388608; // bytes
 
-    // semaphore mediates access to the ringbuffer
+    // semaphore serialises writers to the ringbuffer; the IO thread
+    // reads it without locking
     AP_HAL::Semaphore *semaphore;
     // write_fd_semaphore mediates access to write_fd so the frontend
     // can open/close files without causing the backend to write to a
     // bad fd
     AP_HAL::Semaphore *write_fd_semaphore;
+    // read_fd_semaphore serialises use of _read_fd between log
+    // download and the IO thread read-ahead
+    AP_HAL::Semaphore *read_fd_semaphore;
     
     // performance counters
     AP_HAL::Util::perf_counter_t  _perf_write;
@@ -166,11 +262,23 @@ private:
         uint32_t buf_space_min;
         uint32_t buf_space_max;
         uint32_t buf_space_sigma;
+        uint32_t buf_space_samples;
     };
     struct df_stats stats;
 
-    void Log_Write_DataFlash_Stats_File(const struct df_stats &_stats);
+    // running totals kept by the IO thread; the stats are logged as
+    // differences from the last snapshot
+    struct df_io_stats {
+        uint32_t raw_bytes;
+        uint32_t file_bytes;
+        uint32_t time_us;
+    };
+    struct df_io_stats _io_stats;
+    struct df_io_stats _io_stats_last;
+
+    void Log_Write_DataFlash_Stats_File(const struct df_stats &_stats, const struct df_io_stats &_io);
     void df_stats_gather(uint16_t bytes_written);
+    void df_stats_gather_space(uint32_t bytes_available);
     void df_stats_log();
     void df_stats_clear();
 
@@ -19,11 +19,20 @@
 
 
 #include <AP_HAL/AP_HAL.h>
+#include <AP_Common/Bitmask.h>
 #include <DataFlash/DataFlash.h>
 #include <GCS_MAVLink/GCS.h> // for LOG_ENTRY
 
 extern const AP_HAL::HAL& hal;
 
+// number of LOG_DATA blocks a GCS may ask for again while a download
+// is streaming. Requests outside this window are dropped and will be
+// re-requested by the GCS once the stream completes
+#define LOG_RESEND_BLOCKS 1024
+
+// only report throughput for downloads of at least this many bytes
+#define LOG_SEND_REPORT_MIN_BYTES 65536
+
 // We avoid doing log messages when timing is critical:
 bool DataFlash_Class::should_handle_log_message()
 {
@@ -102,20 +111,22 @@ void DataFlash_Class::handle_log_request_list(GCS_MAVLINK &link, mavlink_message
  */
 void DataFlash_Class::handle_log_request_data(GCS_MAVLINK &link, mavlink_message_t *msg)
 {
+    mavlink_log_request_data_t packet;
+    mavlink_msg_log_request_data_decode(msg, &packet);
+
     if (_log_sending_link != nullptr) {
         // some GCS (e.g. MAVProxy) attempt to stream request_data
         // messages when they're filling gaps in the downloaded logs.
-        // This channel check avoids complaining to them, at the cost
-        // of silently dropping any repeated attempts to start logging
+        // Those are queued to be sent again alongside the stream.
+        // Requests from other channels are refused
         if (_log_sending_link->get_chan() != link.get_chan()) {
             link.send_text(MAV_SEVERITY_INFO, "Log download in progress");
+        } else if (transfer_activity == SENDING && packet.id == _log_num_data) {
+            handle_log_resend_request(packet.ofs, packet.count);
         }
         return;
     }
 
-    mavlink_log_request_data_t packet;
-    mavlink_msg_log_request_data_decode(msg, &packet);
-
     // consider opening or switching logs:
     if (transfer_activity != SENDING || _log_num_data != packet.id) {
 
@@ -148,9 +159,67 @@ void DataFlash_Class::handle_log_request_data(GCS_MAVLINK &link, mavlink_message
     transfer_activity = SENDING;
     _log_sending_link = &link;
 
+    if (_log_resend != nullptr) {
+        _log_resend->clearall();
+    }
+    memset(&_log_send_stats, 0, sizeof(_log_send_stats));
+    _log_send_stats.start_ms = AP_HAL::millis();
+
     handle_log_send();
 }
 
+/*
+  note blocks of the log being sent which the GCS has asked for
+  again. Only data already sent can be resent; anything past the send
+  position will go out anyway. This matters as GCSs such as MAVProxy
+  ask for everything from the first missing offset to 0xFFFFFFFF
+ */
+void DataFlash_Class::handle_log_resend_request(const uint32_t ofs, const uint32_t count)
+{
+    const uint32_t sent = MIN(_log_data_offset, _log_data_size);
+    if (count == 0 || ofs >= sent) {
+        return;
+    }
+    if (_log_resend == nullptr) {
+        _log_resend = new Bitmask(LOG_RESEND_BLOCKS);
+        if (_log_resend == nullptr) {
+            return;
+        }
+    }
+    const uint32_t block_len = MAVLINK_MSG_LOG_DATA_FIELD_DATA_LEN;
+    const uint32_t end = MIN(uint64_t(ofs) + count, sent);
+    const uint32_t first = ofs / block_len;
+    const uint32_t last = (end - 1) / block_len;
+    if (_log_resend->empty()) {
+        _log_resend_base = first;
+    }
+    for (uint32_t b=MAX(first, _log_resend_base); b<=last; b++) {
+        if (b - _log_resend_base >= LOG_RESEND_BLOCKS) {
+            break;
+        }
+        _log_resend->set(b - _log_resend_base);
+    }
+}
+
+/*
+  finish a download, reporting the throughput achieved
+ */
+void DataFlash_Class::handle_log_send_complete()
+{
+    const uint32_t dt_ms = AP_HAL::millis() - _log_send_stats.start_ms;
+    if (_log_send_stats.bytes >= LOG_SEND_REPORT_MIN_BYTES && dt_ms > 0) {
+        // when the link was full on most calls we are running at link
+        // capacity; otherwise reading or the send budget limited us
+        _log_sending_link->send_text(MAV_SEVERITY_INFO, "Log %u: %u B/s, link full %u%%, %u resent",
+                                     (unsigned)_log_num_data,
+                                     (unsigned)(uint64_t(_log_send_stats.bytes) * 1000 / dt_ms),
+                                     (unsigned)(_log_send_stats.calls ? (100U * _log_send_stats.link_full / _log_send_stats.calls) : 0),
+                                     (unsigned)_log_send_stats.resent);
+    }
+    transfer_activity = IDLE;
+    _log_sending_link = nullptr;
+}
+
 /**
    handle request to erase log data
  */
@@ -202,7 +271,7 @@ void DataFlash_Class::handle_log_sending()
 {
 #if CONFIG_HAL_BOARD == HAL_BOARD_SITL
     // assume USB speeds in SITL for the purposes of log download
-    const uint8_t num_sends = 40;
+    uint8_t num_sends = 40;
 #else
     uint8_t num_sends = 1;
     if (_log_sending_link->is_high_bandwidth() && hal.gpio->usb_connected()) {
@@ -217,6 +286,19 @@ void DataFlash_Class::handle_log_sending()
     }
 #endif
 
+    // the window of packets in flight is what the link's transmit
+    // buffer can hold, within the per-call budget above
+    const mavlink_channel_t chan = _log_sending_link->get_chan();
+    const uint16_t window = comm_get_txspace(chan) / PAYLOAD_SIZE(chan, LOG_DATA);
+    const bool link_full = window < num_sends;
+    if (link_full) {
+        num_sends = window;
+    }
+    _log_send_stats.calls++;
+    if (link_full) {
+        _log_send_stats.link_full++;
+    }
+
     for (uint8_t i=0; i<num_sends; i++) {
         if (transfer_activity != SENDING) {
             // may have completed sending data
@@ -277,14 +359,27 @@ bool DataFlash_Class::handle_log_send_data()
         return false;
     }
 
+    // blocks the GCS asked for again go ahead of the stream
+    const int32_t resend_bit = (_log_resend != nullptr) ? _log_resend->first_set() : -1;
+    uint32_t ofs;
+    uint32_t len;
+    if (resend_bit >= 0) {
+        _log_resend->clear(resend_bit);
+        ofs = (_log_resend_base + resend_bit) * MAVLINK_MSG_LOG_DATA_FIELD_DATA_LEN;
+        len = MIN(_log_data_size - ofs, MAVLINK_MSG_LOG_DATA_FIELD_DATA_LEN);
+        _log_send_stats.resent++;
+    } else if (_log_data_remaining > 0) {
+        ofs = _log_data_offset;
+        len = MIN(_log_data_remaining, MAVLINK_MSG_LOG_DATA_FIELD_DATA_LEN);
+    } else {
+        handle_log_send_complete();
+        return false;
+    }
+
     int16_t ret = 0;
-    uint32_t len = _log_data_remaining;
 	mavlink_log_data_t packet;
 
-    if (len > MAVLINK_MSG_LOG_DATA_FIELD_DATA_LEN) {
-        len = MAVLINK_MSG_LOG_DATA_FIELD_DATA_LEN;
-    }
-    ret = get_log_data(_log_num_data, _log_data_page, _log_data_offset, len, packet.data);
+    ret = get_log_data(_log_num_data, _log_data_page, ofs, len, packet.data);
     if (ret < 0) {
         // report as EOF on error
         ret = 0;
@@ -293,7 +388,7 @@ bool DataFlash_Class::handle_log_send_data()
         memset(&packet.data[ret], 0, MAVLINK_MSG_LOG_DATA_FIELD_DATA_LEN-ret);
     }
 
-    packet.ofs = _log_data_offset;
+    packet.ofs = ofs;
     packet.id = _log_num_data;
     packet.count = ret;
     _mav_finalize_message_chan_send(_log_sending_link->get_chan(),
@@ -302,12 +397,19 @@ bool DataFlash_Class::handle_log_send_data()
                                     MAVLINK_MSG_ID_LOG_DATA_MIN_LEN,
                                     MAVLINK_MSG_ID_LOG_DATA_LEN,
                                     MAVLINK_MSG_ID_LOG_DATA_CRC);
-
-    _log_data_offset += len;
-    _log_data_remaining -= len;
-    if (ret < MAVLINK_MSG_LOG_DATA_FIELD_DATA_LEN || _log_data_remaining == 0) {
-        transfer_activity = IDLE;
-        _log_sending_link = nullptr;
+    _log_send_stats.bytes += ret;
+
+    if (resend_bit < 0) {
+        _log_data_offset += len;
+        _log_data_remaining -= len;
+        if (ret < MAVLINK_MSG_LOG_DATA_FIELD_DATA_LEN) {
+            // end of the log
+            _log_data_remaining = 0;
+        }
+    }
+    if (_log_data_remaining == 0 &&
+        (_log_resend == nullptr || _log_resend->empty())) {
+        handle_log_send_complete();
     }
     return true;
 }
@@ -0,0 +1,168 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+/*
+  precompiled writers for dynamically defined log messages.
+
+  DataFlash_Class::Log_Write(name, labels, fmt, ...) looks the message
+  type up by name and interprets the format string on every call. A
+  DataFlash_Writer takes the format as template arguments instead, so
+  the message length, the field offsets and the argument types are
+  fixed at compile time, and it resolves its message type on first
+  use only:
+
+    static DataFlash_Writer<'Q','f','f','B'> writer("XYZ", "TimeUS,X,Y,Z");
+    writer.write(AP_HAL::micros64(), x, y, z);
+
+  The message appears in the log exactly as if written with
+  Log_Write("XYZ", "TimeUS,X,Y,Z", "QffB", ...).
+ */
+
+#include "DataFlash.h"
+
+#include <string.h>
+
+// C++ type and packing for each log format character
+template <char C> struct DataFlash_Field;
+
+template <typename T>
+struct DataFlash_ScalarField {
+    typedef T type;
+    static const uint8_t size = sizeof(T);
+    static void put(uint8_t *p, T v) { memcpy(p, &v, sizeof(T)); }
+};
+
+template <uint8_t N>
+struct DataFlash_CharField {
+    typedef const char *type;
+    static const uint8_t size = N;
+    static void put(uint8_t *p, const char *v) { strncpy((char *)p, v, N); }
+};
+
+template <> struct DataFlash_Field<'b'> : DataFlash_ScalarField<int8_t> {};
+template <> struct DataFlash_Field<'B'> : DataFlash_ScalarField<uint8_t> {};
+template <> struct DataFlash_Field<'M'> : DataFlash_ScalarField<uint8_t> {};
+template <> struct DataFlash_Field<'h'> : DataFlash_ScalarField<int16_t> {};
+template <> struct DataFlash_Field<'c'> : DataFlash_ScalarField<int16_t> {};
+template <> struct DataFlash_Field<'H'> : DataFlash_ScalarField<uint16_t> {};
+template <> struct DataFlash_Field<'C'> : DataFlash_ScalarField<uint16_t> {};
+template <> struct DataFlash_Field<'i'> : DataFlash_ScalarField<int32_t> {};
+template <> struct DataFlash_Field<'L'> : DataFlash_ScalarField<int32_t> {};
+template <> struct DataFlash_Field<'e'> : DataFlash_ScalarField<int32_t> {};
+template <> struct DataFlash_Field<'I'> : DataFlash_ScalarField<uint32_t> {};
+template <> struct DataFlash_Field<'E'> : DataFlash_ScalarField<uint32_t> {};
+template <> struct DataFlash_Field<'f'> : DataFlash_ScalarField<float> {};
+template <> struct DataFlash_Field<'d'> : DataFlash_ScalarField<double> {};
+template <> struct DataFlash_Field<'q'> : DataFlash_ScalarField<int64_t> {};
+template <> struct DataFlash_Field<'Q'> : DataFlash_ScalarField<uint64_t> {};
+template <> struct DataFlash_Field<'n'> : DataFlash_CharField<4> {};
+template <> struct DataFlash_Field<'N'> : DataFlash_CharField<16> {};
+template <> struct DataFlash_Field<'Z'> : DataFlash_CharField<64> {};
+
+// packs fields at offsets worked out at compile time
+template <uint16_t OFS, char... Cs> struct DataFlash_Pack;
+
+template <uint16_t OFS>
+struct DataFlash_Pack<OFS> {
+    static const uint16_t length = OFS;
+    static void pack(uint8_t *) {}
+};
+
+template <uint16_t OFS, char C, char... Cs>
+struct DataFlash_Pack<OFS, C, Cs...> {
+    typedef DataFlash_Pack<OFS + DataFlash_Field<C>::size, Cs...> rest;
+    static const uint16_t length = rest::length;
+
+    template <typename... Args>
+    static void pack(uint8_t *buf, typename DataFlash_Field<C>::type v, Args... args) {
+        DataFlash_Field<C>::put(&buf[OFS], v);
+        rest::pack(buf, args...);
+    }
+};
+
+template <char... FMT>
+class DataFlash_Writer {
+public:
+    typedef DataFlash_Pack<3, FMT...> layout; // after the message header
+    static const uint16_t length = layout::length;
+
+    static_assert(sizeof...(FMT) > 0, "log message needs at least one field");
+    static_assert(sizeof...(FMT) < LS_FORMAT_SIZE, "too many fields for a log message");
+    static_assert(length <= 255, "log message too long");
+
+    // name, labels, units and mults must stay valid for the lifetime
+    // of the writer, as for Log_Write()
+    DataFlash_Writer(const char *name, const char *labels,
+                     const char *units = nullptr, const char *mults = nullptr) :
+        _name(name),
+        _labels(labels),
+        _units(units),
+        _mults(mults),
+        _f(nullptr)
+    {}
+
+    /* Do not allow copies */
+    DataFlash_Writer(const DataFlash_Writer &other) = delete;
+    DataFlash_Writer &operator=(const DataFlash_Writer&) = delete;
+
+    void write(typename DataFlash_Field<FMT>::type... args) {
+        DataFlash_Class *df = DataFlash_Class::instance();
+        if (df == nullptr) {
+            return;
+        }
+        if (_f == nullptr) {
+            _f = df->msg_fmt_for_name(_name, _labels, _units, _mults, _fmt);
+            if (_f == nullptr) {
+                df->internal_error();
+                return;
+            }
+        }
+        if (!df->Log_Write_Emit_FMTs(_f)) {
+            // as with Log_Write(), backends yet to take the FMT for
+            // this message don't get it
+            uint8_t buf[length];
+            fill(buf, args...);
+            df->Log_Write_Block(_f, buf, length);
+            return;
+        }
+        uint8_t fallback[length];
+        uint8_t *buf = (uint8_t *)df->ReserveBlock(fallback, length);
+        fill(buf, args...);
+        df->CommitBlock(buf, length);
+    }
+
+    // message type, or -1 before the first write
+    int16_t msg_type() const { return _f ? _f->msg_type : -1; }
+
+private:
+    static const char _fmt[sizeof...(FMT)+1];
+
+    void fill(uint8_t *buf, typename DataFlash_Field<FMT>::type... args) const {
+        buf[0] = HEAD_BYTE1;
+        buf[1] = HEAD_BYTE2;
+        buf[2] = _f->msg_type;
+        layout::pack(buf, args...);
+    }
+
+    const char *_name;
+    const char *_labels;
+    const char *_units;
+    const char *_mults;
+    struct DataFlash_Class::log_write_fmt *_f;
+};
+
+template <char... FMT>
+const char DataFlash_Writer<FMT...>::_fmt[sizeof...(FMT)+1] = { FMT..., '\0' };
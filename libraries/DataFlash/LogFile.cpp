@@ -257,6 +257,30 @@ void DataFlash_Class::Log_Write_RSSI(AP_RSSI &rssi)
     WriteBlock(&pkt, sizeof(pkt));
 }
 
+// Write parameter save queue statistics, resetting them for the next
+// interval. Nothing is written while no parameters are being saved
+void DataFlash_Class::Log_Write_Param_Save_Stats()
+{
+    struct AP_Param::save_stats stats;
+    AP_Param::get_save_stats(stats, true);
+    if (stats.queued == 0 && stats.depth == 0) {
+        return;
+    }
+    struct log_Param_Save_Stats pkt = {
+        LOG_PACKET_HEADER_INIT(LOG_PARAM_SAVE_MSG),
+        time_us       : AP_HAL::micros64(),
+        depth         : stats.depth,
+        max_depth     : stats.max_depth,
+        queued        : (uint16_t)MIN(stats.queued, UINT16_MAX),
+        coalesced     : (uint16_t)MIN(stats.coalesced, UINT16_MAX),
+        blocked       : (uint16_t)MIN(stats.blocked, UINT16_MAX),
+        saved         : (uint16_t)MIN(stats.saved, UINT16_MAX),
+        avg_latency   : stats.saved ? stats.latency_sum_ms / stats.saved : 0,
+        max_latency   : stats.max_latency_ms
+    };
+    WriteBlock(&pkt, sizeof(pkt));
+}
+
 void DataFlash_Class::Log_Write_Baro_instance(uint64_t time_us, uint8_t baro_instance, enum LogMessages type)
 {
     AP_Baro &baro = AP::baro();
@@ -298,24 +322,26 @@ void DataFlash_Class::Log_Write_IMU_instance(const uint64_t time_us, const uint8
     const AP_InertialSensor &ins = AP::ins();
     const Vector3f &gyro = ins.get_gyro(imu_instance);
     const Vector3f &accel = ins.get_accel(imu_instance);
-    struct log_IMU pkt = {
-        LOG_PACKET_HEADER_INIT(type),
-        time_us : time_us,
-        gyro_x  : gyro.x,
-        gyro_y  : gyro.y,
-        gyro_z  : gyro.z,
-        accel_x : accel.x,
-        accel_y : accel.y,
-        accel_z : accel.z,
-        gyro_error  : ins.get_gyro_error_count(imu_instance),
-        accel_error : ins.get_accel_error_count(imu_instance),
-        temperature : ins.get_temperature(imu_instance),
-        gyro_health : (uint8_t)ins.get_gyro_health(imu_instance),
-        accel_health : (uint8_t)ins.get_accel_health(imu_instance),
-        gyro_rate : ins.get_gyro_rate_hz(imu_instance),
-        accel_rate : ins.get_accel_rate_hz(imu_instance),
-    };
-    WriteBlock(&pkt, sizeof(pkt));
+
+    // filled in place in the log buffer where possible
+    struct log_IMU stack_pkt;
+    struct log_IMU *pkt = ReserveMessage(stack_pkt);
+    LOG_PACKET_HEADER_FILL(pkt, type);
+    pkt->time_us      = time_us;
+    pkt->gyro_x       = gyro.x;
+    pkt->gyro_y       = gyro.y;
+    pkt->gyro_z       = gyro.z;
+    pkt->accel_x      = accel.x;
+    pkt->accel_y      = accel.y;
+    pkt->accel_z      = accel.z;
+    pkt->gyro_error   = ins.get_gyro_error_count(imu_instance);
+    pkt->accel_error  = ins.get_accel_error_count(imu_instance);
+    pkt->temperature  = ins.get_temperature(imu_instance);
+    pkt->gyro_health  = (uint8_t)ins.get_gyro_health(imu_instance);
+    pkt->accel_health = (uint8_t)ins.get_accel_health(imu_instance);
+    pkt->gyro_rate    = ins.get_gyro_rate_hz(imu_instance);
+    pkt->accel_rate   = ins.get_accel_rate_hz(imu_instance);
+    CommitBlock(pkt, sizeof(*pkt));
 }
 
 // Write an raw accel/gyro data packet
@@ -350,20 +376,20 @@ void DataFlash_Class::Log_Write_IMUDT_instance(const uint64_t time_us, const uin
     ins.get_delta_angle(imu_instance, delta_angle);
     ins.get_delta_velocity(imu_instance, delta_velocity);
 
-    struct log_IMUDT pkt = {
-        LOG_PACKET_HEADER_INIT(type),
-        time_us : time_us,
-        delta_time   : delta_t,
-        delta_vel_dt : delta_vel_t,
-        delta_ang_dt : delta_ang_t,
-        delta_ang_x  : delta_angle.x,
-        delta_ang_y  : delta_angle.y,
-        delta_ang_z  : delta_angle.z,
-        delta_vel_x  : delta_velocity.x,
-        delta_vel_y  : delta_velocity.y,
-        delta_vel_z  : delta_velocity.z
-    };
-    WriteBlock(&pkt, sizeof(pkt));
+    struct log_IMUDT stack_pkt;
+    struct log_IMUDT *pkt = ReserveMessage(stack_pkt);
+    LOG_PACKET_HEADER_FILL(pkt, type);
+    pkt->time_us      = time_us;
+    pkt->delta_time   = delta_t;
+    pkt->delta_vel_dt = delta_vel_t;
+    pkt->delta_ang_dt = delta_ang_t;
+    pkt->delta_ang_x  = delta_angle.x;
+    pkt->delta_ang_y  = delta_angle.y;
+    pkt->delta_ang_z  = delta_angle.z;
+    pkt->delta_vel_x  = delta_velocity.x;
+    pkt->delta_vel_y  = delta_velocity.y;
+    pkt->delta_vel_z  = delta_velocity.z;
+    CommitBlock(pkt, sizeof(*pkt));
 }
 
 void DataFlash_Class::Log_Write_IMUDT(uint64_t time_us, uint8_t imu_mask)
@@ -1361,37 +1387,37 @@ void DataFlash_Class::Log_Write_Trigger(const AP_AHRS &ahrs, const Location &cur
 // Write an attitude packet
 void DataFlash_Class::Log_Write_Attitude(AP_AHRS &ahrs, const Vector3f &targets)
 {
-    struct log_Attitude pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_ATTITUDE_MSG),
-        time_us         : AP_HAL::micros64(),
-        control_roll    : (int16_t)targets.x,
-        roll            : (int16_t)ahrs.roll_sensor,
-        control_pitch   : (int16_t)targets.y,
-        pitch           : (int16_t)ahrs.pitch_sensor,
-        control_yaw     : (uint16_t)targets.z,
-        yaw             : (uint16_t)ahrs.yaw_sensor,
-        error_rp        : (uint16_t)(ahrs.get_error_rp() * 100),
-        error_yaw       : (uint16_t)(ahrs.get_error_yaw() * 100)
-    };
-    WriteBlock(&pkt, sizeof(pkt));
+    struct log_Attitude stack_pkt;
+    struct log_Attitude *pkt = ReserveMessage(stack_pkt);
+    LOG_PACKET_HEADER_FILL(pkt, LOG_ATTITUDE_MSG);
+    pkt->time_us       = AP_HAL::micros64();
+    pkt->control_roll  = (int16_t)targets.x;
+    pkt->roll          = (int16_t)ahrs.roll_sensor;
+    pkt->control_pitch = (int16_t)targets.y;
+    pkt->pitch         = (int16_t)ahrs.pitch_sensor;
+    pkt->control_yaw   = (uint16_t)targets.z;
+    pkt->yaw           = (uint16_t)ahrs.yaw_sensor;
+    pkt->error_rp      = (uint16_t)(ahrs.get_error_rp() * 100);
+    pkt->error_yaw     = (uint16_t)(ahrs.get_error_yaw() * 100);
+    CommitBlock(pkt, sizeof(*pkt));
 }
 
 // Write an attitude packet
 void DataFlash_Class::Log_Write_AttitudeView(AP_AHRS_View &ahrs, const Vector3f &targets)
 {
-    struct log_Attitude pkt = {
-        LOG_PACKET_HEADER_INIT(LOG_ATTITUDE_MSG),
-        time_us         : AP_HAL::micros64(),
-        control_roll    : (int16_t)targets.x,
-        roll            : (int16_t)ahrs.roll_sensor,
-        control_pitch   : (int16_t)targets.y,
-        pitch           : (int16_t)ahrs.pitch_sensor,
-        control_yaw     : (uint16_t)targets.z,
-        yaw             : (uint16_t)ahrs.yaw_sensor,
-        error_rp        : (uint16_t)(ahrs.get_error_rp() * 100),
-        error_yaw       : (uint16_t)(ahrs.get_error_yaw() * 100)
-    };
-    WriteBlock(&pkt, sizeof(pkt));
+    struct log_Attitude stack_pkt;
+    struct log_Attitude *pkt = ReserveMessage(stack_pkt);
+    LOG_PACKET_HEADER_FILL(pkt, LOG_ATTITUDE_MSG);
+    pkt->time_us       = AP_HAL::micros64();
+    pkt->control_roll  = (int16_t)targets.x;
+    pkt->roll          = (int16_t)ahrs.roll_sensor;
+    pkt->control_pitch = (int16_t)targets.y;
+    pkt->pitch         = (int16_t)ahrs.pitch_sensor;
+    pkt->control_yaw   = (uint16_t)targets.z;
+    pkt->yaw           = (uint16_t)ahrs.yaw_sensor;
+    pkt->error_rp      = (uint16_t)(ahrs.get_error_rp() * 100);
+    pkt->error_yaw     = (uint16_t)(ahrs.get_error_yaw() * 100);
+    CommitBlock(pkt, sizeof(*pkt));
 }
 
 void DataFlash_Class::Log_Write_Current_instance(const uint64_t time_us,
@@ -1634,23 +1660,24 @@ void DataFlash_Class::Log_Write_Rate(const AP_AHRS &ahrs,
 {
     const Vector3f &rate_targets = attitude_control.rate_bf_targets();
     const Vector3f &accel_target = pos_control.get_accel_target();
-    struct log_Rate pkt_rate = {
-        LOG_PACKET_HEADER_INIT(LOG_RATE_MSG),
-        time_us         : AP_HAL::micros64(),
-        control_roll    : degrees(rate_targets.x),
-        roll            : degrees(ahrs.get_gyro().x),
-        roll_out        : motors.get_roll(),
-        control_pitch   : degrees(rate_targets.y),
-        pitch           : degrees(ahrs.get_gyro().y),
-        pitch_out       : motors.get_pitch(),
-        control_yaw     : degrees(rate_targets.z),
-        yaw             : degrees(ahrs.get_gyro().z),
-        yaw_out         : motors.get_yaw(),
-        control_accel   : (float)accel_target.z,
-        accel           : (float)(-(ahrs.get_accel_ef_blended().z + GRAVITY_MSS) * 100.0f),
-        accel_out       : motors.get_throttle()
-    };
-    WriteBlock(&pkt_rate, sizeof(pkt_rate));
+    const Vector3f &gyro = ahrs.get_gyro();
+    struct log_Rate stack_pkt;
+    struct log_Rate *pkt = ReserveMessage(stack_pkt);
+    LOG_PACKET_HEADER_FILL(pkt, LOG_RATE_MSG);
+    pkt->time_us       = AP_HAL::micros64();
+    pkt->control_roll  = degrees(rate_targets.x);
+    pkt->roll          = degrees(gyro.x);
+    pkt->roll_out      = motors.get_roll();
+    pkt->control_pitch = degrees(rate_targets.y);
+    pkt->pitch         = degrees(gyro.y);
+    pkt->pitch_out     = motors.get_pitch();
+    pkt->control_yaw   = degrees(rate_targets.z);
+    pkt->yaw           = degrees(gyro.z);
+    pkt->yaw_out       = motors.get_yaw();
+    pkt->control_accel = (float)accel_target.z;
+    pkt->accel         = (float)(-(ahrs.get_accel_ef_blended().z + GRAVITY_MSS) * 100.0f);
+    pkt->accel_out     = motors.get_throttle();
+    CommitBlock(pkt, sizeof(*pkt));
 }
 
 // Write rally points
@@ -7,6 +7,9 @@
 #define LOG_PACKET_HEADER	       uint8_t head1, head2, msgid;
 #define LOG_PACKET_HEADER_INIT(id) head1 : HEAD_BYTE1, head2 : HEAD_BYTE2, msgid : id
 #define LOG_PACKET_HEADER_LEN 3 // bytes required for LOG_PACKET_HEADER
+// fill in the header of a message being written in place, see
+// DataFlash_Class::ReserveMessage()
+#define LOG_PACKET_HEADER_FILL(pkt, id) do { (pkt)->head1 = HEAD_BYTE1; (pkt)->head2 = HEAD_BYTE2; (pkt)->msgid = id; } while (0)
 
 // once the logging code is all converted we will remove these from
 // this header
@@ -156,6 +159,9 @@ struct PACKED log_DSF {
     uint32_t buf_space_min;
     uint32_t buf_space_max;
     uint32_t buf_space_avg;
+    uint32_t file_bytes;
+    float    compress_ratio;
+    uint32_t io_time_us;
 };
 
 struct PACKED log_GPS {
@@ -236,6 +242,31 @@ struct PACKED log_ISBD {
 };
 static_assert(sizeof(log_ISBD) < 256, "log_ISBD is over-size");
 
+// peaks of the spectrum of one axis of an IMU batch
+struct PACKED log_ISFP {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    uint16_t isb_seqno;
+    uint8_t sensor_type;
+    uint8_t instance;
+    uint8_t axis;
+    float sample_rate_hz;
+    float peak_freq[3];
+    float peak_energy[3];
+    float total_energy;
+};
+
+// coarse spectrum of one axis of an IMU batch
+struct PACKED log_ISFB {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    uint16_t isb_seqno;
+    uint8_t sensor_type;
+    uint8_t instance;
+    uint8_t axis;
+    float band[10];
+};
+
 struct PACKED log_Vibe {
     LOG_PACKET_HEADER;
     uint64_t time_us;
@@ -741,6 +772,8 @@ struct PACKED log_TERRAIN {
     float current_height;
     uint16_t pending;
     uint16_t loaded;
+    uint32_t cache_hits;
+    uint32_t cache_misses;
 };
 
 /*
@@ -1032,6 +1065,31 @@ struct PACKED log_Performance {
     uint16_t load;
 };
 
+struct PACKED log_Task_Stats {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    char name[16];
+    uint16_t run_count;
+    uint16_t overruns;
+    uint16_t skipped;
+    uint16_t slipped;
+    uint32_t max_time;
+    uint16_t hist[8];
+};
+
+struct PACKED log_Param_Save_Stats {
+    LOG_PACKET_HEADER;
+    uint64_t time_us;
+    uint16_t depth;
+    uint16_t max_depth;
+    uint16_t queued;
+    uint16_t coalesced;
+    uint16_t blocked;
+    uint16_t saved;
+    uint32_t avg_latency;
+    uint32_t max_latency;
+};
+
 struct PACKED log_SRTL {
     LOG_PACKET_HEADER;
     uint64_t time_us;
@@ -1115,6 +1173,16 @@ struct PACKED log_DSTL {
 #define ISBD_UNITS  "s--ooo"
 #define ISBD_MULTS  "F--???"
 
+#define ISFP_LABELS "TimeUS,N,type,instance,axis,smp_rate,F1,F2,F3,E1,E2,E3,Tot"
+#define ISFP_FMT    "QHBBBffffffff"
+#define ISFP_UNITS  "s----zzzz----"
+#define ISFP_MULTS  "F------------"
+
+#define ISFB_LABELS "TimeUS,N,type,instance,axis,B0,B1,B2,B3,B4,B5,B6,B7,B8,B9"
+#define ISFB_FMT    "QHBBBffffffffff"
+#define ISFB_UNITS  "s--------------"
+#define ISFB_MULTS  "F--------------"
+
 #define IMU_LABELS "TimeUS,GyrX,GyrY,GyrZ,AccX,AccY,AccZ,EG,EA,T,GH,AH,GHz,AHz"
 #define IMU_FMT   "QffffffIIfBBHH"
 #define IMU_UNITS "sEEEooo--O--zz"
@@ -1274,6 +1342,10 @@ Format characters in the format string for binary log messages
       "PRX", "QBfffffffffff", "TimeUS,Health,D0,D45,D90,D135,D180,D225,D270,D315,DUp,CAn,CDis", "s-mmmmmmmmmhm", "F-BBBBBBBBB00" }, \
     { LOG_PERFORMANCE_MSG, sizeof(log_Performance),                     \
       "PM",  "QHHIIH", "TimeUS,NLon,NLoop,MaxT,Mem,Load", "s---b%", "F---0A" }, \
+    { LOG_SCHED_TASK_MSG, sizeof(log_Task_Stats),                       \
+      "TSK", "QNHHHHIHHHHHHHH", "TimeUS,Name,N,Ovr,Skip,Slip,MaxT,H0,H1,H2,H3,H4,H5,H6,H7", "s-----s--------", "F-----F--------" }, \
+    { LOG_PARAM_SAVE_MSG, sizeof(log_Param_Save_Stats),                 \
+      "PSAV", "QHHHHHHII", "TimeUS,Depth,MaxDepth,NQ,NCoal,NBlk,NSav,AvgLat,MaxLat", "s------ss", "F------CC" }, \
     { LOG_SRTL_MSG, sizeof(log_SRTL), \
       "SRTL", "QBHHBfff", "TimeUS,Active,NumPts,MaxPts,Action,N,E,D", "s----mmm", "F----000" }
 
@@ -1340,7 +1412,7 @@ Format characters in the format string for binary log messages
     { LOG_XKV2_MSG, sizeof(log_ekfStateVar), \
       "XKV2","Qffffffffffff","TimeUS,V12,V13,V14,V15,V16,V17,V18,V19,V20,V21,V22,V23", "s------------", "F------------" }, \
     { LOG_TERRAIN_MSG, sizeof(log_TERRAIN), \
-      "TERR","QBLLHffHH","TimeUS,Status,Lat,Lng,Spacing,TerrH,CHeight,Pending,Loaded", "s-DU-mm--", "F-GG-00--" }, \
+      "TERR","QBLLHffHHII","TimeUS,Status,Lat,Lng,Spacing,TerrH,CHeight,Pending,Loaded,Hits,Misses", "s-DU-mm----", "F-GG-00----" }, \
     { LOG_GPS_UBX1_MSG, sizeof(log_Ubx1), \
       "UBX1", "QBHBBHI",  "TimeUS,Instance,noisePerMS,jamInd,aPower,agcCnt,config", "s------", "F------"  }, \
     { LOG_GPS_UBX2_MSG, sizeof(log_Ubx2), \
@@ -1417,10 +1489,14 @@ Format characters in the format string for binary log messages
       "ISBH",ISBH_FMT,ISBH_LABELS,ISBH_UNITS,ISBH_MULTS },  \
     { LOG_ISBD_MSG, sizeof(log_ISBD), \
       "ISBD",ISBD_FMT,ISBD_LABELS, ISBD_UNITS, ISBD_MULTS }, \
+    { LOG_ISFP_MSG, sizeof(log_ISFP), \
+      "ISFP",ISFP_FMT,ISFP_LABELS, ISFP_UNITS, ISFP_MULTS }, \
+    { LOG_ISFB_MSG, sizeof(log_ISFB), \
+      "ISFB",ISFB_FMT,ISFB_LABELS, ISFB_UNITS, ISFB_MULTS }, \
     { LOG_ORGN_MSG, sizeof(log_ORGN), \
       "ORGN","QBLLe","TimeUS,Type,Lat,Lng,Alt", "s-DUm", "F-GGB" },   \
     { LOG_DF_FILE_STATS, sizeof(log_DSF), \
-      "DSF", "QIBHIIII", "TimeUS,Dp,IErr,Blk,Bytes,FMn,FMx,FAv", "s---b---", "F---0---" }, \
+      "DSF", "QIBHIIIIIfI", "TimeUS,Dp,IErr,Blk,Bytes,FMn,FMx,FAv,FBytes,CR,IOT", "s---b---b-s", "F---0---0-F" }, \
     { LOG_RPM_MSG, sizeof(log_RPM), \
       "RPM",  "Qff", "TimeUS,rpm1,rpm2", "sqq", "F00" }, \
     { LOG_GIMBAL1_MSG, sizeof(log_Gimbal1), \
@@ -1600,6 +1676,10 @@ enum LogMessages : uint8_t {
     LOG_ISBD_MSG,
     LOG_ASP2_MSG,
     LOG_PERFORMANCE_MSG,
+    LOG_SCHED_TASK_MSG,
+    LOG_PARAM_SAVE_MSG,
+    LOG_ISFP_MSG,
+    LOG_ISFB_MSG,
     _LOG_LAST_MSG_
 };
 
@@ -0,0 +1,112 @@
+#include <AP_gbenchmark.h>
+
+#include <AP_HAL/AP_HAL.h>
+#include <DataFlash/DataFlash.h>
+#include <DataFlash/DataFlash_Backend.h>
+#include <DataFlash/DataFlash_Writer.h>
+#include <DataFlash/DFMessageWriter.h>
+#include <GCS_MAVLink/GCS_Dummy.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+static AP_Int32 log_bitmask;
+static DataFlash_Class dataflash{log_bitmask};
+
+/*
+  a backend which accepts and discards everything, so the benchmarks
+  measure message packing rather than storage
+ */
+class DataFlash_Null : public DataFlash_Backend {
+public:
+    DataFlash_Null(DataFlash_Class &front, DFMessageWriter_DFLogStart *writer) :
+        DataFlash_Backend(front, writer) {}
+
+    bool CardInserted(void) const override { return true; }
+    void EraseAll() override {}
+    bool NeedPrep() override { return false; }
+    void Prep() override {}
+    uint16_t find_last_log() override { return 0; }
+    void get_log_boundaries(uint16_t, uint16_t &start_page, uint16_t &end_page) override { start_page = end_page = 0; }
+    void get_log_info(uint16_t, uint32_t &size, uint32_t &time_utc) override { size = time_utc = 0; }
+    int16_t get_log_data(uint16_t, uint16_t, uint32_t, uint16_t, uint8_t *) override { return 0; }
+    uint16_t get_num_logs() override { return 0; }
+    bool logging_started(void) const override { return true; }
+    uint32_t bufferspace_available() override { return 1024; }
+    uint16_t start_new_log(void) override { return 0; }
+    void stop_logging(void) override {}
+    bool logging_enabled() const override { return true; }
+    bool logging_failed() const override { return false; }
+    bool WritesOK() const override { return true; }
+
+private:
+    bool _WritePrioritisedBlock(const void *pBuffer, uint16_t size, bool) override {
+        gbenchmark_escape(const_cast<void *>(pBuffer));
+        return true;
+    }
+};
+
+static DFMessageWriter_DFLogStart null_writer;
+static DataFlash_Null null_backend{dataflash, &null_writer};
+
+static DataFlash_Writer<'Q','f','f','f','f'> bmw_writer("BMW", "TimeUS,A,B,C,D");
+
+// give the name lookup a list the size a vehicle builds up in flight
+static void add_messages(void)
+{
+    static bool done;
+    if (done) {
+        return;
+    }
+    static const char *names[] = {
+        "BM00", "BM01", "BM02", "BM03", "BM04", "BM05", "BM06", "BM07", "BM08", "BM09",
+        "BM10", "BM11", "BM12", "BM13", "BM14", "BM15", "BM16", "BM17", "BM18", "BM19",
+    };
+    for (uint8_t i=0; i<ARRAY_SIZE(names); i++) {
+        dataflash.Log_Write(names[i], "TimeUS,V", "Qf", AP_HAL::micros64(), 0.0f);
+    }
+    done = true;
+}
+
+static void null_backend_write(uint8_t msg_type, ...)
+{
+    va_list arg_list;
+    va_start(arg_list, msg_type);
+    null_backend.Log_Write(msg_type, arg_list);
+    va_end(arg_list);
+}
+
+// the front end of Log_Write(): name lookup and argument forwarding
+static void BM_LogWriteVarargs(benchmark::State& state)
+{
+    add_messages();
+    while (state.KeepRunning()) {
+        dataflash.Log_Write("BMV", "TimeUS,A,B,C,D", "Qffff",
+                            (uint64_t)1234, 1.0f, 2.0f, 3.0f, 4.0f);
+    }
+}
+
+// the per backend cost of Log_Write(): interpreting the format string
+static void BM_LogWriteVarargsPack(benchmark::State& state)
+{
+    add_messages();
+    bmw_writer.write(0, 0, 0, 0, 0);
+    const uint8_t msg_type = bmw_writer.msg_type();
+    while (state.KeepRunning()) {
+        null_backend_write(msg_type, (uint64_t)1234, 1.0f, 2.0f, 3.0f, 4.0f);
+    }
+}
+
+// the whole of a precompiled write, packing included
+static void BM_LogWriteWriter(benchmark::State& state)
+{
+    add_messages();
+    while (state.KeepRunning()) {
+        bmw_writer.write(1234, 1.0f, 2.0f, 3.0f, 4.0f);
+    }
+}
+
+BENCHMARK(BM_LogWriteVarargs);
+BENCHMARK(BM_LogWriteVarargsPack);
+BENCHMARK(BM_LogWriteWriter);
+
+BENCHMARK_MAIN()
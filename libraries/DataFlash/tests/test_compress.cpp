@@ -0,0 +1,160 @@
+#include <AP_gtest.h>
+
+#include <DataFlash/DataFlash_Compress.h>
+
+#include <string.h>
+
+#define TEST_BLOCK_SIZE 4096
+
+// repeatable pseudo-random bytes
+static uint32_t seed;
+
+static uint8_t rand_byte(void)
+{
+    seed = seed * 1103515245U + 12345U;
+    return seed >> 16;
+}
+
+/*
+  fill a buffer with something like log data: fixed length messages
+  with a header, an increasing timestamp and a few noisy fields
+ */
+static void fill_log_like(uint8_t *buf, uint16_t len)
+{
+    uint32_t time_ms = 1000;
+    for (uint16_t i=0; i<len; i++) {
+        const uint8_t ofs = i % 32;
+        if (ofs == 0) {
+            time_ms += 2;
+            buf[i] = 0xA3;
+        } else if (ofs == 1) {
+            buf[i] = 0x95;
+        } else if (ofs < 6) {
+            buf[i] = (time_ms >> (8 * (ofs - 2))) & 0xFF;
+        } else if (ofs < 10) {
+            buf[i] = rand_byte();
+        } else {
+            buf[i] = ofs;
+        }
+    }
+}
+
+static void check_round_trip(const uint8_t *src, uint16_t len)
+{
+    DataFlash_Compressor compressor;
+    ASSERT_TRUE(compressor.init());
+
+    static uint8_t compressed[DF_BLOCK_MAX_FRAME(TEST_BLOCK_SIZE)];
+    static uint8_t out[TEST_BLOCK_SIZE];
+    const uint32_t clen = compressor.compress(src, len, compressed);
+    ASSERT_LE(clen, DF_BLOCK_MAX_FRAME(len) - sizeof(struct df_block_header));
+    ASSERT_EQ((int32_t)len, DataFlash_Compressor::decompress(compressed, clen, out, sizeof(out)));
+    EXPECT_EQ(0, memcmp(src, out, len));
+}
+
+TEST(DataFlashCompressTest, RoundTrip)
+{
+    static uint8_t buf[TEST_BLOCK_SIZE];
+
+    seed = 1;
+    fill_log_like(buf, sizeof(buf));
+    check_round_trip(buf, sizeof(buf));
+
+    // incompressible
+    for (uint16_t i=0; i<sizeof(buf); i++) {
+        buf[i] = rand_byte();
+    }
+    check_round_trip(buf, sizeof(buf));
+
+    // a long run, which needs long match lengths
+    memset(buf, 0x55, sizeof(buf));
+    check_round_trip(buf, sizeof(buf));
+
+    // short blocks are all literals
+    for (uint16_t len=0; len<20; len++) {
+        check_round_trip(buf, len);
+    }
+}
+
+TEST(DataFlashCompressTest, CompressesLogData)
+{
+    static uint8_t buf[TEST_BLOCK_SIZE];
+    static uint8_t frame[DF_BLOCK_MAX_FRAME(TEST_BLOCK_SIZE)];
+    seed = 2;
+    fill_log_like(buf, sizeof(buf));
+
+    DataFlash_Compressor compressor;
+    ASSERT_TRUE(compressor.init());
+    const uint32_t flen = compressor.frame(buf, sizeof(buf), frame);
+    EXPECT_LT(flen, sizeof(buf) / 2);
+
+    struct df_block_header hdr;
+    memcpy(&hdr, frame, sizeof(hdr));
+    EXPECT_EQ(DF_BLOCK_MAGIC, hdr.magic);
+    EXPECT_EQ(DF_BLOCK_FLAG_COMPRESSED, hdr.flags);
+    EXPECT_EQ(sizeof(buf), hdr.raw_length);
+}
+
+TEST(DataFlashCompressTest, DecompressRejectsOverflow)
+{
+    static uint8_t buf[TEST_BLOCK_SIZE];
+    static uint8_t compressed[DF_BLOCK_MAX_FRAME(TEST_BLOCK_SIZE)];
+    static uint8_t out[TEST_BLOCK_SIZE];
+    memset(buf, 0x55, sizeof(buf));
+
+    DataFlash_Compressor compressor;
+    ASSERT_TRUE(compressor.init());
+    const uint32_t clen = compressor.compress(buf, sizeof(buf), compressed);
+    EXPECT_EQ(-1, DataFlash_Compressor::decompress(compressed, clen, out, sizeof(buf) - 1));
+    EXPECT_EQ(-1, DataFlash_Compressor::decompress(compressed, clen - 1, out, sizeof(out)));
+}
+
+/*
+  a log of several frames decodes to the original bytes, skipping a
+  corrupt frame and stopping at a truncated one
+ */
+TEST(DataFlashCompressTest, DecodeLog)
+{
+    const uint8_t num_frames = 4;
+    const uint16_t block_size = 1024;
+    static uint8_t raw[num_frames * block_size];
+    static uint8_t log[num_frames * DF_BLOCK_MAX_FRAME(block_size)];
+    static uint8_t out[sizeof(raw)];
+    uint32_t frame_ofs[num_frames + 1];
+
+    seed = 3;
+    fill_log_like(raw, sizeof(raw));
+    // one block that won't compress, so is stored
+    for (uint16_t i=0; i<block_size; i++) {
+        raw[block_size + i] = rand_byte();
+    }
+
+    DataFlash_Compressor compressor;
+    ASSERT_TRUE(compressor.init());
+    uint32_t log_len = 0;
+    for (uint8_t i=0; i<num_frames; i++) {
+        frame_ofs[i] = log_len;
+        log_len += compressor.frame(&raw[i * block_size], block_size, &log[log_len]);
+    }
+    frame_ofs[num_frames] = log_len;
+
+    ASSERT_TRUE(DataFlash_Compressor::is_compressed_log(log, log_len));
+    EXPECT_FALSE(DataFlash_Compressor::is_compressed_log(raw, sizeof(raw)));
+
+    ASSERT_EQ(sizeof(raw), DataFlash_Compressor::decode_log(log, log_len, nullptr));
+    ASSERT_EQ(sizeof(raw), DataFlash_Compressor::decode_log(log, log_len, out));
+    EXPECT_EQ(0, memcmp(raw, out, sizeof(raw)));
+
+    // a crash part way through the last frame loses only that frame
+    const uint32_t truncated_len = frame_ofs[num_frames - 1] + 20;
+    ASSERT_EQ(sizeof(raw) - block_size, DataFlash_Compressor::decode_log(log, truncated_len, out));
+    EXPECT_EQ(0, memcmp(raw, out, sizeof(raw) - block_size));
+
+    // a corrupt frame is skipped
+    log[frame_ofs[1] + sizeof(struct df_block_header) + 10] ^= 0xFF;
+    ASSERT_EQ(sizeof(raw) - block_size, DataFlash_Compressor::decode_log(log, log_len, out));
+    EXPECT_EQ(0, memcmp(raw, out, block_size));
+    EXPECT_EQ(0, memcmp(&raw[2 * block_size], &out[block_size], 2 * block_size));
+}
+
+AP_GTEST_MAIN()
@@ -0,0 +1,126 @@
+#include <AP_gtest.h>
+
+#include <AP_HAL/AP_HAL.h>
+#include <DataFlash/DataFlash.h>
+#include <DataFlash/DataFlash_Backend.h>
+#include <DataFlash/DataFlash_Writer.h>
+#include <DataFlash/DFMessageWriter.h>
+#include <GCS_MAVLink/GCS_Dummy.h>
+
+#include <stdarg.h>
+#include <string.h>
+
+const AP_HAL::HAL& hal = AP_HAL::get_HAL();
+
+static AP_Int32 log_bitmask;
+static DataFlash_Class dataflash{log_bitmask};
+
+/*
+  a backend which keeps a copy of the last message written to it
+ */
+class DataFlash_Capture : public DataFlash_Backend {
+public:
+    DataFlash_Capture(DataFlash_Class &front, DFMessageWriter_DFLogStart *writer) :
+        DataFlash_Backend(front, writer) {}
+
+    bool CardInserted(void) const override { return true; }
+    void EraseAll() override {}
+    bool NeedPrep() override { return false; }
+    void Prep() override {}
+    uint16_t find_last_log() override { return 0; }
+    void get_log_boundaries(uint16_t, uint16_t &start_page, uint16_t &end_page) override { start_page = end_page = 0; }
+    void get_log_info(uint16_t, uint32_t &size, uint32_t &time_utc) override { size = time_utc = 0; }
+    int16_t get_log_data(uint16_t, uint16_t, uint32_t, uint16_t, uint8_t *) override { return 0; }
+    uint16_t get_num_logs() override { return 0; }
+    bool logging_started(void) const override { return true; }
+    uint32_t bufferspace_available() override { return 1024; }
+    uint16_t start_new_log(void) override { return 0; }
+    void stop_logging(void) override {}
+    bool logging_enabled() const override { return true; }
+    bool logging_failed() const override { return false; }
+    bool WritesOK() const override { return true; }
+
+    uint8_t last[256];
+    uint16_t last_len;
+
+private:
+    bool _WritePrioritisedBlock(const void *pBuffer, uint16_t size, bool) override {
+        memcpy(last, pBuffer, size);
+        last_len = size;
+        return true;
+    }
+};
+
+static DFMessageWriter_DFLogStart capture_writer;
+static DataFlash_Capture capture{dataflash, &capture_writer};
+
+// pack a message the way Log_Write() does, through the backend
+static void log_write_varargs(uint8_t msg_type, ...)
+{
+    va_list arg_list;
+    va_start(arg_list, msg_type);
+    capture.Log_Write(msg_type, arg_list);
+    va_end(arg_list);
+}
+
+// pack a message with a writer's compile time layout
+template <char... FMT, typename... Args>
+static void writer_pack(const DataFlash_Writer<FMT...> &writer, uint8_t *buf, Args... args)
+{
+    buf[0] = HEAD_BYTE1;
+    buf[1] = HEAD_BYTE2;
+    buf[2] = writer.msg_type();
+    DataFlash_Writer<FMT...>::layout::pack(buf, args...);
+}
+
+// AC_PosControl's PSC message, converted from Log_Write()
+static DataFlash_Writer<'Q','f','f','f','f','f','f','f','f','f','f','f','f'> psc_writer(
+    "PSC", "TimeUS,TPX,TPY,PX,PY,TVX,TVY,VX,VY,TAX,TAY,AX,AY", "smmmmnnnnoooo", "FBBBBBBBBBBBB");
+
+TEST(DataFlashWriter, PSCMatchesLogWrite)
+{
+    // the first write looks up the message type
+    psc_writer.write(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    ASSERT_GE(psc_writer.msg_type(), 0);
+
+    const uint64_t time_us = 0x0123456789ABCDEFULL;
+    const float v[12] = { 1.5f, -2.25f, 1e6f, -1e-6f, 0.1f, 3.14159f,
+                          -0.0f, 42.0f, 1e-38f, -7.5f, 65504.0f, 0.333f };
+
+    log_write_varargs(psc_writer.msg_type(), time_us,
+                      (double)v[0], (double)v[1], (double)v[2], (double)v[3],
+                      (double)v[4], (double)v[5], (double)v[6], (double)v[7],
+                      (double)v[8], (double)v[9], (double)v[10], (double)v[11]);
+
+    const uint16_t len = psc_writer.length;
+    uint8_t buf[len];
+    writer_pack(psc_writer, buf, time_us,
+                v[0], v[1], v[2], v[3], v[4], v[5],
+                v[6], v[7], v[8], v[9], v[10], v[11]);
+
+    ASSERT_EQ(len, capture.last_len);
+    EXPECT_EQ(0, memcmp(capture.last, buf, len));
+}
+
+// one of every integer width, plus a name field
+static DataFlash_Writer<'B','b','h','H','i','I','q','n'> mix_writer(
+    "TWMX", "A,B,C,D,E,F,G,H");
+
+TEST(DataFlashWriter, MixedFieldsMatchLogWrite)
+{
+    mix_writer.write(0, 0, 0, 0, 0, 0, 0, "ABCD");
+    ASSERT_GE(mix_writer.msg_type(), 0);
+
+    log_write_varargs(mix_writer.msg_type(), 200, -100, -30000, 60000,
+                      -2000000000, 4000000000U, (int64_t)-1234567890123LL, "WXYZ");
+
+    const uint16_t len = mix_writer.length;
+    uint8_t buf[len];
+    writer_pack(mix_writer, buf, 200, -100, -30000, 60000,
+                -2000000000, 4000000000U, (int64_t)-1234567890123LL, "WXYZ");
+
+    ASSERT_EQ(len, capture.last_len);
+    EXPECT_EQ(0, memcmp(capture.last, buf, len));
+}
+
+AP_GTEST_MAIN()
@@ -0,0 +1,164 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+/*
+  a bank of cascaded biquad filters for many channels, for example 3
+  axes of several IMUs each passing through a low pass filter and a
+  few notch filters.
+
+  Rather than one object per filter, the coefficients and delay
+  elements of every channel are held in contiguous arrays per stage
+  (structure of arrays). A block of samples is run through the bank
+  with the channel loop innermost, so each stage becomes a handful of
+  multiply-adds over adjacent floats that the compiler can turn into
+  SSE/NEON instructions, and a channel count known at compile time
+  lets it fully unroll the loop on small MCUs.
+
+  Each stage is a transposed direct form II biquad. A stage which has
+  not been configured passes its input through unchanged.
+ */
+
+#include <AP_Math/AP_Math.h>
+#include <string.h>
+#include "LowPassFilter2p.h"
+
+template <uint8_t N_CHANNELS, uint8_t N_STAGES>
+class BiquadFilterBank {
+public:
+    BiquadFilterBank(void) {
+        for (uint8_t s=0; s<N_STAGES; s++) {
+            for (uint8_t c=0; c<N_CHANNELS; c++) {
+                set_passthrough(s, c);
+            }
+        }
+        reset();
+    }
+
+    // number of channels in each sample
+    static uint8_t num_channels(void) { return N_CHANNELS; }
+
+    // set the normalised coefficients (a0 == 1) of one stage of a channel
+    void set_coefficients(uint8_t stage, uint8_t channel,
+                          float b0, float b1, float b2, float a1, float a2) {
+        if (stage >= N_STAGES || channel >= N_CHANNELS) {
+            return;
+        }
+        struct stage_coeffs &k = _coeffs[stage];
+        k.b0[channel] = b0;
+        k.b1[channel] = b1;
+        k.b2[channel] = b2;
+        k.a1[channel] = a1;
+        k.a2[channel] = a2;
+    }
+
+    // make one stage of a channel pass its input through
+    void set_passthrough(uint8_t stage, uint8_t channel) {
+        set_coefficients(stage, channel, 1, 0, 0, 0, 0);
+    }
+
+    // second order butterworth low pass, as used by LowPassFilter2p
+    void set_lowpass(uint8_t stage, uint8_t channel, float sample_freq_hz, float cutoff_freq_hz) {
+        if (cutoff_freq_hz <= 0 || cutoff_freq_hz >= sample_freq_hz * 0.5f) {
+            set_passthrough(stage, channel);
+            return;
+        }
+        struct DigitalBiquadFilter<float>::biquad_params p;
+        DigitalBiquadFilter<float>::compute_params(sample_freq_hz, cutoff_freq_hz, p);
+        set_coefficients(stage, channel, p.b0, p.b1, p.b2, p.a1, p.a2);
+    }
+
+    // notch filter, with the same design as NotchFilter
+    void set_notch(uint8_t stage, uint8_t channel, float sample_freq_hz,
+                   float center_freq_hz, float bandwidth_hz, float attenuation_dB) {
+        if (center_freq_hz <= bandwidth_hz * 0.5f || center_freq_hz >= sample_freq_hz * 0.5f) {
+            set_passthrough(stage, channel);
+            return;
+        }
+        const float omega = 2.0f * M_PI * center_freq_hz / sample_freq_hz;
+        const float octaves = log2f(center_freq_hz / (center_freq_hz - bandwidth_hz/2)) * 2;
+        const float A = powf(10, -attenuation_dB/40);
+        const float Q = sqrtf(powf(2, octaves)) / (powf(2, octaves) - 1);
+        const float alpha = sinf(omega) / (2 * Q/A);
+        const float a0_inv = 1.0f / (1.0f + alpha/A);
+        const float cos2 = -2.0f * cosf(omega);
+        set_coefficients(stage, channel,
+                         (1.0f + alpha*A) * a0_inv,
+                         cos2 * a0_inv,
+                         (1.0f - alpha*A) * a0_inv,
+                         cos2 * a0_inv,
+                         (1.0f - alpha/A) * a0_inv);
+    }
+
+    // set the same stage on all three axes starting at channel
+    void set_lowpass_vector3f(uint8_t stage, uint8_t channel, float sample_freq_hz, float cutoff_freq_hz) {
+        for (uint8_t i=0; i<3; i++) {
+            set_lowpass(stage, channel+i, sample_freq_hz, cutoff_freq_hz);
+        }
+    }
+    void set_notch_vector3f(uint8_t stage, uint8_t channel, float sample_freq_hz,
+                            float center_freq_hz, float bandwidth_hz, float attenuation_dB) {
+        for (uint8_t i=0; i<3; i++) {
+            set_notch(stage, channel+i, sample_freq_hz, center_freq_hz, bandwidth_hz, attenuation_dB);
+        }
+    }
+
+    // clear the delay elements of all stages
+    void reset(void) {
+        memset(_state, 0, sizeof(_state));
+    }
+
+    /*
+      filter n_samples samples in place. samples holds n_samples rows
+      of N_CHANNELS floats, one value per channel
+     */
+    void apply(float *samples, uint16_t n_samples) {
+        for (uint16_t i=0; i<n_samples; i++) {
+            float *x = &samples[i * N_CHANNELS];
+            for (uint8_t s=0; s<N_STAGES; s++) {
+                apply_stage(_coeffs[s], _state[s], x);
+            }
+        }
+    }
+
+    // filter a single row of N_CHANNELS samples in place
+    void apply(float sample[N_CHANNELS]) {
+        apply(sample, 1);
+    }
+
+private:
+    struct stage_coeffs {
+        float b0[N_CHANNELS];
+        float b1[N_CHANNELS];
+        float b2[N_CHANNELS];
+        float a1[N_CHANNELS];
+        float a2[N_CHANNELS];
+    } _coeffs[N_STAGES];
+
+    struct stage_state {
+        float z1[N_CHANNELS];
+        float z2[N_CHANNELS];
+    } _state[N_STAGES];
+
+    static void apply_stage(const struct stage_coeffs &k, struct stage_state &z, float *x) {
+        for (uint8_t c=0; c<N_CHANNELS; c++) {
+            const float in = x[c];
+            const float out = k.b0[c] * in + z.z1[c];
+            z.z1[c] = k.b1[c] * in - k.a1[c] * out + z.z2[c];
+            z.z2[c] = k.b2[c] * in - k.a2[c] * out;
+            x[c] = out;
+        }
+    }
+};
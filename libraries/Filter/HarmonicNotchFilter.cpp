@@ -0,0 +1,185 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HarmonicNotchFilter.h"
+
+/*
+  initialise filter
+ */
+template <class T>
+void HarmonicNotchFilter<T>::init(float sample_freq_hz, float center_freq_hz, float bandwidth_hz, float attenuation_dB, uint8_t harmonics)
+{
+    _sample_freq_hz = sample_freq_hz;
+    _bandwidth_hz = bandwidth_hz;
+    _attenuation_dB = attenuation_dB;
+    _harmonics = harmonics & ((1U<<HNF_MAX_HARMONICS)-1);
+    _center_freq_hz = center_freq_hz;
+    _active = 0;
+
+    // a full init computes everything up front
+    for (uint8_t i=0; i<HNF_MAX_HARMONICS; i++) {
+        if (_harmonics & (1U<<i)) {
+            update_harmonic(i);
+        }
+    }
+    _pending = 0;
+    _initialised = true;
+}
+
+/*
+  move the base frequency. The coefficients are recomputed by apply()
+ */
+template <class T>
+void HarmonicNotchFilter<T>::update(float center_freq_hz)
+{
+    if (!_initialised || is_equal(center_freq_hz, _center_freq_hz)) {
+        return;
+    }
+    _center_freq_hz = center_freq_hz;
+    _pending = _harmonics;
+}
+
+/*
+  recompute the coefficients for harmonic i, disabling it if it can't
+  be represented at this sample rate
+ */
+template <class T>
+void HarmonicNotchFilter<T>::update_harmonic(uint8_t i)
+{
+    const uint8_t bit = 1U<<i;
+    const float freq = _center_freq_hz * (i+1);
+    const float bandwidth = _bandwidth_hz * (i+1);
+
+    if (freq <= bandwidth * 0.5f || freq >= _sample_freq_hz * 0.5f) {
+        _active &= ~bit;
+        return;
+    }
+    _filters[i].init(_sample_freq_hz, freq, bandwidth, _attenuation_dB);
+    _active |= bit;
+}
+
+/*
+  apply a new input sample, returning new output
+ */
+template <class T>
+T HarmonicNotchFilter<T>::apply(const T &sample)
+{
+    if (!_initialised) {
+        return sample;
+    }
+
+    if (_pending) {
+        // recompute one harmonic per sample
+        for (uint8_t i=0; i<HNF_MAX_HARMONICS; i++) {
+            const uint8_t bit = 1U<<i;
+            if (_pending & bit) {
+                update_harmonic(i);
+                _pending &= ~bit;
+                break;
+            }
+        }
+    }
+
+    T output = sample;
+    for (uint8_t i=0; i<HNF_MAX_HARMONICS; i++) {
+        if (_active & (1U<<i)) {
+            output = _filters[i].apply(output);
+        }
+    }
+    return output;
+}
+
+/*
+  reset the filter, it will pass samples through until init() is
+  called again
+ */
+template <class T>
+void HarmonicNotchFilter<T>::reset(void)
+{
+    _initialised = false;
+    _active = 0;
+    _pending = 0;
+}
+
+// table of user settable parameters
+const AP_Param::GroupInfo HarmonicNotchFilterParams::var_info[] = {
+
+    // @Param: ENABLE
+    // @DisplayName: Harmonic Notch Filter enable
+    // @Description: Harmonic Notch Filter enable
+    // @Values: 0:Disabled,1:Enabled
+    // @User: Advanced
+    AP_GROUPINFO_FLAGS("ENABLE", 1, HarmonicNotchFilterParams, enable, 0, AP_PARAM_FLAG_ENABLE),
+
+    // @Param: FREQ
+    // @DisplayName: Harmonic Notch Filter base frequency
+    // @Description: Notch center frequency in Hz of the base harmonic. In throttle tracking mode this is the frequency at the reference throttle
+    // @Range: 10 400
+    // @Units: Hz
+    // @User: Advanced
+    AP_GROUPINFO("FREQ", 2, HarmonicNotchFilterParams, _center_freq_hz, 80),
+
+    // @Param: BW
+    // @DisplayName: Harmonic Notch Filter bandwidth
+    // @Description: Notch bandwidth in Hz of the base harmonic. Higher harmonics use a proportionally wider bandwidth
+    // @Range: 5 100
+    // @Units: Hz
+    // @User: Advanced
+    AP_GROUPINFO("BW", 3, HarmonicNotchFilterParams, _bandwidth_hz, 20),
+
+    // @Param: ATT
+    // @DisplayName: Harmonic Notch Filter attenuation
+    // @Description: Notch attenuation in dB
+    // @Range: 5 30
+    // @Units: dB
+    // @User: Advanced
+    AP_GROUPINFO("ATT", 4, HarmonicNotchFilterParams, _attenuation_dB, 15),
+
+    // @Param: HMNCS
+    // @DisplayName: Harmonic Notch Filter harmonics
+    // @Description: Bitmask of harmonic frequencies to apply the notch filter to
+    // @Bitmask: 0:1st harmonic,1:2nd harmonic,2:3rd harmonic,3:4th harmonic
+    // @User: Advanced
+    AP_GROUPINFO("HMNCS", 5, HarmonicNotchFilterParams, _harmonics, 3),
+
+    // @Param: REF
+    // @DisplayName: Harmonic Notch Filter reference value
+    // @Description: In throttle tracking mode this is the throttle (0 to 1) at which the noise is at the base frequency, zero meaning the learned hover throttle. In RPM and ESC tracking modes the measured revolutions per second are multiplied by this value to give the base frequency, zero meaning 1. ESC telemetry reports electrical RPM, so for ESC tracking set this to 2 divided by the number of motor poles
+    // @Range: 0 1
+    // @User: Advanced
+    AP_GROUPINFO("REF", 6, HarmonicNotchFilterParams, _reference, 0),
+
+    // @Param: MODE
+    // @DisplayName: Harmonic Notch Filter tracking mode
+    // @Description: Source of the base frequency of the harmonic notch. Fixed uses the FREQ parameter, throttle scales FREQ with the square root of throttle, RPM uses the first RPM sensor and ESC uses the average of BLHeli ESC telemetry RPM
+    // @Values: 0:Fixed,1:Throttle,2:RPM Sensor,3:ESC Telemetry
+    // @User: Advanced
+    AP_GROUPINFO("MODE", 7, HarmonicNotchFilterParams, _tracking_mode, TRACKING_THROTTLE),
+
+    AP_GROUPEND
+};
+
+/*
+  harmonic notch filter parameters - constructor
+ */
+HarmonicNotchFilterParams::HarmonicNotchFilterParams(void)
+{
+    AP_Param::setup_object_defaults(this, var_info);
+}
+
+/*
+   instantiate template classes
+ */
+template class HarmonicNotchFilter<Vector3f>;
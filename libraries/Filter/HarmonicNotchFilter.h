@@ -0,0 +1,108 @@
+/*
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+/*
+  a set of notch filters on a base frequency and its harmonics, where
+  the base frequency can be moved at runtime, for example to follow
+  motor noise as the throttle or RPM changes.
+
+  Changing the base frequency doesn't recompute any coefficients
+  itself. Instead the harmonics are marked as pending and apply()
+  recomputes at most one of them per sample, so the cost of a
+  frequency change is spread over several samples rather than landing
+  in a single fast loop.
+ */
+
+#include <AP_Math/AP_Math.h>
+#include <AP_Param/AP_Param.h>
+#include "NotchFilter.h"
+
+// maximum number of harmonics, including the base frequency
+#define HNF_MAX_HARMONICS 4
+
+template <class T>
+class HarmonicNotchFilter {
+public:
+    /*
+      setup the filters. harmonics is a bitmask, bit 0 being the base
+      frequency, bit 1 the 2nd harmonic and so on. Each harmonic's
+      bandwidth is scaled with its frequency
+     */
+    void init(float sample_freq_hz, float center_freq_hz, float bandwidth_hz, float attenuation_dB, uint8_t harmonics);
+
+    // move the base frequency, coefficients are updated by apply()
+    void update(float center_freq_hz);
+
+    T apply(const T &sample);
+    void reset(void);
+
+    float get_center_freq_hz(void) const { return _center_freq_hz; }
+
+private:
+    // recompute the coefficients of one harmonic
+    void update_harmonic(uint8_t i);
+
+    NotchFilter<T> _filters[HNF_MAX_HARMONICS];
+
+    float _sample_freq_hz;
+    float _center_freq_hz;
+    float _bandwidth_hz;
+    float _attenuation_dB;
+
+    // harmonics asked for
+    uint8_t _harmonics;
+    // harmonics below the nyquist frequency with valid coefficients
+    uint8_t _active;
+    // harmonics needing their coefficients recomputed
+    uint8_t _pending;
+    bool _initialised;
+};
+
+/*
+  harmonic notch filter parameters
+ */
+class HarmonicNotchFilterParams {
+public:
+    enum TrackingMode {
+        TRACKING_FIXED    = 0,
+        TRACKING_THROTTLE = 1,
+        TRACKING_RPM      = 2,
+        TRACKING_ESC      = 3,
+    };
+
+    HarmonicNotchFilterParams(void);
+
+    bool enabled(void) const { return enable; }
+    float center_freq_hz(void) const { return _center_freq_hz; }
+    float bandwidth_hz(void) const { return _bandwidth_hz; }
+    float attenuation_dB(void) const { return _attenuation_dB; }
+    uint8_t harmonics(void) const { return _harmonics; }
+    float reference(void) const { return _reference; }
+    enum TrackingMode tracking_mode(void) const { return (enum TrackingMode)_tracking_mode.get(); }
+
+    static const struct AP_Param::GroupInfo var_info[];
+
+private:
+    AP_Int8 enable;
+    AP_Float _center_freq_hz;
+    AP_Float _bandwidth_hz;
+    AP_Float _attenuation_dB;
+    AP_Int8 _harmonics;
+    AP_Float _reference;
+    AP_Int8 _tracking_mode;
+};
+
+typedef HarmonicNotchFilter<Vector3f> HarmonicNotchFilterVector3f;
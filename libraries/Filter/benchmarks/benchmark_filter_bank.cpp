@@ -0,0 +1,91 @@
+#include <AP_gbenchmark.h>
+
+#include <Filter/LowPassFilter2p.h>
+#include <Filter/NotchFilter.h>
+#include <Filter/BiquadFilterBank.h>
+
+/*
+  compare filtering the gyros of three IMUs through a low pass filter
+  and two notch filters using one filter object per IMU and stage
+  against a single BiquadFilterBank. Each iteration filters 10ms of
+  samples at the sample rate given as the benchmark argument
+ */
+
+#define NUM_IMUS 3
+#define NUM_NOTCHES 2
+#define BLOCK_MS 10
+#define MAX_BLOCK_SAMPLES (8000 * BLOCK_MS / 1000)
+
+static void fill_samples(Vector3f samples[][NUM_IMUS], uint16_t n, float sample_freq_hz)
+{
+    for (uint16_t i=0; i<n; i++) {
+        const float t = i / sample_freq_hz;
+        for (uint8_t imu=0; imu<NUM_IMUS; imu++) {
+            samples[i][imu] = Vector3f(sinf(2 * M_PI * 80 * t),
+                                       cosf(2 * M_PI * 160 * t),
+                                       sinf(2 * M_PI * 5 * t) + imu);
+        }
+    }
+}
+
+static void BM_FilterObjects(benchmark::State& state)
+{
+    const float sample_freq_hz = state.range_x();
+    const uint16_t n = sample_freq_hz * BLOCK_MS / 1000;
+
+    LowPassFilter2pVector3f lpf[NUM_IMUS];
+    NotchFilterVector3f notch[NUM_IMUS][NUM_NOTCHES];
+    for (uint8_t imu=0; imu<NUM_IMUS; imu++) {
+        lpf[imu].set_cutoff_frequency(sample_freq_hz, 188);
+        for (uint8_t s=0; s<NUM_NOTCHES; s++) {
+            notch[imu][s].init(sample_freq_hz, 80 * (s+1), 20, 15);
+        }
+    }
+
+    static Vector3f input[MAX_BLOCK_SAMPLES][NUM_IMUS];
+    static Vector3f samples[MAX_BLOCK_SAMPLES][NUM_IMUS];
+    fill_samples(input, n, sample_freq_hz);
+
+    while (state.KeepRunning()) {
+        memcpy(samples, input, sizeof(samples[0]) * n);
+        for (uint16_t i=0; i<n; i++) {
+            for (uint8_t imu=0; imu<NUM_IMUS; imu++) {
+                Vector3f v = lpf[imu].apply(samples[i][imu]);
+                for (uint8_t s=0; s<NUM_NOTCHES; s++) {
+                    v = notch[imu][s].apply(v);
+                }
+                samples[i][imu] = v;
+            }
+        }
+        gbenchmark_escape(samples);
+    }
+}
+
+static void BM_FilterBank(benchmark::State& state)
+{
+    const float sample_freq_hz = state.range_x();
+    const uint16_t n = sample_freq_hz * BLOCK_MS / 1000;
+
+    BiquadFilterBank<NUM_IMUS*3, NUM_NOTCHES+1> bank;
+    for (uint8_t imu=0; imu<NUM_IMUS; imu++) {
+        bank.set_lowpass_vector3f(0, imu*3, sample_freq_hz, 188);
+        for (uint8_t s=0; s<NUM_NOTCHES; s++) {
+            bank.set_notch_vector3f(s+1, imu*3, sample_freq_hz, 80 * (s+1), 20, 15);
+        }
+    }
+
+    static Vector3f input[MAX_BLOCK_SAMPLES][NUM_IMUS];
+    static Vector3f samples[MAX_BLOCK_SAMPLES][NUM_IMUS];
+    fill_samples(input, n, sample_freq_hz);
+
+    while (state.KeepRunning()) {
+        memcpy(samples, input, sizeof(samples[0]) * n);
+        bank.apply(&samples[0][0].x, n);
+        gbenchmark_escape(samples);
+    }
+}
+
+BENCHMARK(BM_FilterObjects)->Arg(1000)->Arg(4000)->Arg(8000);
+BENCHMARK(BM_FilterBank)->Arg(1000)->Arg(4000)->Arg(8000);
+
+BENCHMARK_MAIN()
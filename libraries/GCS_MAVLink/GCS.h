@@ -5,6 +5,7 @@
 
 #include <AP_HAL/AP_HAL.h>
 #include <AP_Common/AP_Common.h>
+#include <AP_Common/Bitmask.h>
 #include "GCS_MAVLink.h"
 #include <DataFlash/DataFlash.h>
 #include <AP_Mission/AP_Mission.h>
@@ -412,6 +413,23 @@ private:
                                                          // queued send
     uint32_t                    _queued_parameter_send_time_ms;
 
+    // PARAM_REQUEST_READ by index left to the running download, one
+    // bit per parameter. They are queued as requests if the download
+    // ends before sending them
+    Bitmask *                   _queued_parameter_reads;
+    uint16_t                    _queued_parameter_reads_size;
+    uint16_t                    _queued_parameter_num_reads;
+
+    // measured capacity of the link in bytes/s, used to pace
+    // parameter downloads
+    uint32_t                    _param_link_rate;
+    uint16_t                    _param_txspace_after_send;
+    uint16_t                    _param_txspace_max;
+
+    uint16_t param_stream_bytes_allowed(uint32_t tnow);
+    bool param_stream_pending(uint16_t param_index) const;
+    void param_requeue_reads(void);
+
     /// Count the number of reportable parameters.
     ///
     /// Not all parameters can be reported via MAVlink.  We count the number
@@ -483,8 +501,12 @@ private:
     };
 
     // queue of pending parameter requests and replies
-    static ObjectBuffer<pending_param_request> param_requests;
-    static ObjectBuffer<pending_param_reply> param_replies;
+    // requests are queued by the main thread and answered by the IO
+    // thread, so each queue has exactly one producer and one consumer.
+    // Each link has its own reply queue so that a link without space
+    // doesn't hold up replies for the others
+    static SPSCObjectBuffer<pending_param_request> param_requests;
+    static SPSCObjectBuffer<pending_param_reply> *param_replies[MAVLINK_COMM_NUM_BUFFERS];
 
     // have we registered the IO timer callback?
     static bool param_timer_registered;
@@ -493,7 +515,7 @@ private:
     void param_io_timer(void);
     
     // send an async parameter reply
-    void send_parameter_reply(void);
+    bool send_parameter_reply(void);
 
     void send_distance_sensor(const AP_RangeFinder_Backend *sensor, const uint8_t instance) const;
 
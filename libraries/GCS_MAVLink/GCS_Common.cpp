@@ -69,6 +69,13 @@ GCS_MAVLINK::init(AP_HAL::UARTDriver *port, mavlink_channel_t mav_chan)
 
     mavlink_comm_port[chan] = _port;
     _queued_parameter = nullptr;
+    _queued_parameter_num_reads = 0;
+    if (param_replies[chan] == nullptr) {
+        param_replies[chan] = new SPSCObjectBuffer<pending_param_reply>(4);
+    }
+
+    // assume a 57600 baud telemetry radio until we have measured the link
+    _param_link_rate = 5760;
 
     snprintf(_perf_packet_name, sizeof(_perf_packet_name), "GCS_Packet_%u", chan);
     _perf_packet = hal.util->perf_alloc(AP_HAL::Util::PC_ELAPSED, _perf_packet_name);
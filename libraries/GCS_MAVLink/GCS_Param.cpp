@@ -23,11 +23,89 @@
 extern const AP_HAL::HAL& hal;
 
 // queue of pending parameter requests and replies
-ObjectBuffer<GCS_MAVLINK::pending_param_request> GCS_MAVLINK::param_requests(20);
-ObjectBuffer<GCS_MAVLINK::pending_param_reply> GCS_MAVLINK::param_replies(5);
+SPSCObjectBuffer<GCS_MAVLINK::pending_param_request> GCS_MAVLINK::param_requests(32);
+SPSCObjectBuffer<GCS_MAVLINK::pending_param_reply> *GCS_MAVLINK::param_replies[MAVLINK_COMM_NUM_BUFFERS];
 
 bool GCS_MAVLINK::param_timer_registered;
 
+/*
+  work out how many bytes of parameters we may send on this link
+  now. Rather than assuming a baudrate we measure how fast the link
+  drains its transmit buffer, and probe upwards whenever the buffer
+  runs empty. While no telemetry streams are running on the link, as
+  is the case while a GCS connects, parameters get most of it
+ */
+uint16_t GCS_MAVLINK::param_stream_bytes_allowed(uint32_t tnow)
+{
+    const uint16_t txspace = comm_get_txspace(chan);
+    uint32_t dt = tnow - _queued_parameter_send_time_ms;
+
+    if (txspace > _param_txspace_max) {
+        _param_txspace_max = txspace;
+    }
+
+    if (dt > 0 && dt < 1000 && txspace >= _param_txspace_after_send) {
+        const uint32_t drain_rate = (txspace - _param_txspace_after_send) * 1000U / dt;
+        if (txspace < _param_txspace_max) {
+            // the buffer did not run empty, so it drained at the
+            // capacity of the link
+            _param_link_rate = (_param_link_rate * 7 + drain_rate) / 8;
+        } else {
+            // the buffer ran empty, so the link can go faster
+            _param_link_rate = MAX(_param_link_rate, drain_rate);
+            _param_link_rate += _param_link_rate / 8;
+        }
+        // keep within 1200 baud and a fast USB link
+        _param_link_rate = constrain_int32(_param_link_rate, 120, 1000000);
+    }
+
+    if (dt > 1000) {
+        dt = 1000;
+    }
+    const bool streaming = (chan_is_streaming & (1U<<(chan-MAVLINK_COMM_0))) != 0;
+    const uint32_t share_pct = streaming ? 30 : 70;
+    const uint32_t bytes_allowed = (_param_link_rate * share_pct / 100) * dt / 1000;
+
+    return MIN(bytes_allowed, txspace);
+}
+
+/*
+  return true if a parameter is still to be sent by the download
+  running on this link
+ */
+bool GCS_MAVLINK::param_stream_pending(uint16_t param_index) const
+{
+    return _queued_parameter != nullptr &&
+        param_index >= _queued_parameter_index &&
+        param_index < _queued_parameter_count;
+}
+
+/*
+  queue the reads left to a download which ended before it sent
+  them. Anything the download did send is forgotten. Reads that don't
+  fit in the request queue are left for the next call
+ */
+void GCS_MAVLINK::param_requeue_reads(void)
+{
+    for (uint16_t i=0; i<_queued_parameter_reads_size && _queued_parameter_num_reads > 0; i++) {
+        if (!_queued_parameter_reads->get(i)) {
+            continue;
+        }
+        if (i >= _queued_parameter_index) {
+            if (param_requests.space() == 0) {
+                return;
+            }
+            struct pending_param_request req;
+            req.chan = chan;
+            req.param_index = i;
+            req.param_name[0] = 0;
+            param_requests.push(req);
+        }
+        _queued_parameter_reads->clear(i);
+        _queued_parameter_num_reads--;
+    }
+}
+
 /**
  * @brief Send the next pending parameter, called from deferred message
  * handling code
@@ -39,25 +117,10 @@ GCS_MAVLINK::queued_param_send()
         return;
     }
 
-    // send one parameter async reply if pending
-    send_parameter_reply();
+    const uint32_t tnow = AP_HAL::millis();
+    const uint32_t tstart = AP_HAL::micros();
 
-    if (_queued_parameter == nullptr) {
-        return;
-    }
-    
-    uint16_t bytes_allowed;
-    uint8_t count;
-    uint32_t tnow = AP_HAL::millis();
-    uint32_t tstart = AP_HAL::micros();
-
-    // use at most 30% of bandwidth on parameters. The constant 26 is
-    // 1/(1000 * 1/8 * 0.001 * 0.3)
-    bytes_allowed = 57 * (tnow - _queued_parameter_send_time_ms) * 26;
-    if (bytes_allowed > comm_get_txspace(chan)) {
-        bytes_allowed = comm_get_txspace(chan);
-    }
-    count = bytes_allowed / (MAVLINK_MSG_ID_PARAM_VALUE_LEN + packet_overhead());
+    uint16_t count = param_stream_bytes_allowed(tnow) / (MAVLINK_MSG_ID_PARAM_VALUE_LEN + packet_overhead());
 
     // when we don't have flow control we really need to keep the
     // param download very slow, or it tends to stall
@@ -65,15 +128,19 @@ GCS_MAVLINK::queued_param_send()
         count = 5;
     }
 
-    while (_queued_parameter != nullptr && count--) {
-        AP_Param      *vp;
-        float value;
+    // answers to PARAM_REQUEST_READ go first as the GCS is waiting
+    // on them. The caller has checked there is space for one, any
+    // more come out of the budget
+    if (send_parameter_reply()) {
+        while (count > 0 && send_parameter_reply()) {
+            count--;
+        }
+    }
 
-        // copy the current parameter and prepare to move to the next
-        vp = _queued_parameter;
+    while (_queued_parameter != nullptr && count--) {
+        AP_Param *vp = _queued_parameter;
 
-        // if the parameter can be cast to float, report it here and break out of the loop
-        value = vp->cast_to_float(_queued_parameter_type);
+        const float value = vp->cast_to_float(_queued_parameter_type);
 
         char param_name[AP_MAX_NAME_SIZE];
         vp->copy_name_token(_queued_parameter_token, param_name, sizeof(param_name), true);
@@ -94,6 +161,10 @@ GCS_MAVLINK::queued_param_send()
             break;
         }
     }
+    if (_queued_parameter == nullptr && _queued_parameter_num_reads > 0) {
+        param_requeue_reads();
+    }
+    _param_txspace_after_send = comm_get_txspace(chan);
     _queued_parameter_send_time_ms = tnow;
 }
 
@@ -201,6 +272,21 @@ void GCS_MAVLINK::handle_param_request_list(mavlink_message_t *msg)
     _queued_parameter = AP_Param::first(&_queued_parameter_token, &_queued_parameter_type);
     _queued_parameter_index = 0;
     _queued_parameter_count = AP_Param::count_parameters();
+
+    // the new download sends everything, so reads left to the last
+    // one are forgotten
+    if (_queued_parameter_reads != nullptr &&
+        _queued_parameter_reads_size != _queued_parameter_count) {
+        delete _queued_parameter_reads;
+        _queued_parameter_reads = nullptr;
+    }
+    if (_queued_parameter_reads == nullptr) {
+        _queued_parameter_reads = new Bitmask(_queued_parameter_count);
+    } else {
+        _queued_parameter_reads->clearall();
+    }
+    _queued_parameter_reads_size = _queued_parameter_reads != nullptr ? _queued_parameter_count : 0;
+    _queued_parameter_num_reads = 0;
 }
 
 void GCS_MAVLINK::handle_param_request_read(mavlink_message_t *msg)
@@ -213,6 +299,18 @@ void GCS_MAVLINK::handle_param_request_read(mavlink_message_t *msg)
     mavlink_param_request_read_t packet;
     mavlink_msg_param_request_read_decode(msg, &packet);
 
+    if (packet.param_index >= 0 && param_stream_pending(packet.param_index) &&
+        packet.param_index < _queued_parameter_reads_size) {
+        // the running download will send this one anyway, so only
+        // parameters the GCS actually missed get sent twice. Remember
+        // it in case the download ends early
+        if (!_queued_parameter_reads->get(packet.param_index)) {
+            _queued_parameter_reads->set(packet.param_index);
+            _queued_parameter_num_reads++;
+        }
+        return;
+    }
+
     /*
       we reserve some space for sending parameters if the client ever
       fails to get a parameter due to lack of space
@@ -357,7 +455,8 @@ void GCS_MAVLINK::send_queued_parameters(void)
     }
 
     if (_queued_parameter == nullptr &&
-        param_replies.empty()) {
+        _queued_parameter_num_reads == 0 &&
+        (param_replies[chan] == nullptr || param_replies[chan]->empty())) {
         return;
     }
     if (streamRates[STREAM_PARAMS].get() <= 0) {
@@ -380,16 +479,18 @@ void GCS_MAVLINK::param_io_timer(void)
     // block the main thread counting parameters (~30ms on PH)
     AP_Param::count_parameters();
 
-    if (param_replies.space() == 0) {
-        // no room
-        return;
-    }
-    
     if (!param_requests.pop(req)) {
         // nothing to do
         return;
     }
 
+    SPSCObjectBuffer<pending_param_reply> *replies = param_replies[req.chan];
+    if (replies == nullptr || replies->space() == 0) {
+        // the link isn't keeping up. Drop the request rather than hold
+        // up requests from other links, the GCS will ask again
+        return;
+    }
+
     struct pending_param_reply reply;
     AP_Param *vp;
 
@@ -415,28 +516,35 @@ void GCS_MAVLINK::param_io_timer(void)
     reply.count = AP_Param::count_parameters();
 
     // queue for transmission
-    param_replies.push(reply);
+    replies->push(reply);
 }
 
 /*
-  send a reply to a PARAM_REQUEST_READ
+  send a reply to a PARAM_REQUEST_READ on this link. Returns false if
+  there was nothing to send or no space to send it
  */
-void GCS_MAVLINK::send_parameter_reply(void)
+bool GCS_MAVLINK::send_parameter_reply(void)
 {
     struct pending_param_reply reply;
-    
-    if (!param_replies.pop(reply)) {
+    SPSCObjectBuffer<pending_param_reply> *replies = param_replies[chan];
+
+    if (replies == nullptr || !replies->peek(reply)) {
         // nothing to do
-        return;
+        return false;
+    }
+    if (!HAVE_PAYLOAD_SPACE(chan, PARAM_VALUE)) {
+        return false;
     }
+    replies->pop();
     
     mavlink_msg_param_value_send(
-        reply.chan,
+        chan,
         reply.param_name,
         reply.value,
         mav_var_type(reply.p_type),
         reply.count,
         reply.param_index);
+    return true;
 }
 
 void GCS_MAVLINK::handle_common_param_message(mavlink_message_t *msg)